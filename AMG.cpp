@@ -0,0 +1,428 @@
+#include "AMG.h"
+#include "SparseSolver.h"
+#include <iostream>
+#include <math.h>
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
+
+namespace
+{
+// Greedy aggregation over the strength graph. Returns the number of
+// aggregates; aggregate[i] = -1 for nodes without strong connections, which
+// are left to the smoother.
+template <class T, class I>
+int aggregateNodes(CSRMatrix<T, I> &A, double theta, std::vector<int> &aggregate)
+{
+    int n = A.rows;
+    I *diag = A.diagonalPositions();
+    auto strong = [&](int i, I k) {
+        int j = A.col_index[k];
+        T a = A.values[k];
+        return j != i && a * a >= theta * theta * fabs(A.values[diag[i]] * A.values[diag[j]]);
+    };
+
+    // Phase 1: a node whose strong neighbours are all free becomes the root of
+    // an aggregate made of itself and those neighbours
+    aggregate.assign(n, -1);
+    std::vector<char> isolated(n, true); // not vector<bool>: written in parallel
+#pragma omp parallel for schedule(static)
+    for (int i = 0; i < n; i++)
+    {
+        for (I k = A.row_position[i]; k < A.row_position[i + 1]; k++)
+        {
+            if (strong(i, k))
+            {
+                isolated[i] = false;
+                break;
+            }
+        }
+    }
+    int count = 0;
+    for (int i = 0; i < n; i++)
+    {
+        bool free = aggregate[i] == -1;
+        for (I k = A.row_position[i]; k < A.row_position[i + 1] && free; k++)
+        {
+            free = !strong(i, k) || aggregate[A.col_index[k]] == -1;
+        }
+        if (!free || isolated[i])
+        {
+            continue;
+        }
+        aggregate[i] = count;
+        for (I k = A.row_position[i]; k < A.row_position[i + 1]; k++)
+        {
+            if (strong(i, k))
+            {
+                aggregate[A.col_index[k]] = count;
+            }
+        }
+        count++;
+    }
+
+    // Phase 2: remaining nodes join the aggregate they are most strongly
+    // connected to, among those formed in phase 1
+    std::vector<int> phase1(aggregate);
+    for (int i = 0; i < n; i++)
+    {
+        if (phase1[i] != -1 || isolated[i])
+        {
+            continue;
+        }
+        T strongest = 0;
+        for (I k = A.row_position[i]; k < A.row_position[i + 1]; k++)
+        {
+            int j = A.col_index[k];
+            if (strong(i, k) && phase1[j] != -1 && fabs(A.values[k]) > strongest)
+            {
+                strongest = fabs(A.values[k]);
+                aggregate[i] = phase1[j];
+            }
+        }
+    }
+
+    // Phase 3: what is left forms new aggregates with its free strong neighbours
+    for (int i = 0; i < n; i++)
+    {
+        if (aggregate[i] != -1 || isolated[i])
+        {
+            continue;
+        }
+        aggregate[i] = count;
+        for (I k = A.row_position[i]; k < A.row_position[i + 1]; k++)
+        {
+            if (strong(i, k) && aggregate[A.col_index[k]] == -1)
+            {
+                aggregate[A.col_index[k]] = count;
+            }
+        }
+        count++;
+    }
+    return count;
+}
+
+// P = (I - omega D^-1 A) P_tent, with P_tent the normalised indicator of every
+// aggregate and omega = 4/3 / rho(D^-1 A), rho bounded by Gershgorin discs
+// P is built when null, otherwise only its values are recomputed: its pattern
+// depends on the patterns of A and of the aggregates alone
+template <class T, class I>
+void smoothedProlongator(CSRMatrix<T, I> &A, const std::vector<int> &aggregate, int count,
+                         std::shared_ptr<CSRMatrix<T, I>> &P)
+{
+    int n = A.rows;
+    std::vector<int> sizes(count, 0);
+    for (int a : aggregate)
+    {
+        if (a != -1)
+        {
+            sizes[a]++;
+        }
+    }
+    std::shared_ptr<I[]> t_row_position(new I[n + 1]);
+    t_row_position[0] = 0;
+    for (int i = 0; i < n; i++)
+    {
+        t_row_position[i + 1] = t_row_position[i] + (aggregate[i] != -1);
+    }
+    I t_nnzs = t_row_position[n];
+    std::shared_ptr<int[]> t_col_index(new int[std::max<I>(t_nnzs, 1)]);
+    std::shared_ptr<T[]> t_values(new T[std::max<I>(t_nnzs, 1)]);
+    for (int i = 0; i < n; i++)
+    {
+        if (aggregate[i] != -1)
+        {
+            t_col_index[t_row_position[i]] = aggregate[i];
+            t_values[t_row_position[i]] = 1 / sqrt((T)sizes[aggregate[i]]);
+        }
+    }
+    CSRMatrix<T, I> tentative(n, count, t_nnzs, t_values, t_row_position, t_col_index);
+
+    // D^-1 A on the pattern of A
+    T *inv_diag = A.inverseDiagonal();
+    std::shared_ptr<T[]> s_values(new T[std::max<I>(A.nnzs, 1)]);
+    T rho = 0;
+#pragma omp parallel for reduction(max : rho) schedule(static)
+    for (int i = 0; i < n; i++)
+    {
+        T row_sum = 0;
+        for (I k = A.row_position[i]; k < A.row_position[i + 1]; k++)
+        {
+            s_values[k] = inv_diag[i] * A.values[k];
+            row_sum += fabs(s_values[k]);
+        }
+        rho = std::max(rho, row_sum);
+    }
+    CSRMatrix<T, I> scaled(n, n, A.nnzs, s_values, A.row_position, A.col_index);
+    T omega = 4.0 / 3.0 / rho;
+
+    if (!P)
+    {
+        P = scaled.matMatMultSymbolic(tentative);
+    }
+    scaled.matMatMultNumeric(tentative, *P);
+#pragma omp parallel for schedule(static)
+    for (int i = 0; i < n; i++)
+    {
+        for (I k = P->row_position[i]; k < P->row_position[i + 1]; k++)
+        {
+            P->values[k] *= -omega;
+        }
+        if (aggregate[i] != -1)
+        {
+            // a_ii != 0, so column aggregate[i] is in row i of D^-1 A P_tent
+            int *row_start = &P->col_index[0] + P->row_position[i];
+            int *row_end = &P->col_index[0] + P->row_position[i + 1];
+            I k = std::lower_bound(row_start, row_end, aggregate[i]) - &P->col_index[0];
+            P->values[k] += t_values[t_row_position[i]];
+        }
+    }
+}
+
+// Values of R = P^T into the pattern built by P->transpose(), which stores the
+// entries of every row of R in increasing row of P
+template <class T, class I>
+void restrictionValues(CSRMatrix<T, I> &P, CSRMatrix<T, I> &R)
+{
+    std::vector<I> next(R.row_position.get(), R.row_position.get() + R.rows);
+    for (int i = 0; i < P.rows; i++)
+    {
+        for (I k = P.row_position[i]; k < P.row_position[i + 1]; k++)
+        {
+            R.values[next[P.col_index[k]]++] = P.values[k];
+        }
+    }
+}
+
+template <class T, class I>
+void checkAMGDiagonal(CSRMatrix<T, I> &A)
+{
+    I *diag = A.diagonalPositions();
+    for (int i = 0; i < A.rows; i++)
+    {
+        if (diag[i] == -1 || A.values[diag[i]] == 0)
+        {
+            throw std::invalid_argument("AMG needs a non-zero diagonal");
+        }
+    }
+}
+} // namespace
+
+template <class T, class I>
+void SmoothedAggregationAMG<T, I>::setup(CSRMatrix<T, I> &A)
+{
+    if (pattern == A.col_index && !levels.empty())
+    {
+        // Same pattern: keep the aggregates and the patterns of P, R, A P and
+        // the coarse matrices, and recompute their values level by level
+        levels[0].A = std::make_shared<CSRMatrix<T, I>>(A.rows, A.cols, A.nnzs, A.values, A.row_position, A.col_index);
+        for (int l = 0; l < (int)levels.size() - 1; l++)
+        {
+            AMGLevel<T, I> &level = levels[l];
+            CSRMatrix<T, I> &A_coarse = *levels[l + 1].A;
+            checkAMGDiagonal(*level.A);
+            smoothedProlongator(*level.A, level.aggregate, A_coarse.rows, level.P);
+            restrictionValues(*level.P, *level.R);
+            level.A->matMatMultNumeric(*level.P, *level.AP);
+            level.R->matMatMultNumeric(*level.AP, A_coarse);
+        }
+    }
+    else
+    {
+        levels.clear();
+        levels.emplace_back();
+        levels[0].A = std::make_shared<CSRMatrix<T, I>>(A.rows, A.cols, A.nnzs, A.values, A.row_position, A.col_index);
+
+        double theta = strength_threshold;
+        while ((int)levels.size() < max_levels && levels.back().A->rows > coarse_size)
+        {
+            CSRMatrix<T, I> &A_fine = *levels.back().A;
+            checkAMGDiagonal(A_fine);
+
+            std::vector<int> aggregate;
+            int count = aggregateNodes(A_fine, theta, aggregate);
+            if (count == 0 || count == A_fine.rows)
+            {
+                // nothing left to coarsen
+                break;
+            }
+            std::shared_ptr<CSRMatrix<T, I>> P;
+            smoothedProlongator(A_fine, aggregate, count, P);
+            std::shared_ptr<CSRMatrix<T, I>> R = P->transpose();
+            std::shared_ptr<CSRMatrix<T, I>> AP = A_fine.matMatMult(*P);
+            std::shared_ptr<CSRMatrix<T, I>> A_coarse = R->matMatMult(*AP);
+
+            levels.back().P = P;
+            levels.back().R = R;
+            levels.back().AP = AP;
+            levels.back().aggregate = std::move(aggregate);
+            levels.emplace_back();
+            levels.back().A = A_coarse;
+            theta *= 0.5;
+        }
+
+        for (AMGLevel<T, I> &level : levels)
+        {
+            int n = level.A->rows;
+            level.x.assign(n, 0);
+            level.b.assign(n, 0);
+            level.r.assign(n, 0);
+        }
+    }
+
+    for (AMGLevel<T, I> &level : levels)
+    {
+        level.chebyshev = nullptr;
+    }
+    if (smoother == AMGSmoother::Chebyshev)
+    {
+        for (int l = 0; l < (int)levels.size() - 1; l++)
+        {
+            setupChebyshev(l);
+        }
+    }
+
+    // Direct solve on the coarsest level. Its pattern is unchanged on a
+    // re-setup, so the solver copy is refreshed and refactorised numerically.
+    AMGLevel<T, I> &coarsest = levels.back();
+    if (pattern == A.col_index && coarse_factor)
+    {
+        CSRMatrix<T, I> &A_solver = coarse_solver->A;
+        std::copy(coarsest.A->values.get(), coarsest.A->values.get() + coarsest.A->nnzs, A_solver.values.get());
+        A_solver.invalidateDiagonal();
+        coarse_solver->cholesky_numeric(*coarse_factor);
+        return;
+    }
+    coarse_solver = std::make_shared<SparseSolver<T, I>>(*coarsest.A, coarsest.b);
+    coarse_factor = coarse_solver->cholesky_decomp();
+    pattern = A.col_index;
+
+    std::cout << "AMG: " << levels.size() << " levels, rows";
+    for (AMGLevel<T, I> &level : levels)
+    {
+        std::cout << " " << level.A->rows;
+    }
+    std::cout << ", operator complexity = " << operatorComplexity() << std::endl;
+}
+
+template <class T, class I>
+double SmoothedAggregationAMG<T, I>::operatorComplexity()
+{
+    double total = 0;
+    for (AMGLevel<T, I> &level : levels)
+    {
+        total += level.A->nnzs;
+    }
+    return levels.empty() ? 0 : total / levels[0].A->nnzs;
+}
+
+// Chebyshev smoother of level l, for a smoother chosen after setup as well
+template <class T, class I>
+void SmoothedAggregationAMG<T, I>::setupChebyshev(int l)
+{
+    levels[l].chebyshev = std::make_shared<ChebyshevPreconditioner<T, I>>(chebyshev_degree, chebyshev_lower_fraction);
+    levels[l].chebyshev->setup(*levels[l].A);
+}
+
+template <class T, class I>
+void SmoothedAggregationAMG<T, I>::smooth(int l, int sweeps, bool forward)
+{
+    CSRMatrix<T, I> &A = *levels[l].A;
+    std::vector<T> &x = levels[l].x;
+    std::vector<T> &b = levels[l].b;
+    std::vector<T> &r = levels[l].r;
+    T *inv_diag = A.inverseDiagonal();
+    I *diag = A.diagonalPositions();
+    int n = A.rows;
+
+    for (int sweep = 0; sweep < sweeps; sweep++)
+    {
+        if (smoother == AMGSmoother::Chebyshev)
+        {
+            // x += p(D^-1 A) D^-1 (b - A x); apply reads each r_i before
+            // writing z_i, so the residual can be corrected in place
+            if (!levels[l].chebyshev)
+            {
+                setupChebyshev(l);
+            }
+            A.matVecMult(x, r);
+#pragma omp parallel for schedule(static)
+            for (int i = 0; i < n; i++)
+            {
+                r[i] = b[i] - r[i];
+            }
+            levels[l].chebyshev->apply(r, r);
+#pragma omp parallel for schedule(static)
+            for (int i = 0; i < n; i++)
+            {
+                x[i] += r[i];
+            }
+            continue;
+        }
+        if (smoother == AMGSmoother::Jacobi)
+        {
+            A.matVecMult(x, r);
+#pragma omp parallel for schedule(static)
+            for (int i = 0; i < n; i++)
+            {
+                x[i] += jacobi_weight * inv_diag[i] * (b[i] - r[i]);
+            }
+            continue;
+        }
+        for (int k = 0; k < n; k++)
+        {
+            int i = forward ? k : n - 1 - k;
+            T sum = b[i];
+            for (I j = A.row_position[i]; j < A.row_position[i + 1]; j++)
+            {
+                if (j != diag[i])
+                {
+                    sum -= A.values[j] * x[A.col_index[j]];
+                }
+            }
+            x[i] = sum * inv_diag[i];
+        }
+    }
+}
+
+template <class T, class I>
+void SmoothedAggregationAMG<T, I>::cycle(int l)
+{
+    AMGLevel<T, I> &level = levels[l];
+    if (l == (int)levels.size() - 1)
+    {
+        coarse_solver->b = level.b;
+        coarse_solver->cholesky_solve(*coarse_factor, level.x);
+        return;
+    }
+
+    std::fill(level.x.begin(), level.x.end(), 0);
+    smooth(l, pre_sweeps, true);
+
+    // restrict the residual, correct from the coarse level, smooth again
+    int n = level.A->rows;
+    level.A->matVecMult(level.x, level.r);
+#pragma omp parallel for schedule(static)
+    for (int i = 0; i < n; i++)
+    {
+        level.r[i] = level.b[i] - level.r[i];
+    }
+    level.R->matVecMult(level.r, levels[l + 1].b);
+    cycle(l + 1);
+    level.P->matVecMult(levels[l + 1].x, level.r);
+#pragma omp parallel for schedule(static)
+    for (int i = 0; i < n; i++)
+    {
+        level.x[i] += level.r[i];
+    }
+
+    smooth(l, post_sweeps, false);
+}
+
+template <class T, class I>
+void SmoothedAggregationAMG<T, I>::apply(const std::vector<T> &r, std::vector<T> &z)
+{
+    std::copy(r.begin(), r.end(), levels[0].b.begin());
+    cycle(0);
+    std::copy(levels[0].x.begin(), levels[0].x.end(), z.begin());
+}
@@ -0,0 +1,79 @@
+#pragma once
+#include "CSRMatrix.h"
+#include "Preconditioner.h"
+#include "Chebyshev.h"
+#include "SparseSolver.h"
+#include <vector>
+#include <memory>
+
+enum class AMGSmoother
+{
+    Jacobi,     // damped Jacobi, parallel
+    GaussSeidel, // forward sweeps before the coarse correction, backward after
+    Chebyshev    // Chebyshev polynomial in D^-1 A, parallel and symmetric
+};
+
+// One level of the hierarchy: A_l and the transfers to the next coarser level,
+// with the cycle's work vectors allocated once in setup
+template <class T, class I = int>
+struct AMGLevel
+{
+    std::shared_ptr<CSRMatrix<T, I>> A;
+    std::shared_ptr<CSRMatrix<T, I>> P; // prolongation from level l + 1
+    std::shared_ptr<CSRMatrix<T, I>> R; // restriction, P^T
+    std::shared_ptr<CSRMatrix<T, I>> AP; // A_l P, kept for the values of R A_l P on a re-setup
+    std::vector<int> aggregate;         // aggregate (coarse node) of every node
+    // the smoother for AMGSmoother::Chebyshev, tuned to A_l
+    std::shared_ptr<ChebyshevPreconditioner<T, I>> chebyshev;
+
+    std::vector<T> x{}, b{}, r{};
+};
+
+// Smoothed aggregation algebraic multigrid (Vanek, Mandel and Brezina) for
+// symmetric positive definite A. setup(A) builds the hierarchy:
+//  - strength graph: j is strongly connected to i if |a_ij| >= theta sqrt(|a_ii a_jj|),
+//    with theta halved on every coarser level
+//  - greedy aggregation of each node with its strong neighbours
+//  - tentative prolongator from the constant vector on every aggregate, smoothed by
+//    one damped Jacobi step, P = (I - 4/3 / rho(D^-1 A) D^-1 A) P_tent
+//  - Galerkin coarse operator R A P with R = P^T, by sparse matrix products
+// until the coarse matrix has at most coarse_size rows, which is then factored
+// with sparse Cholesky. While A.col_index is the same array, setup(A) keeps the
+// aggregates, the patterns of every product and the coarse symbolic analysis,
+// and recomputes only the values of P, R, the coarse matrices and the coarse
+// factor. apply(r, z) is one V-cycle from z = 0, so the hierarchy is a
+// preconditioner for conjugate gradients, or a solver on its own with
+// SparseSolver::stationaryIterative.
+template <class T, class I = int>
+class SmoothedAggregationAMG : public Preconditioner<T, I>
+{
+public:
+    void setup(CSRMatrix<T, I> &A) override;
+    void apply(const std::vector<T> &r, std::vector<T> &z) override;
+
+    double strength_threshold = 0.08;
+    AMGSmoother smoother = AMGSmoother::GaussSeidel;
+    double jacobi_weight = 2.0 / 3.0;
+    // products with A per Chebyshev sweep, and the part of the spectrum of
+    // D^-1 A it damps (see ChebyshevPreconditioner)
+    int chebyshev_degree = 2;
+    double chebyshev_lower_fraction = 0.3;
+    int pre_sweeps = 1;
+    int post_sweeps = 1;
+    int coarse_size = 500;
+    int max_levels = 25;
+
+    std::vector<AMGLevel<T, I>> levels{};
+
+    // sum of nnz(A_l) over nnz(A_0)
+    double operatorComplexity();
+
+private:
+    void cycle(int level);
+    void smooth(int level, int sweeps, bool forward);
+    void setupChebyshev(int level);
+
+    std::shared_ptr<int[]> pattern; // col_index of the A the hierarchy was built for
+    std::shared_ptr<SparseSolver<T, I>> coarse_solver;
+    std::shared_ptr<CSRMatrix<T, I>> coarse_factor;
+};
@@ -0,0 +1,297 @@
+#include <iostream>
+#include "BinaryIO.h"
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace
+{
+const char binary_magic[8] = {'C', 'S', 'R', 'B', 'I', 'N', '\0', '\0'};
+const uint32_t binary_version = 1;
+const uint32_t binary_byte_order = 0x01020304;
+const uint64_t binary_alignment = 64;
+
+inline uint64_t alignUp(uint64_t offset)
+{
+    return (offset + binary_alignment - 1) / binary_alignment * binary_alignment;
+}
+
+// Position-dependent 64-bit mix summed over words, so blocks can be hashed in parallel
+uint64_t binaryChecksum(const unsigned char *data, uint64_t length)
+{
+    uint64_t words = length / 8;
+    uint64_t sum = 0;
+#pragma omp parallel for reduction(+ : sum) schedule(static)
+    for (long long w = 0; w < (long long)words; w++)
+    {
+        uint64_t v;
+        memcpy(&v, data + 8 * w, 8);
+        v ^= (uint64_t)w * 0x9E3779B97F4A7C15ULL;
+        v ^= v >> 33;
+        v *= 0xFF51AFD7ED558CCDULL;
+        v ^= v >> 33;
+        sum += v;
+    }
+    for (uint64_t i = words * 8; i < length; i++)
+    {
+        sum += (uint64_t)data[i] * 0xC4CEB9FE1A85EC53ULL + i;
+    }
+    return sum;
+}
+
+// Keeps the file mapped while any matrix array still refers to it
+struct BinaryMapping
+{
+    void *address = nullptr;
+    size_t length = 0;
+    ~BinaryMapping()
+    {
+        if (address != nullptr)
+        {
+            munmap(address, length);
+        }
+    }
+};
+
+// Sections are hashed separately and combined, so the padding is not covered
+uint64_t sectionsChecksum(const void *row_pos, uint64_t row_pos_bytes, const void *col_ind, uint64_t col_ind_bytes,
+                          const void *vals, uint64_t vals_bytes)
+{
+    uint64_t h_rows = binaryChecksum((const unsigned char *)row_pos, row_pos_bytes);
+    uint64_t h_cols = binaryChecksum((const unsigned char *)col_ind, col_ind_bytes);
+    uint64_t h_vals = binaryChecksum((const unsigned char *)vals, vals_bytes);
+    return h_rows ^ ((h_cols << 21) | (h_cols >> 43)) ^ ((h_vals << 42) | (h_vals >> 22));
+}
+
+void writePadded(FILE *file, const void *data, uint64_t bytes, uint64_t &position, uint64_t offset)
+{
+    static const char zeros[binary_alignment] = {};
+    if (offset > position)
+    {
+        if (fwrite(zeros, 1, offset - position, file) != offset - position)
+        {
+            throw std::runtime_error("Unable to write binary matrix padding");
+        }
+        position = offset;
+    }
+    if (bytes > 0 && fwrite(data, 1, bytes, file) != bytes)
+    {
+        throw std::runtime_error("Unable to write binary matrix section");
+    }
+    position += bytes;
+}
+
+void writeBinarySections(const std::string &filename, BinaryHeader &header, const void *row_pos, uint64_t row_pos_bytes,
+                         const void *col_ind, uint64_t col_ind_bytes, const void *vals, uint64_t vals_bytes)
+{
+    memcpy(header.magic, binary_magic, 8);
+    header.version = binary_version;
+    header.byte_order = binary_byte_order;
+    header.row_position_offset = alignUp(sizeof(BinaryHeader));
+    header.col_index_offset = alignUp(header.row_position_offset + row_pos_bytes);
+    header.values_offset = alignUp(header.col_index_offset + col_ind_bytes);
+    header.file_size = header.values_offset + vals_bytes;
+    header.checksum = sectionsChecksum(row_pos, row_pos_bytes, col_ind, col_ind_bytes, vals, vals_bytes);
+
+    FILE *file = fopen(filename.c_str(), "wb");
+    if (file == nullptr)
+    {
+        throw std::runtime_error("Unable to open file " + filename);
+    }
+    uint64_t position = 0;
+    try
+    {
+        writePadded(file, &header, sizeof(BinaryHeader), position, 0);
+        writePadded(file, row_pos, row_pos_bytes, position, header.row_position_offset);
+        writePadded(file, col_ind, col_ind_bytes, position, header.col_index_offset);
+        writePadded(file, vals, vals_bytes, position, header.values_offset);
+    }
+    catch (const std::exception &e)
+    {
+        fclose(file);
+        throw std::runtime_error("Unable to write file " + filename);
+    }
+    fclose(file);
+}
+
+std::shared_ptr<BinaryMapping> mapBinary(const std::string &filename, uint32_t kind, uint32_t value_size,
+                                         uint32_t index_size, bool verify_checksum, BinaryHeader &header)
+{
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        throw std::runtime_error("Unable to open file " + filename);
+    }
+    struct stat file_stat;
+    fstat(fd, &file_stat);
+    size_t file_size = file_stat.st_size;
+    if (file_size < sizeof(BinaryHeader))
+    {
+        close(fd);
+        throw std::invalid_argument("File is too small to be a binary matrix: " + filename);
+    }
+
+    // Private writable mapping: copy-on-write, so solvers may modify the values
+    // without touching the file or other processes' pages
+    std::shared_ptr<BinaryMapping> mapping(new BinaryMapping);
+    mapping->address = mmap(nullptr, file_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    mapping->length = file_size;
+    close(fd);
+    if (mapping->address == MAP_FAILED)
+    {
+        mapping->address = nullptr;
+        throw std::runtime_error("Unable to map file " + filename);
+    }
+
+    memcpy(&header, mapping->address, sizeof(BinaryHeader));
+    if (memcmp(header.magic, binary_magic, 8) != 0)
+    {
+        throw std::invalid_argument("Not a binary matrix file: " + filename);
+    }
+    if (header.version != binary_version || header.byte_order != binary_byte_order)
+    {
+        throw std::invalid_argument("Unsupported binary matrix version or byte order: " + filename);
+    }
+    if (header.kind != kind || header.value_size != value_size || header.index_size != index_size)
+    {
+        throw std::invalid_argument("Binary matrix type does not match the requested template types: " + filename);
+    }
+    if (header.file_size != file_size)
+    {
+        throw std::invalid_argument("Binary matrix file is truncated: " + filename);
+    }
+    // Sizes are bounded by the file size first, so the products below cannot overflow
+    if (header.rows < 0 || header.cols < 0 || header.nnzs > file_size ||
+        (kind == 0 && header.nnzs != (uint64_t)header.rows * (uint64_t)header.cols))
+    {
+        throw std::invalid_argument("Binary matrix dimensions are inconsistent: " + filename);
+    }
+    uint64_t row_pos_bytes = kind == 1 ? (uint64_t)(header.rows + 1) * index_size : 0;
+    uint64_t col_ind_bytes = kind == 1 ? header.nnzs * sizeof(int) : 0;
+    uint64_t vals_bytes = header.nnzs * value_size;
+    uint64_t offsets[3] = {header.row_position_offset, header.col_index_offset, header.values_offset};
+    for (uint64_t offset : offsets)
+    {
+        if (offset < sizeof(BinaryHeader) || offset > file_size || offset % binary_alignment != 0)
+        {
+            throw std::invalid_argument("Binary matrix section offsets are out of bounds: " + filename);
+        }
+    }
+    if (row_pos_bytes > file_size - header.row_position_offset ||
+        header.row_position_offset + row_pos_bytes > header.col_index_offset ||
+        col_ind_bytes > file_size - header.col_index_offset ||
+        header.col_index_offset + col_ind_bytes > header.values_offset ||
+        vals_bytes > file_size - header.values_offset)
+    {
+        throw std::invalid_argument("Binary matrix sections are inconsistent: " + filename);
+    }
+    if (verify_checksum)
+    {
+        const char *base = (const char *)mapping->address;
+        if (sectionsChecksum(base + header.row_position_offset, row_pos_bytes, base + header.col_index_offset, col_ind_bytes,
+                             base + header.values_offset, vals_bytes) != header.checksum)
+        {
+            throw std::invalid_argument("Binary matrix checksum mismatch: " + filename);
+        }
+    }
+    return mapping;
+}
+
+// shared_ptr to a section of the mapping; the deleter holds the mapping alive
+template <class V>
+std::shared_ptr<V[]> mappedSection(std::shared_ptr<BinaryMapping> mapping, uint64_t offset)
+{
+    V *ptr = (V *)((char *)mapping->address + offset);
+    return std::shared_ptr<V[]>(ptr, [mapping](V *) {});
+}
+} // namespace
+
+template <class T, class I>
+void writeBinary(const std::string &filename, CSRMatrix<T, I> &A)
+{
+    BinaryHeader header = {};
+    header.kind = 1;
+    header.value_size = sizeof(T);
+    header.index_size = sizeof(I);
+    header.rows = A.rows;
+    header.cols = A.cols;
+    header.nnzs = A.nnzs;
+    writeBinarySections(filename, header, &A.row_position[0], (uint64_t)(A.rows + 1) * sizeof(I),
+                        &A.col_index[0], (uint64_t)A.nnzs * sizeof(int), &A.values[0], (uint64_t)A.nnzs * sizeof(T));
+}
+
+template <class T>
+void writeBinary(const std::string &filename, Matrix<T> &A)
+{
+    BinaryHeader header = {};
+    header.kind = 0;
+    header.value_size = sizeof(T);
+    header.rows = A.rows;
+    header.cols = A.cols;
+    header.nnzs = (uint64_t)A.rows * A.cols;
+    writeBinarySections(filename, header, nullptr, 0, nullptr, 0, &A.values[0], header.nnzs * sizeof(T));
+}
+
+template <class T, class I>
+std::shared_ptr<CSRMatrix<T, I>> loadBinaryCSR(const std::string &filename, bool verify_checksum)
+{
+    BinaryHeader header;
+    std::shared_ptr<BinaryMapping> mapping = mapBinary(filename, 1, sizeof(T), sizeof(I), verify_checksum, header);
+    if (header.nnzs > (uint64_t)std::numeric_limits<I>::max())
+    {
+        throw std::invalid_argument("Binary matrix has more non-zeros than the index type can hold: " + filename);
+    }
+
+    // Row positions must run from 0 to nnzs without decreasing, so that every
+    // row indexes inside the col_index and values sections
+    const I *row_position = (const I *)((const char *)mapping->address + header.row_position_offset);
+    int rows = header.rows;
+    I nnzs = (I)header.nnzs;
+    bool ordered = row_position[0] == 0 && row_position[rows] == nnzs;
+#pragma omp parallel for reduction(&& : ordered) schedule(static)
+    for (int i = 0; i < rows; i++)
+    {
+        ordered = ordered && row_position[i] <= row_position[i + 1];
+    }
+    if (!ordered)
+    {
+        throw std::invalid_argument("Binary matrix row positions are inconsistent: " + filename);
+    }
+    if (verify_checksum)
+    {
+        const int *col_index = (const int *)((const char *)mapping->address + header.col_index_offset);
+        int cols = header.cols;
+        bool in_range = true;
+#pragma omp parallel for reduction(&& : in_range) schedule(static)
+        for (I k = 0; k < nnzs; k++)
+        {
+            in_range = in_range && col_index[k] >= 0 && col_index[k] < cols;
+        }
+        if (!in_range)
+        {
+            throw std::invalid_argument("Binary matrix column indices are out of range: " + filename);
+        }
+    }
+
+    std::shared_ptr<CSRMatrix<T, I>> result(new CSRMatrix<T, I>(header.rows, header.cols, (I)header.nnzs,
+                                                                mappedSection<T>(mapping, header.values_offset),
+                                                                mappedSection<I>(mapping, header.row_position_offset),
+                                                                mappedSection<int>(mapping, header.col_index_offset)));
+    return result;
+}
+
+template <class T>
+std::shared_ptr<Matrix<T>> loadBinaryMatrix(const std::string &filename, bool verify_checksum)
+{
+    BinaryHeader header;
+    std::shared_ptr<BinaryMapping> mapping = mapBinary(filename, 0, sizeof(T), 0, verify_checksum, header);
+
+    std::shared_ptr<Matrix<T>> result(new Matrix<T>(header.rows, header.cols, mappedSection<T>(mapping, header.values_offset)));
+    return result;
+}
@@ -0,0 +1,50 @@
+#pragma once
+#include "Matrix.h"
+#include "CSRMatrix.h"
+#include <memory>
+#include <string>
+#include <cstdint>
+
+// Versioned binary container for Matrix and CSRMatrix.
+// Layout: a 128-byte header followed by the row_position, col_index and values
+// sections, each starting on a 64-byte boundary. The header records the value
+// and index sizes so a file is only loaded with matching template types.
+struct BinaryHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order; // 0x01020304 as written by the producing machine
+    uint32_t kind;       // 0 = dense Matrix, 1 = CSRMatrix
+    uint32_t value_size;
+    uint32_t index_size;
+    int32_t rows;
+    int32_t cols;
+    uint32_t reserved;
+    uint64_t nnzs;
+    uint64_t row_position_offset;
+    uint64_t col_index_offset;
+    uint64_t values_offset;
+    uint64_t file_size;
+    uint64_t checksum; // over everything after the header
+    char padding[128 - 88];
+};
+static_assert(sizeof(BinaryHeader) == 128, "BinaryHeader must be 128 bytes");
+
+template <class T, class I>
+void writeBinary(const std::string &filename, CSRMatrix<T, I> &A);
+
+template <class T>
+void writeBinary(const std::string &filename, Matrix<T> &A);
+
+// Load by memory-mapping the file. The matrix arrays point straight into the
+// mapping, which stays alive until the last shared_ptr referring to it is gone.
+// Pages are mapped copy-on-write, so they are shared between processes until
+// one of them modifies the values. The header, section bounds and row
+// positions are always validated; verifying the checksum (and the column
+// indices, which are then checked too) reads the whole file. Throws
+// std::invalid_argument for a truncated or inconsistent file.
+template <class T, class I = int>
+std::shared_ptr<CSRMatrix<T, I>> loadBinaryCSR(const std::string &filename, bool verify_checksum = false);
+
+template <class T>
+std::shared_ptr<Matrix<T>> loadBinaryMatrix(const std::string &filename, bool verify_checksum = false);
@@ -0,0 +1,265 @@
+#include <iostream>
+#include "CSRBuilder.h"
+#include "utilities.h"
+#include <stdexcept>
+#include <algorithm>
+#include <memory>
+
+template <class T, class I>
+CSRBuilder<T, I>::CSRBuilder(int rows, int cols) : rows(rows), cols(cols)
+{
+}
+
+template <class T, class I>
+CSRBuilder<T, I>::~CSRBuilder()
+{
+}
+
+template <class T, class I>
+void CSRBuilder<T, I>::addBatch(const int *row_ind, const int *col_ind, const T *vals, size_t count)
+{
+    Batch batch;
+    batch.keys.resize(count);
+    batch.vals.resize(count);
+
+    // Encode (row, col) as a single key so that sorting by key gives row-major order
+    for (size_t i = 0; i < count; i++)
+    {
+        if (row_ind[i] < 0 || row_ind[i] >= rows || col_ind[i] < 0 || col_ind[i] >= cols)
+        {
+            throw std::invalid_argument("Triplet index out of range");
+        }
+        batch.keys[i] = (uint64_t)row_ind[i] * (uint64_t)cols + (uint64_t)col_ind[i];
+        batch.vals[i] = vals[i];
+    }
+
+    std::lock_guard<std::mutex> lock(batch_mutex);
+    total += count;
+    batches.push_back(std::move(batch));
+}
+
+template <class T, class I>
+void CSRBuilder<T, I>::addBatch(std::vector<int> &row_ind, std::vector<int> &col_ind, std::vector<T> &vals)
+{
+    if (row_ind.size() != col_ind.size() || row_ind.size() != vals.size())
+    {
+        throw std::invalid_argument("Dimensions don't match");
+    }
+    addBatch(row_ind.data(), col_ind.data(), vals.data(), vals.size());
+}
+
+template <class T, class I>
+size_t CSRBuilder<T, I>::size()
+{
+    std::lock_guard<std::mutex> lock(batch_mutex);
+    return total;
+}
+
+template <class T, class I>
+void CSRBuilder<T, I>::radixSort(uint64_t *&keys, T *&vals, uint64_t *&keys_tmp, T *&vals_tmp, size_t n, int bits)
+{
+    const int radix_bits = 8;
+    const int buckets = 1 << radix_bits;
+
+    // One block per thread, each keeps its own histogram so the scatter is stable
+    // and needs no atomics
+    int nblocks = std::max(1, std::min(numThreads(), (int)(n / 4096) + 1));
+    size_t block_len = (n + nblocks - 1) / nblocks;
+    std::vector<size_t> hist((size_t)nblocks * buckets);
+
+    for (int shift = 0; shift < bits; shift += radix_bits)
+    {
+        std::fill(hist.begin(), hist.end(), 0);
+
+#pragma omp parallel for schedule(static, 1)
+        for (int blk = 0; blk < nblocks; blk++)
+        {
+            size_t start = std::min(n, blk * block_len);
+            size_t end = std::min(n, start + block_len);
+            size_t *h = &hist[(size_t)blk * buckets];
+            for (size_t i = start; i < end; i++)
+            {
+                h[(keys[i] >> shift) & (buckets - 1)]++;
+            }
+        }
+
+        // Skip the pass if every key has the same digit
+        bool trivial = false;
+        for (int d = 0; d < buckets && !trivial; d++)
+        {
+            size_t count = 0;
+            for (int blk = 0; blk < nblocks; blk++)
+            {
+                count += hist[(size_t)blk * buckets + d];
+            }
+            trivial = (count == n);
+        }
+        if (trivial)
+        {
+            continue;
+        }
+
+        // Exclusive prefix sum in (digit, block) order gives each block its write offsets
+        size_t offset = 0;
+        for (int d = 0; d < buckets; d++)
+        {
+            for (int blk = 0; blk < nblocks; blk++)
+            {
+                size_t count = hist[(size_t)blk * buckets + d];
+                hist[(size_t)blk * buckets + d] = offset;
+                offset += count;
+            }
+        }
+
+#pragma omp parallel for schedule(static, 1)
+        for (int blk = 0; blk < nblocks; blk++)
+        {
+            size_t start = std::min(n, blk * block_len);
+            size_t end = std::min(n, start + block_len);
+            size_t *h = &hist[(size_t)blk * buckets];
+            for (size_t i = start; i < end; i++)
+            {
+                size_t dest = h[(keys[i] >> shift) & (buckets - 1)]++;
+                keys_tmp[dest] = keys[i];
+                vals_tmp[dest] = vals[i];
+            }
+        }
+
+        std::swap(keys, keys_tmp);
+        std::swap(vals, vals_tmp);
+    }
+}
+
+template <class T, class I>
+std::shared_ptr<CSRMatrix<T, I>> CSRBuilder<T, I>::build()
+{
+    std::lock_guard<std::mutex> lock(batch_mutex);
+    size_t n = total;
+
+    // Gather all batches into one contiguous buffer
+    std::vector<size_t> batch_offset(batches.size() + 1, 0);
+    for (size_t b = 0; b < batches.size(); b++)
+    {
+        batch_offset[b + 1] = batch_offset[b] + batches[b].keys.size();
+    }
+
+    std::unique_ptr<uint64_t[]> keys_buf(new uint64_t[std::max<size_t>(n, 1)]);
+    std::unique_ptr<uint64_t[]> keys_tmp_buf(new uint64_t[std::max<size_t>(n, 1)]);
+    std::unique_ptr<T[]> vals_buf(new T[std::max<size_t>(n, 1)]);
+    std::unique_ptr<T[]> vals_tmp_buf(new T[std::max<size_t>(n, 1)]);
+
+#pragma omp parallel for schedule(dynamic, 1)
+    for (long long b = 0; b < (long long)batches.size(); b++)
+    {
+        std::copy(batches[b].keys.begin(), batches[b].keys.end(), &keys_buf[batch_offset[b]]);
+        std::copy(batches[b].vals.begin(), batches[b].vals.end(), &vals_buf[batch_offset[b]]);
+    }
+    batches.clear();
+    batches.shrink_to_fit();
+    total = 0;
+
+    // Only sort on as many bits as the largest key needs
+    uint64_t max_key = (uint64_t)rows * (uint64_t)cols;
+    int bits = 0;
+    while (bits < 64 && (max_key >> bits) != 0)
+    {
+        bits++;
+    }
+
+    uint64_t *keys = keys_buf.get();
+    uint64_t *keys_tmp = keys_tmp_buf.get();
+    T *vals = vals_buf.get();
+    T *vals_tmp = vals_tmp_buf.get();
+    radixSort(keys, vals, keys_tmp, vals_tmp, n, bits);
+
+    // Mark the first entry of each run of equal keys, counting runs per block
+    int nblocks = std::max(1, std::min(numThreads(), (int)(n / 4096) + 1));
+    size_t block_len = (n + nblocks - 1) / nblocks;
+    std::vector<size_t> block_unique(nblocks + 1, 0);
+
+#pragma omp parallel for schedule(static, 1)
+    for (int blk = 0; blk < nblocks; blk++)
+    {
+        size_t start = std::min(n, blk * block_len);
+        size_t end = std::min(n, start + block_len);
+        size_t count = 0;
+        for (size_t i = start; i < end; i++)
+        {
+            if (i == 0 || keys[i] != keys[i - 1])
+            {
+                count++;
+            }
+        }
+        block_unique[blk + 1] = count;
+    }
+    for (int blk = 0; blk < nblocks; blk++)
+    {
+        block_unique[blk + 1] += block_unique[blk];
+    }
+    I new_nnzs = (I)block_unique[nblocks];
+
+    // These buffers are handed to the matrix as they are, without a further copy
+    T *out_vals = new T[std::max<size_t>(new_nnzs, 1)];
+    int *out_cols = new int[std::max<size_t>(new_nnzs, 1)];
+    I *out_rows = new I[rows + 1];
+
+    // Sum duplicates. A run that starts in a block is owned by that block, even
+    // if it extends past the block end. The spare key buffer holds the unique keys.
+    uint64_t *unique_keys = keys_tmp;
+#pragma omp parallel for schedule(static, 1)
+    for (int blk = 0; blk < nblocks; blk++)
+    {
+        size_t start = std::min(n, blk * block_len);
+        size_t end = std::min(n, start + block_len);
+        size_t out = block_unique[blk];
+        size_t i = start;
+        // skip the tail of a run owned by the previous block
+        while (i < end && i > 0 && keys[i] == keys[i - 1])
+        {
+            i++;
+        }
+        while (i < end)
+        {
+            uint64_t key = keys[i];
+            T sum = vals[i];
+            size_t j = i + 1;
+            while (j < n && keys[j] == key)
+            {
+                sum += vals[j];
+                j++;
+            }
+            unique_keys[out] = key;
+            out_cols[out] = (int)(key % (uint64_t)cols);
+            out_vals[out] = sum;
+            out++;
+            i = j;
+        }
+    }
+
+    // row_position[r] is the first entry whose row is >= r. Each row boundary is
+    // written by the single entry that crosses it.
+    out_rows[0] = 0;
+#pragma omp parallel for schedule(static)
+    for (long long k = 0; k < (long long)new_nnzs; k++)
+    {
+        int row = (int)(unique_keys[k] / (uint64_t)cols);
+        int prev_row = k == 0 ? -1 : (int)(unique_keys[k - 1] / (uint64_t)cols);
+        for (int r = prev_row + 1; r <= row; r++)
+        {
+            out_rows[r] = (I)k;
+        }
+    }
+    int last_row = new_nnzs == 0 ? -1 : (int)(unique_keys[new_nnzs - 1] / (uint64_t)cols);
+    for (int r = last_row + 1; r <= rows; r++)
+    {
+        out_rows[r] = new_nnzs;
+    }
+
+    std::shared_ptr<T[]> values_ptr(out_vals);
+    std::shared_ptr<I[]> row_pos(out_rows);
+    std::shared_ptr<int[]> col_ind(out_cols);
+
+    std::shared_ptr<CSRMatrix<T, I>> result(new CSRMatrix<T, I>(rows, cols, new_nnzs, values_ptr, row_pos, col_ind));
+    result->preallocated = true;
+    return result;
+}
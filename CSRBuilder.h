@@ -0,0 +1,46 @@
+#pragma once
+#include "CSRMatrix.h"
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <cstdint>
+
+// Assembles a CSRMatrix from (row, col, value) triplets.
+// Triplets can be added in batches from many threads at once. Duplicate
+// entries are summed when the matrix is built.
+template <class T, class I = int>
+class CSRBuilder
+{
+public:
+    CSRBuilder(int rows, int cols);
+
+    ~CSRBuilder();
+
+    // Thread-safe: the batch is copied outside the lock, only the hand-over is serialised
+    void addBatch(const int *row_ind, const int *col_ind, const T *vals, size_t count);
+    void addBatch(std::vector<int> &row_ind, std::vector<int> &col_ind, std::vector<T> &vals);
+
+    // Number of triplets added so far (including duplicates)
+    size_t size();
+
+    // Sorts the triplets, sums duplicates and returns the CSR matrix.
+    // The builder is emptied, so it can be reused for the next assembly.
+    std::shared_ptr<CSRMatrix<T, I>> build();
+
+    int rows = -1;
+    int cols = -1;
+
+private:
+    struct Batch
+    {
+        std::vector<uint64_t> keys;
+        std::vector<T> vals;
+    };
+
+    // parallel LSD radix sort of keys, carrying vals along
+    void radixSort(uint64_t *&keys, T *&vals, uint64_t *&keys_tmp, T *&vals_tmp, size_t n, int bits);
+
+    std::vector<Batch> batches;
+    size_t total = 0;
+    std::mutex batch_mutex;
+};
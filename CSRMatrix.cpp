@@ -5,24 +5,29 @@
 #include <stdio.h>  /* printf, NULL */
 #include <stdlib.h> /* srand, rand */
 #include <time.h>
+#include <stdexcept>
 
 // Default constructor - creates emmpty matrix
-template <class T>
-CSRMatrix<T>::CSRMatrix()
+template <class T, class I>
+CSRMatrix<T, I>::CSRMatrix()
 {
 }
 
 // Constructor
-template <class T>
-CSRMatrix<T>::CSRMatrix(int rows, int cols, int nnzs, bool preallocate) : Matrix<T>(rows, cols, false), nnzs(nnzs)
+template <class T, class I>
+CSRMatrix<T, I>::CSRMatrix(int rows, int cols, I nnzs, bool preallocate) : Matrix<T>(), nnzs(nnzs)
 {
+    // rows * cols can overflow an int for large sparse matrices, and the
+    // dense size_of_values is meaningless here, so only set the dimensions
+    this->rows = rows;
+    this->cols = cols;
 
     this->preallocated = preallocate;
     if (this->preallocated)
     {
         // Values and col index should be same length, while rows should be no.rows + 1
         std::shared_ptr<T[]> vals(new T[this->nnzs]);
-        std::shared_ptr<int[]> rows(new int[this->rows + 1]);
+        std::shared_ptr<I[]> rows(new I[this->rows + 1]);
         std::shared_ptr<int[]> cols(new int[this->nnzs]);
         this->values = vals;
         this->row_position = rows;
@@ -31,23 +36,26 @@ CSRMatrix<T>::CSRMatrix(int rows, int cols, int nnzs, bool preallocate) : Matrix
 }
 
 // Constructor
-template <class T>
-CSRMatrix<T>::CSRMatrix(int rows, int cols, int nnzs, std::shared_ptr<T[]> values_ptr, std::shared_ptr<int[]> row_pos, std::shared_ptr<int[]> col_ind)
-    : Matrix<T>(rows, cols, values_ptr), nnzs(nnzs), row_position(row_pos), col_index(col_ind)
+template <class T, class I>
+CSRMatrix<T, I>::CSRMatrix(int rows, int cols, I nnzs, std::shared_ptr<T[]> values_ptr, std::shared_ptr<I[]> row_pos, std::shared_ptr<int[]> col_ind)
+    : Matrix<T>(), nnzs(nnzs), row_position(row_pos), col_index(col_ind)
 {
+    this->rows = rows;
+    this->cols = cols;
+    this->values = values_ptr;
 }
 
 // Copy constructor
-template <class T>
-CSRMatrix<T>::CSRMatrix(const CSRMatrix<T> &M2)
+template <class T, class I>
+CSRMatrix<T, I>::CSRMatrix(const CSRMatrix<T, I> &M2)
 {
     this->rows = M2.rows;
     this->cols = M2.cols;
     this->nnzs = M2.nnzs;
     this->values = std::shared_ptr<T[]>(new T[this->nnzs]);
-    this->row_position = std::shared_ptr<int[]>(new int[this->rows + 1]);
+    this->row_position = std::shared_ptr<I[]>(new I[this->rows + 1]);
     this->col_index = std::shared_ptr<int[]>(new int[this->nnzs]);
-    for (int i = 0; i < this->nnzs; i++)
+    for (I i = 0; i < this->nnzs; i++)
     {
         this->values[i] = M2.values[i];
         this->col_index[i] = M2.col_index[i];
@@ -60,8 +68,8 @@ CSRMatrix<T>::CSRMatrix(const CSRMatrix<T> &M2)
 }
 
 // Copy constructor - overloading the assignment operator
-template <class T>
-CSRMatrix<T> &CSRMatrix<T>::operator=(const CSRMatrix<T> &M2)
+template <class T, class I>
+CSRMatrix<T, I> &CSRMatrix<T, I>::operator=(const CSRMatrix<T, I> &M2)
 {
     // self-assignment check
     if (this == &M2)
@@ -70,9 +78,9 @@ CSRMatrix<T> &CSRMatrix<T>::operator=(const CSRMatrix<T> &M2)
     this->cols = M2.cols;
     this->nnzs = M2.nnzs;
     this->values = std::shared_ptr<T[]>(new T[this->nnzs]);
-    this->row_position = std::shared_ptr<int[]>(new int[this->rows + 1]);
+    this->row_position = std::shared_ptr<I[]>(new I[this->rows + 1]);
     this->col_index = std::shared_ptr<int[]>(new int[this->nnzs]);
-    for (int i = 0; i < this->nnzs; i++)
+    for (I i = 0; i < this->nnzs; i++)
     {
         this->values[i] = M2.values[i];
         this->col_index[i] = M2.col_index[i];
@@ -82,12 +90,15 @@ CSRMatrix<T> &CSRMatrix<T>::operator=(const CSRMatrix<T> &M2)
         this->row_position[i] = M2.row_position[i];
     }
     this->preallocated = true;
+    // the cached diagonal belonged to the old matrix
+    diag_position_valid = false;
+    inv_diagonal_valid = false;
     return *this;
 }
 
 // Constructor - random sparse matrix
-template <class T>
-CSRMatrix<T>::CSRMatrix(int size, double sparsity)
+template <class T, class I>
+CSRMatrix<T, I>::CSRMatrix(int size, double sparsity)
 {
     // initialize random seed
     srand(time(NULL));
@@ -149,7 +160,7 @@ CSRMatrix<T>::CSRMatrix(int size, double sparsity)
         }
     }
 
-    std::shared_ptr<CSRMatrix<T>> R(new CSRMatrix<T>(size, size, nos, true));
+    std::shared_ptr<CSRMatrix<T, I>> R(new CSRMatrix<T, I>(size, size, nos, true));
 
     for (int i = 0; i < R_cols.size(); i++)
     {
@@ -166,16 +177,16 @@ CSRMatrix<T>::CSRMatrix(int size, double sparsity)
 
     // A = L L^T
     // Get transpose of R
-    std::shared_ptr<CSRMatrix<T>> R_T = R->transpose();
+    std::shared_ptr<CSRMatrix<T, I>> R_T = R->transpose();
 
     // Do matrix multiplication
-    std::shared_ptr<CSRMatrix<T>> A = R->matMatMult(*R_T);
+    std::shared_ptr<CSRMatrix<T, I>> A = R->matMatMult(*R_T);
 
     this->values = std::shared_ptr<T[]>(new T[A->nnzs]);
-    this->row_position = std::shared_ptr<int[]>(new int[A->rows + 1]);
+    this->row_position = std::shared_ptr<I[]>(new I[A->rows + 1]);
     this->col_index = std::shared_ptr<int[]>(new int[A->nnzs]);
 
-    for (int i = 0; i < A->nnzs; i++)
+    for (I i = 0; i < A->nnzs; i++)
     {
         this->values[i] = A->values[i];
         this->col_index[i] = A->col_index[i];
@@ -191,17 +202,17 @@ CSRMatrix<T>::CSRMatrix(int size, double sparsity)
     this->nnzs = A->nnzs;
 }
 
-template <class T>
-CSRMatrix<T>::~CSRMatrix()
+template <class T, class I>
+CSRMatrix<T, I>::~CSRMatrix()
 {
 }
 
-template <class T>
-void CSRMatrix<T>::printMatrix()
+template <class T, class I>
+void CSRMatrix<T, I>::printMatrix()
 {
     std::cout << "Printing matrix" << std::endl;
     std::cout << "Values: ";
-    for (int j = 0; j < this->nnzs; j++)
+    for (I j = 0; j < this->nnzs; j++)
     {
         std::cout << this->values[j] << " ";
     }
@@ -213,15 +224,15 @@ void CSRMatrix<T>::printMatrix()
     }
     std::cout << std::endl;
     std::cout << "col_index: ";
-    for (int j = 0; j < this->nnzs; j++)
+    for (I j = 0; j < this->nnzs; j++)
     {
         std::cout << this->col_index[j] << " ";
     }
     std::cout << std::endl;
 }
 
-template <class T>
-void CSRMatrix<T>::print2DMatrix()
+template <class T, class I>
+void CSRMatrix<T, I>::print2DMatrix()
 {
     if (this->rows > 100)
     {
@@ -235,11 +246,11 @@ void CSRMatrix<T>::print2DMatrix()
         for (int i = 0; i < this->rows; i++)
         {
             // rows indices of matrix
-            int r_start = row_position[i];
-            int r_end = row_position[i + 1];
+            I r_start = row_position[i];
+            I r_end = row_position[i + 1];
 
             // cii - index of col_index of array
-            for (int cii = r_start; cii < r_end; cii++)
+            for (I cii = r_start; cii < r_end; cii++)
             {
                 int ci = col_index[cii];
                 // Store non-zeros in row-major order
@@ -255,223 +266,454 @@ void CSRMatrix<T>::print2DMatrix()
     }
 }
 
-template <class T>
-std::shared_ptr<CSRMatrix<T>> CSRMatrix<T>::transpose()
+template <class T, class I>
+std::shared_ptr<CSRMatrix<T, I>> CSRMatrix<T, I>::transpose()
 {
-    std::vector<T> t_values;
-    std::vector<int> t_cols;
-    std::vector<int> t_rows;
+    // Counting sort by column: count the entries of every column, take the
+    // prefix sum, then scatter the rows in increasing order, which leaves the
+    // rows of the transpose sorted. O(nnzs + rows + cols).
+    std::shared_ptr<CSRMatrix<T, I>> t_Matrix(new CSRMatrix<T, I>(this->cols, this->rows, nnzs, true));
 
-    // First element in row vector will always be 0
-    t_rows.push_back(0);
-
-    // Note that outer loop is cols as there will be as many rows
-    // in transposed matrix as columns in the original one
-    for (int i = 0; i < this->cols; i++)
-    {
-        std::vector<int> cols_nnzs{};
-        int k = 0;
-        for (int c = 0; c < nnzs; c++)
-        {
-            // Store values and column indices on column i,
-            // which corresponds to row i in transposed matrix
-            if (i == col_index[c])
-            {
-                cols_nnzs.push_back(i);
-                t_values.push_back(this->values[c]);
-                for (int k = 0; k < this->rows; k++)
-                    if (c >= row_position[k] && c < row_position[k + 1])
-                    {
-                        t_cols.push_back(k);
-                    }
-            }
-        }
-        // Store row position incrementally based on number of nnzs in row
-        t_rows.push_back(cols_nnzs.size() + t_rows.back());
-    }
-
-    // Construct transposed matrix
-    std::shared_ptr<CSRMatrix<T>> t_Matrix(new CSRMatrix<T>(this->rows, this->rows, nnzs, true));
-
-    for (int i = 0; i < t_cols.size(); i++)
+    std::fill(t_Matrix->row_position.get(), t_Matrix->row_position.get() + this->cols + 1, 0);
+    for (I c = 0; c < nnzs; c++)
     {
-        t_Matrix->col_index[i] = t_cols[i];
+        t_Matrix->row_position[col_index[c] + 1]++;
     }
-    for (int i = 0; i < t_rows.size(); i++)
+    for (int i = 0; i < this->cols; i++)
     {
-        t_Matrix->row_position[i] = t_rows[i];
+        t_Matrix->row_position[i + 1] += t_Matrix->row_position[i];
     }
-    for (int i = 0; i < t_values.size(); i++)
+
+    std::vector<I> next(t_Matrix->row_position.get(), t_Matrix->row_position.get() + this->cols);
+    for (int i = 0; i < this->rows; i++)
     {
-        t_Matrix->values[i] = t_values[i];
+        for (I c = row_position[i]; c < row_position[i + 1]; c++)
+        {
+            I dest = next[col_index[c]]++;
+            t_Matrix->col_index[dest] = i;
+            t_Matrix->values[dest] = this->values[c];
+        }
     }
 
     return t_Matrix;
 }
 
-template <class T>
-void CSRMatrix<T>::matVecMult(std::vector<T> &input, std::vector<T> &output)
+template <class T, class I>
+void CSRMatrix<T, I>::matVecMult(std::vector<T> &input, std::vector<T> &output)
 {
     // TODO: check the sizes
 
+    // rows are independent, so they can be split over threads
+#pragma omp parallel for schedule(static)
     for (int i = 0; i < this->rows; i++)
     {
-        output[i] = 0.0;
+        T sum = 0.0;
+        for (I val_index = this->row_position[i]; val_index < this->row_position[i + 1]; val_index++)
+        {
+            sum += this->values[val_index] * input[this->col_index[val_index]];
+        }
+        output[i] = sum;
     }
+}
 
-    for (int i = 0; i < this->rows; i++)
+namespace
+{
+// Y = A X over all rows of A for a compile-time block width K, so the
+// loop over the vectors is fully unrolled and vectorised
+template <int K, class T, class I>
+void spmmFixedWidth(const I *row_position, const int *col_index, const T *values, const T *X, T *Y, int rows)
+{
+#pragma omp parallel for schedule(static)
+    for (int i = 0; i < rows; i++)
     {
-        for (int val_index = this->row_position[i]; val_index < this->row_position[i + 1]; val_index++)
+        T sum[K] = {};
+        for (I val_index = row_position[i]; val_index < row_position[i + 1]; val_index++)
+        {
+            const T a = values[val_index];
+            const T *x_row = X + (size_t)col_index[val_index] * K;
+#pragma omp simd
+            for (int k = 0; k < K; k++)
+            {
+                sum[k] += a * x_row[k];
+            }
+        }
+        T *y_row = Y + (size_t)i * K;
+#pragma omp simd
+        for (int k = 0; k < K; k++)
         {
-            output[i] += this->values[val_index] * input[this->col_index[val_index]];
+            y_row[k] = sum[k];
         }
     }
 }
+} // namespace
 
-template <class T>
-std::shared_ptr<CSRMatrix<T>> CSRMatrix<T>::matMatMultSymbolic(CSRMatrix<T> &mat_right)
+template <class T, class I>
+void CSRMatrix<T, I>::matMultiVecMult(std::vector<T> &input, int n_vecs, std::vector<T> &output)
 {
-    std::vector<int> col_ind;
-    std::vector<int> row_pos(this->rows + 1, 0);
+    if (input.size() != (size_t)this->cols * n_vecs || output.size() != (size_t)this->rows * n_vecs)
+    {
+        throw std::invalid_argument("Dimensions don't match");
+    }
+    const I *rp = &row_position[0];
+    const int *ci = &col_index[0];
+    const T *vals = &this->values[0];
 
-    row_pos[0] = 0;
+    // common block sizes get a specialised kernel
+    switch (n_vecs)
+    {
+    case 1:
+        spmmFixedWidth<1>(rp, ci, vals, input.data(), output.data(), this->rows);
+        return;
+    case 4:
+        spmmFixedWidth<4>(rp, ci, vals, input.data(), output.data(), this->rows);
+        return;
+    case 8:
+        spmmFixedWidth<8>(rp, ci, vals, input.data(), output.data(), this->rows);
+        return;
+    case 16:
+        spmmFixedWidth<16>(rp, ci, vals, input.data(), output.data(), this->rows);
+        return;
+    case 32:
+        spmmFixedWidth<32>(rp, ci, vals, input.data(), output.data(), this->rows);
+        return;
+    }
 
-    // loop over rows of A
+    T *Y = output.data();
+    const T *X = input.data();
+#pragma omp parallel for schedule(static)
     for (int i = 0; i < this->rows; i++)
     {
-        // rows indices of left matrix
-        int r_start = this->row_position[i];
-        int r_end = this->row_position[i + 1];
+        T *y_row = Y + (size_t)i * n_vecs;
+        for (int k = 0; k < n_vecs; k++)
+        {
+            y_row[k] = 0;
+        }
+        for (I val_index = rp[i]; val_index < rp[i + 1]; val_index++)
+        {
+            const T a = vals[val_index];
+            const T *x_row = X + (size_t)ci[val_index] * n_vecs;
+#pragma omp simd
+            for (int k = 0; k < n_vecs; k++)
+            {
+                y_row[k] += a * x_row[k];
+            }
+        }
+    }
+}
 
-        // loop over column indices for this row in A - equivalent to rows in B
-        std::vector<int> cols_nnzs{};
+template <class T, class I>
+std::shared_ptr<CSRMatrix<T, I>> CSRMatrix<T, I>::matMatMultSymbolic(CSRMatrix<T, I> &mat_right)
+{
+    // Gustavson: the columns of row i of the product are the union of the rows
+    // of mat_right selected by row i of this matrix. A per-thread marker array
+    // over the output columns finds the union in O(flops) without sorting the
+    // duplicates; rows are counted in a first pass so the output is allocated once.
+    int rows = this->rows;
+    int cols = mat_right.cols;
+    std::shared_ptr<I[]> row_pos(new I[rows + 1]);
+    row_pos[0] = 0;
 
-        // cii - index of col_index of left array
-        for (int cii = r_start; cii < r_end; cii++)
+#pragma omp parallel
+    {
+        std::vector<int> mark(cols, -1);
+#pragma omp for schedule(dynamic, 256)
+        for (int i = 0; i < rows; i++)
         {
-            int ci = col_index[cii];
-            // left col index corresponds to right row index
-            int row_right_start = mat_right.row_position[ci];
-            int row_right_end = mat_right.row_position[ci + 1];
-            for (int rr = row_right_start; rr < row_right_end; rr++)
+            I count = 0;
+            for (I cii = row_position[i]; cii < row_position[i + 1]; cii++)
             {
-                // this is the column index of output that is nnz
-                // the corresponding row index is i
-                cols_nnzs.push_back(mat_right.col_index[rr]);
+                int ci = col_index[cii];
+                for (I rr = mat_right.row_position[ci]; rr < mat_right.row_position[ci + 1]; rr++)
+                {
+                    int c = mat_right.col_index[rr];
+                    if (mark[c] != i)
+                    {
+                        mark[c] = i;
+                        count++;
+                    }
+                }
             }
+            row_pos[i + 1] = count;
         }
-        // sort non_zeros & remove duplicates
-        sort(cols_nnzs.begin(), cols_nnzs.end());
-        cols_nnzs.erase(unique(cols_nnzs.begin(), cols_nnzs.end()), cols_nnzs.end());
-
-        int nnzs_per_row = cols_nnzs.size();
+    }
+    for (int i = 0; i < rows; i++)
+    {
+        row_pos[i + 1] += row_pos[i];
+    }
 
-        row_pos[i + 1] = row_pos[i] + nnzs_per_row;
+    I new_nnzs = row_pos[rows];
+    std::shared_ptr<int[]> col_ind(new int[std::max<I>(new_nnzs, 1)]);
+    std::shared_ptr<T[]> new_values(new T[std::max<I>(new_nnzs, 1)]);
 
-        // Concatenate
-        for (int j = 0; j < nnzs_per_row; j++)
+#pragma omp parallel
+    {
+        std::vector<int> mark(cols, -1);
+#pragma omp for schedule(dynamic, 256)
+        for (int i = 0; i < rows; i++)
         {
-            col_ind.push_back(cols_nnzs[j]);
+            I next = row_pos[i];
+            for (I cii = row_position[i]; cii < row_position[i + 1]; cii++)
+            {
+                int ci = col_index[cii];
+                for (I rr = mat_right.row_position[ci]; rr < mat_right.row_position[ci + 1]; rr++)
+                {
+                    int c = mat_right.col_index[rr];
+                    if (mark[c] != i)
+                    {
+                        mark[c] = i;
+                        col_ind[next++] = c;
+                    }
+                }
+            }
+            std::sort(&col_ind[0] + row_pos[i], &col_ind[0] + row_pos[i + 1]);
+            std::fill(&new_values[0] + row_pos[i], &new_values[0] + row_pos[i + 1], 0);
         }
     }
 
-    int new_nnzs = col_ind.size();
+    return std::shared_ptr<CSRMatrix<T, I>>(new CSRMatrix<T, I>(rows, cols, new_nnzs, new_values, row_pos, col_ind));
+}
 
-    std::shared_ptr<CSRMatrix<T>> result(new CSRMatrix<T>(this->rows, mat_right.cols, new_nnzs, true));
+template <class T, class I>
+std::shared_ptr<CSRMatrix<T, I>> CSRMatrix<T, I>::matMatMult(CSRMatrix<T, I> &mat_right)
+{
+    std::shared_ptr<CSRMatrix<T, I>> result = matMatMultSymbolic(mat_right);
+    matMatMultNumeric(mat_right, *result);
+    return result;
+}
 
-    for (int i = 0; i < new_nnzs; i++)
+template <class T, class I>
+void CSRMatrix<T, I>::matMatMultNumeric(CSRMatrix<T, I> &mat_right, CSRMatrix<T, I> &result)
+{
+    // Numeric pass: accumulate row i in a dense per-thread array indexed by
+    // column, then gather it into the sorted pattern (which also clears it)
+#pragma omp parallel
     {
-        result->col_index[i] = col_ind[i];
-        result->values[i] = 0;
+        std::vector<T> accumulator(mat_right.cols, 0);
+#pragma omp for schedule(dynamic, 256)
+        for (int i = 0; i < this->rows; i++)
+        {
+            for (I cii = row_position[i]; cii < row_position[i + 1]; cii++)
+            {
+                int ci = col_index[cii];
+                T a = this->values[cii];
+                for (I rr = mat_right.row_position[ci]; rr < mat_right.row_position[ci + 1]; rr++)
+                {
+                    accumulator[mat_right.col_index[rr]] += a * mat_right.values[rr];
+                }
+            }
+            for (I k = result.row_position[i]; k < result.row_position[i + 1]; k++)
+            {
+                int c = result.col_index[k];
+                result.values[k] = accumulator[c];
+                accumulator[c] = 0;
+            }
+        }
     }
-    for (int i = 0; i < this->rows + 1; i++)
+    result.invalidateDiagonal();
+}
+
+template <class T, class I>
+void CSRMatrix<T, I>::sortRows()
+{
+    // Rows are independent, and most are already sorted so they are left alone
+#pragma omp parallel for schedule(dynamic, 256)
+    for (int i = 0; i < this->rows; i++)
     {
-        result->row_position[i] = row_pos[i];
+        I r_start = row_position[i];
+        I r_end = row_position[i + 1];
+        if (std::is_sorted(&col_index[0] + r_start, &col_index[0] + r_end))
+        {
+            continue;
+        }
+        std::vector<std::pair<int, T>> row_entries;
+        for (I cii = r_start; cii < r_end; cii++)
+        {
+            row_entries.push_back({col_index[cii], this->values[cii]});
+        }
+        std::sort(row_entries.begin(), row_entries.end(),
+                  [](const std::pair<int, T> &a, const std::pair<int, T> &b) { return a.first < b.first; });
+        for (I cii = r_start; cii < r_end; cii++)
+        {
+            col_index[cii] = row_entries[cii - r_start].first;
+            this->values[cii] = row_entries[cii - r_start].second;
+        }
     }
-
-    return result;
+    // entries may have moved
+    diag_position_valid = false;
+    inv_diagonal_valid = false;
 }
 
-template <class T>
-std::shared_ptr<CSRMatrix<T>> CSRMatrix<T>::matMatMult(CSRMatrix<T> &mat_right)
+namespace
+{
+inline uint64_t mixPattern(uint64_t v, uint64_t position)
 {
-    // for now, we assume output has been preallocated
-    std::vector<T> output_all_values{};
-    std::vector<int> output_cols{};
-    std::vector<int> output_row_position(this->rows + 1, 0);
+    v ^= position * 0x9E3779B97F4A7C15ULL;
+    v ^= v >> 33;
+    v *= 0xFF51AFD7ED558CCDULL;
+    v ^= v >> 33;
+    return v;
+}
+} // namespace
 
-    // loop over rows of A
-    for (int i = 0; i < this->rows; i++)
+template <class T, class I>
+uint64_t CSRMatrix<T, I>::patternHash()
+{
+    // Each entry is mixed with its position and the results summed, so the
+    // hash can be reduced in parallel
+    uint64_t h_rows = 0;
+    uint64_t h_cols = 0;
+#pragma omp parallel for reduction(+ : h_rows) schedule(static)
+    for (int i = 0; i <= this->rows; i++)
     {
-        // rows indices of left matrix
-        int r_start = row_position[i];
-        int r_end = row_position[i + 1];
-
-        // loop over column indices for this row in A - equivalent to rows in B
-        std::vector<int> cols_nnzs{};
+        h_rows += mixPattern((uint64_t)row_position[i], (uint64_t)i);
+    }
+#pragma omp parallel for reduction(+ : h_cols) schedule(static)
+    for (I k = 0; k < nnzs; k++)
+    {
+        h_cols += mixPattern((uint64_t)col_index[k], (uint64_t)k + 0x5bd1e995ULL);
+    }
+    return mixPattern(h_rows ^ (h_cols * 31), ((uint64_t)this->rows << 32) ^ (uint64_t)this->cols);
+}
 
-        // cii - index of col_index of left array
-        for (int cii = r_start; cii < r_end; cii++)
+template <class T, class I>
+I *CSRMatrix<T, I>::diagonalPositions()
+{
+    if (!diag_position_valid)
+    {
+        // binary search in sorted rows, a scan in unsorted ones
+        bool sorted = true;
+        diag_position.assign(this->rows, -1);
+#pragma omp parallel for schedule(static) reduction(&& : sorted)
+        for (int i = 0; i < this->rows; i++)
         {
-            int ci = col_index[cii];
-            // left col index corresponds to right row index
-            int row_right_start = mat_right.row_position[ci];
-            int row_right_end = mat_right.row_position[ci + 1];
-            for (int rr = row_right_start; rr < row_right_end; rr++)
+            int *row_begin = &col_index[0] + row_position[i];
+            int *row_end = &col_index[0] + row_position[i + 1];
+            int *it;
+            if (std::is_sorted(row_begin, row_end))
+            {
+                it = std::lower_bound(row_begin, row_end, i);
+            }
+            else
             {
-                // this is the column index of output that is nnz
-                // the corresponding row index is i
-                cols_nnzs.push_back(mat_right.col_index[rr]);
+                sorted = false;
+                it = std::find(row_begin, row_end, i);
+            }
+            if (it != row_end && *it == i)
+            {
+                diag_position[i] = (I)(it - &col_index[0]);
             }
         }
-        // sort non_zeros & remove duplicates
-        sort(cols_nnzs.begin(), cols_nnzs.end());
-        cols_nnzs.erase(unique(cols_nnzs.begin(), cols_nnzs.end()), cols_nnzs.end());
+        rows_sorted = sorted;
+        diag_position_valid = true;
+    }
+    return diag_position.data();
+}
 
-        std::vector<T> output_vals_per_row(cols_nnzs.size(), 0);
+template <class T, class I>
+bool CSRMatrix<T, I>::rowsSorted()
+{
+    diagonalPositions();
+    return rows_sorted;
+}
 
-        for (int cii = r_start; cii < r_end; cii++)
+template <class T, class I>
+T *CSRMatrix<T, I>::inverseDiagonal()
+{
+    if (!inv_diagonal_valid)
+    {
+        I *diag = diagonalPositions();
+        inv_diagonal.assign(this->rows, 0);
+        bool singular = false;
+#pragma omp parallel for schedule(static) reduction(|| : singular)
+        for (int i = 0; i < this->rows; i++)
         {
-            int ci = col_index[cii];
-            // left col index corresponds to right row index
-            int row_right_start = mat_right.row_position[ci];
-            int row_right_end = mat_right.row_position[ci + 1];
-            for (int rr = row_right_start; rr < row_right_end; rr++)
+            if (diag[i] < 0 || this->values[diag[i]] == T(0))
             {
-                // multiply
-                for (int n = 0; n < cols_nnzs.size(); n++)
-                {
-                    if (cols_nnzs[n] == mat_right.col_index[rr])
-                    {
-                        output_vals_per_row[n] += this->values[cii] * mat_right.values[rr];
-                    }
-                }
+                singular = true;
+            }
+            else
+            {
+                inv_diagonal[i] = T(1) / this->values[diag[i]];
             }
         }
-        output_row_position[i + 1] = output_row_position[i] + cols_nnzs.size();
-
-        // Concatenate
-        for (int j = 0; j < cols_nnzs.size(); j++)
+        if (singular)
         {
-            output_cols.push_back(cols_nnzs[j]);
-            output_all_values.push_back(output_vals_per_row[j]);
+            throw std::invalid_argument("Matrix has a zero on the diagonal");
         }
+        inv_diagonal_valid = true;
     }
+    return inv_diagonal.data();
+}
 
-    std::shared_ptr<CSRMatrix<T>> result(new CSRMatrix<T>(this->rows, mat_right.cols, output_cols.size(), true));
+template <class T, class I>
+void CSRMatrix<T, I>::invalidateDiagonal()
+{
+    diag_position_valid = false;
+    inv_diagonal_valid = false;
+}
+
+template <class T, class I>
+void CSRMatrix<T, I>::lockPattern()
+{
+    // sorted rows let entryIndex use a binary search
+    sortRows();
+    pattern_locked = true;
+    invalidateDiagonal();
+}
 
-    for (int i = 0; i < output_cols.size(); i++)
+// the end of an assembly: the values added since lockPattern or zeroValues
+// are final, so the diagonal is read afresh
+template <class T, class I>
+void CSRMatrix<T, I>::unlockPattern()
+{
+    pattern_locked = false;
+    invalidateDiagonal();
+}
+
+template <class T, class I>
+I CSRMatrix<T, I>::entryIndex(int row, int col)
+{
+    if (!pattern_locked)
     {
-        result->col_index[i] = output_cols[i];
+        throw std::logic_error("Pattern must be locked before looking up entries");
     }
-    for (int i = 0; i <= this->rows; i++)
+    int *row_begin = &col_index[0] + row_position[row];
+    int *row_end = &col_index[0] + row_position[row + 1];
+    int *it = std::lower_bound(row_begin, row_end, col);
+    if (it == row_end || *it != col)
     {
-        result->row_position[i] = output_row_position[i];
+        return -1;
     }
-    for (int i = 0; i < output_all_values.size(); i++)
+    return (I)(it - &col_index[0]);
+}
+
+template <class T, class I>
+void CSRMatrix<T, I>::addAt(I index, T value)
+{
+    // Several threads may hit the same entry, so the update must be atomic.
+    // The cached diagonal is invalidated once per assembly, not here.
+#pragma omp atomic
+    this->values[index] += value;
+}
+
+template <class T, class I>
+void CSRMatrix<T, I>::add(int row, int col, T value)
+{
+    I index = entryIndex(row, col);
+    if (index < 0)
     {
-        result->values[i] = output_all_values[i];
+        throw std::invalid_argument("Entry is not in the locked sparsity pattern");
     }
+    addAt(index, value);
+}
 
-    return result;
-}
\ No newline at end of file
+template <class T, class I>
+void CSRMatrix<T, I>::zeroValues()
+{
+#pragma omp parallel for schedule(static)
+    for (I i = 0; i < nnzs; i++)
+    {
+        this->values[i] = 0;
+    }
+    invalidateDiagonal();
+}
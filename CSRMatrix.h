@@ -2,8 +2,12 @@
 #include "Matrix.h"
 #include <vector>
 #include <memory>
+#include <cstdint>
 
-template <class T>
+// I is the index type used for row_position and nnzs (int or long long).
+// Column indices are bounded by the number of columns, so they stay 32-bit
+// regardless of I, which keeps col_index and the kernels reading it compact.
+template <class T, class I = int>
 class CSRMatrix : public Matrix<T>
 {
 public:
@@ -11,16 +15,16 @@ public:
     CSRMatrix(void);
 
     // Constructor
-    CSRMatrix(int rows, int cols, int nnzs, bool preallocate);
+    CSRMatrix(int rows, int cols, I nnzs, bool preallocate);
     CSRMatrix(int size, double sparsity);
 
     //Constructor
-    CSRMatrix(int rows, int cols, int nnzs, std::shared_ptr<T[]> values_ptr, std::shared_ptr<int[]> row_pos, std::shared_ptr<int[]> col_ind);
+    CSRMatrix(int rows, int cols, I nnzs, std::shared_ptr<T[]> values_ptr, std::shared_ptr<I[]> row_pos, std::shared_ptr<int[]> col_ind);
 
     // Copy constructor
-    CSRMatrix(const CSRMatrix<T>& M2);
+    CSRMatrix(const CSRMatrix<T, I> &M2);
 
-    CSRMatrix<T> &operator=(const CSRMatrix<T> &M2);
+    CSRMatrix<T, I> &operator=(const CSRMatrix<T, I> &M2);
 
     ~CSRMatrix();
 
@@ -30,17 +34,66 @@ public:
 
     void matVecMult(std::vector<T> &input, std::vector<T> &output);
 
-    std::shared_ptr<CSRMatrix<T>> matMatMult(CSRMatrix<T> &mat_right);
-    std::shared_ptr<CSRMatrix<T>> matMatMultSymbolic(CSRMatrix<T> &mat_right);
+    // Sparse matrix times a block of n_vecs vectors, both stored row-major:
+    // input is cols x n_vecs, output is rows x n_vecs. The matrix is read once
+    // for the whole block.
+    void matMultiVecMult(std::vector<T> &input, int n_vecs, std::vector<T> &output);
 
-    CSRMatrix<T> cholesky();
-    std::shared_ptr<CSRMatrix<T>> transpose();
+    std::shared_ptr<CSRMatrix<T, I>> matMatMult(CSRMatrix<T, I> &mat_right);
+    std::shared_ptr<CSRMatrix<T, I>> matMatMultSymbolic(CSRMatrix<T, I> &mat_right);
+    // values of this * mat_right into result, which has the pattern given by
+    // matMatMultSymbolic for the same two patterns
+    void matMatMultNumeric(CSRMatrix<T, I> &mat_right, CSRMatrix<T, I> &result);
 
-    std::shared_ptr<int[]> row_position; //create nullpointer
-    std::shared_ptr<int[]> col_index;    // create nullpointer
+    CSRMatrix<T, I> cholesky();
+    std::shared_ptr<CSRMatrix<T, I>> transpose();
+
+    // sort the column indices (and values) within every row
+    void sortRows();
+
+    // 64-bit hash of the dimensions, row_position and col_index (not the values),
+    // used to recognise a sparsity pattern that has been analysed before
+    uint64_t patternHash();
+
+    // Cached diagonal for smoothers and triangular solves, built on first use.
+    // diagonalPositions()[i] is the index of a_ii in values, or -1 if it is not
+    // stored. When rowsSorted() (see sortRows() and lockPattern()), the entries
+    // before it are the strictly lower part of row i and the entries after it
+    // the strictly upper part; the rows are never reordered here.
+    // inverseDiagonal()[i] is 1 / a_ii. Call invalidateDiagonal() after
+    // changing values or the pattern directly. lockPattern, zeroValues and
+    // unlockPattern do so themselves, but add and addAt do not, so the
+    // diagonal must not be read in the middle of an assembly.
+    I *diagonalPositions();
+    T *inverseDiagonal();
+    void invalidateDiagonal();
+    bool rowsSorted();
+
+    // Fixed-pattern assembly. lockPattern() sorts the columns of every row once,
+    // after which add() can be called concurrently from many threads without
+    // allocating or changing row_position/col_index.
+    void lockPattern();
+    void unlockPattern();
+    // index into values/col_index of entry (row, col), or -1 if not in the pattern
+    I entryIndex(int row, int col);
+    void add(int row, int col, T value);
+    void addAt(I index, T value);
+    // set every value to zero but keep the sparsity pattern
+    void zeroValues();
+
+    std::shared_ptr<I[]> row_position; //create nullpointer
+    std::shared_ptr<int[]> col_index;  // create nullpointer
 
     // number of non-zeros
-    int nnzs = -1;
+    I nnzs = -1;
+
+    bool pattern_locked = false;
+
+    std::vector<I> diag_position{};
+    std::vector<T> inv_diagonal{};
+    bool diag_position_valid = false;
+    bool rows_sorted = true;
+    bool inv_diagonal_valid = false;
 
     // we're inheriting the values pointer so we don't have to include it here
-};
\ No newline at end of file
+};
@@ -0,0 +1,234 @@
+#include "Chebyshev.h"
+#include <math.h>
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
+
+namespace
+{
+// Number of eigenvalues below x of the symmetric tridiagonal matrix with
+// diagonal alpha and off-diagonal beta (Sturm sequence)
+int eigenvaluesBelow(const std::vector<double> &alpha, const std::vector<double> &beta, double x)
+{
+    int count = 0;
+    double q = 1;
+    for (size_t i = 0; i < alpha.size(); i++)
+    {
+        double coupling = i > 0 ? beta[i - 1] * beta[i - 1] : 0;
+        q = alpha[i] - x - (i > 0 ? coupling / q : 0);
+        if (q == 0)
+        {
+            q = -1e-300;
+        }
+        if (q < 0)
+        {
+            count++;
+        }
+    }
+    return count;
+}
+
+// The k-th smallest eigenvalue (k from 1) of the tridiagonal matrix, by bisection
+// inside its Gershgorin bounds
+double tridiagonalEigenvalue(const std::vector<double> &alpha, const std::vector<double> &beta, int k)
+{
+    int m = alpha.size();
+    double low = alpha[0], high = alpha[0];
+    for (int i = 0; i < m; i++)
+    {
+        double radius = (i > 0 ? fabs(beta[i - 1]) : 0) + (i < m - 1 ? fabs(beta[i]) : 0);
+        low = std::min(low, alpha[i] - radius);
+        high = std::max(high, alpha[i] + radius);
+    }
+    for (int it = 0; it < 100 && high - low > 1e-14 * std::max(fabs(low), fabs(high)); it++)
+    {
+        double middle = 0.5 * (low + high);
+        if (eigenvaluesBelow(alpha, beta, middle) >= k)
+        {
+            high = middle;
+        }
+        else
+        {
+            low = middle;
+        }
+    }
+    return 0.5 * (low + high);
+}
+
+// deterministic entries in [-0.5, 0.5) (splitmix64 of the index)
+inline double startEntry(uint64_t i, uint64_t seed)
+{
+    uint64_t z = i + seed * 0x9e3779b97f4a7c15ULL + 0x9e3779b97f4a7c15ULL;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    z ^= z >> 31;
+    return (double)(z >> 11) / 9007199254740992.0 - 0.5;
+}
+} // namespace
+
+template <class T, class I>
+SpectrumEstimate lanczosSpectrum(CSRMatrix<T, I> &A, int steps, bool jacobi_scaled, uint64_t seed, double tolerance)
+{
+    int n = A.rows;
+    SpectrumEstimate estimate;
+    if (n == 0 || steps < 1)
+    {
+        return estimate;
+    }
+
+    // S = D^-1/2 A D^-1/2 is applied as scale * (A (scale * v))
+    std::vector<T> scale;
+    if (jacobi_scaled)
+    {
+        I *diag = A.diagonalPositions();
+        scale.resize(n);
+        for (int i = 0; i < n; i++)
+        {
+            if (diag[i] == -1 || !(A.values[diag[i]] > 0))
+            {
+                throw std::invalid_argument("Jacobi-scaled spectrum needs a positive diagonal");
+            }
+            scale[i] = 1 / sqrt(A.values[diag[i]]);
+        }
+    }
+
+    std::vector<T> v(n), v_old(n, 0), u(n), w(n);
+    double norm = 0;
+    for (int i = 0; i < n; i++)
+    {
+        v[i] = startEntry(i, seed);
+        norm += (double)v[i] * v[i];
+    }
+    norm = sqrt(norm);
+    for (int i = 0; i < n; i++)
+    {
+        v[i] /= norm;
+    }
+
+    std::vector<double> alpha, beta;
+    double beta_old = 0;
+    for (int j = 0; j < steps; j++)
+    {
+        if (jacobi_scaled)
+        {
+#pragma omp parallel for schedule(static)
+            for (int i = 0; i < n; i++)
+            {
+                u[i] = scale[i] * v[i];
+            }
+            A.matVecMult(u, w);
+        }
+        else
+        {
+            A.matVecMult(v, w);
+        }
+
+        double a = 0;
+#pragma omp parallel for reduction(+ : a) schedule(static)
+        for (int i = 0; i < n; i++)
+        {
+            if (jacobi_scaled)
+            {
+                w[i] *= scale[i];
+            }
+            a += (double)w[i] * v[i];
+        }
+        alpha.push_back(a);
+
+        // stop once the extreme Ritz values have settled
+        if (tolerance > 0 && alpha.size() % 10 == 0)
+        {
+            double lambda_min = tridiagonalEigenvalue(alpha, beta, 1);
+            double lambda_max = tridiagonalEigenvalue(alpha, beta, alpha.size());
+            bool settled = fabs(lambda_min - estimate.lambda_min) <= tolerance * fabs(lambda_min) &&
+                           fabs(lambda_max - estimate.lambda_max) <= tolerance * fabs(lambda_max);
+            estimate.lambda_min = lambda_min;
+            estimate.lambda_max = lambda_max;
+            if (settled)
+            {
+                break;
+            }
+        }
+
+        double b = 0;
+#pragma omp parallel for reduction(+ : b) schedule(static)
+        for (int i = 0; i < n; i++)
+        {
+            w[i] -= a * v[i] + beta_old * v_old[i];
+            b += (double)w[i] * w[i];
+        }
+        b = sqrt(b);
+
+        // done, or the Krylov space is invariant and the Ritz values exact
+        if (j == steps - 1 || b <= 1e-12 * fabs(a))
+        {
+            break;
+        }
+        beta.push_back(b);
+#pragma omp parallel for schedule(static)
+        for (int i = 0; i < n; i++)
+        {
+            v_old[i] = v[i];
+            v[i] = w[i] / b;
+        }
+        beta_old = b;
+    }
+
+    estimate.steps = alpha.size();
+    estimate.lambda_min = tridiagonalEigenvalue(alpha, beta, 1);
+    estimate.lambda_max = tridiagonalEigenvalue(alpha, beta, estimate.steps);
+    return estimate;
+}
+
+template <class T, class I>
+void ChebyshevPreconditioner<T, I>::setup(CSRMatrix<T, I> &A)
+{
+    if (degree < 1 || !(lower_fraction > 0 && lower_fraction < 1))
+    {
+        throw std::invalid_argument("Chebyshev needs degree >= 1 and 0 < lower_fraction < 1");
+    }
+    int n = A.rows;
+    matrix = std::make_shared<CSRMatrix<T, I>>(A.rows, A.cols, A.nnzs, A.values, A.row_position, A.col_index);
+    T *inv_diag = matrix->inverseDiagonal();
+    inv_diagonal.assign(inv_diag, inv_diag + n);
+
+    // the Ritz value approaches lambda_max from below, hence the margin
+    lambda_max = 1.1 * lanczosSpectrum(*matrix, lanczos_steps, true).lambda_max;
+    lambda_min = lower_fraction * lambda_max;
+    residual.assign(n, 0);
+    direction.assign(n, 0);
+    product.assign(n, 0);
+}
+
+template <class T, class I>
+void ChebyshevPreconditioner<T, I>::apply(const std::vector<T> &r, std::vector<T> &z)
+{
+    // Chebyshev iteration (Saad, Algorithm 12.1) preconditioned by D, from z = 0
+    int n = matrix->rows;
+    double theta = 0.5 * (lambda_max + lambda_min);
+    double delta = 0.5 * (lambda_max - lambda_min);
+    double sigma = theta / delta;
+    double rho = 1 / sigma;
+#pragma omp parallel for schedule(static)
+    for (int i = 0; i < n; i++)
+    {
+        residual[i] = r[i];
+        direction[i] = inv_diagonal[i] * r[i] / theta;
+        z[i] = direction[i];
+    }
+    for (int step = 1; step < degree; step++)
+    {
+        double rho_new = 1 / (2 * sigma - rho);
+        double d_scale = rho_new * rho;
+        double z_scale = 2 * rho_new / delta;
+        matrix->matVecMult(direction, product);
+#pragma omp parallel for schedule(static)
+        for (int i = 0; i < n; i++)
+        {
+            residual[i] -= product[i];
+            direction[i] = d_scale * direction[i] + z_scale * inv_diagonal[i] * residual[i];
+            z[i] += direction[i];
+        }
+        rho = rho_new;
+    }
+}
@@ -0,0 +1,64 @@
+#pragma once
+#include "CSRMatrix.h"
+#include "Preconditioner.h"
+#include <vector>
+#include <memory>
+#include <cstdint>
+
+// Extreme Ritz values of a symmetric matrix after a number of Lanczos steps.
+// They lie inside the spectrum and converge to its ends from within, the
+// largest quickly, the smallest more slowly for badly conditioned matrices.
+struct SpectrumEstimate
+{
+    double lambda_min = 0;
+    double lambda_max = 0;
+    int steps = 0; // fewer than asked for if the Krylov space became invariant or the values settled
+};
+
+// Lanczos without reorthogonalisation from a fixed pseudo-random start vector:
+// one product with A and two reductions per step. With jacobi_scaled, the
+// spectrum of D^-1 A (through the similar D^-1/2 A D^-1/2), which needs a
+// positive diagonal. A must be symmetric. With a positive tolerance, it stops
+// before steps once both Ritz values have changed by less than that
+// (relative) over the last ten steps; the smallest needs about as many steps
+// as CG needs iterations for a moderate accuracy.
+template <class T, class I>
+SpectrumEstimate lanczosSpectrum(CSRMatrix<T, I> &A, int steps = 30, bool jacobi_scaled = false, uint64_t seed = 0,
+                                 double tolerance = 0);
+
+// Chebyshev polynomial preconditioner or smoother for symmetric positive
+// definite A: apply(r, z) is degree steps of the Jacobi-preconditioned
+// Chebyshev iteration for A z = r from z = 0, which is z = p(D^-1 A) D^-1 r for
+// a polynomial p of degree - 1. It uses degree - 1 products with A and no
+// reductions, and M is symmetric, so it can precondition CG. The polynomial
+// is tuned to the interval [lower_fraction, 1] * 1.1 lambda_max(D^-1 A), with
+// lambda_max estimated in setup by lanczos_steps Lanczos steps: the default
+// damps the upper part of the spectrum, as a multigrid smoother should, and a
+// smaller lower_fraction makes it a better preconditioner on its own.
+template <class T, class I = int>
+class ChebyshevPreconditioner : public Preconditioner<T, I>
+{
+public:
+    explicit ChebyshevPreconditioner(int degree = 3, double lower_fraction = 0.1)
+        : degree(degree), lower_fraction(lower_fraction)
+    {
+    }
+
+    void setup(CSRMatrix<T, I> &A) override;
+    void apply(const std::vector<T> &r, std::vector<T> &z) override;
+
+    int degree;
+    double lower_fraction;
+    int lanczos_steps = 10;
+
+    // the interval the polynomial is tuned to, from the last setup
+    double lambda_min = 0;
+    double lambda_max = 0;
+
+    // A itself, sharing its arrays, so the products read the current values
+    std::shared_ptr<CSRMatrix<T, I>> matrix;
+    std::vector<T> inv_diagonal{};
+
+private:
+    std::vector<T> residual{}, direction{}, product{};
+};
@@ -0,0 +1,305 @@
+#include <iostream>
+#include "Generators.h"
+#include "CSRBuilder.h"
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <vector>
+
+namespace
+{
+// splitmix64 finaliser: a good 64-bit hash, used as a counter-based random generator
+inline uint64_t mixHash(uint64_t x)
+{
+    x += 0x9E3779B97F4A7C15ULL;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+// uniform double in [0, 1) for the given counters
+inline double uniformHash(uint64_t seed, uint64_t a, uint64_t b)
+{
+    uint64_t h = mixHash(seed ^ mixHash(a ^ mixHash(b)));
+    return (double)(h >> 11) * (1.0 / 9007199254740992.0);
+}
+
+// Two-pass CSR emission: count the entries of each row, prefix sum, then fill.
+// fill(i, cols, vals) writes the count(i) entries of row i, with sorted columns.
+template <class T, class I, class CountFn, class FillFn>
+std::shared_ptr<CSRMatrix<T, I>> generateRows(int rows, int cols, CountFn count, FillFn fill)
+{
+    std::shared_ptr<I[]> row_pos(new I[rows + 1]);
+    row_pos[0] = 0;
+#pragma omp parallel for schedule(static)
+    for (int i = 0; i < rows; i++)
+    {
+        row_pos[i + 1] = count(i);
+    }
+    for (int i = 0; i < rows; i++)
+    {
+        row_pos[i + 1] += row_pos[i];
+    }
+
+    I nnzs = row_pos[rows];
+    std::shared_ptr<T[]> values(new T[std::max<I>(nnzs, 1)]);
+    std::shared_ptr<int[]> col_ind(new int[std::max<I>(nnzs, 1)]);
+
+#pragma omp parallel for schedule(static)
+    for (int i = 0; i < rows; i++)
+    {
+        fill(i, &col_ind[row_pos[i]], &values[row_pos[i]]);
+    }
+
+    std::shared_ptr<CSRMatrix<T, I>> result(new CSRMatrix<T, I>(rows, cols, nnzs, values, row_pos, col_ind));
+    result->preallocated = true;
+    return result;
+}
+} // namespace
+
+template <class T, class I>
+std::shared_ptr<CSRMatrix<T, I>> poisson2D(int nx, int ny)
+{
+    return anisotropicDiffusion2D<T, I>(nx, ny, 1.0, 0.0);
+}
+
+template <class T, class I>
+std::shared_ptr<CSRMatrix<T, I>> poisson3D(int nx, int ny, int nz, int stencil)
+{
+    if (stencil != 7 && stencil != 27)
+    {
+        throw std::invalid_argument("poisson3D supports 7-point and 27-point stencils");
+    }
+    int n = nx * ny * nz;
+    int reach_diag = stencil == 27 ? 1 : 0;
+
+    // Neighbours are visited in increasing index order so columns come out sorted
+    auto visit = [=](int i, auto &&emit) {
+        int x = i % nx;
+        int y = (i / nx) % ny;
+        int z = i / (nx * ny);
+        for (int dz = -1; dz <= 1; dz++)
+        {
+            for (int dy = -1; dy <= 1; dy++)
+            {
+                for (int dx = -1; dx <= 1; dx++)
+                {
+                    int distance = abs(dx) + abs(dy) + abs(dz);
+                    if (distance > 1 && !reach_diag)
+                        continue;
+                    if (x + dx < 0 || x + dx >= nx || y + dy < 0 || y + dy >= ny || z + dz < 0 || z + dz >= nz)
+                        continue;
+                    int j = i + dx + dy * nx + dz * nx * ny;
+                    emit(j, distance == 0 ? (T)(stencil - 1) : (T)-1);
+                }
+            }
+        }
+    };
+
+    return generateRows<T, I>(
+        n, n,
+        [&](int i) {
+            I count = 0;
+            visit(i, [&](int, T) { count++; });
+            return count;
+        },
+        [&](int i, int *cols, T *vals) {
+            int k = 0;
+            visit(i, [&](int j, T v) {
+                cols[k] = j;
+                vals[k] = v;
+                k++;
+            });
+        });
+}
+
+template <class T, class I>
+std::shared_ptr<CSRMatrix<T, I>> anisotropicDiffusion2D(int nx, int ny, double epsilon, double theta)
+{
+    int n = nx * ny;
+    // Conductivity tensor R diag(1, epsilon) R^T
+    double c = cos(theta), s = sin(theta);
+    double a_xx = c * c + epsilon * s * s;
+    double a_yy = s * s + epsilon * c * c;
+    double a_xy = (1.0 - epsilon) * c * s;
+    bool mixed = fabs(a_xy) > 1e-14 * (a_xx + a_yy);
+
+    // 9-point stencil, unscaled by h^2; the corner terms only appear with a mixed derivative
+    auto weight = [=](int dx, int dy) -> double {
+        if (dx == 0 && dy == 0)
+            return 2.0 * (a_xx + a_yy);
+        if (dy == 0)
+            return -a_xx;
+        if (dx == 0)
+            return -a_yy;
+        return dx == dy ? -0.5 * a_xy : 0.5 * a_xy;
+    };
+
+    auto visit = [=](int i, auto &&emit) {
+        int x = i % nx;
+        int y = i / nx;
+        for (int dy = -1; dy <= 1; dy++)
+        {
+            for (int dx = -1; dx <= 1; dx++)
+            {
+                if (dx != 0 && dy != 0 && !mixed)
+                    continue;
+                if (x + dx < 0 || x + dx >= nx || y + dy < 0 || y + dy >= ny)
+                    continue;
+                emit(i + dx + dy * nx, (T)weight(dx, dy));
+            }
+        }
+    };
+
+    return generateRows<T, I>(
+        n, n,
+        [&](int i) {
+            I count = 0;
+            visit(i, [&](int, T) { count++; });
+            return count;
+        },
+        [&](int i, int *cols, T *vals) {
+            int k = 0;
+            visit(i, [&](int j, T v) {
+                cols[k] = j;
+                vals[k] = v;
+                k++;
+            });
+        });
+}
+
+template <class T, class I>
+std::shared_ptr<CSRMatrix<T, I>> convectionDiffusion2D(int nx, int ny, double peclet)
+{
+    int n = nx * ny;
+    auto visit = [=](int i, auto &&emit) {
+        int x = i % nx;
+        int y = i / nx;
+        if (y > 0)
+            emit(i - nx, (T)-1);
+        if (x > 0)
+            emit(i - 1, (T)(-1 - 0.5 * peclet));
+        emit(i, (T)4);
+        if (x < nx - 1)
+            emit(i + 1, (T)(-1 + 0.5 * peclet));
+        if (y < ny - 1)
+            emit(i + nx, (T)-1);
+    };
+
+    return generateRows<T, I>(
+        n, n,
+        [&](int i) {
+            I count = 0;
+            visit(i, [&](int, T) { count++; });
+            return count;
+        },
+        [&](int i, int *cols, T *vals) {
+            int k = 0;
+            visit(i, [&](int j, T v) {
+                cols[k] = j;
+                vals[k] = v;
+                k++;
+            });
+        });
+}
+
+template <class T, class I>
+std::shared_ptr<CSRMatrix<T, I>> bandedSPD(int size, int bandwidth, uint64_t seed)
+{
+    // Entry (i, j) is keyed on (min, max) so the matrix is exactly symmetric.
+    // Off-diagonals are in [-1, 0), so a diagonal of 2 * bandwidth + 1 makes it dominant.
+    auto offdiag = [=](int i, int j) {
+        return (T)(-uniformHash(seed, std::min(i, j), std::max(i, j)) - 1e-3);
+    };
+
+    return generateRows<T, I>(
+        size, size,
+        [=](int i) { return (I)(std::min(size - 1, i + bandwidth) - std::max(0, i - bandwidth) + 1); },
+        [=](int i, int *cols, T *vals) {
+            int k = 0;
+            for (int j = std::max(0, i - bandwidth); j <= std::min(size - 1, i + bandwidth); j++)
+            {
+                cols[k] = j;
+                vals[k] = (i == j) ? (T)(2 * bandwidth + 1) : offdiag(i, j);
+                k++;
+            }
+        });
+}
+
+template <class T, class I>
+std::shared_ptr<CSRMatrix<T, I>> randomSPD(int size, int avg_row_length, RowLengthDistribution distribution, uint64_t seed)
+{
+    // Draw the lower-triangle off-diagonals of each row, then mirror them.
+    // Rows are handed to the builder in blocks, which sorts and merges repeated columns.
+    CSRBuilder<T, I> builder(size, size);
+    int block = 4096;
+    int nblocks = (size + block - 1) / block;
+
+#pragma omp parallel for schedule(dynamic, 1)
+    for (int blk = 0; blk < nblocks; blk++)
+    {
+        std::vector<int> rows, cols;
+        std::vector<T> vals;
+        for (int i = blk * block; i < std::min(size, (blk + 1) * block); i++)
+        {
+            double u = uniformHash(seed, i, (uint64_t)-1);
+            int length = avg_row_length;
+            if (distribution == RowLengthDistribution::Uniform)
+            {
+                length = (int)(u * (2 * avg_row_length + 1));
+            }
+            else if (distribution == RowLengthDistribution::PowerLaw)
+            {
+                // Pareto with exponent 2 and mean avg_row_length
+                length = (int)(0.5 * avg_row_length / sqrt(1.0 - u));
+            }
+            length = std::min(length, i);
+
+            for (int k = 0; k < length; k++)
+            {
+                int j = (int)(uniformHash(seed, i, 2 * k) * i);
+                T v = (T)(-uniformHash(seed, i, 2 * k + 1) - 1e-3);
+                rows.push_back(i);
+                cols.push_back(j);
+                vals.push_back(v);
+                rows.push_back(j);
+                cols.push_back(i);
+                vals.push_back(v);
+            }
+        }
+        builder.addBatch(rows, cols, vals);
+    }
+    std::shared_ptr<CSRMatrix<T, I>> offdiag = builder.build();
+
+    // Insert the diagonal: one more than the absolute row sum gives strict dominance
+    return generateRows<T, I>(
+        size, size,
+        [&](int i) { return offdiag->row_position[i + 1] - offdiag->row_position[i] + 1; },
+        [&](int i, int *cols, T *vals) {
+            T row_sum = 1;
+            for (I cii = offdiag->row_position[i]; cii < offdiag->row_position[i + 1]; cii++)
+            {
+                row_sum += fabs(offdiag->values[cii]);
+            }
+            int k = 0;
+            bool placed = false;
+            for (I cii = offdiag->row_position[i]; cii < offdiag->row_position[i + 1]; cii++)
+            {
+                if (!placed && offdiag->col_index[cii] > i)
+                {
+                    cols[k] = i;
+                    vals[k] = row_sum;
+                    k++;
+                    placed = true;
+                }
+                cols[k] = offdiag->col_index[cii];
+                vals[k] = offdiag->values[cii];
+                k++;
+            }
+            if (!placed)
+            {
+                cols[k] = i;
+                vals[k] = row_sum;
+            }
+        });
+}
@@ -0,0 +1,43 @@
+#pragma once
+#include "CSRMatrix.h"
+#include <memory>
+#include <cstdint>
+
+// Structured and random test problems, emitted directly in CSR form in O(nnz).
+// Rows are generated in parallel; random values come from a counter-based
+// generator keyed on (seed, row, col), so results do not depend on the thread count.
+
+// 5-point Laplacian on an nx x ny grid with Dirichlet boundaries
+template <class T, class I = int>
+std::shared_ptr<CSRMatrix<T, I>> poisson2D(int nx, int ny);
+
+// 7-point or 27-point Laplacian on an nx x ny x nz grid
+template <class T, class I = int>
+std::shared_ptr<CSRMatrix<T, I>> poisson3D(int nx, int ny, int nz, int stencil = 7);
+
+// Diffusion with conductivity 1 along the angle theta and epsilon across it.
+// theta = 0 gives a 5-point stencil, otherwise the mixed derivative makes it 9-point.
+template <class T, class I = int>
+std::shared_ptr<CSRMatrix<T, I>> anisotropicDiffusion2D(int nx, int ny, double epsilon, double theta = 0.0);
+
+// Diffusion plus convection along x with central differences, at cell Peclet
+// number peclet: nonsymmetric, and not diagonally dominant for peclet > 2
+template <class T, class I = int>
+std::shared_ptr<CSRMatrix<T, I>> convectionDiffusion2D(int nx, int ny, double peclet);
+
+// Symmetric, diagonally dominant band matrix with random off-diagonal values
+template <class T, class I = int>
+std::shared_ptr<CSRMatrix<T, I>> bandedSPD(int size, int bandwidth, uint64_t seed = 0);
+
+enum class RowLengthDistribution
+{
+    Constant, // every row has avg_row_length off-diagonals in the lower triangle
+    Uniform,  // uniform in [0, 2 * avg_row_length]
+    PowerLaw  // Pareto tail with exponent 2, a few very long rows
+};
+
+// Random symmetric, diagonally dominant (so SPD) matrix. avg_row_length is the
+// mean number of lower-triangle off-diagonals drawn per row before symmetrising.
+template <class T, class I = int>
+std::shared_ptr<CSRMatrix<T, I>> randomSPD(int size, int avg_row_length, RowLengthDistribution distribution = RowLengthDistribution::Constant,
+                                           uint64_t seed = 0);
@@ -0,0 +1,341 @@
+#include "GeometricMultigrid.h"
+#include "Generators.h"
+#include "SparseSolver.h"
+#include <iostream>
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
+
+namespace
+{
+// Whether A holds exactly the entries of stencil, row by row in the same order
+template <class T, class I>
+bool matchesStencil(CSRMatrix<T, I> &A, CSRMatrix<T, I> &stencil)
+{
+    if (A.rows != stencil.rows || A.nnzs != stencil.nnzs)
+    {
+        return false;
+    }
+    return std::equal(&A.row_position[0], &A.row_position[0] + A.rows + 1, &stencil.row_position[0]) &&
+           std::equal(&A.col_index[0], &A.col_index[0] + A.nnzs, &stencil.col_index[0]) &&
+           std::equal(&A.values[0], &A.values[0] + A.nnzs, &stencil.values[0]);
+}
+
+// Sum of v over the grid neighbours of point i = (x, y, z): the off-diagonal
+// part of the stencil, whose entries are all -1
+template <class T>
+inline T neighbourSum(const T *v, int i, int x, int y, int z, int nx, int ny, int nz)
+{
+    T sum = 0;
+    if (x > 0)
+        sum += v[i - 1];
+    if (x < nx - 1)
+        sum += v[i + 1];
+    if (y > 0)
+        sum += v[i - nx];
+    if (y < ny - 1)
+        sum += v[i + nx];
+    if (z > 0)
+        sum += v[i - nx * ny];
+    if (z < nz - 1)
+        sum += v[i + nx * ny];
+    return sum;
+}
+
+// Coarse points that fine point f interpolates from, with their weights: the
+// coincident one, or the two either side, dropping those on the boundary
+inline int interpolationStencil(int f, int n_coarse, int *coarse, double *weight)
+{
+    if (f % 2 == 1)
+    {
+        coarse[0] = (f - 1) / 2;
+        weight[0] = 1;
+        return 1;
+    }
+    int count = 0;
+    for (int c : {f / 2 - 1, f / 2})
+    {
+        if (c >= 0 && c < n_coarse)
+        {
+            coarse[count] = c;
+            weight[count++] = 0.5;
+        }
+    }
+    return count;
+}
+} // namespace
+
+template <class T, class I>
+GeometricMultigrid<T, I>::GeometricMultigrid(int nx, int ny, int nz) : nx(nx), ny(ny), nz(nz)
+{
+    if (nx < 1 || ny < 1 || nz < 1)
+    {
+        throw std::invalid_argument("GMG needs a grid of at least one point");
+    }
+}
+
+template <class T, class I>
+void GeometricMultigrid<T, I>::setup(CSRMatrix<T, I> &A)
+{
+    if (A.rows != nx * ny * nz || A.cols != A.rows)
+    {
+        throw std::invalid_argument("GMG grid does not match the size of A");
+    }
+    bool three_d = nz > 1;
+
+    // The smoother, residual and coarse levels use the unscaled stencil in the
+    // grid's natural order, so any other matrix would get an unrelated operator
+    std::shared_ptr<CSRMatrix<T, I>> stencil = three_d ? poisson3D<T, I>(nx, ny, nz, 7) : poisson2D<T, I>(nx, ny);
+    if (!matchesStencil(A, *stencil))
+    {
+        throw std::invalid_argument("GMG needs A to be the poisson2D / poisson3D stencil of its grid, in natural order");
+    }
+    auto coarsenable = [&](int n) { return n >= 3 && n % 2 == 1; };
+
+    levels.clear();
+    levels.push_back({nx, ny, nz, nullptr});
+    while (levels.back().nx * levels.back().ny * levels.back().nz > coarse_size && coarsenable(levels.back().nx) &&
+           coarsenable(levels.back().ny) && (!three_d || coarsenable(levels.back().nz)))
+    {
+        GMGLevel<T, I> &fine = levels.back();
+        levels.push_back({(fine.nx - 1) / 2, (fine.ny - 1) / 2, three_d ? (fine.nz - 1) / 2 : 1, nullptr});
+    }
+
+    // CSR levels: A itself, then the stencil rediscretised on the coarse grids.
+    // The coarsest level always has one, for the factorisation.
+    for (int l = 0; l < (int)levels.size(); l++)
+    {
+        GMGLevel<T, I> &level = levels[l];
+        if (matrix_free && l != (int)levels.size() - 1)
+        {
+            continue;
+        }
+        if (l == 0)
+        {
+            level.A = std::make_shared<CSRMatrix<T, I>>(A.rows, A.cols, A.nnzs, A.values, A.row_position, A.col_index);
+        }
+        else
+        {
+            level.A = three_d ? poisson3D<T, I>(level.nx, level.ny, level.nz, 7) : poisson2D<T, I>(level.nx, level.ny);
+        }
+    }
+
+    for (GMGLevel<T, I> &level : levels)
+    {
+        int n = level.nx * level.ny * level.nz;
+        level.x.assign(n, 0);
+        level.b.assign(n, 0);
+        level.r.assign(n, 0);
+    }
+
+    // Direct solve on the coarsest level
+    GMGLevel<T, I> &coarsest = levels.back();
+    coarse_solver = std::make_shared<SparseSolver<T, I>>(*coarsest.A, coarsest.b);
+    coarse_factor = coarse_solver->cholesky_decomp();
+
+    std::cout << "GMG: " << levels.size() << " levels, grids";
+    for (GMGLevel<T, I> &level : levels)
+    {
+        std::cout << " " << level.nx << "x" << level.ny;
+        if (three_d)
+        {
+            std::cout << "x" << level.nz;
+        }
+    }
+    std::cout << (matrix_free ? ", matrix-free" : ", CSR") << std::endl;
+}
+
+template <class T, class I>
+void GeometricMultigrid<T, I>::smooth(int l, int sweeps, int first_colour)
+{
+    GMGLevel<T, I> &level = levels[l];
+    const int lx = level.nx, ly = level.ny, lz = level.nz;
+    T *x = level.x.data();
+    const T *b = level.b.data();
+    const T diagonal = lz > 1 ? 6 : 4;
+    CSRMatrix<T, I> *A = level.A.get();
+    I *diag = A ? A->diagonalPositions() : nullptr;
+
+    // points of one colour only depend on points of the other
+    for (int sweep = 0; sweep < sweeps; sweep++)
+    {
+        for (int colour : {first_colour, 1 - first_colour})
+        {
+#pragma omp parallel for collapse(2) schedule(static)
+            for (int z = 0; z < lz; z++)
+            {
+                for (int y = 0; y < ly; y++)
+                {
+                    for (int px = (colour + y + z) % 2; px < lx; px += 2)
+                    {
+                        int i = px + lx * (y + ly * z);
+                        if (!A)
+                        {
+                            x[i] = (b[i] + neighbourSum(x, i, px, y, z, lx, ly, lz)) / diagonal;
+                            continue;
+                        }
+                        T sum = b[i];
+                        for (I k = A->row_position[i]; k < A->row_position[i + 1]; k++)
+                        {
+                            if (k != diag[i])
+                            {
+                                sum -= A->values[k] * x[A->col_index[k]];
+                            }
+                        }
+                        x[i] = sum / A->values[diag[i]];
+                    }
+                }
+            }
+        }
+    }
+}
+
+template <class T, class I>
+void GeometricMultigrid<T, I>::residual(int l)
+{
+    GMGLevel<T, I> &level = levels[l];
+    int n = level.nx * level.ny * level.nz;
+    if (level.A)
+    {
+        level.A->matVecMult(level.x, level.r);
+#pragma omp parallel for schedule(static)
+        for (int i = 0; i < n; i++)
+        {
+            level.r[i] = level.b[i] - level.r[i];
+        }
+        return;
+    }
+    const int lx = level.nx, ly = level.ny, lz = level.nz;
+    const T *x = level.x.data();
+    const T diagonal = lz > 1 ? 6 : 4;
+#pragma omp parallel for collapse(2) schedule(static)
+    for (int z = 0; z < lz; z++)
+    {
+        for (int y = 0; y < ly; y++)
+        {
+            for (int px = 0; px < lx; px++)
+            {
+                int i = px + lx * (y + ly * z);
+                level.r[i] = level.b[i] - (diagonal * x[i] - neighbourSum(x, i, px, y, z, lx, ly, lz));
+            }
+        }
+    }
+}
+
+// b on level l + 1 = 4 R r, with R full weighting: weights 1/2 at the
+// coincident point and 1/4 at its neighbours, in every direction
+template <class T, class I>
+void GeometricMultigrid<T, I>::restrictResidual(int l)
+{
+    GMGLevel<T, I> &fine = levels[l];
+    GMGLevel<T, I> &coarse = levels[l + 1];
+    const int dz_max = fine.nz > 1 ? 1 : 0;
+    const double weight[3] = {0.25, 0.5, 0.25};
+#pragma omp parallel for collapse(2) schedule(static)
+    for (int Z = 0; Z < coarse.nz; Z++)
+    {
+        for (int Y = 0; Y < coarse.ny; Y++)
+        {
+            for (int X = 0; X < coarse.nx; X++)
+            {
+                int fz = dz_max ? 2 * Z + 1 : 0;
+                double sum = 0;
+                for (int dz = -dz_max; dz <= dz_max; dz++)
+                {
+                    double wz = dz_max ? weight[dz + 1] : 1;
+                    for (int dy = -1; dy <= 1; dy++)
+                    {
+                        for (int dx = -1; dx <= 1; dx++)
+                        {
+                            int i = (2 * X + 1 + dx) + fine.nx * ((2 * Y + 1 + dy) + fine.ny * (fz + dz));
+                            sum += wz * weight[dy + 1] * weight[dx + 1] * fine.r[i];
+                        }
+                    }
+                }
+                coarse.b[X + coarse.nx * (Y + coarse.ny * Z)] = 4 * sum;
+            }
+        }
+    }
+}
+
+// x on level l += P x on level l + 1, by linear interpolation in every direction
+template <class T, class I>
+void GeometricMultigrid<T, I>::prolongateCorrection(int l)
+{
+    GMGLevel<T, I> &fine = levels[l];
+    GMGLevel<T, I> &coarse = levels[l + 1];
+    bool three_d = fine.nz > 1;
+#pragma omp parallel for collapse(2) schedule(static)
+    for (int z = 0; z < fine.nz; z++)
+    {
+        for (int y = 0; y < fine.ny; y++)
+        {
+            int cz[2] = {0}, cy[2], cx[2];
+            double wz[2] = {1}, wy[2], wx[2];
+            int nz_c = three_d ? interpolationStencil(z, coarse.nz, cz, wz) : 1;
+            int ny_c = interpolationStencil(y, coarse.ny, cy, wy);
+            for (int x = 0; x < fine.nx; x++)
+            {
+                int nx_c = interpolationStencil(x, coarse.nx, cx, wx);
+                double sum = 0;
+                for (int a = 0; a < nz_c; a++)
+                {
+                    for (int c = 0; c < ny_c; c++)
+                    {
+                        for (int d = 0; d < nx_c; d++)
+                        {
+                            sum += wz[a] * wy[c] * wx[d] * coarse.x[cx[d] + coarse.nx * (cy[c] + coarse.ny * cz[a])];
+                        }
+                    }
+                }
+                fine.x[x + fine.nx * (y + fine.ny * z)] += sum;
+            }
+        }
+    }
+}
+
+// One cycle on level l from the current levels[l].x
+template <class T, class I>
+void GeometricMultigrid<T, I>::cycle(int l, MultigridCycle type)
+{
+    GMGLevel<T, I> &level = levels[l];
+    if (l == (int)levels.size() - 1)
+    {
+        coarse_solver->b = level.b;
+        coarse_solver->cholesky_solve(*coarse_factor, level.x);
+        return;
+    }
+
+    smooth(l, pre_sweeps, 0);
+    residual(l);
+    restrictResidual(l);
+
+    GMGLevel<T, I> &coarse = levels[l + 1];
+    std::fill(coarse.x.begin(), coarse.x.end(), 0);
+    switch (type)
+    {
+    case MultigridCycle::V:
+        cycle(l + 1, MultigridCycle::V);
+        break;
+    case MultigridCycle::W:
+        cycle(l + 1, MultigridCycle::W);
+        cycle(l + 1, MultigridCycle::W);
+        break;
+    case MultigridCycle::F:
+        cycle(l + 1, MultigridCycle::F);
+        cycle(l + 1, MultigridCycle::V);
+        break;
+    }
+    prolongateCorrection(l);
+
+    smooth(l, post_sweeps, red_first_post_smoothing ? 0 : 1);
+}
+
+template <class T, class I>
+void GeometricMultigrid<T, I>::apply(const std::vector<T> &r, std::vector<T> &z)
+{
+    std::copy(r.begin(), r.end(), levels[0].b.begin());
+    std::fill(levels[0].x.begin(), levels[0].x.end(), 0);
+    cycle(0, cycle_type);
+    std::copy(levels[0].x.begin(), levels[0].x.end(), z.begin());
+}
@@ -0,0 +1,73 @@
+#pragma once
+#include "CSRMatrix.h"
+#include "Preconditioner.h"
+#include "SparseSolver.h"
+#include <vector>
+#include <memory>
+
+enum class MultigridCycle
+{
+    V, // one coarse-grid correction per level
+    W, // two
+    F  // an F-cycle then a V-cycle on the coarser level
+};
+
+// One level of the grid hierarchy, nx x ny x nz points with x fastest, and the
+// cycle's work vectors allocated once in setup
+template <class T, class I = int>
+struct GMGLevel
+{
+    int nx, ny, nz;
+    std::shared_ptr<CSRMatrix<T, I>> A; // null on matrix-free levels
+    std::vector<T> x{}, b{}, r{};
+};
+
+// Geometric multigrid for the Poisson problems of poisson2D (nz = 1, 5-point
+// stencil) and poisson3D (7-point stencil) on an nx x ny x nz grid. Grids are
+// coarsened by two in every direction, n -> (n - 1) / 2, while all sides are
+// odd and longer than 2, so 2^k m - 1 points per side give k coarser levels.
+//  - red-black Gauss-Seidel smoothing, parallel within each colour. The sweeps
+//    before the coarse correction are red first and those after it black
+//    first, their adjoint, so with pre_sweeps == post_sweeps the V- and W-cycles
+//    are symmetric operators and can precondition CG. red_first_post_smoothing
+//    runs both red first, which converges about twice as fast as a standalone
+//    iteration with SparseSolver::stationaryIterative but is not symmetric.
+//  - full weighting restriction and linear interpolation
+//  - the coarse operators are the same stencil on the coarse grid, so the
+//    restricted residual is scaled by 4 (the matrices are not scaled by h^2)
+// The levels apply the stencil directly (matrix_free), or are CSR matrices:
+// A itself on the finest level and poisson2D / poisson3D below it. The coarsest
+// level, at most coarse_size rows or no longer coarsenable, is factored with
+// sparse Cholesky. apply(r, z) is one cycle from z = 0: a preconditioner for
+// conjugate gradients, or a solver with SparseSolver::stationaryIterative.
+template <class T, class I = int>
+class GeometricMultigrid : public Preconditioner<T, I>
+{
+public:
+    GeometricMultigrid(int nx, int ny, int nz = 1);
+
+    // throws std::invalid_argument if A is not the poisson2D / poisson3D(..., 7)
+    // matrix of the grid, with the same values and in the natural order
+    void setup(CSRMatrix<T, I> &A) override;
+    void apply(const std::vector<T> &r, std::vector<T> &z) override;
+
+    MultigridCycle cycle_type = MultigridCycle::V;
+    bool matrix_free = true;
+    int pre_sweeps = 1;
+    int post_sweeps = 1;
+    bool red_first_post_smoothing = false;
+    int coarse_size = 100;
+
+    std::vector<GMGLevel<T, I>> levels{};
+
+private:
+    void cycle(int level, MultigridCycle type);
+    void smooth(int level, int sweeps, int first_colour);
+    void residual(int level);
+    void restrictResidual(int level);
+    void prolongateCorrection(int level);
+
+    int nx, ny, nz;
+    std::shared_ptr<SparseSolver<T, I>> coarse_solver;
+    std::shared_ptr<CSRMatrix<T, I>> coarse_factor;
+};
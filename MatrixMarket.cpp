@@ -0,0 +1,255 @@
+#include <iostream>
+#include "MatrixMarket.h"
+#include "CSRBuilder.h"
+#include "utilities.h"
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace
+{
+// Skips blanks (not newlines) and returns the new position
+inline const char *skipBlanks(const char *p, const char *end)
+{
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\r'))
+    {
+        p++;
+    }
+    return p;
+}
+
+inline const char *nextLine(const char *p, const char *end)
+{
+    const char *nl = (const char *)memchr(p, '\n', end - p);
+    return nl == nullptr ? end : nl + 1;
+}
+
+inline std::string lowercase(std::string word)
+{
+    std::transform(word.begin(), word.end(), word.begin(), ::tolower);
+    return word;
+}
+} // namespace
+
+template <class T, class I>
+std::shared_ptr<CSRMatrix<T, I>> readMatrixMarket(const std::string &filename, bool print)
+{
+    auto t1 = std::chrono::high_resolution_clock::now();
+
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        throw std::runtime_error("Unable to open file " + filename);
+    }
+    struct stat file_stat;
+    fstat(fd, &file_stat);
+    size_t file_size = file_stat.st_size;
+    if (file_size == 0)
+    {
+        close(fd);
+        throw std::runtime_error("Empty Matrix Market file " + filename);
+    }
+    const char *data = (const char *)mmap(nullptr, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+    {
+        throw std::runtime_error("Unable to map file " + filename);
+    }
+    // The file is read front to back once
+    madvise((void *)data, file_size, MADV_SEQUENTIAL);
+    const char *end = data + file_size;
+
+    // Banner: %%MatrixMarket matrix coordinate <field> <symmetry>
+    const char *line_end = nextLine(data, end);
+    std::string banner(data, line_end);
+    char object[64] = "", format[64] = "", field[64] = "", symmetry[64] = "";
+    if (sscanf(banner.c_str(), "%%%%MatrixMarket %63s %63s %63s %63s", object, format, field, symmetry) != 4 ||
+        lowercase(object) != "matrix" || lowercase(format) != "coordinate")
+    {
+        munmap((void *)data, file_size);
+        throw std::invalid_argument("Only Matrix Market coordinate matrices are supported");
+    }
+    std::string field_s = lowercase(field);
+    std::string symmetry_s = lowercase(symmetry);
+    bool pattern = field_s == "pattern";
+    bool symmetric = symmetry_s == "symmetric";
+    if ((field_s != "real" && field_s != "integer" && !pattern) || (symmetry_s != "general" && !symmetric))
+    {
+        munmap((void *)data, file_size);
+        throw std::invalid_argument("Unsupported Matrix Market type: " + field_s + " " + symmetry_s);
+    }
+
+    // Skip comments, then read the size line
+    const char *p = line_end;
+    while (p < end && (*p == '%' || *p == '\n'))
+    {
+        p = nextLine(p, end);
+    }
+    line_end = nextLine(p, end);
+    int rows = 0, cols = 0;
+    long long entries = 0;
+    if (sscanf(std::string(p, line_end).c_str(), "%d %d %lld", &rows, &cols, &entries) != 3)
+    {
+        munmap((void *)data, file_size);
+        throw std::invalid_argument("Invalid Matrix Market size line");
+    }
+    p = line_end;
+
+    // Split the body into one chunk per thread, with each boundary moved to the next line start
+    int nchunks = std::max(1, std::min(numThreads() * 4, (int)((end - p) / (1 << 16)) + 1));
+    std::vector<const char *> bounds(nchunks + 1);
+    bounds[0] = p;
+    bounds[nchunks] = end;
+    for (int c = 1; c < nchunks; c++)
+    {
+        const char *guess = p + (end - p) * c / nchunks;
+        bounds[c] = std::max(bounds[c - 1], guess == p ? p : nextLine(guess - 1, end));
+    }
+
+    CSRBuilder<T, I> builder(rows, cols);
+    std::vector<long long> chunk_entries(nchunks, 0);
+    std::vector<char> chunk_error(nchunks, 0);
+
+#pragma omp parallel for schedule(dynamic, 1)
+    for (int c = 0; c < nchunks; c++)
+    {
+        std::vector<int> row_ind, col_ind;
+        std::vector<T> vals;
+        const char *q = bounds[c];
+        const char *chunk_end = bounds[c + 1];
+        while (q < chunk_end)
+        {
+            const char *l_end = nextLine(q, chunk_end);
+            q = skipBlanks(q, l_end);
+            if (q >= l_end || *q == '\n' || *q == '%')
+            {
+                q = l_end;
+                continue;
+            }
+            int i = 0, j = 0;
+            double v = 1.0;
+            auto r1 = std::from_chars(q, l_end, i);
+            auto r2 = std::from_chars(skipBlanks(r1.ptr, l_end), l_end, j);
+            bool ok = r1.ec == std::errc() && r2.ec == std::errc();
+            if (!pattern && ok)
+            {
+                auto r3 = std::from_chars(skipBlanks(r2.ptr, l_end), l_end, v);
+                ok = r3.ec == std::errc();
+            }
+            if (!ok || i < 1 || i > rows || j < 1 || j > cols)
+            {
+                chunk_error[c] = 1;
+                break;
+            }
+            // Matrix Market is 1-based
+            row_ind.push_back(i - 1);
+            col_ind.push_back(j - 1);
+            vals.push_back((T)v);
+            if (symmetric && i != j)
+            {
+                row_ind.push_back(j - 1);
+                col_ind.push_back(i - 1);
+                vals.push_back((T)v);
+            }
+            chunk_entries[c]++;
+            q = l_end;
+        }
+        builder.addBatch(row_ind, col_ind, vals);
+    }
+    munmap((void *)data, file_size);
+
+    long long parsed = 0;
+    bool parse_error = false;
+    for (int c = 0; c < nchunks; c++)
+    {
+        parsed += chunk_entries[c];
+        parse_error = parse_error || chunk_error[c];
+    }
+    if (parse_error || parsed != entries)
+    {
+        throw std::invalid_argument("Invalid Matrix Market entries in " + filename);
+    }
+
+    std::shared_ptr<CSRMatrix<T, I>> result = builder.build();
+
+    auto t2 = std::chrono::high_resolution_clock::now();
+    if (print)
+    {
+        double duration = std::chrono::duration<double>(t2 - t1).count();
+        std::cout << "Read " << filename << ": " << rows << "x" << cols << ", nnzs = " << result->nnzs
+                  << ", time = " << duration << " s, throughput = " << (double)file_size / 1e6 / duration << " MB/s" << std::endl;
+    }
+    return result;
+}
+
+template <class T, class I>
+void writeMatrixMarket(const std::string &filename, CSRMatrix<T, I> &A, bool symmetric)
+{
+    FILE *file = fopen(filename.c_str(), "w");
+    if (file == nullptr)
+    {
+        throw std::runtime_error("Unable to open file " + filename);
+    }
+
+    // Count entries first, the size line comes before them
+    long long entries = 0;
+    for (int i = 0; i < A.rows; i++)
+    {
+        for (I cii = A.row_position[i]; cii < A.row_position[i + 1]; cii++)
+        {
+            if (!symmetric || A.col_index[cii] <= i)
+            {
+                entries++;
+            }
+        }
+    }
+
+    fprintf(file, "%%%%MatrixMarket matrix coordinate real %s\n", symmetric ? "symmetric" : "general");
+    fprintf(file, "%d %d %lld\n", A.rows, A.cols, entries);
+
+    // Format rows in parallel blocks, then write the blocks in order
+    int nblocks = std::max(1, std::min(numThreads() * 4, A.rows));
+    std::vector<std::string> text(nblocks);
+#pragma omp parallel for schedule(dynamic, 1)
+    for (int blk = 0; blk < nblocks; blk++)
+    {
+        int r_begin = (int)((long long)A.rows * blk / nblocks);
+        int r_end = (int)((long long)A.rows * (blk + 1) / nblocks);
+        char buffer[96];
+        // leave room for the separators after each number
+        char *buffer_end = buffer + sizeof(buffer) - 4;
+        for (int i = r_begin; i < r_end; i++)
+        {
+            for (I cii = A.row_position[i]; cii < A.row_position[i + 1]; cii++)
+            {
+                int j = A.col_index[cii];
+                if (symmetric && j > i)
+                {
+                    continue;
+                }
+                // to_chars writes the shortest representation that round-trips exactly
+                char *q = std::to_chars(buffer, buffer_end, i + 1).ptr;
+                *q++ = ' ';
+                q = std::to_chars(q, buffer_end, j + 1).ptr;
+                *q++ = ' ';
+                q = std::to_chars(q, buffer_end, (double)A.values[cii]).ptr;
+                *q++ = '\n';
+                text[blk].append(buffer, q - buffer);
+            }
+        }
+    }
+    for (int blk = 0; blk < nblocks; blk++)
+    {
+        fwrite(text[blk].data(), 1, text[blk].size(), file);
+    }
+    fclose(file);
+}
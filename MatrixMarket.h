@@ -0,0 +1,15 @@
+#pragma once
+#include "CSRMatrix.h"
+#include <memory>
+#include <string>
+
+// Matrix Market (.mtx) coordinate format I/O.
+// Supports real, integer and pattern fields with general or symmetric symmetry.
+// The reader memory-maps the file and parses it in parallel, one chunk per thread.
+template <class T, class I = int>
+std::shared_ptr<CSRMatrix<T, I>> readMatrixMarket(const std::string &filename, bool print = false);
+
+// Writes A as a general, real coordinate matrix. If symmetric is true, only the
+// lower triangle is written and the header says symmetric.
+template <class T, class I>
+void writeMatrixMarket(const std::string &filename, CSRMatrix<T, I> &A, bool symmetric = false);
@@ -0,0 +1,371 @@
+#include "Preconditioner.h"
+#include "TriangularSolve.h"
+#include <math.h>
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
+
+namespace
+{
+// A itself, or when its rows are unsorted a sorted copy held by copy: the
+// triangular parts are read as the entries before and after the diagonal
+template <class T, class I>
+CSRMatrix<T, I> &withSortedRows(CSRMatrix<T, I> &A, std::shared_ptr<CSRMatrix<T, I>> &copy)
+{
+    if (A.rowsSorted())
+    {
+        return A;
+    }
+    copy = std::make_shared<CSRMatrix<T, I>>(A);
+    copy->sortRows();
+    return *copy;
+}
+} // namespace
+
+template <class T, class I>
+void JacobiPreconditioner<T, I>::setup(CSRMatrix<T, I> &A)
+{
+    T *inv_diag = A.inverseDiagonal();
+    inv_diagonal.assign(inv_diag, inv_diag + A.rows);
+}
+
+template <class T, class I>
+void JacobiPreconditioner<T, I>::apply(const std::vector<T> &r, std::vector<T> &z)
+{
+    int n = inv_diagonal.size();
+#pragma omp parallel for schedule(static)
+    for (int i = 0; i < n; i++)
+    {
+        z[i] = inv_diagonal[i] * r[i];
+    }
+}
+
+template <class T, class I>
+SSORPreconditioner<T, I>::SSORPreconditioner(double omega) : omega(omega)
+{
+    if (omega <= 0 || omega >= 2)
+    {
+        throw std::invalid_argument("SSOR needs 0 < omega < 2");
+    }
+}
+
+template <class T, class I>
+void SSORPreconditioner<T, I>::setup(CSRMatrix<T, I> &A_in)
+{
+    std::shared_ptr<CSRMatrix<T, I>> sorted_copy;
+    CSRMatrix<T, I> &A = withSortedRows(A_in, sorted_copy);
+    int n = A.rows;
+    I *diag = A.diagonalPositions();
+    matrix = std::make_shared<CSRMatrix<T, I>>(A.rows, A.cols, A.nnzs, A.values, A.row_position, A.col_index);
+    if (!analysis || analysis->pattern != A.col_index)
+    {
+        analysis = analyseTriangular(*matrix, false);
+    }
+
+    scaled_inv_diagonal.resize(n);
+    middle_scale.resize(n);
+    for (int i = 0; i < n; i++)
+    {
+        if (diag[i] == -1 || A.values[diag[i]] == 0)
+        {
+            throw std::invalid_argument("SSOR needs a non-zero diagonal");
+        }
+        T d = A.values[diag[i]];
+        scaled_inv_diagonal[i] = omega / d;
+        middle_scale[i] = (2 - omega) / omega * d / omega;
+    }
+}
+
+template <class T, class I>
+void SSORPreconditioner<T, I>::apply(const std::vector<T> &r, std::vector<T> &z)
+{
+    // (D / w + L) y = r, then (D / w + U) z = (2 - w) / w D / w y
+    int n = matrix->rows;
+    std::copy(r.begin(), r.end(), z.begin());
+    lowerSolve<T, I>(*matrix, *analysis, scaled_inv_diagonal.data(), z);
+#pragma omp parallel for schedule(static)
+    for (int i = 0; i < n; i++)
+    {
+        z[i] *= middle_scale[i];
+    }
+    upperSolve<T, I>(*matrix, *analysis, scaled_inv_diagonal.data(), z);
+}
+
+template <class T, class I>
+void MulticolourSORPreconditioner<T, I>::setup(CSRMatrix<T, I> &A)
+{
+    if (omega <= 0 || omega >= 2)
+    {
+        throw std::invalid_argument("SOR needs 0 < omega < 2");
+    }
+    int n = A.rows;
+    I *diag = A.diagonalPositions();
+    matrix = std::make_shared<CSRMatrix<T, I>>(A.rows, A.cols, A.nnzs, A.values, A.row_position, A.col_index);
+    if (pattern != A.col_index)
+    {
+        colouring = greedyColouring(*matrix);
+        pattern = A.col_index;
+    }
+
+    scaled_inv_diagonal.resize(n);
+    for (int i = 0; i < n; i++)
+    {
+        if (diag[i] == -1 || A.values[diag[i]] == 0)
+        {
+            throw std::invalid_argument("SOR needs a non-zero diagonal");
+        }
+        scaled_inv_diagonal[i] = omega / A.values[diag[i]];
+    }
+}
+
+template <class T, class I>
+void MulticolourSORPreconditioner<T, I>::sweep(int c, const std::vector<T> &r, std::vector<T> &z)
+{
+    const I *row_position = matrix->row_position.get();
+    const int *col_index = matrix->col_index.get();
+    const T *values = matrix->values.get();
+    const int *members = colouring.members.data();
+    int start = colouring.ptr[c];
+    int end = colouring.ptr[c + 1];
+#pragma omp parallel for schedule(static)
+    for (int m = start; m < end; m++)
+    {
+        int i = members[m];
+        T sum = r[i];
+        for (I k = row_position[i]; k < row_position[i + 1]; k++)
+        {
+            sum -= values[k] * z[col_index[k]];
+        }
+        z[i] += scaled_inv_diagonal[i] * sum;
+    }
+}
+
+template <class T, class I>
+void MulticolourSORPreconditioner<T, I>::apply(const std::vector<T> &r, std::vector<T> &z)
+{
+    int n_colours = colouring.n_colours;
+    std::fill(z.begin(), z.end(), 0);
+    if (n_colours == 0)
+    {
+        return;
+    }
+
+    // The first colour sees only zeros: z = w D^-1 r on it
+    const int *members = colouring.members.data();
+    int first_end = colouring.ptr[1];
+#pragma omp parallel for schedule(static)
+    for (int m = 0; m < first_end; m++)
+    {
+        int i = members[m];
+        z[i] = scaled_inv_diagonal[i] * r[i];
+    }
+    for (int c = 1; c < n_colours; c++)
+    {
+        sweep(c, r, z);
+    }
+
+    if (symmetric)
+    {
+        for (int c = omega == 1 ? n_colours - 2 : n_colours - 1; c >= 0; c--)
+        {
+            sweep(c, r, z);
+        }
+    }
+}
+
+template <class T, class I>
+void IC0Preconditioner<T, I>::setup(CSRMatrix<T, I> &A_in)
+{
+    std::shared_ptr<CSRMatrix<T, I>> sorted_copy;
+    CSRMatrix<T, I> &A = withSortedRows(A_in, sorted_copy);
+    int n = A.rows;
+    I *diag = A.diagonalPositions();
+
+    // Pattern of R: the lower triangle of A, with the diagonal last in every row
+    if (pattern != A.col_index)
+    {
+        std::shared_ptr<I[]> row_position(new I[n + 1]);
+        row_position[0] = 0;
+        for (int i = 0; i < n; i++)
+        {
+            if (diag[i] == -1)
+            {
+                throw std::invalid_argument("Incomplete Cholesky needs every diagonal entry");
+            }
+            row_position[i + 1] = row_position[i] + (diag[i] - A.row_position[i]) + 1;
+        }
+        I nnzs = row_position[n];
+        std::shared_ptr<int[]> col_index(new int[std::max<I>(nnzs, 1)]);
+        std::shared_ptr<T[]> values(new T[std::max<I>(nnzs, 1)]);
+        source.resize(nnzs);
+        for (int i = 0; i < n; i++)
+        {
+            I dest = row_position[i];
+            for (I k = A.row_position[i]; k <= diag[i]; k++, dest++)
+            {
+                col_index[dest] = A.col_index[k];
+                source[dest] = k;
+            }
+        }
+        R = std::make_shared<CSRMatrix<T, I>>(n, n, nnzs, values, row_position, col_index);
+        analysis = analyseTriangular(*R, true);
+        pattern = A.col_index;
+    }
+
+    I nnzs = R->nnzs;
+#pragma omp parallel for schedule(static)
+    for (I k = 0; k < nnzs; k++)
+    {
+        R->values[k] = A.values[source[k]];
+    }
+
+    // Row by row (up-looking): R(i, j) = (a_ij - R(i, :j) . R(j, :j)) / R(j, j).
+    // Rows only read the rows of their column indices, which are in earlier
+    // levels of the lower schedule.
+    bool failed = false;
+    I *row_position = R->row_position.get();
+    int *col_index = R->col_index.get();
+    T *values = R->values.get();
+    forEachScheduledRow(analysis->lower, n, true, [&](int i) {
+        I start = row_position[i];
+        I end = row_position[i + 1] - 1;
+        for (I k = start; k < end; k++)
+        {
+            int j = col_index[k];
+            T sum = values[k];
+            I p = start;
+            I q = row_position[j];
+            I q_end = row_position[j + 1] - 1;
+            while (p < k && q < q_end)
+            {
+                if (col_index[p] == col_index[q])
+                {
+                    sum -= values[p++] * values[q++];
+                }
+                else if (col_index[p] < col_index[q])
+                {
+                    p++;
+                }
+                else
+                {
+                    q++;
+                }
+            }
+            values[k] = sum / values[q_end];
+        }
+        T pivot = values[end];
+        for (I k = start; k < end; k++)
+        {
+            pivot -= values[k] * values[k];
+        }
+        if (!(pivot > 0))
+        {
+#pragma omp atomic write
+            failed = true;
+            pivot = 1;
+        }
+        values[end] = sqrt(pivot);
+    });
+    if (failed)
+    {
+        throw std::invalid_argument("Incomplete Cholesky breakdown: non-positive pivot");
+    }
+    R->invalidateDiagonal();
+}
+
+template <class T, class I>
+void IC0Preconditioner<T, I>::apply(const std::vector<T> &r, std::vector<T> &z)
+{
+    T *inv_diag = R->inverseDiagonal();
+    std::copy(r.begin(), r.end(), z.begin());
+    lowerSolve<T, I>(*R, *analysis, inv_diag, z);
+    transposedLowerSolve<T, I>(*R, *analysis, inv_diag, z);
+}
+
+template <class T, class I>
+void ILU0Preconditioner<T, I>::setup(CSRMatrix<T, I> &A_in)
+{
+    std::shared_ptr<CSRMatrix<T, I>> sorted_copy;
+    CSRMatrix<T, I> &A = withSortedRows(A_in, sorted_copy);
+    int n = A.rows;
+    I *a_diag = A.diagonalPositions();
+    for (int i = 0; i < n; i++)
+    {
+        if (a_diag[i] == -1)
+        {
+            throw std::invalid_argument("Incomplete LU needs every diagonal entry");
+        }
+    }
+
+    if (!LU || LU->col_index != A.col_index)
+    {
+        std::shared_ptr<T[]> values(new T[std::max<I>(A.nnzs, 1)]);
+        LU = std::make_shared<CSRMatrix<T, I>>(n, n, A.nnzs, values, A.row_position, A.col_index);
+        analysis = analyseTriangular(*LU, false);
+    }
+
+    I nnzs = A.nnzs;
+#pragma omp parallel for schedule(static)
+    for (I k = 0; k < nnzs; k++)
+    {
+        LU->values[k] = A.values[k];
+    }
+
+    // IKJ elimination restricted to the pattern of A: row i is updated by the
+    // rows c < i it has entries in, which are in earlier levels of the lower schedule
+    bool failed = false;
+    I *diag = LU->diagonalPositions();
+    I *row_position = LU->row_position.get();
+    int *col_index = LU->col_index.get();
+    T *values = LU->values.get();
+    forEachScheduledRow(analysis->lower, n, true, [&](int i) {
+        I end = row_position[i + 1];
+        for (I k = row_position[i]; k < diag[i]; k++)
+        {
+            int c = col_index[k];
+            if (values[diag[c]] == 0)
+            {
+#pragma omp atomic write
+                failed = true;
+                return;
+            }
+            T l_ic = values[k] / values[diag[c]];
+            values[k] = l_ic;
+
+            // row i -= l_ic * U(c, :), dropping what falls outside the pattern
+            I p = k + 1;
+            for (I q = diag[c] + 1; q < row_position[c + 1]; q++)
+            {
+                while (p < end && col_index[p] < col_index[q])
+                {
+                    p++;
+                }
+                if (p == end)
+                {
+                    break;
+                }
+                if (col_index[p] == col_index[q])
+                {
+                    values[p] -= l_ic * values[q];
+                }
+            }
+        }
+        if (values[diag[i]] == 0)
+        {
+#pragma omp atomic write
+            failed = true;
+        }
+    });
+    if (failed)
+    {
+        throw std::invalid_argument("Incomplete LU breakdown: zero pivot");
+    }
+}
+
+template <class T, class I>
+void ILU0Preconditioner<T, I>::apply(const std::vector<T> &r, std::vector<T> &z)
+{
+    std::copy(r.begin(), r.end(), z.begin());
+    lowerSolve<T, I>(*LU, *analysis, nullptr, z);
+    upperSolve<T, I>(*LU, *analysis, nullptr, z);
+}
@@ -0,0 +1,120 @@
+#pragma once
+#include "CSRMatrix.h"
+#include "TriangularSolve.h"
+#include "Reordering.h"
+#include <vector>
+#include <memory>
+
+// Preconditioner M ~ A for the Krylov solvers. setup(A) builds M from the
+// current values of A and can be called again after they change: work that
+// depends only on the sparsity pattern is kept while A.col_index is the same
+// array. apply(r, z) computes z = M^-1 r. The triangular preconditioners
+// (SSOR, IC0, ILU0) work on a sorted copy of A when its rows are unsorted,
+// which is rebuilt on every setup.
+template <class T, class I = int>
+class Preconditioner
+{
+public:
+    virtual ~Preconditioner() {}
+
+    virtual void setup(CSRMatrix<T, I> &A) = 0;
+
+    virtual void apply(const std::vector<T> &r, std::vector<T> &z) = 0;
+};
+
+// M = D
+template <class T, class I = int>
+class JacobiPreconditioner : public Preconditioner<T, I>
+{
+public:
+    void setup(CSRMatrix<T, I> &A) override;
+    void apply(const std::vector<T> &r, std::vector<T> &z) override;
+
+    std::vector<T> inv_diagonal{};
+};
+
+// Symmetric SOR: M = w / (2 - w) (D / w + L) D^-1 w (D / w + U), for 0 < w < 2.
+// The triangular sweeps are level-scheduled on the pattern of A.
+template <class T, class I = int>
+class SSORPreconditioner : public Preconditioner<T, I>
+{
+public:
+    explicit SSORPreconditioner(double omega = 1.0);
+
+    void setup(CSRMatrix<T, I> &A) override;
+    void apply(const std::vector<T> &r, std::vector<T> &z) override;
+
+    double omega;
+
+    // A itself, sharing its arrays, so the sweeps read the current values
+    std::shared_ptr<CSRMatrix<T, I>> matrix;
+    std::shared_ptr<TriangularAnalysis<I>> analysis;
+    std::vector<T> scaled_inv_diagonal{}; // w / a_ii
+    std::vector<T> middle_scale{};        // (2 - w) / w * a_ii / w
+};
+
+// SOR in a multicolour ordering: A is greedily coloured so that rows of one
+// colour do not couple, and the sweeps update all the rows of a colour in
+// parallel, one colour after the other. apply(r, z) is one forward sweep from
+// z = 0, M = (D / w + L) in the colour order, or with symmetric one forward
+// and one backward sweep, M = SSOR of the colour-permuted A, which is
+// symmetric and can precondition CG. With w = 1 the backward sweep skips the
+// last colour, whose update would not change it, so on a red-black colouring
+// a symmetric application costs one product with A, and w != 1 gains little
+// over symmetric Gauss-Seidel. setup throws
+// std::invalid_argument unless 0 < w < 2 and the diagonal is non-zero.
+template <class T, class I = int>
+class MulticolourSORPreconditioner : public Preconditioner<T, I>
+{
+public:
+    explicit MulticolourSORPreconditioner(double omega = 1.0, bool symmetric = true)
+        : omega(omega), symmetric(symmetric)
+    {
+    }
+
+    void setup(CSRMatrix<T, I> &A) override;
+    void apply(const std::vector<T> &r, std::vector<T> &z) override;
+
+    double omega;
+    bool symmetric;
+
+    // A itself, sharing its arrays, so the sweeps read the current values
+    std::shared_ptr<CSRMatrix<T, I>> matrix;
+    std::shared_ptr<int[]> pattern; // col_index of the A coloured
+    Colouring colouring;
+    std::vector<T> scaled_inv_diagonal{}; // w / a_ii
+
+private:
+    // z_i += w / a_ii (r_i - A(i, :) z) for the rows i of colour c
+    void sweep(int c, const std::vector<T> &r, std::vector<T> &z);
+};
+
+// Zero-fill incomplete Cholesky: M = R R^T with R lower triangular on the
+// pattern of the lower triangle of A. A must be symmetric; throws
+// std::invalid_argument if a pivot is not positive.
+template <class T, class I = int>
+class IC0Preconditioner : public Preconditioner<T, I>
+{
+public:
+    void setup(CSRMatrix<T, I> &A) override;
+    void apply(const std::vector<T> &r, std::vector<T> &z) override;
+
+    std::shared_ptr<int[]> pattern; // col_index of the A analysed
+    std::shared_ptr<CSRMatrix<T, I>> R;
+    std::vector<I> source{}; // position in A.values of every entry of R
+    std::shared_ptr<TriangularAnalysis<I>> analysis;
+};
+
+// Zero-fill incomplete LU: M = L U on the pattern of A, stored like the
+// factor of lu_decomp() (unit L before the diagonal, U from it). Throws
+// std::invalid_argument on a zero pivot.
+template <class T, class I = int>
+class ILU0Preconditioner : public Preconditioner<T, I>
+{
+public:
+    void setup(CSRMatrix<T, I> &A) override;
+    void apply(const std::vector<T> &r, std::vector<T> &z) override;
+
+    std::shared_ptr<CSRMatrix<T, I>> LU; // shares row_position and col_index with A
+    std::shared_ptr<TriangularAnalysis<I>> analysis;
+};
@@ -0,0 +1,1203 @@
+#include <iostream>
+#include "Reordering.h"
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
+#include <random>
+#include <queue>
+#include <limits>
+
+template <class T, class I>
+AdjacencyGraph<I> buildAdjacency(CSRMatrix<T, I> &A)
+{
+    if (A.rows != A.cols)
+    {
+        throw std::invalid_argument("Only implemented for square matrix");
+    }
+    int n = A.rows;
+    AdjacencyGraph<I> graph;
+    graph.n = n;
+
+    // Count every off-diagonal entry in both its row and its column, then fill,
+    // then sort each list and drop the duplicates of entries present in A and A^T
+    std::vector<I> count(n + 1, 0);
+    for (int i = 0; i < n; i++)
+    {
+        for (I cii = A.row_position[i]; cii < A.row_position[i + 1]; cii++)
+        {
+            int j = A.col_index[cii];
+            if (j != i)
+            {
+                count[i + 1]++;
+                count[j + 1]++;
+            }
+        }
+    }
+    for (int i = 0; i < n; i++)
+    {
+        count[i + 1] += count[i];
+    }
+    std::vector<int> adj(count[n]);
+    std::vector<I> next(count.begin(), count.end() - 1);
+    for (int i = 0; i < n; i++)
+    {
+        for (I cii = A.row_position[i]; cii < A.row_position[i + 1]; cii++)
+        {
+            int j = A.col_index[cii];
+            if (j != i)
+            {
+                adj[next[i]++] = j;
+                adj[next[j]++] = i;
+            }
+        }
+    }
+
+    graph.ptr.assign(n + 1, 0);
+    std::vector<I> unique_count(n, 0);
+#pragma omp parallel for schedule(dynamic, 256)
+    for (int i = 0; i < n; i++)
+    {
+        std::sort(adj.begin() + count[i], adj.begin() + count[i + 1]);
+        unique_count[i] = std::unique(adj.begin() + count[i], adj.begin() + count[i + 1]) - (adj.begin() + count[i]);
+    }
+    for (int i = 0; i < n; i++)
+    {
+        graph.ptr[i + 1] = graph.ptr[i] + unique_count[i];
+    }
+    graph.adj.resize(graph.ptr[n]);
+#pragma omp parallel for schedule(static)
+    for (int i = 0; i < n; i++)
+    {
+        std::copy(adj.begin() + count[i], adj.begin() + count[i] + unique_count[i], graph.adj.begin() + graph.ptr[i]);
+    }
+    return graph;
+}
+
+namespace
+{
+// Breadth-first level structure from root. Returns the number of levels and
+// leaves the nodes of the last level in last_level.
+template <class I>
+int rootedLevels(const AdjacencyGraph<I> &graph, int root, std::vector<int> &level, std::vector<int> &last_level)
+{
+    std::vector<int> frontier{root};
+    std::vector<int> visited_list{root};
+    level[root] = 0;
+    int depth = 0;
+    while (true)
+    {
+        std::vector<int> next;
+        for (int v : frontier)
+        {
+            for (I k = graph.ptr[v]; k < graph.ptr[v + 1]; k++)
+            {
+                int w = graph.adj[k];
+                if (level[w] < 0)
+                {
+                    level[w] = depth + 1;
+                    next.push_back(w);
+                    visited_list.push_back(w);
+                }
+            }
+        }
+        if (next.empty())
+        {
+            break;
+        }
+        frontier.swap(next);
+        depth++;
+    }
+    last_level = frontier;
+    // reset for the next search
+    for (int v : visited_list)
+    {
+        level[v] = -1;
+    }
+    return depth + 1;
+}
+
+// George-Liu pseudo-peripheral node: move to a minimum degree node of the last
+// level while the eccentricity keeps increasing
+template <class I>
+int pseudoPeripheralNode(const AdjacencyGraph<I> &graph, int start, std::vector<int> &level)
+{
+    std::vector<int> last_level;
+    int root = start;
+    int depth = rootedLevels(graph, root, level, last_level);
+    while (true)
+    {
+        int candidate = last_level[0];
+        for (int v : last_level)
+        {
+            if (graph.degree(v) < graph.degree(candidate))
+            {
+                candidate = v;
+            }
+        }
+        std::vector<int> candidate_last;
+        int candidate_depth = rootedLevels(graph, candidate, level, candidate_last);
+        if (candidate_depth <= depth)
+        {
+            return root;
+        }
+        root = candidate;
+        depth = candidate_depth;
+        last_level.swap(candidate_last);
+    }
+}
+} // namespace
+
+template <class T, class I>
+std::vector<int> reverseCuthillMcKee(CSRMatrix<T, I> &A)
+{
+    AdjacencyGraph<I> graph = buildAdjacency(A);
+    int n = graph.n;
+
+    std::vector<int> order;
+    order.reserve(n);
+    std::vector<char> visited(n, 0);
+    std::vector<int> level(n, -1);
+
+    // Components are started in order of their lowest degree unvisited node
+    std::vector<int> by_degree(n);
+    for (int i = 0; i < n; i++)
+    {
+        by_degree[i] = i;
+    }
+    std::stable_sort(by_degree.begin(), by_degree.end(), [&](int a, int b) { return graph.degree(a) < graph.degree(b); });
+
+    std::vector<int> neighbours;
+    for (int start : by_degree)
+    {
+        if (visited[start])
+        {
+            continue;
+        }
+        int root = pseudoPeripheralNode(graph, start, level);
+
+        // Cuthill-McKee: BFS visiting the neighbours of each node by increasing degree
+        size_t head = order.size();
+        order.push_back(root);
+        visited[root] = 1;
+        while (head < order.size())
+        {
+            int v = order[head++];
+            neighbours.clear();
+            for (I k = graph.ptr[v]; k < graph.ptr[v + 1]; k++)
+            {
+                int w = graph.adj[k];
+                if (!visited[w])
+                {
+                    visited[w] = 1;
+                    neighbours.push_back(w);
+                }
+            }
+            std::sort(neighbours.begin(), neighbours.end(), [&](int a, int b) {
+                return graph.degree(a) < graph.degree(b) || (graph.degree(a) == graph.degree(b) && a < b);
+            });
+            order.insert(order.end(), neighbours.begin(), neighbours.end());
+        }
+    }
+
+    std::reverse(order.begin(), order.end());
+    return order;
+}
+
+template <class T, class I>
+std::shared_ptr<CSRMatrix<T, I>> permuteSymmetric(CSRMatrix<T, I> &A, const std::vector<int> &perm)
+{
+    int n = A.rows;
+    if (A.rows != A.cols || (int)perm.size() != n)
+    {
+        throw std::invalid_argument("Dimensions don't match");
+    }
+    std::vector<int> inverse(n);
+    for (int i = 0; i < n; i++)
+    {
+        inverse[perm[i]] = i;
+    }
+
+    std::shared_ptr<CSRMatrix<T, I>> result(new CSRMatrix<T, I>(n, n, A.nnzs, true));
+    result->row_position[0] = 0;
+    for (int i = 0; i < n; i++)
+    {
+        result->row_position[i + 1] = result->row_position[i] + (A.row_position[perm[i] + 1] - A.row_position[perm[i]]);
+    }
+
+#pragma omp parallel
+    {
+        std::vector<std::pair<int, T>> row_entries;
+#pragma omp for schedule(dynamic, 256)
+        for (int i = 0; i < n; i++)
+        {
+            int old = perm[i];
+            row_entries.clear();
+            for (I cii = A.row_position[old]; cii < A.row_position[old + 1]; cii++)
+            {
+                row_entries.push_back({inverse[A.col_index[cii]], A.values[cii]});
+            }
+            std::sort(row_entries.begin(), row_entries.end(),
+                      [](const std::pair<int, T> &a, const std::pair<int, T> &b) { return a.first < b.first; });
+            I out = result->row_position[i];
+            for (auto &entry : row_entries)
+            {
+                result->col_index[out] = entry.first;
+                result->values[out] = entry.second;
+                out++;
+            }
+        }
+    }
+    return result;
+}
+
+template <class T>
+void permuteVector(const std::vector<T> &input, const std::vector<int> &perm, std::vector<T> &output)
+{
+    output.resize(perm.size());
+#pragma omp parallel for schedule(static)
+    for (int i = 0; i < (int)perm.size(); i++)
+    {
+        output[i] = input[perm[i]];
+    }
+}
+
+template <class T>
+void inversePermuteVector(const std::vector<T> &input, const std::vector<int> &perm, std::vector<T> &output)
+{
+    output.resize(perm.size());
+#pragma omp parallel for schedule(static)
+    for (int i = 0; i < (int)perm.size(); i++)
+    {
+        output[perm[i]] = input[i];
+    }
+}
+
+template <class T, class I>
+int bandwidth(CSRMatrix<T, I> &A)
+{
+    int band = 0;
+#pragma omp parallel for reduction(max : band) schedule(static)
+    for (int i = 0; i < A.rows; i++)
+    {
+        for (I cii = A.row_position[i]; cii < A.row_position[i + 1]; cii++)
+        {
+            band = std::max(band, abs(A.col_index[cii] - i));
+        }
+    }
+    return band;
+}
+
+template <class I>
+AdjacencyGraph<I> permuteGraph(const AdjacencyGraph<I> &graph, const std::vector<int> &perm)
+{
+    int n = graph.n;
+    std::vector<int> inverse(n);
+    for (int i = 0; i < n; i++)
+    {
+        inverse[perm[i]] = i;
+    }
+    AdjacencyGraph<I> permuted;
+    permuted.n = n;
+    permuted.ptr.assign(n + 1, 0);
+    for (int i = 0; i < n; i++)
+    {
+        permuted.ptr[i + 1] = permuted.ptr[i] + graph.degree(perm[i]);
+    }
+    permuted.adj.resize(permuted.ptr[n]);
+#pragma omp parallel for schedule(dynamic, 256)
+    for (int i = 0; i < n; i++)
+    {
+        I out = permuted.ptr[i];
+        for (I k = graph.ptr[perm[i]]; k < graph.ptr[perm[i] + 1]; k++)
+        {
+            permuted.adj[out++] = inverse[graph.adj[k]];
+        }
+        std::sort(permuted.adj.begin() + permuted.ptr[i], permuted.adj.begin() + permuted.ptr[i + 1]);
+    }
+    return permuted;
+}
+
+template <class I>
+std::vector<int> approximateMinimumDegree(const AdjacencyGraph<I> &graph)
+{
+    // Quotient graph: every uneliminated (super)variable i keeps the variables
+    // and the elements (eliminated pivots) it is adjacent to, and every element
+    // e the variables in its clique L_e. Eliminating p merges the elements
+    // around p into one new element instead of forming the fill explicitly.
+    enum Status : char
+    {
+        Variable,
+        Element,
+        Absorbed,
+        Merged
+    };
+    int n = graph.n;
+    std::vector<std::vector<int>> var_adj(n), elem_adj(n), elem_vars(n);
+    std::vector<char> status(n, Variable);
+    std::vector<int> nv(n, 1);            // size of each supervariable, 0 once eliminated or merged
+    std::vector<int> degree(n);           // approximate external degree
+    std::vector<int> elem_weight(n, 0);   // |L_e|, counted in variables
+    std::vector<int> member_next(n, -1);  // variables merged into a supervariable
+    std::vector<int> member_tail(n);
+
+    for (int i = 0; i < n; i++)
+    {
+        var_adj[i].assign(graph.adj.begin() + graph.ptr[i], graph.adj.begin() + graph.ptr[i + 1]);
+        degree[i] = var_adj[i].size();
+        member_tail[i] = i;
+    }
+
+    // Variables bucketed by degree in doubly linked lists
+    std::vector<int> head(n + 1, -1), next(n, -1), prev(n, -1);
+    auto insert = [&](int i) {
+        int d = std::min(degree[i], n);
+        next[i] = head[d];
+        prev[i] = -1;
+        if (head[d] != -1)
+        {
+            prev[head[d]] = i;
+        }
+        head[d] = i;
+    };
+    auto remove = [&](int i) {
+        int d = std::min(degree[i], n);
+        if (prev[i] != -1)
+        {
+            next[prev[i]] = next[i];
+        }
+        else
+        {
+            head[d] = next[i];
+        }
+        if (next[i] != -1)
+        {
+            prev[next[i]] = prev[i];
+        }
+    };
+    for (int i = 0; i < n; i++)
+    {
+        insert(i);
+    }
+
+    std::vector<int> mark(n, -1), w(n, 0), w_mark(n, -1), set_mark(n, -1);
+    int set_stamp = 0;
+    std::vector<int> order;
+    order.reserve(n);
+    std::vector<int> Lp;
+    std::vector<std::pair<uint64_t, int>> hashes;
+    int eliminated = 0;
+    int min_degree = 0;
+
+    for (int stamp = 0; eliminated < n; stamp++)
+    {
+        while (head[min_degree] == -1)
+        {
+            min_degree++;
+        }
+        int p = head[min_degree];
+        remove(p);
+
+        // New element: the union of the elements around p and its variables
+        Lp.clear();
+        int lp_weight = 0;
+        mark[p] = stamp;
+        for (int e : elem_adj[p])
+        {
+            if (status[e] != Element)
+            {
+                continue;
+            }
+            for (int v : elem_vars[e])
+            {
+                if (nv[v] > 0 && mark[v] != stamp)
+                {
+                    mark[v] = stamp;
+                    Lp.push_back(v);
+                    lp_weight += nv[v];
+                }
+            }
+            status[e] = Absorbed;
+            std::vector<int>().swap(elem_vars[e]);
+        }
+        for (int v : var_adj[p])
+        {
+            if (nv[v] > 0 && mark[v] != stamp)
+            {
+                mark[v] = stamp;
+                Lp.push_back(v);
+                lp_weight += nv[v];
+            }
+        }
+        std::vector<int>().swap(var_adj[p]);
+        std::vector<int>().swap(elem_adj[p]);
+
+        for (int q = p; q != -1; q = member_next[q])
+        {
+            order.push_back(q);
+        }
+        eliminated += nv[p];
+        nv[p] = 0;
+        status[p] = Element;
+        elem_vars[p] = Lp;
+        elem_weight[p] = lp_weight;
+
+        // w[e] = |L_e \ Lp| for the other elements adjacent to Lp
+        for (int i : Lp)
+        {
+            for (int e : elem_adj[i])
+            {
+                if (status[e] != Element || e == p)
+                {
+                    continue;
+                }
+                if (w_mark[e] != stamp)
+                {
+                    w_mark[e] = stamp;
+                    w[e] = elem_weight[e];
+                }
+                w[e] -= nv[i];
+            }
+        }
+
+        // Clean the lists of each variable in Lp and bound its degree
+        hashes.clear();
+        for (int i : Lp)
+        {
+            remove(i);
+            int external = 0;
+            uint64_t hash = 0;
+            size_t kept = 0;
+            for (int e : elem_adj[i])
+            {
+                if (status[e] != Element || e == p)
+                {
+                    continue;
+                }
+                if (w[e] == 0)
+                {
+                    // aggressive absorption: L_e is contained in Lp
+                    status[e] = Absorbed;
+                    std::vector<int>().swap(elem_vars[e]);
+                    continue;
+                }
+                external += w[e];
+                hash += e;
+                elem_adj[i][kept++] = e;
+            }
+            elem_adj[i].resize(kept);
+            elem_adj[i].push_back(p);
+            hash += p;
+
+            int var_weight = 0;
+            kept = 0;
+            for (int v : var_adj[i])
+            {
+                // variables in Lp are now reached through the element p
+                if (nv[v] > 0 && mark[v] != stamp)
+                {
+                    var_weight += nv[v];
+                    hash += v;
+                    var_adj[i][kept++] = v;
+                }
+            }
+            var_adj[i].resize(kept);
+
+            int d = std::min(degree[i] + lp_weight - nv[i], var_weight + lp_weight - nv[i] + external);
+            degree[i] = std::max(0, std::min(d, n - eliminated - nv[i]));
+            hashes.push_back({hash, i});
+        }
+
+        // Supervariables: variables of Lp with identical adjacency are merged
+        std::sort(hashes.begin(), hashes.end());
+        for (size_t g = 0; g < hashes.size();)
+        {
+            size_t g_end = g + 1;
+            while (g_end < hashes.size() && hashes[g_end].first == hashes[g].first)
+            {
+                g_end++;
+            }
+            for (size_t a = g; a < g_end; a++)
+            {
+                int i = hashes[a].second;
+                if (nv[i] == 0)
+                {
+                    continue;
+                }
+                set_stamp++;
+                for (int v : var_adj[i])
+                {
+                    set_mark[v] = set_stamp;
+                }
+                for (int e : elem_adj[i])
+                {
+                    set_mark[e] = set_stamp;
+                }
+                for (size_t c = a + 1; c < g_end; c++)
+                {
+                    int j = hashes[c].second;
+                    if (nv[j] == 0 || var_adj[j].size() != var_adj[i].size() || elem_adj[j].size() != elem_adj[i].size())
+                    {
+                        continue;
+                    }
+                    bool same = true;
+                    for (int v : var_adj[j])
+                    {
+                        same = same && set_mark[v] == set_stamp;
+                    }
+                    for (int e : elem_adj[j])
+                    {
+                        same = same && set_mark[e] == set_stamp;
+                    }
+                    if (!same)
+                    {
+                        continue;
+                    }
+                    degree[i] = std::max(0, degree[i] - nv[j]);
+                    nv[i] += nv[j];
+                    nv[j] = 0;
+                    status[j] = Merged;
+                    member_next[member_tail[i]] = j;
+                    member_tail[i] = member_tail[j];
+                    std::vector<int>().swap(var_adj[j]);
+                    std::vector<int>().swap(elem_adj[j]);
+                }
+            }
+            g = g_end;
+        }
+
+        for (int i : Lp)
+        {
+            if (nv[i] > 0)
+            {
+                insert(i);
+                min_degree = std::min(min_degree, std::min(degree[i], n));
+            }
+        }
+    }
+    return order;
+}
+
+template <class T, class I>
+std::vector<int> approximateMinimumDegree(CSRMatrix<T, I> &A)
+{
+    return approximateMinimumDegree(buildAdjacency(A));
+}
+
+namespace
+{
+// Graph with vertex and edge weights, for the coarse levels of the bisection
+template <class I>
+struct WeightedGraph
+{
+    AdjacencyGraph<I> graph;
+    std::vector<int> edge_weight;
+    std::vector<int> vertex_weight;
+    int total_weight = 0;
+};
+
+template <class I>
+WeightedGraph<I> unitWeights(const AdjacencyGraph<I> &graph)
+{
+    WeightedGraph<I> weighted;
+    weighted.graph = graph;
+    weighted.edge_weight.assign(graph.adj.size(), 1);
+    weighted.vertex_weight.assign(graph.n, 1);
+    weighted.total_weight = graph.n;
+    return weighted;
+}
+
+// Heavy-edge matching: every vertex is paired with the unmatched neighbour it
+// shares the heaviest edge with, and each pair becomes one coarse vertex
+template <class I>
+WeightedGraph<I> coarsen(const WeightedGraph<I> &fine, std::vector<int> &cmap, std::mt19937 &rng)
+{
+    const AdjacencyGraph<I> &g = fine.graph;
+    int n = g.n;
+    std::vector<int> visit(n);
+    for (int i = 0; i < n; i++)
+    {
+        visit[i] = i;
+    }
+    std::shuffle(visit.begin(), visit.end(), rng);
+
+    // coarse vertices much heavier than average would unbalance the bisection
+    int max_vertex_weight = std::max(2, (int)(1.5 * fine.total_weight / 50));
+    std::vector<int> match(n, -1);
+    for (int v : visit)
+    {
+        if (match[v] != -1)
+        {
+            continue;
+        }
+        int best = -1;
+        int best_weight = -1;
+        for (I k = g.ptr[v]; k < g.ptr[v + 1]; k++)
+        {
+            int u = g.adj[k];
+            if (match[u] == -1 && u != v && fine.edge_weight[k] > best_weight &&
+                fine.vertex_weight[u] + fine.vertex_weight[v] <= max_vertex_weight)
+            {
+                best = u;
+                best_weight = fine.edge_weight[k];
+            }
+        }
+        match[v] = best == -1 ? v : best;
+        if (best != -1)
+        {
+            match[best] = v;
+        }
+    }
+
+    cmap.assign(n, -1);
+    std::vector<int> members;
+    members.reserve(n);
+    int coarse_n = 0;
+    for (int v = 0; v < n; v++)
+    {
+        if (cmap[v] == -1)
+        {
+            cmap[v] = coarse_n;
+            cmap[match[v]] = coarse_n;
+            members.push_back(v);
+            coarse_n++;
+        }
+    }
+
+    WeightedGraph<I> coarse;
+    coarse.graph.n = coarse_n;
+    coarse.graph.ptr.assign(coarse_n + 1, 0);
+    coarse.vertex_weight.assign(coarse_n, 0);
+    coarse.total_weight = fine.total_weight;
+    std::vector<I> position(coarse_n, -1);
+    for (int c = 0; c < coarse_n; c++)
+    {
+        I start = coarse.graph.adj.size();
+        int pair[2] = {members[c], match[members[c]]};
+        for (int m = 0; m < (pair[0] == pair[1] ? 1 : 2); m++)
+        {
+            int f = pair[m];
+            coarse.vertex_weight[c] += fine.vertex_weight[f];
+            for (I k = g.ptr[f]; k < g.ptr[f + 1]; k++)
+            {
+                int cu = cmap[g.adj[k]];
+                if (cu == c)
+                {
+                    continue;
+                }
+                if (position[cu] < start)
+                {
+                    position[cu] = coarse.graph.adj.size();
+                    coarse.graph.adj.push_back(cu);
+                    coarse.edge_weight.push_back(fine.edge_weight[k]);
+                }
+                else
+                {
+                    coarse.edge_weight[position[cu]] += fine.edge_weight[k];
+                }
+            }
+        }
+        coarse.graph.ptr[c + 1] = coarse.graph.adj.size();
+    }
+    return coarse;
+}
+
+template <class I>
+int edgeCut(const WeightedGraph<I> &wg, const std::vector<char> &part)
+{
+    int cut = 0;
+    for (int v = 0; v < wg.graph.n; v++)
+    {
+        for (I k = wg.graph.ptr[v]; k < wg.graph.ptr[v + 1]; k++)
+        {
+            if (part[v] != part[wg.graph.adj[k]])
+            {
+                cut += wg.edge_weight[k];
+            }
+        }
+    }
+    return cut / 2;
+}
+
+// Fiduccia-Mattheyses refinement: move the boundary vertex with the highest
+// gain that keeps the balance, lock it, and keep the best prefix of the moves
+template <class I>
+void refineBisection(const WeightedGraph<I> &wg, std::vector<char> &part, int max_weight)
+{
+    const AdjacencyGraph<I> &g = wg.graph;
+    int n = g.n;
+    std::vector<int> gain(n);
+    std::vector<char> locked(n);
+    std::vector<int> moves;
+
+    for (int pass = 0; pass < 8; pass++)
+    {
+        int side_weight[2] = {0, 0};
+        for (int v = 0; v < n; v++)
+        {
+            side_weight[(int)part[v]] += wg.vertex_weight[v];
+        }
+        std::priority_queue<std::pair<int, int>> heap;
+        for (int v = 0; v < n; v++)
+        {
+            int external = 0;
+            int internal = 0;
+            for (I k = g.ptr[v]; k < g.ptr[v + 1]; k++)
+            {
+                (part[g.adj[k]] == part[v] ? internal : external) += wg.edge_weight[k];
+            }
+            gain[v] = external - internal;
+            if (external > 0)
+            {
+                heap.push({gain[v], v});
+            }
+        }
+        std::fill(locked.begin(), locked.end(), 0);
+        moves.clear();
+
+        auto overweight = [&]() { return std::max(0, std::max(side_weight[0], side_weight[1]) - max_weight); };
+        int cut = edgeCut(wg, part);
+        int best_cut = cut;
+        int best_over = overweight();
+        size_t best_moves = 0;
+        int since_best = 0;
+        while (!heap.empty() && since_best < 100)
+        {
+            auto top = heap.top();
+            heap.pop();
+            int v = top.second;
+            if (locked[v] || top.first != gain[v])
+            {
+                continue;
+            }
+            int from = part[v];
+            int to = 1 - from;
+            if (side_weight[to] + wg.vertex_weight[v] > max_weight && side_weight[to] + wg.vertex_weight[v] > side_weight[from])
+            {
+                continue;
+            }
+            part[v] = to;
+            side_weight[from] -= wg.vertex_weight[v];
+            side_weight[to] += wg.vertex_weight[v];
+            cut -= gain[v];
+            gain[v] = -gain[v];
+            locked[v] = 1;
+            moves.push_back(v);
+            for (I k = g.ptr[v]; k < g.ptr[v + 1]; k++)
+            {
+                int u = g.adj[k];
+                gain[u] += part[u] == to ? -2 * wg.edge_weight[k] : 2 * wg.edge_weight[k];
+                if (!locked[u])
+                {
+                    heap.push({gain[u], u});
+                }
+            }
+
+            int over = overweight();
+            if (over < best_over || (over == best_over && cut < best_cut))
+            {
+                best_cut = cut;
+                best_over = over;
+                best_moves = moves.size();
+                since_best = 0;
+            }
+            else
+            {
+                since_best++;
+            }
+        }
+
+        for (size_t k = moves.size(); k > best_moves; k--)
+        {
+            part[moves[k - 1]] ^= 1;
+        }
+        if (best_moves == 0)
+        {
+            break;
+        }
+    }
+}
+
+// Greedy graph growing from a few random seeds, each refined, keeping the best cut
+template <class I>
+std::vector<char> initialBisection(const WeightedGraph<I> &wg, int max_weight, std::mt19937 &rng)
+{
+    const AdjacencyGraph<I> &g = wg.graph;
+    int n = g.n;
+    std::vector<char> best;
+    int best_cut = std::numeric_limits<int>::max();
+    std::vector<char> part(n);
+    std::vector<int> queue;
+    for (int trial = 0; trial < 4; trial++)
+    {
+        std::fill(part.begin(), part.end(), 1);
+        int grown = 0;
+        int next_unvisited = 0;
+        queue.assign(1, std::uniform_int_distribution<int>(0, n - 1)(rng));
+        part[queue[0]] = 0;
+        grown += wg.vertex_weight[queue[0]];
+        for (size_t head = 0; 2 * grown < wg.total_weight;)
+        {
+            if (head == queue.size())
+            {
+                // the component is exhausted, continue from another one
+                while (part[next_unvisited] == 0)
+                {
+                    next_unvisited++;
+                }
+                queue.push_back(next_unvisited);
+                part[next_unvisited] = 0;
+                grown += wg.vertex_weight[next_unvisited];
+                continue;
+            }
+            int v = queue[head++];
+            for (I k = g.ptr[v]; k < g.ptr[v + 1] && 2 * grown < wg.total_weight; k++)
+            {
+                int u = g.adj[k];
+                if (part[u] == 1)
+                {
+                    part[u] = 0;
+                    grown += wg.vertex_weight[u];
+                    queue.push_back(u);
+                }
+            }
+        }
+        refineBisection(wg, part, max_weight);
+        int cut = edgeCut(wg, part);
+        if (cut < best_cut)
+        {
+            best_cut = cut;
+            best = part;
+        }
+    }
+    return best;
+}
+
+template <class I>
+std::vector<char> multilevelBisection(const AdjacencyGraph<I> &graph)
+{
+    std::mt19937 rng(graph.n);
+    std::vector<WeightedGraph<I>> levels;
+    std::vector<std::vector<int>> cmaps;
+    levels.push_back(unitWeights(graph));
+    while (levels.back().graph.n > 100)
+    {
+        std::vector<int> cmap;
+        WeightedGraph<I> coarse = coarsen(levels.back(), cmap, rng);
+        if (coarse.graph.n > 0.85 * levels.back().graph.n)
+        {
+            break;
+        }
+        cmaps.push_back(std::move(cmap));
+        levels.push_back(std::move(coarse));
+    }
+
+    int max_weight = (int)(0.55 * graph.n) + 1;
+    std::vector<char> part = initialBisection(levels.back(), max_weight, rng);
+    for (int level = (int)cmaps.size() - 1; level >= 0; level--)
+    {
+        std::vector<char> fine_part(levels[level].graph.n);
+        for (int v = 0; v < levels[level].graph.n; v++)
+        {
+            fine_part[v] = part[cmaps[level][v]];
+        }
+        part.swap(fine_part);
+        refineBisection(levels[level], part, max_weight);
+    }
+    return part;
+}
+
+// Smallest vertex separator covering the cut edges of a bisection: a minimum
+// vertex cover of the bipartite graph of cut edges (Konig's theorem)
+template <class I>
+std::vector<char> vertexSeparator(const AdjacencyGraph<I> &g, const std::vector<char> &part)
+{
+    int n = g.n;
+    std::vector<int> local(n, -1);
+    std::vector<int> left, right;
+    for (int v = 0; v < n; v++)
+    {
+        for (I k = g.ptr[v]; k < g.ptr[v + 1]; k++)
+        {
+            if (part[g.adj[k]] != part[v])
+            {
+                std::vector<int> &side = part[v] == 0 ? left : right;
+                local[v] = side.size();
+                side.push_back(v);
+                break;
+            }
+        }
+    }
+
+    // maximum matching: greedy start, then BFS augmenting paths
+    int nl = left.size();
+    int nr = right.size();
+    std::vector<int> match_l(nl, -1), match_r(nr, -1), parent_r(nr), seen_r(nr, -1);
+    auto forEachRight = [&](int l, auto visit) {
+        int v = left[l];
+        for (I k = g.ptr[v]; k < g.ptr[v + 1]; k++)
+        {
+            if (part[g.adj[k]] == 1)
+            {
+                if (visit(local[g.adj[k]]))
+                {
+                    return;
+                }
+            }
+        }
+    };
+    for (int l = 0; l < nl; l++)
+    {
+        forEachRight(l, [&](int r) {
+            if (match_r[r] == -1)
+            {
+                match_r[r] = l;
+                match_l[l] = r;
+                return true;
+            }
+            return false;
+        });
+    }
+    std::vector<int> queue;
+    for (int l = 0; l < nl; l++)
+    {
+        if (match_l[l] != -1)
+        {
+            continue;
+        }
+        queue.assign(1, l);
+        int found = -1;
+        for (size_t head = 0; head < queue.size() && found == -1; head++)
+        {
+            int x = queue[head];
+            forEachRight(x, [&](int r) {
+                if (seen_r[r] == l)
+                {
+                    return false;
+                }
+                seen_r[r] = l;
+                parent_r[r] = x;
+                if (match_r[r] == -1)
+                {
+                    found = r;
+                    return true;
+                }
+                queue.push_back(match_r[r]);
+                return false;
+            });
+        }
+        for (int r = found; r != -1;)
+        {
+            int x = parent_r[r];
+            int previous = match_l[x];
+            match_l[x] = r;
+            match_r[r] = x;
+            r = previous;
+        }
+    }
+
+    // Z = reachable from the unmatched left vertices along alternating paths;
+    // the cover is (left \ Z) + (right & Z)
+    std::vector<char> z_left(nl, 0), z_right(nr, 0);
+    queue.clear();
+    for (int l = 0; l < nl; l++)
+    {
+        if (match_l[l] == -1)
+        {
+            z_left[l] = 1;
+            queue.push_back(l);
+        }
+    }
+    for (size_t head = 0; head < queue.size(); head++)
+    {
+        forEachRight(queue[head], [&](int r) {
+            if (!z_right[r])
+            {
+                z_right[r] = 1;
+                int l = match_r[r];
+                if (l != -1 && !z_left[l])
+                {
+                    z_left[l] = 1;
+                    queue.push_back(l);
+                }
+            }
+            return false;
+        });
+    }
+
+    std::vector<char> separator(n, 0);
+    for (int l = 0; l < nl; l++)
+    {
+        separator[left[l]] = !z_left[l];
+    }
+    for (int r = 0; r < nr; r++)
+    {
+        separator[right[r]] = z_right[r];
+    }
+    return separator;
+}
+
+template <class I>
+AdjacencyGraph<I> inducedSubgraph(const AdjacencyGraph<I> &g, const std::vector<int> &vertices)
+{
+    std::vector<int> local(g.n, -1);
+    for (size_t i = 0; i < vertices.size(); i++)
+    {
+        local[vertices[i]] = i;
+    }
+    AdjacencyGraph<I> sub;
+    sub.n = vertices.size();
+    sub.ptr.assign(sub.n + 1, 0);
+    for (int i = 0; i < sub.n; i++)
+    {
+        int v = vertices[i];
+        for (I k = g.ptr[v]; k < g.ptr[v + 1]; k++)
+        {
+            if (local[g.adj[k]] != -1)
+            {
+                sub.adj.push_back(local[g.adj[k]]);
+            }
+        }
+        sub.ptr[i + 1] = sub.adj.size();
+    }
+    return sub;
+}
+
+// Order the two halves first and the separator last, recursively, with the
+// halves as independent tasks. Small subgraphs are ordered by AMD.
+template <class I>
+void dissect(const AdjacencyGraph<I> &g, const std::vector<int> &labels, int *order)
+{
+    const int leaf_size = 256;
+    int n = g.n;
+    auto leafOrder = [&]() {
+        std::vector<int> perm = approximateMinimumDegree(g);
+        for (int k = 0; k < n; k++)
+        {
+            order[k] = labels[perm[k]];
+        }
+    };
+    if (n <= leaf_size)
+    {
+        leafOrder();
+        return;
+    }
+
+    std::vector<char> part = multilevelBisection(g);
+    std::vector<char> separator = vertexSeparator(g, part);
+    std::vector<int> halves[2], sep;
+    for (int v = 0; v < n; v++)
+    {
+        if (separator[v])
+        {
+            sep.push_back(v);
+        }
+        else
+        {
+            halves[(int)part[v]].push_back(v);
+        }
+    }
+    if (halves[0].empty() || halves[1].empty())
+    {
+        leafOrder();
+        return;
+    }
+
+    int offset = 0;
+    for (int h = 0; h < 2; h++)
+    {
+        int *half_order = order + offset;
+        offset += halves[h].size();
+#pragma omp task firstprivate(h, half_order) shared(g, labels, halves) if (n > 20000)
+        {
+            std::vector<int> half_labels(halves[h].size());
+            for (size_t i = 0; i < halves[h].size(); i++)
+            {
+                half_labels[i] = labels[halves[h][i]];
+            }
+            dissect(inducedSubgraph(g, halves[h]), half_labels, half_order);
+        }
+    }
+    for (int v : sep)
+    {
+        order[offset++] = labels[v];
+    }
+#pragma omp taskwait
+}
+} // namespace
+
+template <class I>
+std::vector<int> nestedDissection(const AdjacencyGraph<I> &graph)
+{
+    std::vector<int> order(graph.n);
+    std::vector<int> labels(graph.n);
+    for (int i = 0; i < graph.n; i++)
+    {
+        labels[i] = i;
+    }
+#pragma omp parallel
+#pragma omp single
+    dissect(graph, labels, order.data());
+    return order;
+}
+
+template <class T, class I>
+std::vector<int> nestedDissection(CSRMatrix<T, I> &A)
+{
+    return nestedDissection(buildAdjacency(A));
+}
+
+template <class I>
+Colouring greedyColouring(const AdjacencyGraph<I> &graph)
+{
+    int n = graph.n;
+    Colouring colouring;
+    colouring.colour.assign(n, -1);
+
+    // used[c] == v marks colour c as taken by a neighbour of v
+    std::vector<int> used;
+    for (int v = 0; v < n; v++)
+    {
+        for (I k = graph.ptr[v]; k < graph.ptr[v + 1]; k++)
+        {
+            int c = colouring.colour[graph.adj[k]];
+            if (c >= 0)
+            {
+                used[c] = v;
+            }
+        }
+        int c = 0;
+        while (c < colouring.n_colours && used[c] == v)
+        {
+            c++;
+        }
+        if (c == colouring.n_colours)
+        {
+            colouring.n_colours++;
+            used.push_back(-1);
+        }
+        colouring.colour[v] = c;
+    }
+
+    colouring.ptr.assign(colouring.n_colours + 1, 0);
+    for (int v = 0; v < n; v++)
+    {
+        colouring.ptr[colouring.colour[v] + 1]++;
+    }
+    for (int c = 0; c < colouring.n_colours; c++)
+    {
+        colouring.ptr[c + 1] += colouring.ptr[c];
+    }
+    colouring.members.resize(n);
+    std::vector<int> next(colouring.ptr.begin(), colouring.ptr.end() - 1);
+    for (int v = 0; v < n; v++)
+    {
+        colouring.members[next[colouring.colour[v]]++] = v;
+    }
+    return colouring;
+}
+
+template <class T, class I>
+Colouring greedyColouring(CSRMatrix<T, I> &A)
+{
+    return greedyColouring(buildAdjacency(A));
+}
@@ -0,0 +1,91 @@
+#pragma once
+#include "CSRMatrix.h"
+#include <vector>
+#include <memory>
+
+// Symmetric adjacency structure of a sparse matrix (pattern of A + A^T without
+// the diagonal), the input for graph-based orderings.
+template <class I = int>
+struct AdjacencyGraph
+{
+    int n = 0;
+    std::vector<I> ptr; // size n + 1
+    std::vector<int> adj;
+
+    int degree(int v) const { return (int)(ptr[v + 1] - ptr[v]); }
+};
+
+template <class T, class I>
+AdjacencyGraph<I> buildAdjacency(CSRMatrix<T, I> &A);
+
+// Reverse Cuthill-McKee ordering. perm[new_index] = old_index.
+// Every connected component starts from a pseudo-peripheral node.
+template <class T, class I>
+std::vector<int> reverseCuthillMcKee(CSRMatrix<T, I> &A);
+
+// B = P A P^T, i.e. B(i, j) = A(perm[i], perm[j]), with sorted columns
+template <class T, class I>
+std::shared_ptr<CSRMatrix<T, I>> permuteSymmetric(CSRMatrix<T, I> &A, const std::vector<int> &perm);
+
+// output[i] = input[perm[i]], the vector in the new ordering
+template <class T>
+void permuteVector(const std::vector<T> &input, const std::vector<int> &perm, std::vector<T> &output);
+
+// output[perm[i]] = input[i], back to the original ordering
+template <class T>
+void inversePermuteVector(const std::vector<T> &input, const std::vector<int> &perm, std::vector<T> &output);
+
+// max |i - j| over the non-zeros
+template <class T, class I>
+int bandwidth(CSRMatrix<T, I> &A);
+
+// G' with G'(i, j) = G(perm[i], perm[j]), sorted adjacency lists
+template <class I>
+AdjacencyGraph<I> permuteGraph(const AdjacencyGraph<I> &graph, const std::vector<int> &perm);
+
+// Fill-reducing orderings for the sparse direct solvers. perm[new_index] = old_index.
+enum class FillOrdering
+{
+    Natural,
+    AMD,
+    NestedDissection,
+    // the ordering with the smallest predicted fill
+    Automatic
+};
+
+// Approximate minimum degree on the quotient graph, with element absorption,
+// supervariables and the approximate external degree bound of Amestoy, Davis
+// and Duff
+template <class I>
+std::vector<int> approximateMinimumDegree(const AdjacencyGraph<I> &graph);
+template <class T, class I>
+std::vector<int> approximateMinimumDegree(CSRMatrix<T, I> &A);
+
+// Nested dissection by recursive multilevel bisection: heavy-edge matching to
+// coarsen, greedy graph growing on the coarsest graph, Fiduccia-Mattheyses
+// refinement on the way back, and a minimum vertex separator from the edge
+// cut. Subgraphs below a few hundred vertices are ordered by AMD.
+template <class I>
+std::vector<int> nestedDissection(const AdjacencyGraph<I> &graph);
+template <class T, class I>
+std::vector<int> nestedDissection(CSRMatrix<T, I> &A);
+
+// Partition of the vertices into colours such that no two adjacent vertices
+// share one. The vertices of colour c are members[ptr[c] .. ptr[c + 1]), in
+// increasing order.
+struct Colouring
+{
+    int n_colours = 0;
+    std::vector<int> colour; // colour of every vertex
+    std::vector<int> ptr;    // size n_colours + 1
+    std::vector<int> members;
+};
+
+// Greedy (first-fit) colouring in the natural order: every vertex takes the
+// smallest colour not used by a neighbour coloured before it, so at most
+// max degree + 1 colours. Natural orderings of the 5- and 7-point stencils
+// get two (red-black), of the 27-point stencil eight.
+template <class I>
+Colouring greedyColouring(const AdjacencyGraph<I> &graph);
+template <class T, class I>
+Colouring greedyColouring(CSRMatrix<T, I> &A);
@@ -0,0 +1,487 @@
+#include "SolverSession.h"
+#include "utilities.h"
+#include <iostream>
+#include <math.h>
+#include <algorithm>
+#include <numeric>
+#include <stdexcept>
+#include <vector>
+
+namespace
+{
+// Cholesky factor of the symmetric k x k matrix G (row-major), in place in
+// its lower triangle; returns false if G is not numerically positive definite
+bool denseCholesky(std::vector<double> &G, int k)
+{
+    for (int j = 0; j < k; j++)
+    {
+        double d = G[j * k + j];
+        for (int m = 0; m < j; m++)
+        {
+            d -= G[j * k + m] * G[j * k + m];
+        }
+        if (!(d > 0))
+        {
+            return false;
+        }
+        d = sqrt(d);
+        G[j * k + j] = d;
+        for (int i = j + 1; i < k; i++)
+        {
+            double sum = G[i * k + j];
+            for (int m = 0; m < j; m++)
+            {
+                sum -= G[i * k + m] * G[j * k + m];
+            }
+            G[i * k + j] = sum / d;
+        }
+    }
+    return true;
+}
+
+// y = L^-1 y and y = L^-T y, with L from denseCholesky
+void lowerSolve(const std::vector<double> &L, int k, double *y)
+{
+    for (int i = 0; i < k; i++)
+    {
+        for (int m = 0; m < i; m++)
+        {
+            y[i] -= L[i * k + m] * y[m];
+        }
+        y[i] /= L[i * k + i];
+    }
+}
+
+void lowerTransposeSolve(const std::vector<double> &L, int k, double *y)
+{
+    for (int i = k - 1; i >= 0; i--)
+    {
+        for (int m = i + 1; m < k; m++)
+        {
+            y[i] -= L[m * k + i] * y[m];
+        }
+        y[i] /= L[i * k + i];
+    }
+}
+
+// Eigenvalues of the symmetric k x k matrix S by cyclic Jacobi rotations: S is
+// overwritten, with the eigenvalues on its diagonal and the eigenvectors in
+// the columns of V
+void symmetricEigen(std::vector<double> &S, int k, std::vector<double> &V)
+{
+    V.assign((size_t)k * k, 0);
+    for (int i = 0; i < k; i++)
+    {
+        V[i * k + i] = 1;
+    }
+    double norm = 0;
+    for (double s : S)
+    {
+        norm += s * s;
+    }
+    for (int sweep = 0; sweep < 50; sweep++)
+    {
+        double off = 0;
+        for (int p = 0; p < k; p++)
+        {
+            for (int q = p + 1; q < k; q++)
+            {
+                off += S[p * k + q] * S[p * k + q];
+            }
+        }
+        if (off <= 1e-30 * norm)
+        {
+            return;
+        }
+        for (int p = 0; p < k; p++)
+        {
+            for (int q = p + 1; q < k; q++)
+            {
+                if (S[p * k + q] == 0)
+                {
+                    continue;
+                }
+                // the rotation in the (p, q) plane that zeroes S_pq
+                double theta = (S[q * k + q] - S[p * k + p]) / (2 * S[p * k + q]);
+                double t = (theta >= 0 ? 1 : -1) / (fabs(theta) + sqrt(theta * theta + 1));
+                double c = 1 / sqrt(t * t + 1), s = t * c;
+                for (int r = 0; r < k; r++)
+                {
+                    double a = S[r * k + p], b = S[r * k + q];
+                    S[r * k + p] = c * a - s * b;
+                    S[r * k + q] = s * a + c * b;
+                }
+                for (int r = 0; r < k; r++)
+                {
+                    double a = S[p * k + r], b = S[q * k + r];
+                    S[p * k + r] = c * a - s * b;
+                    S[q * k + r] = s * a + c * b;
+                }
+                for (int r = 0; r < k; r++)
+                {
+                    double a = V[r * k + p], b = V[r * k + q];
+                    V[r * k + p] = c * a - s * b;
+                    V[r * k + q] = s * a + c * b;
+                }
+            }
+        }
+    }
+}
+} // namespace
+
+template <class T, class I>
+void SolverSession<T, I>::reset()
+{
+    W.clear();
+    deflation_vectors = 0;
+}
+
+template <class T, class I>
+void SolverSession<T, I>::solve(CSRMatrix<T, I> &A, const std::vector<T> &b, std::vector<T> &x, double &tol,
+                                int &it_max, Preconditioner<T, I> *M)
+{
+    int n = A.rows;
+    if (A.cols != n || b.size() != (size_t)n || x.size() != (size_t)n)
+    {
+        throw std::invalid_argument("Dimensions don't match");
+    }
+    if (W.size() != (size_t)n * deflation_vectors)
+    {
+        reset();
+    }
+    if (!warm_start)
+    {
+        std::fill(x.begin(), x.end(), 0);
+    }
+
+    // A W for the current A, and W^T A W factored for the projections
+    int k = deflation_vectors;
+    std::vector<T> AW((size_t)n * k);
+    std::vector<double> WtAW((size_t)k * k, 0);
+    if (k > 0)
+    {
+        A.matMultiVecMult(W, k, AW);
+        double *G = WtAW.data();
+#pragma omp parallel for reduction(+ : G[:k * k]) schedule(static)
+        for (int i = 0; i < n; i++)
+        {
+            for (int j = 0; j < k; j++)
+            {
+                for (int m = 0; m <= j; m++)
+                {
+                    G[j * k + m] += W[(size_t)i * k + j] * AW[(size_t)i * k + m];
+                }
+            }
+        }
+        if (!denseCholesky(WtAW, k))
+        {
+            std::cout << "deflation space is not A-definite, solving without it" << std::endl;
+            reset();
+            k = 0;
+        }
+    }
+
+    // mu = (W^T A W)^-1 U^T v, for U = W or A W
+    std::vector<double> mu(std::max(k, 1));
+    auto project = [&](const std::vector<T> &U, const std::vector<T> &v) {
+        std::fill(mu.begin(), mu.end(), 0);
+        double *m = mu.data();
+#pragma omp parallel for reduction(+ : m[:k]) schedule(static)
+        for (int i = 0; i < n; i++)
+        {
+            for (int j = 0; j < k; j++)
+            {
+                m[j] += U[(size_t)i * k + j] * v[i];
+            }
+        }
+        lowerSolve(WtAW, k, m);
+        lowerTransposeSolve(WtAW, k, m);
+    };
+
+    // r = b - A x, then x += W mu so that W^T r = 0
+    std::vector<T> r(n), z(M ? n : 0), p(n), Ap(n);
+    A.matVecMult(x, r);
+#pragma omp parallel for schedule(static)
+    for (int i = 0; i < n; i++)
+    {
+        r[i] = b[i] - r[i];
+    }
+    if (k > 0)
+    {
+        project(W, r);
+#pragma omp parallel for schedule(static)
+        for (int i = 0; i < n; i++)
+        {
+            for (int j = 0; j < k; j++)
+            {
+                x[i] += mu[j] * W[(size_t)i * k + j];
+                r[i] -= mu[j] * AW[(size_t)i * k + j];
+            }
+        }
+    }
+    const std::vector<T> &z_ref = M ? z : r;
+
+    // p = z + beta p - W mu, with mu such that W^T A p = 0. Without a
+    // preconditioner z = r, and (A W)^T r is summed in the sweep updating r.
+    int k_p = deflate_iterations ? k : 0;
+    bool fused = k_p > 0 && !M;
+    auto searchDirection = [&](double beta, bool projected) {
+        if (k_p > 0 && !projected)
+        {
+            project(AW, z_ref);
+        }
+#pragma omp parallel for schedule(static)
+        for (int i = 0; i < n; i++)
+        {
+            T value = z_ref[i] + beta * p[i];
+            for (int j = 0; j < k_p; j++)
+            {
+                value -= mu[j] * W[(size_t)i * k + j];
+            }
+            p[i] = value;
+        }
+    };
+    if (M)
+    {
+        M->apply(r, z);
+    }
+    searchDirection(0, false);
+    double rz = vecDotProduct(r, z_ref);
+    double residual = sqrt(vecDotProduct(r, r));
+
+    // the first search directions and their products with A, for the next W
+    std::vector<std::vector<T>> P, AP;
+    int it;
+    for (it = 0; it < it_max && residual >= tol; it++)
+    {
+        A.matVecMult(p, Ap);
+        double alpha = rz / vecDotProduct(p, Ap);
+
+        residual = 0.0;
+        int k_r = fused ? k : 0;
+        int k_reduction = std::max(k_r, 1); // zero-length array reductions crash under GCC
+        std::fill(mu.begin(), mu.end(), 0);
+        double *m = mu.data();
+#pragma omp parallel for reduction(+ : residual, m[:k_reduction]) schedule(static)
+        for (int i = 0; i < n; i++)
+        {
+            x[i] += alpha * p[i];
+            r[i] -= alpha * Ap[i];
+            residual += r[i] * r[i];
+            for (int j = 0; j < k_r; j++)
+            {
+                m[j] += AW[(size_t)i * k + j] * r[i];
+            }
+        }
+        residual = sqrt(residual);
+        if (it < recycle_iterations)
+        {
+            P.push_back(p);
+            AP.push_back(Ap);
+        }
+        if (residual < tol)
+        {
+            break;
+        }
+
+        if (M)
+        {
+            M->apply(r, z);
+        }
+        double rz_new = M ? vecDotProduct(r, z) : residual * residual;
+        double beta = rz_new / rz;
+        rz = rz_new;
+        if (fused)
+        {
+            lowerSolve(WtAW, k, mu.data());
+            lowerTransposeSolve(WtAW, k, mu.data());
+        }
+        searchDirection(beta, fused);
+    }
+    iterations = it;
+    std::cout << "k is :" << it << std::endl;
+    std::cout << "residual is :" << residual << std::endl;
+
+    if (deflation_size > 0 && !P.empty())
+    {
+        updateDeflationSpace(AW, k, P, AP);
+    }
+}
+
+// Harmonic Ritz vectors of A in the span of Z = [W, P]: Z y with
+// (A Z)^T A Z y = theta Z^T A Z y. The Gram matrix Z^T A Z is made symmetric
+// positive definite by scaling the columns to unit A-norm and dropping those
+// numerically dependent on the ones before, so with Z^T A Z = L L^T the
+// problem is the symmetric eigenproblem of L^-1 (A Z)^T A Z L^-T.
+template <class T, class I>
+void SolverSession<T, I>::updateDeflationSpace(const std::vector<T> &AW, int k, const std::vector<std::vector<T>> &P,
+                                               const std::vector<std::vector<T>> &AP)
+{
+    int n = P[0].size();
+    int q = k + P.size();
+
+    // G = Z^T A Z and F = (A Z)^T A Z, upper triangles, in one pass over the rows
+    std::vector<double> G((size_t)q * q, 0), F((size_t)q * q, 0);
+#pragma omp parallel
+    {
+        std::vector<double> G_local((size_t)q * q, 0), F_local((size_t)q * q, 0);
+        std::vector<double> z(q), az(q);
+#pragma omp for schedule(static)
+        for (int i = 0; i < n; i++)
+        {
+            for (int a = 0; a < k; a++)
+            {
+                z[a] = W[(size_t)i * k + a];
+                az[a] = AW[(size_t)i * k + a];
+            }
+            for (int a = k; a < q; a++)
+            {
+                z[a] = P[a - k][i];
+                az[a] = AP[a - k][i];
+            }
+            for (int a = 0; a < q; a++)
+            {
+                for (int c = a; c < q; c++)
+                {
+                    G_local[a * q + c] += z[a] * az[c];
+                    F_local[a * q + c] += az[a] * az[c];
+                }
+            }
+        }
+#pragma omp critical
+        for (size_t e = 0; e < G.size(); e++)
+        {
+            G[e] += G_local[e];
+            F[e] += F_local[e];
+        }
+    }
+
+    // unit A-norm columns, keeping those independent of the ones kept before
+    std::vector<double> scale(q);
+    std::vector<int> kept;
+    std::vector<double> L;
+    for (int a = 0; a < q; a++)
+    {
+        if (!(G[a * q + a] > 0))
+        {
+            continue;
+        }
+        scale[a] = 1 / sqrt(G[a * q + a]);
+        kept.push_back(a);
+        int m = kept.size();
+        L.assign((size_t)m * m, 0);
+        for (int i = 0; i < m; i++)
+        {
+            for (int j = 0; j <= i; j++)
+            {
+                int u = std::min(kept[i], kept[j]), v = std::max(kept[i], kept[j]);
+                L[i * m + j] = scale[u] * scale[v] * G[u * q + v];
+            }
+        }
+        // the last pivot is the squared A-norm of the part of column a that is
+        // A-orthogonal to the kept columns
+        if (!denseCholesky(L, m) || L[(m - 1) * m + m - 1] < 1e-4)
+        {
+            kept.pop_back();
+        }
+    }
+    int m = kept.size();
+    if (m == 0)
+    {
+        return;
+    }
+    L.assign((size_t)m * m, 0);
+    for (int i = 0; i < m; i++)
+    {
+        for (int j = 0; j <= i; j++)
+        {
+            L[i * m + j] = scale[kept[j]] * scale[kept[i]] * G[kept[j] * q + kept[i]];
+        }
+    }
+    denseCholesky(L, m);
+
+    // S = L^-1 F L^-T: Y = L^-1 F a column at a time, then L^-1 applied to
+    // the rows of Y gives the columns of S (symmetric, so stored as rows)
+    std::vector<double> S((size_t)m * m), column(m);
+    for (int j = 0; j < m; j++)
+    {
+        for (int i = 0; i < m; i++)
+        {
+            int u = std::min(kept[i], kept[j]), v = std::max(kept[i], kept[j]);
+            column[i] = scale[u] * scale[v] * F[u * q + v];
+        }
+        lowerSolve(L, m, column.data());
+        for (int i = 0; i < m; i++)
+        {
+            S[i * m + j] = column[i];
+        }
+    }
+    for (int i = 0; i < m; i++)
+    {
+        lowerSolve(L, m, &S[i * m]);
+    }
+    std::vector<double> V;
+    symmetricEigen(S, m, V);
+
+    // the vectors with the smallest harmonic Ritz values, as combinations of Z
+    std::vector<int> order(m);
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&](int u, int v) { return S[u * m + u] < S[v * m + v]; });
+    int k_new = std::min(deflation_size, m);
+    std::vector<double> coefficients((size_t)k_new * q, 0);
+    for (int j = 0; j < k_new; j++)
+    {
+        for (int i = 0; i < m; i++)
+        {
+            column[i] = V[i * m + order[j]];
+        }
+        lowerTransposeSolve(L, m, column.data());
+        for (int i = 0; i < m; i++)
+        {
+            coefficients[j * q + kept[i]] = scale[kept[i]] * column[i];
+        }
+    }
+    std::vector<T> W_new((size_t)n * k_new);
+#pragma omp parallel for schedule(static)
+    for (int i = 0; i < n; i++)
+    {
+        for (int j = 0; j < k_new; j++)
+        {
+            double sum = 0;
+            for (int a = 0; a < k; a++)
+            {
+                sum += coefficients[j * q + a] * W[(size_t)i * k + a];
+            }
+            for (int a = k; a < q; a++)
+            {
+                sum += coefficients[j * q + a] * P[a - k][i];
+            }
+            W_new[(size_t)i * k_new + j] = sum;
+        }
+    }
+
+    // unit columns
+    std::vector<double> norms(k_new, 0);
+    double *norm = norms.data();
+#pragma omp parallel for reduction(+ : norm[:k_new]) schedule(static)
+    for (int i = 0; i < n; i++)
+    {
+        for (int j = 0; j < k_new; j++)
+        {
+            norm[j] += W_new[(size_t)i * k_new + j] * W_new[(size_t)i * k_new + j];
+        }
+    }
+#pragma omp parallel for schedule(static)
+    for (int i = 0; i < n; i++)
+    {
+        for (int j = 0; j < k_new; j++)
+        {
+            W_new[(size_t)i * k_new + j] /= sqrt(norms[j]);
+        }
+    }
+    W.swap(W_new);
+    deflation_vectors = k_new;
+
+    std::cout << "deflation space: " << k_new << " harmonic Ritz vectors, values " << S[order[0] * m + order[0]]
+              << " to " << S[order[k_new - 1] * m + order[k_new - 1]] << std::endl;
+}
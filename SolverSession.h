@@ -0,0 +1,52 @@
+#pragma once
+#include "CSRMatrix.h"
+#include "Preconditioner.h"
+#include <vector>
+
+// A sequence of symmetric positive definite systems A_i x_i = b_i whose
+// matrices and right-hand sides vary slowly from one to the next, such as the
+// time steps of an implicit scheme. Each solve is a deflated CG (Saad, Yeung,
+// Erhel and Guyomarc'h) that keeps the search directions A-orthogonal to a
+// space W of approximate eigenvectors of A for its smallest eigenvalues, which
+// are the ones that slow CG down. W is recycled: after each solve it is
+// replaced by the deflation_size harmonic Ritz vectors of A with the smallest
+// harmonic Ritz values in the span of W and the first recycle_iterations
+// search directions, so it improves over the sequence.
+//  - with warm_start (the default), x is the initial guess, e.g. the solution
+//    of the previous system
+//  - A may change between solves; A W is recomputed at the start of each
+//  - each iteration reads 2 deflation_size more vectors than CG, so deflation
+//    saves time only where an iteration is expensive (a costly preconditioner
+//    or a dense stencil). With deflate_iterations off, W is only projected out
+//    of the initial residual, which costs nothing per iteration but deflates
+//    less as rounding brings W back into the Krylov space.
+//  - the update of W costs about (deflation_size + recycle_iterations)^2 dot
+//    products, once per solve
+template <class T, class I = int>
+class SolverSession
+{
+public:
+    // Solves A x = b to |b - A x| < tol, preconditioned by M when given (set
+    // up on A beforehand). Throws std::invalid_argument if the sizes differ.
+    void solve(CSRMatrix<T, I> &A, const std::vector<T> &b, std::vector<T> &x, double &tol, int &it_max,
+               Preconditioner<T, I> *M = nullptr);
+
+    // forget the deflation space, e.g. when the next system is unrelated
+    void reset();
+
+    bool warm_start = true;
+    int deflation_size = 4;
+    int recycle_iterations = 16;
+    bool deflate_iterations = true;
+
+    // iterations taken by the last solve
+    int iterations = 0;
+
+    // the deflation space: n x deflation_vectors, row-major, unit columns
+    std::vector<T> W{};
+    int deflation_vectors = 0;
+
+private:
+    void updateDeflationSpace(const std::vector<T> &AW, int k, const std::vector<std::vector<T>> &P,
+                              const std::vector<std::vector<T>> &AP);
+};
@@ -4,12 +4,49 @@
 #include <stdexcept>
 #include <vector>
 #include "utilities.h"
+#include "Reordering.h"
+#include "Symbolic.h"
+#include "Supernodal.h"
+#include "TriangularSolve.h"
+#include "Preconditioner.h"
 #include <memory>
 #include <algorithm>
 
-template <class T>
-SparseSolver<T>::SparseSolver(CSRMatrix<T> &A, std::vector<T> &b) : A(A), b(b)
+namespace
+{
+// A preconditioner set up on A, seen from the reordered system: the residual
+// is permuted back to A's ordering, M applied there, and the result permuted
+// into the reordered one, so M keeps its setup and any ordering it relies on
+template <class T, class I>
+class OriginalOrderPreconditioner : public Preconditioner<T, I>
+{
+public:
+    OriginalOrderPreconditioner(Preconditioner<T, I> &M, const std::vector<int> &perm) : M(M), perm(perm) {}
+
+    // M is already set up on A
+    void setup(CSRMatrix<T, I> &) override {}
+
+    void apply(const std::vector<T> &r, std::vector<T> &z) override
+    {
+        inversePermuteVector(r, perm, r_original);
+        z_original.resize(r.size());
+        M.apply(r_original, z_original);
+        permuteVector(z_original, perm, z);
+    }
+
+private:
+    Preconditioner<T, I> &M;
+    const std::vector<int> &perm;
+    std::vector<T> r_original{}, z_original{};
+};
+} // namespace
+
+template <class T, class I>
+SparseSolver<T, I>::SparseSolver(CSRMatrix<T, I> &A, std::vector<T> &b) : A(A), b(b)
 {
+    // The copy of A is the solver's own, so its rows can be sorted for the
+    // solvers that split rows at the diagonal
+    this->A.sortRows();
     // Check our dimensions match
     if (A.cols != b.size())
     {
@@ -19,13 +56,13 @@ SparseSolver<T>::SparseSolver(CSRMatrix<T> &A, std::vector<T> &b) : A(A), b(b)
 }
 
 // destructor
-template <class T>
-SparseSolver<T>::~SparseSolver()
+template <class T, class I>
+SparseSolver<T, I>::~SparseSolver()
 {
 }
 
-template <class T>
-T SparseSolver<T>::residualCalc(std::vector<T> &x, std::vector<T> &output_b)
+template <class T, class I>
+T SparseSolver<T, I>::residualCalc(std::vector<T> &x, std::vector<T> &output_b)
 {
     T residual = 0;
     // A x = b(estimate)
@@ -39,59 +76,156 @@ T SparseSolver<T>::residualCalc(std::vector<T> &x, std::vector<T> &output_b)
     return sqrt(residual);
 }
 
-template <class T>
-void SparseSolver<T>::stationaryIterative(std::vector<T> &x, double &tol, int &it_max, bool isGaussSeidel)
+template <class T, class I>
+SparseSolver<T, I> &SparseSolver<T, I>::reorderedSolver()
 {
-    double residual;
-    std::vector<T> output_b(x.size(), 0);
+    // sortRows and lockPattern rewrite col_index in place, so the pattern is
+    // compared entry by entry with the one the reordering was built for
+    bool same_pattern = reordered_solver != nullptr && (int)reorder_row_position.size() == A.rows + 1 &&
+                        (I)reorder_col_index.size() == A.nnzs &&
+                        std::equal(reorder_row_position.begin(), reorder_row_position.end(), &A.row_position[0]) &&
+                        std::equal(reorder_col_index.begin(), reorder_col_index.end(), &A.col_index[0]);
+    if (!same_pattern)
+    {
+        reorder_perm = reverseCuthillMcKee(A);
+        std::shared_ptr<CSRMatrix<T, I>> A_perm = permuteSymmetric(A, reorder_perm);
 
-    // vector for storing previous iteration if necessary
-    std::vector<T> x_old;
-    if (isGaussSeidel == false)
+        // Permuting a copy of A whose values are their own positions gives the
+        // position in A.values of every entry of the reordered matrix
+        std::shared_ptr<I[]> positions(new I[std::max<I>(A.nnzs, 1)]);
+        for (I k = 0; k < A.nnzs; k++)
+        {
+            positions[k] = k;
+        }
+        CSRMatrix<I, I> position_matrix(A.rows, A.cols, A.nnzs, positions, A.row_position, A.col_index);
+        std::shared_ptr<CSRMatrix<I, I>> permuted_positions = permuteSymmetric(position_matrix, reorder_perm);
+        reorder_source.assign(&permuted_positions->values[0], &permuted_positions->values[0] + A.nnzs);
+        reorder_row_position.assign(&A.row_position[0], &A.row_position[0] + A.rows + 1);
+        reorder_col_index.assign(&A.col_index[0], &A.col_index[0] + A.nnzs);
+
+        std::vector<T> b_perm;
+        permuteVector(b, reorder_perm, b_perm);
+        reordered_solver = std::shared_ptr<SparseSolver<T, I>>(new SparseSolver<T, I>(*A_perm, b_perm));
+        return *reordered_solver;
+    }
+
+    // A's values and b may have changed since the last solve
+    CSRMatrix<T, I> &A_perm = reordered_solver->A;
+    I nnzs = A.nnzs;
+#pragma omp parallel for schedule(static)
+    for (I k = 0; k < nnzs; k++)
+    {
+        A_perm.values[k] = A.values[reorder_source[k]];
+    }
+    A_perm.invalidateDiagonal();
+    permuteVector(b, reorder_perm, reordered_solver->b);
+    return *reordered_solver;
+}
+
+template <class T, class I>
+double SparseSolver<T, I>::initialResidual(std::vector<T> &x, std::vector<T> &r)
+{
+    int n = x.size();
+    r.resize(n);
+    if (!warm_start)
+    {
+        std::fill(x.begin(), x.end(), 0);
+        std::copy(b.begin(), b.end(), r.begin());
+        return sqrt(vecDotProduct(r, r));
+    }
+    A.matVecMult(x, r);
+    double rr = 0;
+#pragma omp parallel for reduction(+ : rr) schedule(static)
+    for (int i = 0; i < n; i++)
+    {
+        r[i] = b[i] - r[i];
+        rr += r[i] * r[i];
+    }
+    return sqrt(rr);
+}
+
+template <class T, class I>
+void SparseSolver<T, I>::stationaryIterative(std::vector<T> &x, double &tol, int &it_max, bool isGaussSeidel)
+{
+    if (reorder)
     {
-        x_old = std::vector<T>(x.size(), 0);
+        std::vector<T> x_perm(x.size(), 0);
+        SparseSolver<T, I> &reordered = reorderedSolver();
+        reordered.warm_start = warm_start;
+        if (warm_start)
+        {
+            permuteVector(x, reorder_perm, x_perm);
+        }
+        reordered.stationaryIterative(x_perm, tol, it_max, isGaussSeidel);
+        iterations = reordered.iterations;
+        inversePermuteVector(x_perm, reorder_perm, x);
+        return;
     }
 
+    double residual;
+    std::vector<T> output_b(x.size(), 0);
+
     // Check our dimensions match
     checkDimensions(A, b);
     checkDimensions(A, x);
 
-    // Set values to zero before hand
-    for (int i = 0; i < x.size(); i++)
+    // Set values to zero before hand, unless starting from the given x
+    if (!warm_start)
+    {
+        for (int i = 0; i < x.size(); i++)
+        {
+            x[i] = 0;
+        }
+    }
+
+    // vector for storing previous iteration if necessary
+    std::vector<T> x_old;
+    if (isGaussSeidel == false)
     {
-        x[i] = 0;
+        x_old = x;
     }
+
+    // The cached diagonal position splits each row into its lower and upper
+    // part, so the sweeps need no per-entry comparison with the row index.
+    // A.values may have changed since the last solve.
+    A.invalidateDiagonal();
+    I *diag = A.diagonalPositions();
+    T *inv_diag = A.inverseDiagonal();
+
+    // sum of a_rj * x_j over the off-diagonal entries of row r
+    auto offDiagonalSum = [&](int r, std::vector<T> &x_in) {
+        T sum = 0;
+        for (I item_index = A.row_position[r]; item_index < diag[r]; item_index++)
+        {
+            sum += A.values[item_index] * x_in[A.col_index[item_index]];
+        }
+        for (I item_index = diag[r] + 1; item_index < A.row_position[r + 1]; item_index++)
+        {
+            sum += A.values[item_index] * x_in[A.col_index[item_index]];
+        }
+        return sum;
+    };
+
     // loop up to a max number of iterations in case the solution doesn't converge
     int k;
     for (k = 0; k < it_max; k++)
     {
-        // loop over rows
-        for (int r = 0; r < A.rows; r++)
+        if (isGaussSeidel)
         {
-            // Initialise sums of aij * xj
-            T diagonal = 0;
-            T sum = 0;
-
-            // loop over non-zero values in row r
-            for (int item_index = A.row_position[r]; item_index < A.row_position[r + 1]; item_index++)
+            // Gauss-Seidel uses the values already updated in this sweep
+            for (int r = 0; r < A.rows; r++)
             {
-                int col_ind = A.col_index[item_index];
-                if (r == col_ind)
-                {
-                    // this is a diagonal element
-                    diagonal = A.values[item_index];
-                }
-                else if (!isGaussSeidel)
-                {
-                    sum += A.values[item_index] * x_old[col_ind];
-                }
-                else
-                {
-                    sum += A.values[item_index] * x[col_ind];
-                }
+                x[r] = inv_diag[r] * (b[r] - offDiagonalSum(r, x));
+            }
+        }
+        else
+        {
+            // Jacobi only reads x_old, so rows can be updated in parallel
+#pragma omp parallel for schedule(static)
+            for (int r = 0; r < A.rows; r++)
+            {
+                x[r] = inv_diag[r] * (b[r] - offDiagonalSum(r, x_old));
             }
-
-            x[r] = (1.0 / diagonal) * (b[r] - sum);
         }
 
         // Call residual calculation method
@@ -111,188 +245,1753 @@ void SparseSolver<T>::stationaryIterative(std::vector<T> &x, double &tol, int &i
             }
         }
     }
-    std::cout << "k is :" << k << std::endl;
-    std::cout << "residual is :" << residual << std::endl;
+    iterations = k;
+    std::cout << "k is :" << k << std::endl;
+    std::cout << "residual is :" << residual << std::endl;
+}
+
+template <class T, class I>
+void SparseSolver<T, I>::stationaryIterative(std::vector<T> &x, double &tol, int &it_max, Preconditioner<T, I> &M)
+{
+    if (reorder)
+    {
+        SparseSolver<T, I> &reordered = reorderedSolver();
+        reordered.warm_start = warm_start;
+        std::vector<T> x_perm(x.size(), 0);
+        if (warm_start)
+        {
+            permuteVector(x, reorder_perm, x_perm);
+        }
+        OriginalOrderPreconditioner<T, I> M_perm(M, reorder_perm);
+        reordered.stationaryIterative(x_perm, tol, it_max, M_perm);
+        iterations = reordered.iterations;
+        inversePermuteVector(x_perm, reorder_perm, x);
+        return;
+    }
+
+    // Check our dimensions match
+    checkDimensions(A, b);
+    checkDimensions(A, x);
+
+    int n = x.size();
+    std::vector<T> r;
+    std::vector<T> correction(n, 0);
+    double residual = initialResidual(x, r);
+
+    int k;
+    for (k = 0; k < it_max && residual >= tol; k++)
+    {
+        M.apply(r, correction);
+#pragma omp parallel for schedule(static)
+        for (int i = 0; i < n; i++)
+        {
+            x[i] += correction[i];
+        }
+
+        // r = b - A x
+        A.matVecMult(x, r);
+        residual = 0.0;
+#pragma omp parallel for reduction(+ : residual) schedule(static)
+        for (int i = 0; i < n; i++)
+        {
+            r[i] = b[i] - r[i];
+            residual += r[i] * r[i];
+        }
+        residual = sqrt(residual);
+
+        if (residual < tol)
+        {
+            break;
+        }
+    }
+    iterations = k;
+    std::cout << "k is :" << k << std::endl;
+    std::cout << "residual is :" << residual << std::endl;
+}
+
+template <class T, class I>
+void SparseSolver<T, I>::sor(std::vector<T> &x, double &tol, int &it_max, double omega, bool symmetric)
+{
+    if (!sor_preconditioner)
+    {
+        sor_preconditioner = std::make_shared<MulticolourSORPreconditioner<T, I>>();
+    }
+    if (reorder)
+    {
+        // the reordered solver keeps its own colouring of the reordered matrix
+        std::vector<T> x_perm(x.size(), 0);
+        SparseSolver<T, I> &reordered = reorderedSolver();
+        reordered.warm_start = warm_start;
+        if (warm_start)
+        {
+            permuteVector(x, reorder_perm, x_perm);
+        }
+        reordered.sor(x_perm, tol, it_max, omega, symmetric);
+        iterations = reordered.iterations;
+        inversePermuteVector(x_perm, reorder_perm, x);
+        return;
+    }
+    sor_preconditioner->omega = omega;
+    sor_preconditioner->symmetric = symmetric;
+    sor_preconditioner->setup(A);
+    stationaryIterative(x, tol, it_max, *sor_preconditioner);
+}
+
+template <class T, class I>
+void SparseSolver<T, I>::chebyshev(std::vector<T> &x, double &tol, int &it_max, bool jacobi_scaled, double lambda_min,
+                                   double lambda_max)
+{
+    if (reorder)
+    {
+        std::vector<T> x_perm(x.size(), 0);
+        SparseSolver<T, I> &reordered = reorderedSolver();
+        reordered.warm_start = warm_start;
+        reordered.residual_check_interval = residual_check_interval;
+        reordered.chebyshev_lanczos_steps = chebyshev_lanczos_steps;
+        reordered.chebyshev_lower_fraction = chebyshev_lower_fraction;
+        if (warm_start)
+        {
+            permuteVector(x, reorder_perm, x_perm);
+        }
+        reordered.chebyshev(x_perm, tol, it_max, jacobi_scaled, lambda_min, lambda_max);
+        iterations = reordered.iterations;
+        inversePermuteVector(x_perm, reorder_perm, x);
+        return;
+    }
+
+    // Check our dimensions match
+    checkDimensions(A, b);
+    checkDimensions(A, x);
+    // A.values may have changed since the last solve
+    A.invalidateDiagonal();
+
+    // Too small an upper bound makes the iteration diverge, so the largest Ritz
+    // value, which a few Lanczos steps find from below, is widened by a margin.
+    // The smallest Ritz value lies above the true lambda_min and converges to
+    // it only after about as many steps as CG takes, so it is no lower bound
+    // and is not used: lambda_min is a fraction of lambda_max instead. Too
+    // large a lower bound only slows convergence.
+    if (lambda_max <= 0)
+    {
+        lambda_max = 1.1 * lanczosSpectrum(A, chebyshev_lanczos_steps, jacobi_scaled).lambda_max;
+    }
+    if (lambda_min <= 0)
+    {
+        lambda_min = chebyshev_lower_fraction * lambda_max;
+    }
+    if (!(lambda_min > 0 && lambda_max > lambda_min))
+    {
+        throw std::invalid_argument("Chebyshev needs 0 < lambda_min < lambda_max");
+    }
+
+    int n = x.size();
+    std::vector<T> r;
+    double residual = initialResidual(x, r);
+    T *inv_diag = A.inverseDiagonal();
+
+    // Saad, Algorithm 12.1, with the preconditioner D or the identity
+    double theta = 0.5 * (lambda_max + lambda_min);
+    double delta = 0.5 * (lambda_max - lambda_min);
+    double sigma = theta / delta;
+    double rho = 1 / sigma;
+    std::vector<T> d(n), Ad(n, 0);
+#pragma omp parallel for schedule(static)
+    for (int i = 0; i < n; i++)
+    {
+        d[i] = (jacobi_scaled ? inv_diag[i] : 1) * r[i] / theta;
+    }
+
+    int interval = std::max(residual_check_interval, 1);
+    int k;
+    for (k = 0; k < it_max && residual >= tol; k++)
+    {
+        double rho_new = 1 / (2 * sigma - rho);
+        double d_scale = rho_new * rho;
+        double r_scale = 2 * rho_new / delta;
+        A.matVecMult(d, Ad);
+#pragma omp parallel for schedule(static)
+        for (int i = 0; i < n; i++)
+        {
+            x[i] += d[i];
+            r[i] -= Ad[i];
+            d[i] = d_scale * d[i] + r_scale * (jacobi_scaled ? inv_diag[i] : 1) * r[i];
+        }
+        rho = rho_new;
+
+        if ((k + 1) % interval == 0 || k == it_max - 1)
+        {
+            residual = sqrt(vecDotProduct(r, r));
+            if (residual < tol)
+            {
+                break;
+            }
+        }
+    }
+    iterations = k;
+    std::cout << "k is :" << k << std::endl;
+    std::cout << "residual is :" << residual << std::endl;
+}
+
+template <class T, class I>
+void SparseSolver<T, I>::conjugateGradient(std::vector<T> &x, double &tol, int &it_max)
+{
+    if (reorder)
+    {
+        std::vector<T> x_perm(x.size(), 0);
+        SparseSolver<T, I> &reordered = reorderedSolver();
+        reordered.cg_variant = cg_variant;
+        reordered.mixed_precision = mixed_precision;
+        reordered.reliable_update_delta = reliable_update_delta;
+        reordered.warm_start = warm_start;
+        if (warm_start)
+        {
+            permuteVector(x, reorder_perm, x_perm);
+        }
+        reordered.conjugateGradient(x_perm, tol, it_max);
+        iterations = reordered.iterations;
+        inversePermuteVector(x_perm, reorder_perm, x);
+        return;
+    }
+    if (mixed_precision)
+    {
+        mixedPrecisionCG(x, tol, it_max);
+        return;
+    }
+    if (cg_variant != CGVariant::Standard)
+    {
+        communicationReducingCG(x, tol, it_max, nullptr);
+        return;
+    }
+
+    double residual;
+    double alpha;
+    double beta;
+    std::vector<T> output_b(x.size(), 0);
+    std::vector<T> residue_vec(x.size(), 0);
+    std::vector<T> p(x.size(), 0);
+    std::vector<T> Ap_product(x.size(), 0);
+    std::vector<T> r_old(x.size(), 0);
+
+    // Check our dimensions match
+    checkDimensions(A, b);
+    checkDimensions(A, x);
+
+    // Find the norm between old value and new guess
+    residual = initialResidual(x, r_old);
+    p = r_old;
+
+    // r.r is carried over from the residual norm of the previous iteration,
+    // so each iteration needs two reductions: p.Ap and the new r.r
+    double rr = residual * residual;
+    int n = x.size();
+    int k;
+    for (k = 0; k < it_max && residual >= tol; k++)
+    {
+        A.matVecMult(p, Ap_product);
+
+        // Calculate alpha gradient
+        alpha = rr / vecDotProduct(p, Ap_product);
+
+        residual = 0.0;
+#pragma omp parallel for reduction(+ : residual) schedule(static)
+        for (int i = 0; i < n; i++)
+        {
+            x[i] += alpha * p[i];
+            residue_vec[i] = r_old[i] - alpha * Ap_product[i];
+            residual += residue_vec[i] * residue_vec[i];
+        }
+
+        // Calculate beta gradient
+        beta = residual / rr;
+        rr = residual;
+        residual = sqrt(residual);
+
+        if (residual < tol)
+        {
+            break;
+        }
+
+#pragma omp parallel for schedule(static)
+        for (int i = 0; i < n; i++)
+        {
+            p[i] = residue_vec[i] + beta * p[i];
+
+            // Update "old"(k) residue vector with new residue (k+1)
+            // for next iteration
+            r_old[i] = residue_vec[i];
+        }
+    }
+    iterations = k;
+    std::cout << "k is :" << k << std::endl;
+    std::cout << "residual is :" << residual << std::endl;
+}
+
+template <class T, class I>
+void SparseSolver<T, I>::conjugateGradient(std::vector<T> &x, double &tol, int &it_max, Preconditioner<T, I> &M)
+{
+    if (reorder)
+    {
+        SparseSolver<T, I> &reordered = reorderedSolver();
+        reordered.cg_variant = cg_variant;
+        reordered.warm_start = warm_start;
+        std::vector<T> x_perm(x.size(), 0);
+        if (warm_start)
+        {
+            permuteVector(x, reorder_perm, x_perm);
+        }
+        OriginalOrderPreconditioner<T, I> M_perm(M, reorder_perm);
+        reordered.conjugateGradient(x_perm, tol, it_max, M_perm);
+        iterations = reordered.iterations;
+        inversePermuteVector(x_perm, reorder_perm, x);
+        return;
+    }
+    if (cg_variant != CGVariant::Standard)
+    {
+        communicationReducingCG(x, tol, it_max, &M);
+        return;
+    }
+
+    // Check our dimensions match
+    checkDimensions(A, b);
+    checkDimensions(A, x);
+
+    int n = x.size();
+    std::vector<T> r;
+    std::vector<T> z(n, 0);
+    std::vector<T> p(n, 0);
+    std::vector<T> Ap_product(n, 0);
+
+    double residual = initialResidual(x, r);
+    M.apply(r, z);
+    p = z;
+    double rz = 0;
+#pragma omp parallel for reduction(+ : rz) schedule(static)
+    for (int i = 0; i < n; i++)
+    {
+        rz += r[i] * z[i];
+    }
+
+    int k;
+    for (k = 0; k < it_max && residual >= tol; k++)
+    {
+        A.matVecMult(p, Ap_product);
+
+        double pAp = 0;
+#pragma omp parallel for reduction(+ : pAp) schedule(static)
+        for (int i = 0; i < n; i++)
+        {
+            pAp += p[i] * Ap_product[i];
+        }
+        double alpha = rz / pAp;
+
+        residual = 0.0;
+#pragma omp parallel for reduction(+ : residual) schedule(static)
+        for (int i = 0; i < n; i++)
+        {
+            x[i] += alpha * p[i];
+            r[i] -= alpha * Ap_product[i];
+            residual += r[i] * r[i];
+        }
+        residual = sqrt(residual);
+
+        if (residual < tol)
+        {
+            break;
+        }
+
+        M.apply(r, z);
+        double rz_new = 0;
+#pragma omp parallel for reduction(+ : rz_new) schedule(static)
+        for (int i = 0; i < n; i++)
+        {
+            rz_new += r[i] * z[i];
+        }
+        double beta = rz_new / rz;
+        rz = rz_new;
+#pragma omp parallel for schedule(static)
+        for (int i = 0; i < n; i++)
+        {
+            p[i] = z[i] + beta * p[i];
+        }
+    }
+    iterations = k;
+    std::cout << "k is :" << k << std::endl;
+    std::cout << "residual is :" << residual << std::endl;
+}
+
+namespace
+{
+// CG for the correction to x, iterated in precision W on A_w, with reliable
+// updates: the correction is added to x and the true residual b - A x is
+// recomputed in T whenever the iterated residual has dropped by delta from its
+// largest value since the last update, or below tol. Continues the iteration
+// count k. With detect_stagnation, returns false if the true residual stops
+// decreasing, which happens when A_w is too inaccurate for the condition
+// number of A, with x reset to the best solution found.
+template <class W, class T, class I>
+bool reliableUpdateCG(CSRMatrix<T, I> &A, CSRMatrix<W, I> &A_w, const std::vector<T> &b, std::vector<T> &x, double tol,
+                      int it_max, double delta, bool detect_stagnation, int &k, double &residual)
+{
+    int n = A.rows;
+    std::vector<T> r(n);
+    std::vector<W> r_w(n), x_w(n, 0), p(n), Ap(n);
+
+    // r = b - A x in T, rounded into r_w; returns r.r
+    auto trueResidual = [&]() {
+        A.matVecMult(x, r);
+        double rr = 0;
+#pragma omp parallel for reduction(+ : rr) schedule(static)
+        for (int i = 0; i < n; i++)
+        {
+            r[i] = b[i] - r[i];
+            r_w[i] = r[i];
+            rr += r[i] * r[i];
+        }
+        return rr;
+    };
+
+    double rr = trueResidual();
+    residual = sqrt(rr);
+    double best = residual;    // smallest true residual so far, at x_best
+    std::vector<T> x_best(detect_stagnation ? x : std::vector<T>());
+    double largest = residual; // largest iterated residual since the last update
+    int stalled = 0;           // reliable updates in a row that did not improve on best
+    std::copy(r_w.begin(), r_w.end(), p.begin());
+    if (residual < tol)
+    {
+        return true;
+    }
+
+    for (; k < it_max; k++)
+    {
+        A_w.matVecMult(p, Ap);
+        double pAp = 0;
+#pragma omp parallel for reduction(+ : pAp) schedule(static)
+        for (int i = 0; i < n; i++)
+        {
+            pAp += (double)p[i] * Ap[i];
+        }
+        if (!(pAp > 0) && detect_stagnation)
+        {
+            x = x_best;
+            residual = best;
+            return false;
+        }
+        double alpha = rr / pAp;
+
+        double rr_new = 0;
+#pragma omp parallel for reduction(+ : rr_new) schedule(static)
+        for (int i = 0; i < n; i++)
+        {
+            x_w[i] += alpha * p[i];
+            r_w[i] -= alpha * Ap[i];
+            rr_new += (double)r_w[i] * r_w[i];
+        }
+        residual = sqrt(rr_new);
+        largest = std::max(largest, residual);
+
+        if (residual < delta * largest || residual < tol)
+        {
+#pragma omp parallel for schedule(static)
+            for (int i = 0; i < n; i++)
+            {
+                x[i] += x_w[i];
+                x_w[i] = 0;
+            }
+            rr_new = trueResidual();
+            residual = sqrt(rr_new);
+            largest = residual;
+            if (residual < tol)
+            {
+                break;
+            }
+            if (detect_stagnation && residual < best)
+            {
+                best = residual;
+                x_best = x;
+                stalled = 0;
+            }
+            else if (detect_stagnation && ++stalled == 2)
+            {
+                x = x_best;
+                residual = best;
+                return false;
+            }
+        }
+
+        double beta = rr_new / rr;
+        rr = rr_new;
+#pragma omp parallel for schedule(static)
+        for (int i = 0; i < n; i++)
+        {
+            p[i] = r_w[i] + beta * p[i];
+        }
+    }
+    return true;
+}
+} // namespace
+
+template <class T, class I>
+void SparseSolver<T, I>::mixedPrecisionCG(std::vector<T> &x, double &tol, int &it_max)
+{
+    // Check our dimensions match
+    checkDimensions(A, b);
+    checkDimensions(A, x);
+    if (!warm_start)
+    {
+        std::fill(x.begin(), x.end(), 0);
+    }
+
+    // A in single precision, sharing the pattern arrays
+    I nnzs = A.nnzs;
+    std::shared_ptr<float[]> values(new float[std::max<I>(nnzs, 1)]);
+#pragma omp parallel for schedule(static)
+    for (I k = 0; k < nnzs; k++)
+    {
+        values[k] = A.values[k];
+    }
+    CSRMatrix<float, I> A_single(A.rows, A.cols, nnzs, values, A.row_position, A.col_index);
+
+    int k = 0;
+    double residual;
+    if (!reliableUpdateCG(A, A_single, b, x, tol, it_max, reliable_update_delta, true, k, residual))
+    {
+        std::cout << "single precision CG stagnated at residual " << residual << ", continuing in full precision"
+                  << std::endl;
+        reliableUpdateCG(A, A, b, x, tol, it_max, reliable_update_delta, false, k, residual);
+    }
+    iterations = k;
+    std::cout << "k is :" << k << std::endl;
+    std::cout << "residual is :" << residual << std::endl;
+}
+
+// Chronopoulos-Gear and pipelined (Ghysels-Vanroose) CG, preconditioned by M
+// when given. Both use the recurrences s = A p, w = A u (and for the pipelined
+// variant q = M s, z = A q) so that alpha and beta follow from r.u and w.u alone:
+// beta = gamma / gamma_old, alpha = gamma / (delta - beta gamma / alpha_old).
+template <class T, class I>
+void SparseSolver<T, I>::communicationReducingCG(std::vector<T> &x, double &tol, int &it_max, Preconditioner<T, I> *M)
+{
+    // Check our dimensions match
+    checkDimensions(A, b);
+    checkDimensions(A, x);
+
+    int n = x.size();
+    const I *row_position = A.row_position.get();
+    const int *col_index = A.col_index.get();
+    const T *values = A.values.get();
+    auto rowProduct = [&](const std::vector<T> &v, int i) {
+        T sum = 0;
+        for (I k = row_position[i]; k < row_position[i + 1]; k++)
+        {
+            sum += values[k] * v[col_index[k]];
+        }
+        return sum;
+    };
+
+    std::vector<T> r(b), u(n), w(n), p(n, 0), s(n, 0);
+    // pipelined only: m = M w (w itself without a preconditioner), A m, q = M s and z = A q
+    bool pipelined = cg_variant == CGVariant::Pipelined;
+    std::vector<T> m_work(pipelined && M ? n : 0), product(pipelined ? n : 0);
+    std::vector<T> q(pipelined ? n : 0, 0), z(pipelined ? n : 0, 0);
+    const std::vector<T> &m = M ? m_work : w;
+    if (!warm_start)
+    {
+        std::fill(x.begin(), x.end(), 0);
+    }
+
+    double gamma, delta, rr;
+    double gamma_old = 1, alpha_old = 1;
+    double residual = 0;
+    bool first = true;
+
+    // (Re)start from the true residual b - A x. The recurrences drift from it
+    // (the pipelined ones most), so convergence is confirmed on it, and the
+    // iteration restarts from it if the updated residual was too optimistic.
+    auto restart = [&]() {
+        A.matVecMult(x, w);
+        double true_rr = 0;
+#pragma omp parallel for reduction(+ : true_rr) schedule(static)
+        for (int i = 0; i < n; i++)
+        {
+            r[i] = b[i] - w[i];
+            p[i] = s[i] = 0;
+            true_rr += r[i] * r[i];
+        }
+        std::fill(q.begin(), q.end(), 0);
+        std::fill(z.begin(), z.end(), 0);
+        if (M)
+        {
+            M->apply(r, u);
+        }
+        else
+        {
+            u = r;
+        }
+        if (pipelined)
+        {
+            A.matVecMult(u, w);
+        }
+        first = true;
+        residual = sqrt(true_rr);
+        return residual < tol;
+    };
+    auto coefficients = [&](double &alpha, double &beta) {
+        beta = first ? 0 : gamma / gamma_old;
+        alpha = first ? gamma / delta : gamma / (delta - beta * gamma / alpha_old);
+        gamma_old = gamma;
+        alpha_old = alpha;
+        first = false;
+    };
+    restart();
+
+    int k;
+    for (k = 0; k < it_max; k++)
+    {
+        gamma = delta = rr = 0;
+        if (!pipelined)
+        {
+            // w = A u with the inner products in the same sweep: the only
+            // reduction of the iteration
+#pragma omp parallel for reduction(+ : gamma, delta, rr) schedule(static)
+            for (int i = 0; i < n; i++)
+            {
+                w[i] = rowProduct(u, i);
+                gamma += r[i] * u[i];
+                delta += w[i] * u[i];
+                rr += r[i] * r[i];
+            }
+        }
+        else
+        {
+            if (M)
+            {
+                M->apply(w, m_work);
+            }
+            // The reduction does not depend on A m, so threads go on to the
+            // SpMV as soon as their part of it is done
+#pragma omp parallel
+            {
+#pragma omp for reduction(+ : gamma, delta, rr) schedule(static) nowait
+                for (int i = 0; i < n; i++)
+                {
+                    gamma += r[i] * u[i];
+                    delta += w[i] * u[i];
+                    rr += r[i] * r[i];
+                }
+#pragma omp for schedule(static)
+                for (int i = 0; i < n; i++)
+                {
+                    product[i] = rowProduct(m, i);
+                }
+            }
+        }
+        residual = sqrt(rr);
+        if (residual < tol)
+        {
+            if (restart())
+            {
+                break;
+            }
+            // the updated residual had drifted: go on from the true one
+            continue;
+        }
+
+        double alpha, beta;
+        coefficients(alpha, beta);
+        if (!pipelined)
+        {
+#pragma omp parallel for schedule(static)
+            for (int i = 0; i < n; i++)
+            {
+                p[i] = u[i] + beta * p[i];
+                s[i] = w[i] + beta * s[i];
+                x[i] += alpha * p[i];
+                r[i] -= alpha * s[i];
+            }
+            if (M)
+            {
+                M->apply(r, u);
+            }
+            else
+            {
+                u = r;
+            }
+        }
+        else
+        {
+#pragma omp parallel for schedule(static)
+            for (int i = 0; i < n; i++)
+            {
+                z[i] = product[i] + beta * z[i];
+                q[i] = m[i] + beta * q[i];
+                s[i] = w[i] + beta * s[i];
+                p[i] = u[i] + beta * p[i];
+                x[i] += alpha * p[i];
+                r[i] -= alpha * s[i];
+                u[i] -= alpha * q[i];
+                w[i] -= alpha * z[i];
+            }
+        }
+    }
+    iterations = k;
+    std::cout << "k is :" << k << std::endl;
+    std::cout << "residual is :" << residual << std::endl;
+}
+
+namespace
+{
+template <class T>
+double parallelDot(const T *u, const T *v, int n)
+{
+    double sum = 0;
+#pragma omp parallel for reduction(+ : sum) schedule(static)
+    for (int i = 0; i < n; i++)
+    {
+        sum += u[i] * v[i];
+    }
+    return sum;
+}
+} // namespace
+
+template <class T, class I>
+void SparseSolver<T, I>::gmres(std::vector<T> &x, double &tol, int &it_max, int restart, Preconditioner<T, I> *M,
+                               GramSchmidt orthogonalisation)
+{
+    if (reorder)
+    {
+        SparseSolver<T, I> &reordered = reorderedSolver();
+        reordered.warm_start = warm_start;
+        std::vector<T> x_perm(x.size(), 0);
+        if (warm_start)
+        {
+            permuteVector(x, reorder_perm, x_perm);
+        }
+        std::shared_ptr<OriginalOrderPreconditioner<T, I>> M_perm_ptr;
+        if (M)
+        {
+            M_perm_ptr = std::make_shared<OriginalOrderPreconditioner<T, I>>(*M, reorder_perm);
+        }
+        reordered.gmres(x_perm, tol, it_max, restart, M_perm_ptr.get(), orthogonalisation);
+        iterations = reordered.iterations;
+        inversePermuteVector(x_perm, reorder_perm, x);
+        return;
+    }
+
+    // Check our dimensions match
+    checkDimensions(A, b);
+    checkDimensions(A, x);
+
+    int n = x.size();
+    int m = std::max(1, std::min(restart, n));
+
+    // Workspace for the whole solve: the basis V (m + 1 vectors of length n,
+    // stored one after the other), the Hessenberg matrix H column by column,
+    // its Givens rotations and the rotated right-hand side g
+    std::vector<T> V((size_t)(m + 1) * n);
+    std::vector<T> H((size_t)(m + 1) * m);
+    std::vector<T> cs(m), sn(m), g(m + 1), y(m), projection(m);
+    std::vector<T> w(n), z(n);
+
+    if (!warm_start)
+    {
+        std::fill(x.begin(), x.end(), 0);
+    }
+    double residual = 0;
+    int k = 0;
+    while (true)
+    {
+        // r = b - A x into the first basis vector
+        T *v0 = V.data();
+        A.matVecMult(x, w);
+#pragma omp parallel for schedule(static)
+        for (int i = 0; i < n; i++)
+        {
+            v0[i] = b[i] - w[i];
+        }
+        residual = sqrt(parallelDot(v0, v0, n));
+        if (residual < tol || k >= it_max)
+        {
+            break;
+        }
+#pragma omp parallel for schedule(static)
+        for (int i = 0; i < n; i++)
+        {
+            v0[i] /= residual;
+        }
+        std::fill(g.begin(), g.end(), 0);
+        g[0] = residual;
+
+        int j;
+        for (j = 0; j < m && k < it_max; j++, k++)
+        {
+            // w = A M^-1 v_j
+            T *v_j = V.data() + (size_t)j * n;
+            std::copy(v_j, v_j + n, z.begin());
+            if (M)
+            {
+                M->apply(z, w);
+                z.swap(w);
+            }
+            A.matVecMult(z, w);
+
+            T *h = H.data() + (size_t)j * (m + 1);
+            if (orthogonalisation == GramSchmidt::Modified)
+            {
+                for (int l = 0; l <= j; l++)
+                {
+                    const T *v_l = V.data() + (size_t)l * n;
+                    h[l] = parallelDot(w.data(), v_l, n);
+#pragma omp parallel for schedule(static)
+                    for (int i = 0; i < n; i++)
+                    {
+                        w[i] -= h[l] * v_l[i];
+                    }
+                }
+            }
+            else
+            {
+                // h = V^T w and w -= V h, twice, each pass reducing all j + 1
+                // products together
+                std::fill(h, h + j + 1, 0);
+                for (int pass = 0; pass < 2; pass++)
+                {
+                    std::fill(projection.begin(), projection.begin() + j + 1, 0);
+                    T *p = projection.data();
+                    const T *basis = V.data();
+                    int count = j + 1;
+#pragma omp parallel for reduction(+ : p[:count]) schedule(static)
+                    for (int i = 0; i < n; i++)
+                    {
+                        for (int l = 0; l < count; l++)
+                        {
+                            p[l] += basis[(size_t)l * n + i] * w[i];
+                        }
+                    }
+#pragma omp parallel for schedule(static)
+                    for (int i = 0; i < n; i++)
+                    {
+                        T sum = 0;
+                        for (int l = 0; l < count; l++)
+                        {
+                            sum += basis[(size_t)l * n + i] * p[l];
+                        }
+                        w[i] -= sum;
+                    }
+                    for (int l = 0; l < count; l++)
+                    {
+                        h[l] += p[l];
+                    }
+                }
+            }
+            h[j + 1] = sqrt(parallelDot(w.data(), w.data(), n));
+
+            T *v_next = V.data() + (size_t)(j + 1) * n;
+            if (h[j + 1] != 0)
+            {
+#pragma omp parallel for schedule(static)
+                for (int i = 0; i < n; i++)
+                {
+                    v_next[i] = w[i] / h[j + 1];
+                }
+            }
+
+            // Apply the previous rotations to the new column, then eliminate h[j + 1]
+            for (int l = 0; l < j; l++)
+            {
+                T temp = cs[l] * h[l] + sn[l] * h[l + 1];
+                h[l + 1] = -sn[l] * h[l] + cs[l] * h[l + 1];
+                h[l] = temp;
+            }
+            T denominator = sqrt(h[j] * h[j] + h[j + 1] * h[j + 1]);
+            cs[j] = h[j] / denominator;
+            sn[j] = h[j + 1] / denominator;
+            h[j] = denominator;
+            h[j + 1] = 0;
+            g[j + 1] = -sn[j] * g[j];
+            g[j] = cs[j] * g[j];
+
+            // |g[j + 1]| is the residual norm of the current iterate
+            if (fabs(g[j + 1]) < tol)
+            {
+                j++;
+                k++;
+                break;
+            }
+        }
+
+        // y = H^-1 g by back substitution, then x += M^-1 V y
+        for (int l = j - 1; l >= 0; l--)
+        {
+            T sum = g[l];
+            for (int c = l + 1; c < j; c++)
+            {
+                sum -= H[(size_t)c * (m + 1) + l] * y[c];
+            }
+            y[l] = sum / H[(size_t)l * (m + 1) + l];
+        }
+        const T *basis = V.data();
+#pragma omp parallel for schedule(static)
+        for (int i = 0; i < n; i++)
+        {
+            T sum = 0;
+            for (int l = 0; l < j; l++)
+            {
+                sum += basis[(size_t)l * n + i] * y[l];
+            }
+            z[i] = sum;
+        }
+        if (M)
+        {
+            M->apply(z, w);
+        }
+        else
+        {
+            std::copy(z.begin(), z.end(), w.begin());
+        }
+#pragma omp parallel for schedule(static)
+        for (int i = 0; i < n; i++)
+        {
+            x[i] += w[i];
+        }
+    }
+    iterations = k;
+    std::cout << "k is :" << k << std::endl;
+    std::cout << "residual is :" << residual << std::endl;
+}
+
+template <class T, class I>
+void SparseSolver<T, I>::bicgstab(std::vector<T> &x, double &tol, int &it_max, Preconditioner<T, I> *M)
+{
+    if (reorder)
+    {
+        SparseSolver<T, I> &reordered = reorderedSolver();
+        reordered.warm_start = warm_start;
+        std::vector<T> x_perm(x.size(), 0);
+        if (warm_start)
+        {
+            permuteVector(x, reorder_perm, x_perm);
+        }
+        std::shared_ptr<OriginalOrderPreconditioner<T, I>> M_perm_ptr;
+        if (M)
+        {
+            M_perm_ptr = std::make_shared<OriginalOrderPreconditioner<T, I>>(*M, reorder_perm);
+        }
+        reordered.bicgstab(x_perm, tol, it_max, M_perm_ptr.get());
+        iterations = reordered.iterations;
+        inversePermuteVector(x_perm, reorder_perm, x);
+        return;
+    }
+
+    // Check our dimensions match
+    checkDimensions(A, b);
+    checkDimensions(A, x);
+
+    int n = x.size();
+    std::vector<T> r;
+    std::vector<T> p(n, 0), v(n, 0), s(n), t(n);
+    std::vector<T> p_hat(n), s_hat(n);
+
+    double rho = 1, alpha = 1, omega = 1;
+    double residual = initialResidual(x, r);
+    std::vector<T> r_hat(r);
+
+    // The updated residual drifts away from b - A x when it passes through
+    // large values, so convergence is confirmed on the true residual, and the
+    // iteration restarts from it (also after a breakdown) when not converged
+    auto restart = [&]() {
+        A.matVecMult(x, t);
+        residual = 0;
+#pragma omp parallel for reduction(+ : residual) schedule(static)
+        for (int i = 0; i < n; i++)
+        {
+            r[i] = b[i] - t[i];
+            r_hat[i] = r[i];
+            p[i] = 0;
+            v[i] = 0;
+            residual += r[i] * r[i];
+        }
+        residual = sqrt(residual);
+        rho = alpha = omega = 1;
+        return residual < tol;
+    };
+
+    int k;
+    for (k = 0; k < it_max; k++)
+    {
+        if (residual < tol && restart())
+        {
+            break;
+        }
+        double rho_new = parallelDot(r_hat.data(), r.data(), n);
+        if (rho_new == 0)
+        {
+            // r is orthogonal to the shadow residual
+            restart();
+            continue;
+        }
+        double beta = (rho_new / rho) * (alpha / omega);
+        rho = rho_new;
+#pragma omp parallel for schedule(static)
+        for (int i = 0; i < n; i++)
+        {
+            p[i] = r[i] + beta * (p[i] - omega * v[i]);
+        }
+
+        if (M)
+        {
+            M->apply(p, p_hat);
+        }
+        else
+        {
+            p_hat = p;
+        }
+        A.matVecMult(p_hat, v);
+        alpha = rho / parallelDot(r_hat.data(), v.data(), n);
+
+        double s_norm = 0;
+#pragma omp parallel for reduction(+ : s_norm) schedule(static)
+        for (int i = 0; i < n; i++)
+        {
+            s[i] = r[i] - alpha * v[i];
+            s_norm += s[i] * s[i];
+        }
+        if (sqrt(s_norm) < tol)
+        {
+            // half step: x + alpha p_hat is already converged
+#pragma omp parallel for schedule(static)
+            for (int i = 0; i < n; i++)
+            {
+                x[i] += alpha * p_hat[i];
+            }
+            if (restart())
+            {
+                k++;
+                break;
+            }
+            continue;
+        }
+
+        if (M)
+        {
+            M->apply(s, s_hat);
+        }
+        else
+        {
+            s_hat = s;
+        }
+        A.matVecMult(s_hat, t);
+        double ts = 0, tt = 0;
+#pragma omp parallel for reduction(+ : ts, tt) schedule(static)
+        for (int i = 0; i < n; i++)
+        {
+            ts += t[i] * s[i];
+            tt += t[i] * t[i];
+        }
+        omega = tt == 0 ? 0 : ts / tt;
+
+        residual = 0;
+#pragma omp parallel for reduction(+ : residual) schedule(static)
+        for (int i = 0; i < n; i++)
+        {
+            x[i] += alpha * p_hat[i] + omega * s_hat[i];
+            r[i] = s[i] - omega * t[i];
+            residual += r[i] * r[i];
+        }
+        residual = sqrt(residual);
+        if (omega == 0)
+        {
+            // stagnation
+            restart();
+        }
+    }
+    iterations = k;
+    std::cout << "k is :" << k << std::endl;
+    std::cout << "residual is :" << residual << std::endl;
+}
+
+namespace
+{
+// Dense kernels for the block solvers. A block of vectors is n x w and
+// row-major, as for CSRMatrix::matMultiVecMult, and the small matrices are
+// w x w. As in spmmFixedWidth, common widths get a compile-time K so the loops
+// over the block are unrolled and vectorised; K = 0 takes the width at run time.
+constexpr int block_tile = 64;
+
+// G = X^T Y, a tile of rows at a time: each column of X against the whole
+// tile of Y, which stays in cache, with the row of G in registers
+template <int K, class T>
+void blockGramKernel(const T *X, const T *Y, int width, int n, double *G)
+{
+    const int w = K ? K : width;
+    int tiles = (n + block_tile - 1) / block_tile;
+#pragma omp parallel
+    {
+        std::vector<double> local((size_t)w * w, 0);
+#pragma omp for schedule(static)
+        for (int t = 0; t < tiles; t++)
+        {
+            int end = std::min(n, (t + 1) * block_tile);
+            for (int a = 0; a < w; a++)
+            {
+                double *g = &local[a * w];
+                if constexpr (K > 0)
+                {
+                    double sum[K] = {};
+                    for (int i = t * block_tile; i < end; i++)
+                    {
+                        const double x = X[(size_t)i * K + a];
+                        const T *y = Y + (size_t)i * K;
+                        // unrolled so that sum is kept in registers at -O2
+#pragma GCC unroll 32
+                        for (int c = 0; c < K; c++)
+                        {
+                            sum[c] += x * y[c];
+                        }
+                    }
+                    for (int c = 0; c < K; c++)
+                    {
+                        g[c] += sum[c];
+                    }
+                }
+                else
+                {
+                    for (int i = t * block_tile; i < end; i++)
+                    {
+                        const double x = X[(size_t)i * w + a];
+                        const T *y = Y + (size_t)i * w;
+                        for (int c = 0; c < w; c++)
+                        {
+                            g[c] += x * y[c];
+                        }
+                    }
+                }
+            }
+        }
+#pragma omp critical
+        for (int a = 0; a < w * w; a++)
+        {
+            G[a] += local[a];
+        }
+    }
+}
+
+// Y += scale X C, a row at a time
+template <int K, class T>
+void blockUpdateKernel(T *Y, const T *X, const double *C, int width, int n, double scale)
+{
+    const int w = K ? K : width;
+#pragma omp parallel for schedule(static)
+    for (int i = 0; i < n; i++)
+    {
+        const T *x = X + (size_t)i * w;
+        T *y = Y + (size_t)i * w;
+        if constexpr (K > 0)
+        {
+            double sum[K];
+            for (int c = 0; c < K; c++)
+            {
+                sum[c] = y[c];
+            }
+            for (int a = 0; a < K; a++)
+            {
+                const double coefficient = scale * x[a];
+#pragma omp simd
+                for (int c = 0; c < K; c++)
+                {
+                    sum[c] += coefficient * C[a * K + c];
+                }
+            }
+            for (int c = 0; c < K; c++)
+            {
+                y[c] = sum[c];
+            }
+        }
+        else
+        {
+            for (int a = 0; a < w; a++)
+            {
+                const double coefficient = scale * x[a];
+                for (int c = 0; c < w; c++)
+                {
+                    y[c] += coefficient * C[a * w + c];
+                }
+            }
+        }
+    }
+}
+
+template <class T>
+void blockGram(const std::vector<T> &X, const std::vector<T> &Y, int width, int n, std::vector<double> &G)
+{
+    G.assign((size_t)width * width, 0);
+    switch (width)
+    {
+    case 4:
+        blockGramKernel<4>(X.data(), Y.data(), width, n, G.data());
+        return;
+    case 8:
+        blockGramKernel<8>(X.data(), Y.data(), width, n, G.data());
+        return;
+    case 16:
+        blockGramKernel<16>(X.data(), Y.data(), width, n, G.data());
+        return;
+    case 32:
+        blockGramKernel<32>(X.data(), Y.data(), width, n, G.data());
+        return;
+    }
+    blockGramKernel<0>(X.data(), Y.data(), width, n, G.data());
+}
+
+template <class T>
+void blockUpdate(std::vector<T> &Y, const std::vector<T> &X, const std::vector<double> &C, int width, int n,
+                 double scale)
+{
+    switch (width)
+    {
+    case 4:
+        blockUpdateKernel<4>(Y.data(), X.data(), C.data(), width, n, scale);
+        return;
+    case 8:
+        blockUpdateKernel<8>(Y.data(), X.data(), C.data(), width, n, scale);
+        return;
+    case 16:
+        blockUpdateKernel<16>(Y.data(), X.data(), C.data(), width, n, scale);
+        return;
+    case 32:
+        blockUpdateKernel<32>(Y.data(), X.data(), C.data(), width, n, scale);
+        return;
+    }
+    blockUpdateKernel<0>(Y.data(), X.data(), C.data(), width, n, scale);
+}
+
+// Cholesky factorisation G = L L^T in place (lower triangle) with symmetric
+// pivoting on the largest remaining diagonal. Stops when that falls below
+// relative_tol times the largest initial diagonal and returns the rank;
+// the pivot order is returned in order.
+inline int pivotedCholesky(std::vector<double> &G, int k, std::vector<int> &order, double relative_tol)
+{
+    order.resize(k);
+    double largest = 0;
+    for (int j = 0; j < k; j++)
+    {
+        order[j] = j;
+        largest = std::max(largest, G[j * k + j]);
+    }
+    for (int j = 0; j < k; j++)
+    {
+        int q = j;
+        for (int i = j + 1; i < k; i++)
+        {
+            if (G[i * k + i] > G[q * k + q])
+            {
+                q = i;
+            }
+        }
+        if (!(G[q * k + q] > relative_tol * largest))
+        {
+            return j;
+        }
+        if (q != j)
+        {
+            for (int l = 0; l < k; l++)
+            {
+                std::swap(G[j * k + l], G[q * k + l]);
+            }
+            for (int l = 0; l < k; l++)
+            {
+                std::swap(G[l * k + j], G[l * k + q]);
+            }
+            std::swap(order[j], order[q]);
+        }
+        double d = sqrt(G[j * k + j]);
+        G[j * k + j] = d;
+        for (int i = j + 1; i < k; i++)
+        {
+            G[i * k + j] /= d;
+            G[j * k + i] = G[i * k + j];
+        }
+        for (int i = j + 1; i < k; i++)
+        {
+            for (int l = j + 1; l < k; l++)
+            {
+                G[i * k + l] -= G[i * k + j] * G[l * k + j];
+            }
+        }
+    }
+    return k;
+}
+
+// Orthonormal basis of the columns of Z (n x w) by Cholesky QR with pivoting.
+// The columns are scaled to unit norm first, so a direction is dropped when it
+// is dependent on the others to within drop_tol, whatever the size of the
+// residuals; that bounds the condition number of what is kept, so one pass
+// is orthogonal to about eps / drop_tol^2, plenty for a basis. Returns the
+// rank; the basis is in the first rank columns of P and the others are zero.
+template <class T>
+int orthonormalBasis(const std::vector<T> &Z, int w, int n, std::vector<T> &P, double drop_tol = 1e-6)
+{
+    std::vector<double> G;
+    blockGram(Z, Z, w, n, G);
+    std::vector<double> scale(w);
+    for (int c = 0; c < w; c++)
+    {
+        double norm = sqrt(G[c * w + c]);
+        scale[c] = norm > 0 ? 1 / norm : 0;
+    }
+    for (int a = 0; a < w; a++)
+    {
+        for (int c = 0; c < w; c++)
+        {
+            G[a * w + c] *= scale[a] * scale[c];
+        }
+    }
+    std::vector<int> order;
+    int rank = pivotedCholesky(G, w, order, drop_tol * drop_tol);
+
+    // P = Z S Pi L^-T, with S the scaling and Pi the pivoting
+    std::vector<double> C((size_t)w * w, 0);
+    std::vector<double> column(w);
+    for (int j = 0; j < rank; j++)
+    {
+        column[j] = 1 / G[j * w + j];
+        for (int r = j - 1; r >= 0; r--)
+        {
+            double sum = 0;
+            for (int l = r + 1; l <= j; l++)
+            {
+                sum += G[l * w + r] * column[l];
+            }
+            column[r] = -sum / G[r * w + r];
+        }
+        for (int r = 0; r <= j; r++)
+        {
+            C[order[r] * w + j] = scale[order[r]] * column[r];
+        }
+    }
+    std::fill(P.begin(), P.end(), 0);
+    blockUpdate(P, Z, C, w, n, 1.0);
+    return rank;
+}
+
+// Solve S C = F for the leading k x k block of S (w x w, symmetric positive
+// definite) and the first k rows of F (w x w), in place in F; the other rows
+// of F are zeroed
+inline void smallSPDSolve(std::vector<double> S, int k, int w, std::vector<double> &F)
+{
+    for (int j = 0; j < k; j++)
+    {
+        double d = S[j * w + j];
+        for (int l = 0; l < j; l++)
+        {
+            d -= S[j * w + l] * S[j * w + l];
+        }
+        if (!(d > 0))
+        {
+            throw std::invalid_argument("Block CG needs a symmetric positive definite matrix");
+        }
+        d = sqrt(d);
+        S[j * w + j] = d;
+        for (int i = j + 1; i < k; i++)
+        {
+            double sum = S[i * w + j];
+            for (int l = 0; l < j; l++)
+            {
+                sum -= S[i * w + l] * S[j * w + l];
+            }
+            S[i * w + j] = sum / d;
+        }
+    }
+    for (int c = 0; c < w; c++)
+    {
+        for (int i = 0; i < k; i++)
+        {
+            double sum = F[i * w + c];
+            for (int l = 0; l < i; l++)
+            {
+                sum -= S[i * w + l] * F[l * w + c];
+            }
+            F[i * w + c] = sum / S[i * w + i];
+        }
+        for (int i = k - 1; i >= 0; i--)
+        {
+            double sum = F[i * w + c];
+            for (int l = i + 1; l < k; l++)
+            {
+                sum -= S[l * w + i] * F[l * w + c];
+            }
+            F[i * w + c] = sum / S[i * w + i];
+        }
+    }
+    std::fill(F.begin() + (size_t)k * w, F.end(), 0);
+}
+} // namespace
+
+// Block CG (O'Leary) in the breakdown-free form of Ji and Li: the search
+// directions P are an orthonormal basis of the active residuals plus the
+// previous directions, computed with a rank-revealing Cholesky QR, so that
+// converged right-hand sides and linearly dependent directions drop out.
+// All blocks keep n_rhs columns, zero where a column is converged or a
+// direction has been dropped, so the dense kernels run at a fixed width.
+template <class T, class I>
+void SparseSolver<T, I>::blockConjugateGradient(std::vector<T> &X, const std::vector<T> &B, int n_rhs, double &tol,
+                                                int &it_max)
+{
+    int n = A.rows;
+    int s = n_rhs;
+    if (A.rows != A.cols || B.size() != (size_t)n * s || (warm_start && X.size() != (size_t)n * s))
+    {
+        throw std::invalid_argument("Dimensions don't match");
+    }
+    if (!warm_start)
+    {
+        X.assign((size_t)n * s, 0);
+    }
+
+    if (reorder)
+    {
+        SparseSolver<T, I> &reordered = reorderedSolver();
+        reordered.warm_start = warm_start;
+        std::vector<T> B_perm((size_t)n * s), X_perm((size_t)n * s);
+        for (int i = 0; i < n; i++)
+        {
+            std::copy(&B[(size_t)reorder_perm[i] * s], &B[(size_t)reorder_perm[i] * s] + s, &B_perm[(size_t)i * s]);
+            std::copy(&X[(size_t)reorder_perm[i] * s], &X[(size_t)reorder_perm[i] * s] + s, &X_perm[(size_t)i * s]);
+        }
+        reordered.blockConjugateGradient(X_perm, B_perm, s, tol, it_max);
+        iterations = reordered.iterations;
+        for (int i = 0; i < n; i++)
+        {
+            std::copy(&X_perm[(size_t)i * s], &X_perm[(size_t)i * s] + s, &X[(size_t)reorder_perm[i] * s]);
+        }
+        return;
+    }
+
+    std::vector<T> R(B);
+    std::vector<T> P((size_t)n * s), Q((size_t)n * s), Z((size_t)n * s);
+    if (warm_start)
+    {
+        // R = B - A X, using Q as the workspace
+        A.matMultiVecMult(X, s, Q);
+#pragma omp parallel for schedule(static)
+        for (size_t i = 0; i < (size_t)n * s; i++)
+        {
+            R[i] -= Q[i];
+        }
+    }
+    std::vector<double> PtQ, coefficients, QtZ;
+    std::vector<double> norms(s);
+    std::vector<char> active(s);
+    int n_active = 0;
+
+    // residual norms, and Z = the residuals still above tol, zero for the others
+    auto activeResiduals = [&]() {
+        std::fill(norms.begin(), norms.end(), 0);
+        double *norm = norms.data();
+        const T *r = R.data();
+#pragma omp parallel for reduction(+ : norm[:s]) schedule(static)
+        for (int i = 0; i < n; i++)
+        {
+            for (int c = 0; c < s; c++)
+            {
+                norm[c] += r[(size_t)i * s + c] * r[(size_t)i * s + c];
+            }
+        }
+        n_active = 0;
+        for (int c = 0; c < s; c++)
+        {
+            norms[c] = sqrt(norms[c]);
+            active[c] = norms[c] >= tol;
+            n_active += active[c];
+        }
+#pragma omp parallel for schedule(static)
+        for (int i = 0; i < n; i++)
+        {
+            for (int c = 0; c < s; c++)
+            {
+                Z[(size_t)i * s + c] = active[c] ? R[(size_t)i * s + c] : 0;
+            }
+        }
+    };
+
+    activeResiduals();
+    int k = orthonormalBasis(Z, s, n, P);
+    int it;
+    for (it = 0; it < it_max && n_active > 0 && k > 0; it++)
+    {
+        // Q = A P, one sparse product for the whole block
+        A.matMultiVecMult(P, s, Q);
+
+        // alpha = (P^T A P)^-1 P^T R; X += P alpha, R -= Q alpha
+        blockGram(P, Q, s, n, PtQ);
+        blockGram(P, R, s, n, coefficients);
+        smallSPDSolve(PtQ, k, s, coefficients);
+        blockUpdate(X, P, coefficients, s, n, 1.0);
+        blockUpdate(R, Q, coefficients, s, n, -1.0);
+
+        activeResiduals();
+        if (n_active == 0)
+        {
+            it++;
+            break;
+        }
+
+        // beta = -(P^T A P)^-1 Q^T Z, then P = orth(Z + P beta)
+        blockGram(Q, Z, s, n, QtZ);
+        smallSPDSolve(PtQ, k, s, QtZ);
+        blockUpdate(Z, P, QtZ, s, n, -1.0);
+        k = orthonormalBasis(Z, s, n, P);
+    }
+    iterations = it;
+
+    double largest = 0;
+    for (double norm : norms)
+    {
+        largest = std::max(largest, norm);
+    }
+    std::cout << "k is :" << it << std::endl;
+    std::cout << "largest residual is :" << largest << std::endl;
+}
+
+// Key of the symbolic caches: the pattern of A and the ordering requested
+template <class T, class I>
+uint64_t SparseSolver<T, I>::symbolicKey()
+{
+    return A.patternHash() ^ (((uint64_t)ordering + 1) * 0x9E3779B97F4A7C15ULL);
+}
+
+template <class T, class I>
+void SparseSolver<T, I>::clearSymbolicCaches()
+{
+    lu_symbolic_cache.clear();
+    cholesky_symbolic_cache.clear();
+}
+
+template <class T, class I>
+std::shared_ptr<SymbolicAnalysis<T, I>> SparseSolver<T, I>::findSymbolic(
+    std::map<uint64_t, std::shared_ptr<SymbolicAnalysis<T, I>>> &cache, uint64_t key)
+{
+    auto cached = cache.find(key);
+    if (cached == cache.end())
+    {
+        return nullptr;
+    }
+    SymbolicAnalysis<T, I> &analysis = *cached->second;
+    if (analysis.cols != A.cols || (int)analysis.row_position.size() != A.rows + 1 ||
+        !std::equal(analysis.row_position.begin(), analysis.row_position.end(), &A.row_position[0]) ||
+        !std::equal(analysis.col_index.begin(), analysis.col_index.end(), &A.col_index[0]))
+    {
+        return nullptr;
+    }
+    analysis.last_used = ++symbolic_cache_clock;
+    return cached->second;
+}
+
+template <class T, class I>
+void SparseSolver<T, I>::storeSymbolic(std::map<uint64_t, std::shared_ptr<SymbolicAnalysis<T, I>>> &cache,
+                                       uint64_t key, std::shared_ptr<SymbolicAnalysis<T, I>> analysis)
+{
+    analysis->cols = A.cols;
+    analysis->row_position.assign(&A.row_position[0], &A.row_position[0] + A.rows + 1);
+    analysis->col_index.assign(&A.col_index[0], &A.col_index[0] + A.nnzs);
+    analysis->last_used = ++symbolic_cache_clock;
+    // a colliding entry for another pattern is replaced
+    cache[key] = analysis;
+    while (cache.size() > std::max<size_t>(symbolic_cache_size, 1))
+    {
+        auto oldest = cache.end();
+        for (auto entry = cache.begin(); entry != cache.end(); ++entry)
+        {
+            if (entry->first != key && (oldest == cache.end() || entry->second->last_used < oldest->second->last_used))
+            {
+                oldest = entry;
+            }
+        }
+        cache.erase(oldest);
+    }
+}
+
+template <class T, class I>
+void SparseSolver<T, I>::recordFactor(const std::shared_ptr<int[]> &pattern, const SymbolicAnalysis<T, I> &analysis)
+{
+    factor_orderings.erase(std::remove_if(factor_orderings.begin(), factor_orderings.end(),
+                                          [](const FactorOrdering<I> &record) { return record.pattern.expired(); }),
+                           factor_orderings.end());
+    for (const FactorOrdering<I> &record : factor_orderings)
+    {
+        if (record.pattern.lock() == pattern)
+        {
+            return;
+        }
+    }
+    factor_orderings.push_back({pattern, analysis.perm, analysis.supernodes});
+}
+
+template <class T, class I>
+const FactorOrdering<I> *SparseSolver<T, I>::factorOrdering(CSRMatrix<T, I> &factor)
+{
+    for (const FactorOrdering<I> &record : factor_orderings)
+    {
+        if (record.pattern.lock() == factor.col_index)
+        {
+            return &record;
+        }
+    }
+    return nullptr;
 }
 
-template <class T>
-void SparseSolver<T>::conjugateGradient(std::vector<T> &x, double &tol, int &it_max)
+// Fill-reducing ordering of a symmetric pattern, empty for the natural order.
+// With FillOrdering::Automatic, AMD and (for larger systems) nested dissection
+// are compared on the fill they predict.
+template <class T, class I>
+std::vector<int> SparseSolver<T, I>::fillReducingOrdering(const AdjacencyGraph<I> &graph)
 {
-    double residual;
-    double alpha;
-    double beta;
-    std::vector<T> output_b(x.size(), 0);
-    std::vector<T> residue_vec(x.size(), 0);
-    std::vector<T> p(x.size(), 0);
-    std::vector<T> Ap_product(x.size(), 0);
-    std::vector<T> r_old(x.size(), 0);
-
-    // Check our dimensions match
-    checkDimensions(A, b);
-    checkDimensions(A, x);
-
-    // Set values to zero before hand
-    for (int i = 0; i < x.size(); i++)
+    if (ordering == FillOrdering::Natural)
     {
-        x[i] = 0;
+        return {};
     }
-
-    // Find the norm between old value and new guess
-    for (int i = 0; i < x.size(); i++)
+    if (ordering == FillOrdering::AMD)
     {
-        r_old[i] = b[i];
-        p[i] = r_old[i];
+        return approximateMinimumDegree(graph);
     }
-
-    int k;
-    for (k = 0; k < it_max; k++)
+    if (ordering == FillOrdering::NestedDissection)
     {
-        A.matVecMult(p, Ap_product);
-
-        // Calculate alpha gradient
-        alpha = vecDotProduct(r_old, r_old) / vecDotProduct(p, Ap_product);
+        return nestedDissection(graph);
+    }
 
-        residual = 0.0;
-        for (int i = 0; i < x.size(); i++)
+    std::vector<int> perm = approximateMinimumDegree(graph);
+    if (graph.n >= 10000)
+    {
+        std::vector<int> nd_perm = nestedDissection(graph);
+        I amd_fill = choleskyFillCount(permuteGraph(graph, perm));
+        I nd_fill = choleskyFillCount(permuteGraph(graph, nd_perm));
+        std::cout << "predicted nnz(L) with AMD: " << amd_fill << ", nested dissection: " << nd_fill << std::endl;
+        if (nd_fill < amd_fill)
         {
-            x[i] += alpha * p[i];
-            residue_vec[i] = r_old[i] - alpha * Ap_product[i];
-            residual += pow(residue_vec[i], 2.0);
+            perm.swap(nd_perm);
         }
+    }
+    return perm;
+}
 
-        residual = sqrt(residual);
+// Symbolic LU: without pivoting the fill of L and U is contained in the
+// Cholesky fill of A + A^T, so the pattern is L + L^T from the elimination tree
+// of the symmetrised (and reordered) pattern. Cached by the pattern of A.
+template <class T, class I>
+std::shared_ptr<CSRMatrix<T, I>> SparseSolver<T, I>::lu_symbolic()
+{
+    checkDimensions(A, b);
 
-        if (residual < tol)
+    uint64_t key = symbolicKey();
+    std::shared_ptr<SymbolicAnalysis<T, I>> cached = findSymbolic(lu_symbolic_cache, key);
+    if (cached)
+    {
+        lu_analysis = cached;
+        recordFactor(lu_analysis->pattern->col_index, *lu_analysis);
+        return lu_analysis->pattern;
+    }
+
+    auto analysis = std::make_shared<SymbolicAnalysis<T, I>>();
+    AdjacencyGraph<I> graph = buildAdjacency(A);
+    analysis->perm = fillReducingOrdering(graph);
+    if (!analysis->perm.empty())
+    {
+        graph = permuteGraph(graph, analysis->perm);
+    }
+    SymbolicFactor<I> factor = symbolicCholesky(graph);
+    int n = factor.n;
+
+    // row i of L (ending at the diagonal) followed by column i of L below the diagonal
+    I nnzs = 2 * factor.nnz() - n;
+    std::shared_ptr<CSRMatrix<T, I>> LU(new CSRMatrix<T, I>(n, n, nnzs, true));
+    LU->row_position[0] = 0;
+    for (int i = 0; i < n; i++)
+    {
+        LU->row_position[i + 1] = LU->row_position[i] + factor.row_counts[i] + factor.col_counts[i] - 1;
+    }
+#pragma omp parallel for schedule(dynamic, 256)
+    for (int i = 0; i < n; i++)
+    {
+        I out = LU->row_position[i];
+        for (I k = factor.row_position[i]; k < factor.row_position[i + 1]; k++)
         {
-            break;
+            LU->col_index[out++] = factor.col_index[k];
         }
-
-        // Calculate beta gradient
-        beta = vecDotProduct(residue_vec, residue_vec) / vecDotProduct(r_old, r_old);
-        for (int i = 0; i < x.size(); i++)
+        for (I k = factor.col_position[i] + 1; k < factor.col_position[i + 1]; k++)
         {
-            p[i] = residue_vec[i] + beta * p[i];
-
-            // Update "old"(k) residue vector with new residue (k+1)
-            // for next iteration
-            r_old[i] = residue_vec[i];
+            LU->col_index[out++] = factor.row_index[k];
         }
     }
-    std::cout << "k is :" << k << std::endl;
-    std::cout << "residual is :" << residual << std::endl;
+    analysis->pattern = LU;
+    analysis->predicted_nnzs = nnzs;
+    std::cout << "LU symbolic: predicted nnz(L + U) = " << nnzs << " for nnz(A) = " << A.nnzs << std::endl;
+
+    storeSymbolic(lu_symbolic_cache, key, analysis);
+    lu_analysis = analysis;
+    recordFactor(LU->col_index, *analysis);
+    return LU;
 }
 
-// LU decomposition
-template <class T>
-std::shared_ptr<CSRMatrix<T>> SparseSolver<T>::lu_decomp()
+// Numeric LU into a matrix that already holds the symbolic pattern
+template <class T, class I>
+void SparseSolver<T, I>::lu_numeric(CSRMatrix<T, I> &LU)
 /*
 LU decomposition
 Algorithm based on similar method as in 'Numerical recipes C++'.
-The input matrix A is copied to LU, which is modified 'in place'.
-Uses Crout's method by setting U_ii = 1.
-Partial pivoting is implemented to ensure the stability of the method.
-Implicit pivoting used to make it independent of scaling of equations.
-An extensions would be to create a pivoting scheme that minimised the 
-number of non-zero elements.
+The values of LU are computed 'in place' on the pattern from lu_symbolic.
+Uses Doolittle's method, with L_ii = 1 implied and U_ii stored on the diagonal.
+No pivoting is done, so the diagonal of A must stay non-zero during elimination.
+The rows and columns are in the fill-reducing order chosen by lu_symbolic.
 */
 {
-    int n, max_ind, i, j, k, row_start, row_start2, row_len, col_indx;
-    n = A.rows;
-    T max, temp, piv_el;
-
-    checkDimensions(A, b);
+    if (!lu_analysis)
+    {
+        lu_symbolic();
+    }
+    // the factorisation is of P A P^T for the fill-reducing ordering P that
+    // LU's pattern was built with, which need not be the last analysis
+    const FactorOrdering<I> *recorded = factorOrdering(LU);
+    const std::vector<int> &order = recorded ? recorded->perm : lu_analysis->perm;
+    std::shared_ptr<CSRMatrix<T, I>> permuted;
+    if (!order.empty())
+    {
+        permuted = permuteSymmetric(A, order);
+    }
+    CSRMatrix<T, I> &A = permuted ? *permuted : this->A;
 
-    std::vector<int> perm_indx(n);    // Store index of permutation
-    std::vector<T> scaling(n);        // Store implicit scaling of each row
-    std::vector<T> pivot_elements(n); // Store implicit scaling of each row
+    int n = A.rows;
+    T max, temp;
 
-    // Implicit scaling, find max in each row and store scaling factor
-    for (i = 0; i < n; i++)
+    // A row of zeros makes the matrix singular
+    for (int i = 0; i < n; i++)
     {
         max = 0.0;
-        row_start = A.row_position[i];
-        row_len = A.row_position[i + 1] - row_start;
-        for (j = 0; j < row_len; j++)
+        for (I j = A.row_position[i]; j < A.row_position[i + 1]; j++)
         {
-            temp = abs(A.values[row_start + j]);
+            temp = abs(A.values[j]);
             if (temp > max)
                 max = temp;
         }
         if (max == 0)
             throw std::invalid_argument("Matrix is singular");
-        scaling[i] = 1.0 / max;
     }
 
-    bool matching = false;
-
-    CSRMatrix<T> matrix_before = A;
-    std::shared_ptr<CSRMatrix<T>> LU;
-    while (!matching)
-    {
-        LU = matrix_before.matMatMultSymbolic(matrix_before);
-
-        if (matrix_before.nnzs != LU->nnzs || matrix_before.rows != LU->rows)
-        {
-            // If they are not the same size
-            matrix_before = *LU;
-            continue;
-        }
-
-        bool allSame = true;
-
-        for (int i = 0; i < LU->rows; i++)
-        {
-            if (matrix_before.row_position[i] != LU->row_position[i])
-            {
-                allSame = false;
-                break;
-            }
-        }
-
-        if (!allSame)
-        {
-            matrix_before = *LU;
-            continue;
-        }
-
-        for (int i = 0; i < LU->nnzs; i++)
-        {
-            if (matrix_before.col_index[i] != LU->col_index[i])
-            {
-                allSame = false;
-                break;
-            }
-        }
-
-        if (!allSame)
-        {
-            matrix_before = *LU;
-            continue;
-        }
-
-        matching = true;
-    }
+    LU.zeroValues();
+    I *LU_diag = LU.diagonalPositions();
 
     // the lower and upper triangular matrix values are stored in the LU matrix
     // loop over rows of LU
-    for (int row = 0; row < LU->rows; row++)
+    for (int row = 0; row < LU.rows; row++)
     {
         // loop over non-zero columns in that row
-        for (int cii = LU->row_position[row]; cii < LU->row_position[row + 1]; cii++)
+        for (I cii = LU.row_position[row]; cii < LU.row_position[row + 1]; cii++)
         {
             // col index of a non-zero
-            int col = LU->col_index[cii];
-
-            // first element is simply equal to A_00
-            if (col == 0 && row == 0)
-            {
-                LU->values[0] = A.values[0];
-                continue;
-            }
+            int col = LU.col_index[cii];
 
             T a_ij = 0.0;
             // search in our original matrix for a_ij
-            for (int a_row_pos = A.row_position[row]; a_row_pos < A.row_position[row + 1]; a_row_pos++)
+            for (I a_row_pos = A.row_position[row]; a_row_pos < A.row_position[row + 1]; a_row_pos++)
             {
                 if (A.col_index[a_row_pos] == col)
                 {
@@ -307,10 +2006,10 @@ number of non-zero elements.
             // sum over alpha_ik * beta_kj
             // look for values in same row first, if they exist check for col equivalents
             T valsum = 0.0;
-            for (int col_vec_ind = LU->row_position[row]; col_vec_ind < LU->row_position[row + 1]; col_vec_ind++)
+            for (I col_vec_ind = LU.row_position[row]; col_vec_ind < LU.row_position[row + 1]; col_vec_ind++)
             {
                 // check on this row, preceding the current value
-                int k = LU->col_index[col_vec_ind];
+                int k = LU.col_index[col_vec_ind];
 
                 // if k is above cutoff, break the loop
                 if (k > cutoff)
@@ -319,14 +2018,14 @@ number of non-zero elements.
                 }
 
                 // if alpha_ik is non-zero
-                if (LU->values[col_vec_ind])
+                if (LU.values[col_vec_ind])
                 {
                     // check whether corresponding beta_kj also exists -> add to valsum
-                    for (int tempcols = LU->row_position[k]; tempcols < LU->row_position[k + 1]; tempcols++)
+                    for (I tempcols = LU.row_position[k]; tempcols < LU.row_position[k + 1]; tempcols++)
                     {
-                        if (LU->col_index[tempcols] == col)
+                        if (LU.col_index[tempcols] == col)
                         {
-                            valsum += (LU->values[col_vec_ind] * LU->values[tempcols]);
+                            valsum += (LU.values[col_vec_ind] * LU.values[tempcols]);
                         }
                     }
                 }
@@ -335,333 +2034,446 @@ number of non-zero elements.
             if (col >= row)
             {
                 // this means that we are in the upper triangle or the diagonal (U)
-                LU->values[cii] = a_ij - valsum;
+                LU.values[cii] = a_ij - valsum;
             }
             else if (col < row)
             {
                 // we are in the lower triangle (L)
                 // we need the beta value from the LU_jj above
-                T b_jj = 0.0;
-
-                for (int LU_vals_index = LU->row_position[col]; LU_vals_index < LU->row_position[col + 1]; LU_vals_index++)
-                {
-                    int temp_col_ind = LU->col_index[LU_vals_index];
-                    if (temp_col_ind == col)
-                    {
-                        b_jj = LU->values[LU_vals_index];
-                        break;
-                    }
-                }
+                T b_jj = LU.values[LU_diag[col]];
 
                 if (b_jj == 0)
                 {
                     std::cerr << "Error: b_jj is zero" << std::endl;
                 }
 
-                LU->values[cii] = (1.0 / b_jj) * (a_ij - valsum);
+                LU.values[cii] = (1.0 / b_jj) * (a_ij - valsum);
             }
         }
     }
-
-    return LU;
+    LU.invalidateDiagonal();
 }
 
-// Linear solver that uses LU decomposition
-template <class T>
-void SparseSolver<T>::lu_solve(CSRMatrix<T> &LU, std::vector<int> &perm_indx, std::vector<T> &x)
-// Solve the equations L*y = b and U*x = y to find x.
+// LU decomposition: symbolic analysis (reused while the pattern of A is
+// unchanged) followed by the numeric factorisation
+template <class T, class I>
+std::shared_ptr<CSRMatrix<T, I>> SparseSolver<T, I>::lu_decomp()
 {
-    int n, ip, i, j, row_start, row_len, col_start, col_indx;
-    n = LU.rows;
-    T sum;
+    std::shared_ptr<CSRMatrix<T, I>> pattern = lu_symbolic();
 
-    checkDimensions(A, x);
+    // The factor shares row_position and col_index with the cached pattern
+    std::shared_ptr<T[]> values(new T[std::max<I>(pattern->nnzs, 1)]);
+    std::shared_ptr<CSRMatrix<T, I>> LU(new CSRMatrix<T, I>(pattern->rows, pattern->cols, pattern->nnzs, values,
+                                                            pattern->row_position, pattern->col_index));
+    lu_numeric(*LU);
+    return LU;
+}
 
-    // The unknown x will be used as temporary storage for y.
-    // The equations for forward and backward substitution have
-    // been simplified by combining (b and sum) and (y and sum).
-    for (i = 0; i < n; i++)
+// LU decomposition with threshold partial pivoting, left-looking by columns
+// (Gilbert-Peierls): column k of L and U comes from the sparse triangular
+// solve L x = B(:, k), whose pattern is found by a depth-first search in the
+// graph of L, so the work is proportional to the flops and nnz(L + U).
+// B = P A P^T for the fill-reducing ordering of lu_symbolic. In each column
+// the diagonal is kept as the pivot if |x_kk| >= threshold * max |x_ik| over the
+// candidate rows, which preserves the ordering; otherwise the largest entry is
+// taken. threshold = 1 is classic partial pivoting.
+// The row interchanges are returned in perm_indx as the sequential swaps used
+// by lu_solve.
+template <class T, class I>
+std::shared_ptr<CSRMatrix<T, I>> SparseSolver<T, I>::lu_decomp(std::vector<int> &perm_indx, double threshold)
+{
+    // the ordering, and the fill of the unpivoted factor as a size estimate
+    std::shared_ptr<CSRMatrix<T, I>> estimate = lu_symbolic();
+    std::shared_ptr<CSRMatrix<T, I>> permuted;
+    if (!lu_analysis->perm.empty())
     {
-        x[i] = b[i];
+        permuted = permuteSymmetric(A, lu_analysis->perm);
     }
-    // Perform forward substitution to solve L*y = b.
-    // Need to keep track of permutation of RHS as well
-    for (i = 0; i < n; i++)
+    CSRMatrix<T, I> &B = permuted ? *permuted : A;
+    int n = B.rows;
+
+    // columns of B
+    std::vector<I> Bp(n + 1, 0);
+    std::vector<int> Bi(B.nnzs);
+    std::vector<T> Bx(B.nnzs);
+    for (I k = 0; k < B.nnzs; k++)
     {
-        ip = perm_indx[i];
-        sum = x[ip];
-        x[ip] = x[i];
-        // row_start = LU.row_position[i];
-        // row_len = LU.row_position[i + 1] - row_start;
-        for (j = LU.row_position[i]; j < LU.row_position[i + 1]; j++)
-        {
-            col_indx = LU.col_index[j];
-            // check if valid and exits loop to avoid uneccesary checks
-            if (col_indx >= i)
-                break;
-            sum -= LU.values[j] * x[col_indx];
-        }
-        x[i] = sum;
+        Bp[B.col_index[k] + 1]++;
     }
-
-    // Perform backward substitution to solve U*x = y
-    // Here x = y before being updated.
-    for (i = n - 1; i >= 0; i--)
+    for (int j = 0; j < n; j++)
     {
-        sum = x[i];
-        row_start = LU.row_position[i];
-        row_len = LU.row_position[i + 1] - row_start;
-        for (j = 0; j < row_len; j++)
-        {
-            col_indx = LU.col_index[row_start + j];
-            if (col_indx >= i + 1)
-                sum -= LU.values[row_start + j] * x[col_indx];
-        }
-        // Find diagonal element
-        for (j = 0; j < row_len; j++)
+        Bp[j + 1] += Bp[j];
+    }
+    std::vector<I> next(Bp.begin(), Bp.end() - 1);
+    for (int i = 0; i < n; i++)
+    {
+        for (I k = B.row_position[i]; k < B.row_position[i + 1]; k++)
         {
-            col_indx = LU.col_index[row_start + j];
-            if (col_indx == i)
-            {
-                x[i] = sum / LU.values[row_start + j];
-                break;
-            }
+            I dest = next[B.col_index[k]]++;
+            Bi[dest] = i;
+            Bx[dest] = B.values[k];
         }
     }
-}
-
-template <class T>
-std::shared_ptr<CSRMatrix<T>> SparseSolver<T>::cholesky_decomp()
-{
-    // for now, we assume output has been preallocated
-    std::vector<T> R_values{};
-    std::vector<int> R_cols{};
-    std::vector<int> R_row_position(A.rows + 1, 0);
 
-    // loop over rows of A
-    for (int i = 0; i < A.rows; i++)
+    // L by columns with the unit diagonal first, rows as rows of B until the
+    // end; U by columns with rows as pivot steps and the diagonal last
+    std::vector<I> Lp(n + 1, 0), Up(n + 1, 0);
+    std::vector<int> Li, Ui;
+    std::vector<T> Lx, Ux;
+    Li.reserve(estimate->nnzs / 2 + n);
+    Lx.reserve(estimate->nnzs / 2 + n);
+    Ui.reserve(estimate->nnzs / 2 + n);
+    Ux.reserve(estimate->nnzs / 2 + n);
+
+    std::vector<int> pinv(n, -1); // pivot step of each row of B
+    std::vector<int> xi(n), stack(n), mark(n, -1);
+    std::vector<I> resume(n);
+    std::vector<T> x(n, 0);
+
+    for (int k = 0; k < n; k++)
     {
-        // rows indices of left matrix
-        int r_start = A.row_position[i];
-        int r_end = A.row_position[i + 1];
+        Lp[k] = Li.size();
+        Up[k] = Ui.size();
 
-        // loop over column indices for this row in A - equivalent to rows in B
-        std::vector<int> cols_nnzs{};
-        // cii - index of col_index of R array
-        int ci = 0;
-        std::vector<int> infills_left{};
-        for (int cii = r_start; (cii < r_end && ci < i); cii++)
+        // Pattern of x: rows reachable from B(:, k) through pivoted columns
+        // of L, left in xi[top ... n) in topological order
+        int top = n;
+        for (I p = Bp[k]; p < Bp[k + 1]; p++)
         {
-            ci = A.col_index[cii];
-
-            for (int k = 0; k < ci; k++)
+            if (mark[Bi[p]] == k)
             {
-                if (cii != r_start && k == A.col_index[cii - 1])
+                continue;
+            }
+            int head = 0;
+            stack[0] = Bi[p];
+            while (head >= 0)
+            {
+                int j = stack[head];
+                int J = pinv[j];
+                if (mark[j] != k)
                 {
-                    infills_left.push_back(A.col_index[cii - 1]);
+                    mark[j] = k;
+                    resume[head] = J < 0 ? 0 : Lp[J] + 1;
                 }
-                for (int r = 0; r < k && k > 0; r++)
+                I end = J < 0 ? 0 : Lp[J + 1];
+                bool done = true;
+                for (I q = resume[head]; q < end; q++)
                 {
-                    int r_start_above = A.row_position[r];
-                    int r_end_above = A.row_position[r + 1];
-                    for (int a = r_start_above; a < r_end_above; a++)
+                    int i = Li[q];
+                    if (mark[i] != k)
                     {
-                        if (infills_left.size() > 0 && A.col_index[a] == k)
-                        {
-                            cols_nnzs.push_back(k);
-                        }
+                        resume[head] = q + 1;
+                        stack[++head] = i;
+                        done = false;
+                        break;
                     }
                 }
+                if (done)
+                {
+                    head--;
+                    xi[--top] = j;
+                }
+            }
+        }
+
+        // Numeric sparse triangular solve
+        for (I p = Bp[k]; p < Bp[k + 1]; p++)
+        {
+            x[Bi[p]] = Bx[p];
+        }
+        for (int px = top; px < n; px++)
+        {
+            int j = xi[px];
+            int J = pinv[j];
+            if (J < 0)
+            {
+                continue;
             }
-            if (ci < i)
+            T x_j = x[j];
+            for (I q = Lp[J] + 1; q < Lp[J + 1]; q++)
             {
-                cols_nnzs.push_back(ci);
+                x[Li[q]] -= Lx[q] * x_j;
             }
         }
-        cols_nnzs.push_back(i);
-        // sort non_zeros & remove duplicates
-        sort(cols_nnzs.begin(), cols_nnzs.end());
-        cols_nnzs.erase(unique(cols_nnzs.begin(), cols_nnzs.end()), cols_nnzs.end());
 
-        // Concatenate
-        for (int j = 0; j < cols_nnzs.size(); j++)
+        // U(:, k) from the pivoted rows, pivot search over the others
+        int pivot_row = -1;
+        T largest = -1;
+        for (int px = top; px < n; px++)
+        {
+            int i = xi[px];
+            if (pinv[i] < 0)
+            {
+                T magnitude = std::abs(x[i]);
+                if (magnitude > largest)
+                {
+                    largest = magnitude;
+                    pivot_row = i;
+                }
+            }
+            else
+            {
+                Ui.push_back(pinv[i]);
+                Ux.push_back(x[i]);
+            }
+        }
+        if (pivot_row == -1 || largest <= 0)
         {
-            R_cols.push_back(cols_nnzs[j]);
+            throw std::invalid_argument("Matrix is singular");
         }
-        R_row_position[i + 1] = R_row_position[i] + cols_nnzs.size();
-
-        if (i == 0)
+        if (pinv[k] < 0 && mark[k] == k && std::abs(x[k]) >= threshold * largest)
         {
-            R_values.push_back(sqrt(A.values[0]));
+            pivot_row = k;
         }
 
-        // Entries in R on row i
-        int R_r_start = R_row_position[i];
-        int R_r_end = R_row_position[i + 1];
-        if (i != 0)
+        T pivot = x[pivot_row];
+        Ui.push_back(k);
+        Ux.push_back(pivot);
+        pinv[pivot_row] = k;
+        Li.push_back(pivot_row);
+        Lx.push_back(1);
+        for (int px = top; px < n; px++)
         {
-            for (int cii = R_r_start; cii < R_r_end; cii++)
+            int i = xi[px];
+            if (pinv[i] < 0)
             {
-                ci = R_cols[cii];
+                Li.push_back(i);
+                Lx.push_back(x[i] / pivot);
+            }
+            x[i] = 0;
+        }
+    }
+    Lp[n] = Li.size();
+    Up[n] = Ui.size();
+    for (int &i : Li)
+    {
+        i = pinv[i];
+    }
 
-                if (ci == 0)
-                {
+    // CSR in pivoted row order: walking the columns in order appends L(i, c),
+    // c < i, and then U(i, c), c >= i, to each row in increasing c
+    I nnzs = (I)(Li.size() - n + Ui.size());
+    std::shared_ptr<CSRMatrix<T, I>> LU(new CSRMatrix<T, I>(n, n, nnzs, true));
+    std::fill(LU->row_position.get(), LU->row_position.get() + n + 1, 0);
+    for (size_t q = 0; q < Li.size(); q++)
+    {
+        LU->row_position[Li[q] + 1]++;
+    }
+    for (size_t q = 0; q < Ui.size(); q++)
+    {
+        LU->row_position[Ui[q] + 1]++;
+    }
+    for (int i = 0; i < n; i++)
+    {
+        // the unit diagonals of L are not stored
+        LU->row_position[i + 1] += LU->row_position[i] - 1;
+    }
+    std::vector<I> fill(LU->row_position.get(), LU->row_position.get() + n);
+    for (int c = 0; c < n; c++)
+    {
+        for (I q = Lp[c] + 1; q < Lp[c + 1]; q++)
+        {
+            I dest = fill[Li[q]]++;
+            LU->col_index[dest] = c;
+            LU->values[dest] = Lx[q];
+        }
+        // U(:, c) is in the order of the search, so place it by row
+        for (I q = Up[c]; q < Up[c + 1]; q++)
+        {
+            I dest = fill[Ui[q]]++;
+            LU->col_index[dest] = c;
+            LU->values[dest] = Ux[q];
+        }
+    }
 
-                    T A_i0;
-                    for (int k = r_start; k < r_end; k++)
-                    {
-                        if (A.col_index[k] == 0)
-                        {
-                            A_i0 = A.values[k];
-                            R_values.push_back(A_i0 / R_values[0]);
-                        }
-                    }
-                }
+    // Row i of the factor is row p[i] of B; express P as the sequential
+    // interchanges (i, perm_indx[i]), perm_indx[i] >= i, that lu_solve applies
+    std::vector<int> row_at(n), position(n);
+    for (int i = 0; i < n; i++)
+    {
+        row_at[i] = i;
+        position[i] = i;
+    }
+    perm_indx.resize(n);
+    std::vector<int> p(n);
+    for (int r = 0; r < n; r++)
+    {
+        p[pinv[r]] = r;
+    }
+    for (int i = 0; i < n; i++)
+    {
+        int from = position[p[i]];
+        perm_indx[i] = from;
+        int displaced = row_at[i];
+        row_at[from] = displaced;
+        position[displaced] = from;
+        row_at[i] = p[i];
+        position[p[i]] = i;
+    }
 
-                T sum_ij = 0;
-                if (ci != 0 && ci != i)
-                {
+    std::cout << "LU with threshold pivoting: nnz(L + U) = " << nnzs << ", predicted without pivoting = "
+              << lu_analysis->predicted_nnzs << std::endl;
+    recordFactor(LU->col_index, *lu_analysis);
+    return LU;
+}
+
+// Linear solver that uses LU decomposition
+template <class T, class I>
+void SparseSolver<T, I>::lu_solve(CSRMatrix<T, I> &LU, std::vector<int> &perm_indx, std::vector<T> &x)
+// Solve the equations L*y = b and U*x = y to find x.
+{
+    int n = LU.rows;
 
-                    int r_start_above = R_row_position[ci];
-                    int r_end_above = R_row_position[ci + 1];
+    checkDimensions(A, x);
 
-                    for (int n = R_r_start; n < R_r_end; n++)
-                    {
-                        // Loop through columns[:j] in row ci above current entry row[i, ci]
-                        for (int a = r_start_above; a < r_end_above; a++)
-                        {
-                            // Match cols in current and above rows
-                            if (R_cols[n] == R_cols[a] && R_cols[n] != ci)
-                            {
-                                sum_ij += R_values[n] * R_values[a];
-                            }
-                        }
-                    }
+    // Levels of L and U, built once per factor pattern
+    if (!lu_solve_analysis || lu_solve_analysis->pattern != LU.col_index)
+    {
+        lu_solve_analysis = analyseTriangular(LU, false);
+    }
 
-                    int diag_r_start = R_row_position[ci];
-                    int diag_r_end = R_row_position[ci + 1];
+    // The factor is of P A P^T, so solve for P x with P b, with the P it was built with
+    const FactorOrdering<I> *recorded = factorOrdering(LU);
+    const std::vector<int> &order =
+        recorded ? recorded->perm : (lu_analysis ? lu_analysis->perm : std::vector<int>());
 
-                    // Loop through row that contains diagonal L entry on current column
-                    for (int diag = diag_r_start; diag < diag_r_end; diag++)
-                    {
-                        if (R_cols[diag] == ci)
-                        {
-                            T A_ij = 0;
-                            // Determine whether ij entry in L also appears in A, else we use a 0
-                            for (int k = r_start; k < r_end; k++)
-                            {
-                                if (ci == A.col_index[k])
-                                {
-                                    A_ij = A.values[k];
-                                }
-                            }
-
-                            R_values.push_back((A_ij - sum_ij) / R_values[diag]);
-                        }
-                    }
-                }
+    // The unknown x will be used as temporary storage for y
+    for (int i = 0; i < n; i++)
+    {
+        x[i] = order.empty() ? b[i] : b[order[i]];
+    }
+    // Row interchanges, all up front: perm_indx[i] >= i, so row i is never
+    // touched again once swapped
+    if (!perm_indx.empty())
+    {
+        for (int i = 0; i < n; i++)
+        {
+            std::swap(x[i], x[perm_indx[i]]);
+        }
+    }
 
-                T sum_jj = 0;
-                if (ci != 0 && ci == i)
-                {
-                    // Loop over Ljk entries in row j
-                    for (int k = R_r_start; (k < R_r_end && R_cols[k] < i); k++)
-                    {
-                        sum_jj += pow(R_values[k], 2);
-                    }
+    // Forward substitution L*y = b (unit diagonal), then backward substitution U*x = y
+    lowerSolve<T, I>(LU, *lu_solve_analysis, nullptr, x);
+    upperSolve<T, I>(LU, *lu_solve_analysis, nullptr, x);
 
-                    // Access jj value in A
-                    T A_jj;
-                    int diag;
-                    for (diag = r_start; diag < r_end; diag++)
-                    {
-                        if (A.col_index[diag] == i)
-                        {
-                            A_jj = A.values[diag];
-                        }
-                    }
+    if (!order.empty())
+    {
+        std::vector<T> permuted_x(x);
+        inversePermuteVector(permuted_x, order, x);
+    }
+}
 
-                    // Ljj = sqrt(Ajj - sum(Ljk[:j]^2)
-                    R_values.push_back(sqrt(A_jj - sum_jj));
-                }
-            }
-        }
+// Symbolic Cholesky: the pattern of the lower triangular factor R of the
+// reordered matrix, P A P^T = R R^T, from the elimination tree and row subtrees,
+// grouped into supernodes (which may add a few explicit zeros). Cached by the
+// pattern of A.
+template <class T, class I>
+std::shared_ptr<CSRMatrix<T, I>> SparseSolver<T, I>::cholesky_symbolic()
+{
+    checkDimensions(A, b);
+
+    uint64_t key = symbolicKey();
+    std::shared_ptr<SymbolicAnalysis<T, I>> cached = findSymbolic(cholesky_symbolic_cache, key);
+    if (cached)
+    {
+        cholesky_analysis = cached;
+        recordFactor(cholesky_analysis->pattern->col_index, *cholesky_analysis);
+        return cholesky_analysis->pattern;
     }
 
-    std::shared_ptr<CSRMatrix<T>> sparse_mat_ptr(new CSRMatrix<T>(A.rows, A.cols, R_values.size(), true));
+    auto analysis = std::make_shared<SymbolicAnalysis<T, I>>();
+    AdjacencyGraph<I> graph = buildAdjacency(A);
+    analysis->perm = fillReducingOrdering(graph);
+    if (!analysis->perm.empty())
+    {
+        graph = permuteGraph(graph, analysis->perm);
+    }
+    SymbolicFactor<I> factor = symbolicCholesky(graph);
+    analysis->predicted_nnzs = factor.nnz();
+    analysis->supernodes = std::make_shared<Supernodes<I>>(findSupernodes(factor));
+    analysis->pattern = supernodalPattern<T, I>(*analysis->supernodes);
+    std::cout << "Cholesky symbolic: predicted nnz(L) = " << analysis->predicted_nnzs << " for nnz(A) = " << A.nnzs
+              << std::endl;
+
+    storeSymbolic(cholesky_symbolic_cache, key, analysis);
+    cholesky_analysis = analysis;
+    recordFactor(analysis->pattern->col_index, *analysis);
+    return analysis->pattern;
+}
 
-    for (int i = 0; i < R_values.size(); i++)
+// Numeric Cholesky into a matrix that already holds the symbolic pattern,
+// using the supernodal multifrontal factorisation
+template <class T, class I>
+void SparseSolver<T, I>::cholesky_numeric(CSRMatrix<T, I> &R)
+{
+    if (!cholesky_analysis)
+    {
+        cholesky_symbolic();
+    }
+    // the ordering and supernodes R's pattern was built with
+    const FactorOrdering<I> *recorded = factorOrdering(R);
+    const std::vector<int> &order = recorded ? recorded->perm : cholesky_analysis->perm;
+    Supernodes<I> &supernodes = recorded ? *recorded->supernodes : *cholesky_analysis->supernodes;
+    if (order.empty())
     {
-        sparse_mat_ptr->col_index[i] = R_cols[i];
-        sparse_mat_ptr->values[i] = R_values[i];
+        supernodalCholesky(A, supernodes, R);
     }
-    for (int i = 0; i <= A.rows; i++)
+    else
     {
-        sparse_mat_ptr->row_position[i] = R_row_position[i];
+        supernodalCholesky(*permuteSymmetric(A, order), supernodes, R);
     }
+}
 
-    return sparse_mat_ptr;
+// Cholesky decomposition: symbolic analysis (reused while the pattern of A is
+// unchanged) followed by the numeric factorisation
+template <class T, class I>
+std::shared_ptr<CSRMatrix<T, I>> SparseSolver<T, I>::cholesky_decomp()
+{
+    std::shared_ptr<CSRMatrix<T, I>> pattern = cholesky_symbolic();
+
+    // The factor shares row_position and col_index with the cached pattern
+    std::shared_ptr<T[]> values(new T[std::max<I>(pattern->nnzs, 1)]);
+    std::shared_ptr<CSRMatrix<T, I>> R(new CSRMatrix<T, I>(pattern->rows, pattern->cols, pattern->nnzs, values,
+                                                           pattern->row_position, pattern->col_index));
+    cholesky_numeric(*R);
+    return R;
 }
 
-// Linear solver that uses LU decomposition
-template <class T>
-void SparseSolver<T>::cholesky_solve(CSRMatrix<T> &R, std::vector<T> &x)
-// Solve the equations L*y = b and U*x = y to find x.
+// Linear solver that uses Cholesky decomposition
+template <class T, class I>
+void SparseSolver<T, I>::cholesky_solve(CSRMatrix<T, I> &R, std::vector<T> &x)
+// Solve the equations R*y = b and R^T*x = y to find x.
 {
-    int n, ip, i, j, row_start, row_len, col_start, col_indx;
-    n = R.rows;
-    T sum;
+    int n = R.rows;
 
     checkDimensions(A, x);
 
-    std::shared_ptr<CSRMatrix<T>> R_T = R.transpose();
-
-    // The unknown x will be used as temporary storage for y.
-    // The equations for forward and backward substitution have
-    // been simplified by combining (b and sum) and (y and sum).
-    for (i = 0; i < n; i++)
+    // Levels of R and R^T, and the pattern of R^T, built once per factor
+    // pattern so that R^T is never formed
+    if (!cholesky_solve_analysis || cholesky_solve_analysis->pattern != R.col_index)
     {
-        x[i] = b[i];
+        cholesky_solve_analysis = analyseTriangular(R, true);
     }
-    // Perform forward substitution to solve L*y = b.
-    // Need to keep track of permutation of RHS as well
-    for (i = 0; i < n; i++)
-    {
-        sum = x[i];
+    T *inv_diag = R.inverseDiagonal();
 
-        for (j = R.row_position[i]; j < R.row_position[i + 1]; j++)
-        {
-            col_indx = R.col_index[j];
-            // check if valid and exits loop to avoid uneccesary checks
-            if (col_indx >= i)
-                break;
-            sum -= R.values[j] * x[col_indx];
-        }
-        x[i] = sum / R.values[j];
+    // The factor is of P A P^T, so solve for P x with P b, with the P it was built with
+    const FactorOrdering<I> *recorded = factorOrdering(R);
+    const std::vector<int> &order =
+        recorded ? recorded->perm : (cholesky_analysis ? cholesky_analysis->perm : std::vector<int>());
+
+    // The unknown x will be used as temporary storage for y
+    for (int i = 0; i < n; i++)
+    {
+        x[i] = order.empty() ? b[i] : b[order[i]];
     }
 
-    // Perform backward substitution to solve U*x = y
-    // Here x = y before being updated.
-    for (i = n - 1; i >= 0; i--)
+    // the diagonal of R^T is the diagonal of R
+    lowerSolve<T, I>(R, *cholesky_solve_analysis, inv_diag, x);
+    transposedLowerSolve<T, I>(R, *cholesky_solve_analysis, inv_diag, x);
+
+    if (!order.empty())
     {
-        sum = x[i];
-        row_start = R_T->row_position[i];
-        row_len = R_T->row_position[i + 1] - row_start;
-        for (j = 0; j < row_len; j++)
-        {
-            col_indx = R_T->col_index[row_start + j];
-            if (col_indx >= i + 1)
-                sum -= R_T->values[row_start + j] * x[col_indx];
-        }
-        // Find diagonal element
-        for (j = 0; j < row_len; j++)
-        {
-            col_indx = R_T->col_index[row_start + j];
-            if (col_indx == i)
-            {
-                x[i] = sum / R_T->values[row_start + j];
-                break;
-            }
-        }
+        std::vector<T> permuted_x(x);
+        inversePermuteVector(permuted_x, order, x);
     }
-}
\ No newline at end of file
+}
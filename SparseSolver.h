@@ -1,30 +1,218 @@
 
 #pragma once
 #include "CSRMatrix.h"
+#include "Supernodal.h"
+#include "Reordering.h"
+#include "TriangularSolve.h"
+#include "Preconditioner.h"
+#include "Chebyshev.h"
 #include <vector>
 #include <memory>
+#include <map>
+#include <cstdint>
 
-template <class T>
+// Result of a symbolic factorisation
+template <class T, class I>
+struct SymbolicAnalysis
+{
+    std::shared_ptr<CSRMatrix<T, I>> pattern;  // pattern of the factor of P A P^T
+    std::vector<int> perm;                     // P as perm[new_index] = old_index, empty for the natural order
+    I predicted_nnzs = 0;                      // nnz of the factor before supernodal padding
+    std::shared_ptr<Supernodes<I>> supernodes; // Cholesky only
+
+    // the pattern of A it was computed for, compared on a cache hit so that a
+    // hash collision is never taken for the same pattern
+    int cols = 0;
+    std::vector<I> row_position;
+    std::vector<int> col_index;
+    uint64_t last_used = 0;
+};
+
+// The ordering (and for Cholesky the supernodes) a factor was computed with,
+// found from the factor by its col_index array
+template <class I>
+struct FactorOrdering
+{
+    std::weak_ptr<int[]> pattern;
+    std::vector<int> perm;
+    std::shared_ptr<Supernodes<I>> supernodes;
+};
+
+// Formulation of conjugate gradients, by the number of global reductions
+// (synchronisation points) per iteration
+enum class CGVariant
+{
+    Standard,         // two reductions: p.Ap, then r.r
+    ChronopoulosGear, // one: r.u, Au.u and r.r fused into the sweep computing w = A u
+    Pipelined         // one (Ghysels-Vanroose), computed in the same parallel region as the next SpMV
+};
+
+// Orthogonalisation of the Krylov basis in GMRES
+enum class GramSchmidt
+{
+    Modified,  // one reduction per basis vector
+    Classical2 // classical Gram-Schmidt applied twice: two block reductions per iteration
+};
+
+template <class T, class I = int>
 class SparseSolver
 {
 public:
-    CSRMatrix<T> A;
+    CSRMatrix<T, I> A;
 
     std::vector<T> b{};
 
-    SparseSolver(CSRMatrix<T> &A, std::vector<T> &b);
+    SparseSolver(CSRMatrix<T, I> &A, std::vector<T> &b);
 
     ~SparseSolver();
 
     void stationaryIterative(std::vector<T> &x, double &tol, int &it_max, bool isGaussSeidel);
 
+    // Stationary iteration x <- x + M^-1 (b - A x) from x = 0, e.g. V-cycles
+    // with M an AMG hierarchy. M must already be set up on A, as for the
+    // preconditioned conjugateGradient.
+    void stationaryIterative(std::vector<T> &x, double &tol, int &it_max, Preconditioner<T, I> &M);
+
+    // Multicolour Gauss-Seidel (omega = 1) or SOR, or with symmetric SGS/SSOR:
+    // the stationary iteration with a MulticolourSORPreconditioner, whose
+    // sweeps run in parallel within each colour. Unlike the natural-order
+    // Gauss-Seidel of stationaryIterative, the result depends on the colouring.
+    // The colouring is kept in sor_preconditioner while A's pattern is unchanged.
+    void sor(std::vector<T> &x, double &tol, int &it_max, double omega = 1.0, bool symmetric = false);
+    std::shared_ptr<MulticolourSORPreconditioner<T, I>> sor_preconditioner;
+
+    // Chebyshev iteration for symmetric positive definite A, Jacobi-preconditioned
+    // unless jacobi_scaled is false. It needs bounds on the spectrum of D^-1 A
+    // (or A) instead of inner products. Those not given are estimated as
+    // ChebyshevPreconditioner does: lambda_max as 1.1 times the largest Ritz
+    // value after chebyshev_lanczos_steps Lanczos steps, and lambda_min as
+    // chebyshev_lower_fraction * lambda_max. The iteration converges at the
+    // rate set by lambda_min / lambda_max, so for ill-conditioned A a lower
+    // bound should be passed in; the smallest Ritz value is not one, since it
+    // lies above the true lambda_min. Each iteration is one product with A and
+    // one vector sweep; the residual norm, the only reduction, is checked
+    // every residual_check_interval iterations.
+    void chebyshev(std::vector<T> &x, double &tol, int &it_max, bool jacobi_scaled = true, double lambda_min = 0,
+                   double lambda_max = 0);
+    int residual_check_interval = 10;
+    int chebyshev_lanczos_steps = 10;
+    double chebyshev_lower_fraction = 0.01;
+
     T residualCalc(std::vector<T> &x, std::vector<T> &output_b);
 
     void conjugateGradient(std::vector<T> &x, double &tol, int &it_max);
 
-    std::shared_ptr<CSRMatrix<T>> lu_decomp();
-    void lu_solve(CSRMatrix<T> &LU, std::vector<int> &piv, std::vector<T> &x);
+    // Preconditioned conjugate gradient. M must already be set up on A; with
+    // reorder set, it is applied in A's ordering (see reorder below).
+    void conjugateGradient(std::vector<T> &x, double &tol, int &it_max, Preconditioner<T, I> &M);
+
+    // Formulation used by both conjugateGradient overloads. The single-reduction
+    // variants are mathematically equivalent but update more vectors per
+    // iteration, and the pipelined one accumulates more rounding error.
+    CGVariant cg_variant = CGVariant::Standard;
+    void communicationReducingCG(std::vector<T> &x, double &tol, int &it_max, Preconditioner<T, I> *M);
+
+    // If true, the unpreconditioned conjugateGradient iterates in single
+    // precision (A and the work vectors in float) with reliable updates: the
+    // solution is accumulated in T and the true residual recomputed in T each
+    // time the iterated one has dropped by reliable_update_delta, so the result
+    // is as accurate as in T. If the true residual stops decreasing, the
+    // solve continues in T. cg_variant is not used.
+    bool mixed_precision = false;
+    double reliable_update_delta = 0.1;
+    void mixedPrecisionCG(std::vector<T> &x, double &tol, int &it_max);
+
+    // Block CG for n_rhs right-hand sides at once, against A (not b): B and X
+    // are n x n_rhs and row-major, as for CSRMatrix::matMultiVecMult. Each
+    // iteration is one sparse product with the block of search directions;
+    // right-hand sides are deflated from it as they converge (residual below tol)
+    // and dependent directions are dropped.
+    void blockConjugateGradient(std::vector<T> &X, const std::vector<T> &B, int n_rhs, double &tol, int &it_max);
+
+    // Solvers for nonsymmetric systems, right-preconditioned by M when given
+    // (set up on A beforehand) so that tol applies to the true residual.
+    // Restarted GMRES(restart); it_max counts inner iterations.
+    void gmres(std::vector<T> &x, double &tol, int &it_max, int restart = 30, Preconditioner<T, I> *M = nullptr,
+               GramSchmidt orthogonalisation = GramSchmidt::Modified);
+    void bicgstab(std::vector<T> &x, double &tol, int &it_max, Preconditioner<T, I> *M = nullptr);
+
+    // iterations taken by the last iterative solve
+    int iterations = 0;
+
+    // If true, the iterative solvers start from the x passed in, e.g. the
+    // solution of the previous time step, rather than from x = 0
+    bool warm_start = false;
+
+    // r = b - A x, after zeroing x unless warm_start is set; returns |r|
+    double initialResidual(std::vector<T> &x, std::vector<T> &r);
+
+    // The decompositions run a symbolic phase (the sparsity pattern of the
+    // factor) and a numeric phase (its values). Symbolic results are cached by
+    // A.patternHash(), so refactorising after changing only A.values runs the
+    // numeric phase alone. A hit is only used when the stored pattern equals
+    // A's. The returned factor shares its pattern arrays with the cache, and
+    // is of the reordered matrix (see ordering below).
+    std::shared_ptr<CSRMatrix<T, I>> lu_decomp();
+    // Gilbert-Peierls LU with threshold partial pivoting; perm_indx receives
+    // the row interchanges for lu_solve. Not cached: the pattern depends on the pivots.
+    std::shared_ptr<CSRMatrix<T, I>> lu_decomp(std::vector<int> &perm_indx, double threshold = 0.1);
+    std::shared_ptr<CSRMatrix<T, I>> lu_symbolic();
+    void lu_numeric(CSRMatrix<T, I> &LU);
+    void lu_solve(CSRMatrix<T, I> &LU, std::vector<int> &piv, std::vector<T> &x);
+
+    std::shared_ptr<CSRMatrix<T, I>> cholesky_decomp();
+    std::shared_ptr<CSRMatrix<T, I>> cholesky_symbolic();
+    void cholesky_numeric(CSRMatrix<T, I> &R);
+    void cholesky_solve(CSRMatrix<T, I> &R, std::vector<T> &x);
+
+    // Fill-reducing ordering applied by the decompositions: the factors are of
+    // P A P^T and the solves permute b and x accordingly
+    FillOrdering ordering = FillOrdering::Automatic;
+    std::vector<int> fillReducingOrdering(const AdjacencyGraph<I> &graph);
+    uint64_t symbolicKey();
+
+    std::map<uint64_t, std::shared_ptr<SymbolicAnalysis<T, I>>> lu_symbolic_cache{};
+    std::map<uint64_t, std::shared_ptr<SymbolicAnalysis<T, I>>> cholesky_symbolic_cache{};
+    // Each cache keeps at most symbolic_cache_size analyses, dropping the
+    // least recently used first
+    size_t symbolic_cache_size = 8;
+    void clearSymbolicCaches();
+    // the cached analysis for A's pattern under key, or null
+    std::shared_ptr<SymbolicAnalysis<T, I>> findSymbolic(std::map<uint64_t, std::shared_ptr<SymbolicAnalysis<T, I>>> &cache,
+                                                         uint64_t key);
+    void storeSymbolic(std::map<uint64_t, std::shared_ptr<SymbolicAnalysis<T, I>>> &cache, uint64_t key,
+                       std::shared_ptr<SymbolicAnalysis<T, I>> analysis);
+    uint64_t symbolic_cache_clock = 0;
+    // the analyses used by the last decompositions
+    std::shared_ptr<SymbolicAnalysis<T, I>> lu_analysis;
+    std::shared_ptr<SymbolicAnalysis<T, I>> cholesky_analysis;
+    // The orderings of the factors handed out, so that a factor kept across a
+    // later decomposition with another ordering or pattern is still solved
+    // (and refactorised) with its own. Records of freed factors are dropped.
+    std::vector<FactorOrdering<I>> factor_orderings{};
+    void recordFactor(const std::shared_ptr<int[]> &pattern, const SymbolicAnalysis<T, I> &analysis);
+    // the record for factor, or null if it did not come from this solver
+    const FactorOrdering<I> *factorOrdering(CSRMatrix<T, I> &factor);
+    // level schedules of the factors last solved with, rebuilt when the
+    // factor's pattern changes
+    std::shared_ptr<TriangularAnalysis<I>> lu_solve_analysis;
+    std::shared_ptr<TriangularAnalysis<I>> cholesky_solve_analysis;
+
+    // If true, the iterative solvers work on a Reverse Cuthill-McKee reordering
+    // of A, for better locality in x, and permute the solution back.
+    // The permutation and the reordered pattern are built on first use and
+    // kept while A's pattern is unchanged; every solve copies A's current
+    // values and b into the reordered system. A preconditioner M passed in
+    // stays set up on A and is applied in A's ordering, so orderings that M
+    // depends on (as for GeometricMultigrid) are kept and its setup is reused.
+    bool reorder = false;
+    SparseSolver<T, I> &reorderedSolver();
 
-    std::shared_ptr<CSRMatrix<T>> cholesky_decomp();
-    void cholesky_solve(CSRMatrix<T> &R, std::vector<T> &x);
+    std::vector<int> reorder_perm{};
+    std::shared_ptr<SparseSolver<T, I>> reordered_solver;
+    // a copy of the pattern the reordering was built for, and the position in
+    // A.values of each entry of the reordered matrix
+    std::vector<I> reorder_row_position{};
+    std::vector<int> reorder_col_index{};
+    std::vector<I> reorder_source{};
 };
\ No newline at end of file
@@ -0,0 +1,388 @@
+#include "Supernodal.h"
+#include <math.h>
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
+
+namespace
+{
+// Relaxed amalgamation thresholds: the fraction of explicit zeros a supernode
+// of a given width may hold, as in CHOLMOD
+inline bool acceptPadding(int width, double zeros, double total)
+{
+    if (width <= 4)
+    {
+        return true;
+    }
+    double fraction = zeros / total;
+    if (width <= 16)
+    {
+        return fraction < 0.8;
+    }
+    if (width <= 48)
+    {
+        return fraction < 0.1;
+    }
+    return fraction < 0.05;
+}
+} // namespace
+
+template <class I>
+Supernodes<I> findSupernodes(const SymbolicFactor<I> &factor)
+{
+    int n = factor.n;
+    Supernodes<I> supernodes;
+
+    // Column j joins the supernode f ... j - 1 when it is the parent of j - 1.
+    // The merged structure is then {f, ..., j - 1} + struct(L_j), so the number
+    // of explicit zeros follows from the column counts.
+    supernodes.of_column.assign(n, 0);
+    if (n > 0)
+    {
+        supernodes.first.push_back(0);
+    }
+    double nonzeros = n > 0 ? factor.col_counts[0] : 0;
+    for (int j = 1; j < n; j++)
+    {
+        int f = supernodes.first.back();
+        bool merge = factor.parent[j - 1] == j;
+        if (merge)
+        {
+            double width = j - f + 1;
+            double height = (j - f) + factor.col_counts[j];
+            double total = width * height - width * (width - 1) / 2;
+            merge = acceptPadding(width, total - nonzeros - factor.col_counts[j], total);
+        }
+        if (merge)
+        {
+            nonzeros += factor.col_counts[j];
+        }
+        else
+        {
+            supernodes.first.push_back(j);
+            nonzeros = factor.col_counts[j];
+        }
+        supernodes.of_column[j] = supernodes.first.size() - 1;
+    }
+    supernodes.count = supernodes.first.size();
+    supernodes.first.push_back(n);
+
+    // The rows of a supernode are its own columns and then the structure of its last column
+    supernodes.parent.assign(supernodes.count, -1);
+    supernodes.row_ptr.assign(supernodes.count + 1, 0);
+    for (int s = 0; s < supernodes.count; s++)
+    {
+        int last = supernodes.first[s + 1] - 1;
+        supernodes.row_ptr[s + 1] = supernodes.row_ptr[s] + supernodes.width(s) - 1 + factor.col_counts[last];
+        if (factor.parent[last] != -1)
+        {
+            supernodes.parent[s] = supernodes.of_column[factor.parent[last]];
+        }
+    }
+    supernodes.rows.resize(supernodes.row_ptr[supernodes.count]);
+    for (int s = 0; s < supernodes.count; s++)
+    {
+        int last = supernodes.first[s + 1] - 1;
+        int *rows = supernodes.rows.data() + supernodes.row_ptr[s];
+        for (int j = supernodes.first[s]; j < last; j++)
+        {
+            *rows++ = j;
+        }
+        std::copy(factor.row_index.begin() + factor.col_position[last],
+                  factor.row_index.begin() + factor.col_position[last + 1], rows);
+    }
+    return supernodes;
+}
+
+template <class T, class I>
+std::shared_ptr<CSRMatrix<T, I>> supernodalPattern(const Supernodes<I> &supernodes)
+{
+    int n = supernodes.first[supernodes.count];
+    std::shared_ptr<I[]> row_position(new I[n + 1]);
+    std::fill(row_position.get(), row_position.get() + n + 1, 0);
+    for (int s = 0; s < supernodes.count; s++)
+    {
+        int w = supernodes.width(s);
+        for (int i = 0; i < supernodes.height(s); i++)
+        {
+            row_position[supernodes.rows[supernodes.row_ptr[s] + i] + 1] += std::min(i, w - 1) + 1;
+        }
+    }
+    for (int i = 0; i < n; i++)
+    {
+        row_position[i + 1] += row_position[i];
+    }
+
+    // Supernodes in column order append to every row in increasing column order
+    I nnzs = row_position[n];
+    std::shared_ptr<int[]> col_index(new int[std::max<I>(nnzs, 1)]);
+    std::vector<I> next(row_position.get(), row_position.get() + n);
+    for (int s = 0; s < supernodes.count; s++)
+    {
+        int f = supernodes.first[s];
+        int w = supernodes.width(s);
+        for (int i = 0; i < supernodes.height(s); i++)
+        {
+            int r = supernodes.rows[supernodes.row_ptr[s] + i];
+            for (int jc = 0; jc <= std::min(i, w - 1); jc++)
+            {
+                col_index[next[r]++] = f + jc;
+            }
+        }
+    }
+
+    std::shared_ptr<T[]> values(new T[std::max<I>(nnzs, 1)]);
+    std::fill(values.get(), values.get() + nnzs, 0);
+    return std::shared_ptr<CSRMatrix<T, I>>(new CSRMatrix<T, I>(n, n, nnzs, values, row_position, col_index));
+}
+
+template <class T>
+bool denseFrontFactor(T *F, int m, int w)
+{
+    // Blocked right-looking: factor a panel of nb columns, then apply it to
+    // all the columns to its right with column-oriented updates, which keeps
+    // the panel in cache and the inner loops contiguous
+    const int nb = 32;
+    for (int kb = 0; kb < w; kb += nb)
+    {
+        int kend = std::min(kb + nb, w);
+
+        for (int k = kb; k < kend; k++)
+        {
+            T *col_k = F + (size_t)k * m;
+            if (!(col_k[k] > 0))
+            {
+                return false;
+            }
+            T d = sqrt(col_k[k]);
+            col_k[k] = d;
+            T inv_d = 1 / d;
+#pragma omp simd
+            for (int i = k + 1; i < m; i++)
+            {
+                col_k[i] *= inv_d;
+            }
+            for (int j = k + 1; j < kend; j++)
+            {
+                T *col_j = F + (size_t)j * m;
+                T l_jk = col_k[j];
+#pragma omp simd
+                for (int i = j; i < m; i++)
+                {
+                    col_j[i] -= l_jk * col_k[i];
+                }
+            }
+        }
+
+        // Trailing update F(j:m, j) -= L(j:m, kb:kend) L(j, kb:kend)^T, in
+        // blocks of rows accumulated in a small buffer so that every entry of
+        // F is loaded and stored once per panel
+        const int rb = 64;
+        T acc[rb];
+        for (int j = kend; j < m; j++)
+        {
+            T *col_j = F + (size_t)j * m;
+            for (int ib = j; ib < m; ib += rb)
+            {
+                int len = std::min(rb, m - ib);
+                for (int i = 0; i < len; i++)
+                {
+                    acc[i] = 0;
+                }
+                for (int k = kb; k < kend; k++)
+                {
+                    const T *col_k = F + (size_t)k * m + ib;
+                    T l_jk = F[(size_t)k * m + j];
+#pragma omp simd
+                    for (int i = 0; i < len; i++)
+                    {
+                        acc[i] += l_jk * col_k[i];
+                    }
+                }
+#pragma omp simd
+                for (int i = 0; i < len; i++)
+                {
+                    col_j[ib + i] -= acc[i];
+                }
+            }
+        }
+    }
+    return true;
+}
+
+namespace
+{
+// Local index of every child update row in the parent front, merging the two
+// sorted row lists
+inline void relativeIndices(const int *child_rows, int child_count, const int *parent_rows, int parent_count,
+                            std::vector<int> &map)
+{
+    map.resize(child_count);
+    int p = 0;
+    for (int i = 0; i < child_count; i++)
+    {
+        while (p < parent_count && parent_rows[p] < child_rows[i])
+        {
+            p++;
+        }
+        map[i] = p;
+    }
+}
+} // namespace
+
+template <class T, class I>
+void supernodalCholesky(CSRMatrix<T, I> &A, const Supernodes<I> &supernodes, CSRMatrix<T, I> &R)
+{
+    int count = supernodes.count;
+
+    // children of each supernode, and how many are still unfactored
+    std::vector<int> child_head(count, -1);
+    std::vector<int> child_next(count, -1);
+    std::vector<int> pending(count, 0);
+    for (int s = count - 1; s >= 0; s--)
+    {
+        int p = supernodes.parent[s];
+        if (p != -1)
+        {
+            child_next[s] = child_head[p];
+            child_head[p] = s;
+            pending[p]++;
+        }
+    }
+
+    // Frontal matrices of finished supernodes, kept until the parent has
+    // added their update (trailing) block
+    std::vector<std::vector<T>> fronts(count);
+    bool failed = false;
+
+    auto factorSupernode = [&](int s, std::vector<int> &map) {
+        int f = supernodes.first[s];
+        int w = supernodes.width(s);
+        int m = supernodes.height(s);
+        const int *rows = supernodes.rows.data() + supernodes.row_ptr[s];
+
+        std::vector<T> &F = fronts[s];
+        F.assign((size_t)m * m, 0);
+
+        // Columns of A, from the upper triangle of the rows as A is symmetric
+        for (int jc = 0; jc < w; jc++)
+        {
+            int c = f + jc;
+            T *col = F.data() + (size_t)jc * m;
+            for (I k = A.row_position[c]; k < A.row_position[c + 1]; k++)
+            {
+                int r = A.col_index[k];
+                if (r >= c)
+                {
+                    col[std::lower_bound(rows, rows + m, r) - rows] += A.values[k];
+                }
+            }
+        }
+
+        // Extend-add the update matrices of the children
+        for (int c = child_head[s]; c != -1; c = child_next[c])
+        {
+            int wc = supernodes.width(c);
+            int mc = supernodes.height(c);
+            int uc = mc - wc;
+            const int *child_rows = supernodes.rows.data() + supernodes.row_ptr[c] + wc;
+            relativeIndices(child_rows, uc, rows, m, map);
+            const T *U = fronts[c].data() + (size_t)wc * mc + wc;
+            for (int jj = 0; jj < uc; jj++)
+            {
+                T *col = F.data() + (size_t)map[jj] * m;
+                const T *u_col = U + (size_t)jj * mc;
+                for (int ii = jj; ii < uc; ii++)
+                {
+                    col[map[ii]] += u_col[ii];
+                }
+            }
+            std::vector<T>().swap(fronts[c]);
+        }
+
+        if (!denseFrontFactor(F.data(), m, w))
+        {
+            return false;
+        }
+
+        // Row r of R holds the supernode's columns f ... min(r, f + w - 1)
+        // contiguously
+        for (int i = 0; i < m; i++)
+        {
+            int r = rows[i];
+            int *row_start = R.col_index.get() + R.row_position[r];
+            int *row_end = R.col_index.get() + R.row_position[r + 1];
+            I pos = std::lower_bound(row_start, row_end, f) - R.col_index.get();
+            int last = std::min(i, w - 1);
+            for (int jc = 0; jc <= last; jc++)
+            {
+                R.values[pos + jc] = F[i + (size_t)jc * m];
+            }
+        }
+
+        if (m == w)
+        {
+            std::vector<T>().swap(F);
+        }
+        return true;
+    };
+
+    // Factor from every leaf upwards. The task that finishes the last child of
+    // a supernode goes on to factor that supernode, so independent subtrees
+    // run concurrently without recursion.
+    std::vector<int> leaves;
+    for (int s = 0; s < count; s++)
+    {
+        if (pending[s] == 0)
+        {
+            leaves.push_back(s);
+        }
+    }
+    int leaves_per_task = 16;
+#pragma omp parallel
+#pragma omp single
+    {
+        for (size_t start = 0; start < leaves.size(); start += leaves_per_task)
+        {
+#pragma omp task firstprivate(start) shared(failed, fronts, pending)
+            {
+                std::vector<int> map;
+                size_t end = std::min(start + leaves_per_task, leaves.size());
+                for (size_t l = start; l < end; l++)
+                {
+                    int s = leaves[l];
+                    while (s != -1)
+                    {
+                        bool ok;
+#pragma omp atomic read
+                        ok = failed;
+                        ok = !ok && factorSupernode(s, map);
+                        if (!ok)
+                        {
+#pragma omp atomic write
+                            failed = true;
+                        }
+
+                        int p = supernodes.parent[s];
+                        if (p == -1)
+                        {
+                            break;
+                        }
+                        int remaining;
+#pragma omp flush
+#pragma omp atomic capture
+                        remaining = --pending[p];
+#pragma omp flush
+                        s = remaining == 0 ? p : -1;
+                    }
+                }
+            }
+        }
+    }
+
+    if (failed)
+    {
+        throw std::invalid_argument("Matrix is not positive definite");
+    }
+    R.invalidateDiagonal();
+}
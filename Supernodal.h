@@ -0,0 +1,47 @@
+#pragma once
+#include "CSRMatrix.h"
+#include "Symbolic.h"
+#include <vector>
+#include <memory>
+
+// Relaxed supernodes of a Cholesky factor: runs of consecutive columns
+// j, j + 1, ... of L where column j + 1 is the parent of column j in the
+// elimination tree. The columns of a supernode share one row structure and are
+// factored as one dense block; a supernode may store a bounded fraction of
+// explicit zeros so that chains of small columns are still factored in blocks.
+template <class I = int>
+struct Supernodes
+{
+    int count = 0;
+    std::vector<int> first;     // first column of each supernode, size count + 1
+    std::vector<int> parent;    // supernodal elimination tree, -1 for a root
+    std::vector<I> row_ptr;     // row structure of each supernode, size count + 1
+    std::vector<int> rows;      // sorted, the supernode's own columns first
+    std::vector<int> of_column; // supernode containing each column
+
+    int width(int s) const { return first[s + 1] - first[s]; }
+    int height(int s) const { return (int)(row_ptr[s + 1] - row_ptr[s]); }
+};
+
+template <class I>
+Supernodes<I> findSupernodes(const SymbolicFactor<I> &factor);
+
+// Pattern of the lower triangular factor as stored by the supernodes, which
+// includes their explicit zeros. Rows are sorted with the diagonal last.
+template <class T, class I>
+std::shared_ptr<CSRMatrix<T, I>> supernodalPattern(const Supernodes<I> &supernodes);
+
+// Multifrontal numeric Cholesky, A = R R^T with A symmetric. R must hold the
+// pattern of the factor (sorted rows, as from SparseSolver::cholesky_symbolic).
+// Every supernode assembles a dense frontal matrix from A and the update
+// matrices of its children, factors its columns with dense blocked kernels and
+// passes the Schur complement to its parent. Independent subtrees are factored
+// in parallel as OpenMP tasks. Throws if A is not positive definite.
+template <class T, class I>
+void supernodalCholesky(CSRMatrix<T, I> &A, const Supernodes<I> &supernodes, CSRMatrix<T, I> &R);
+
+// Partial dense Cholesky of the lower triangle of the m x m column-major
+// matrix F: the first w columns are replaced by [L11; L21] and the trailing
+// block by F22 - L21 L21^T. Returns false on a non-positive pivot.
+template <class T>
+bool denseFrontFactor(T *F, int m, int w);
@@ -0,0 +1,181 @@
+#include "Symbolic.h"
+#include <vector>
+
+template <class I>
+std::vector<int> eliminationTree(const AdjacencyGraph<I> &graph)
+{
+    // Liu's algorithm: ancestor[] is a path-compressed view of the tree built
+    // so far, so each row only walks up to the current root of its subtrees
+    int n = graph.n;
+    std::vector<int> parent(n, -1);
+    std::vector<int> ancestor(n, -1);
+    for (int i = 0; i < n; i++)
+    {
+        for (I k = graph.ptr[i]; k < graph.ptr[i + 1]; k++)
+        {
+            int r = graph.adj[k];
+            if (r >= i)
+            {
+                continue;
+            }
+            while (ancestor[r] != -1 && ancestor[r] != i)
+            {
+                int next = ancestor[r];
+                ancestor[r] = i;
+                r = next;
+            }
+            if (ancestor[r] == -1)
+            {
+                ancestor[r] = i;
+                parent[r] = i;
+            }
+        }
+    }
+    return parent;
+}
+
+std::vector<int> treePostorder(const std::vector<int> &parent)
+{
+    int n = parent.size();
+
+    // children as linked lists, built backwards so they come out in increasing order
+    std::vector<int> head(n, -1);
+    std::vector<int> next(n, -1);
+    for (int j = n - 1; j >= 0; j--)
+    {
+        if (parent[j] != -1)
+        {
+            next[j] = head[parent[j]];
+            head[parent[j]] = j;
+        }
+    }
+
+    std::vector<int> post;
+    post.reserve(n);
+    std::vector<int> stack;
+    for (int root = 0; root < n; root++)
+    {
+        if (parent[root] != -1)
+        {
+            continue;
+        }
+        stack.push_back(root);
+        while (!stack.empty())
+        {
+            int p = stack.back();
+            int child = head[p];
+            if (child == -1)
+            {
+                stack.pop_back();
+                post.push_back(p);
+            }
+            else
+            {
+                // detach the child so the node is emitted once all are done
+                head[p] = next[child];
+                stack.push_back(child);
+            }
+        }
+    }
+    return post;
+}
+
+namespace
+{
+// Row subtree of row i: the nodes reached walking up the elimination tree from
+// every j < i with A(i, j) != 0, stopping at nodes already marked for this row.
+// These are exactly the off-diagonal columns of row i of L.
+template <class I, class Visit>
+void rowSubtree(const AdjacencyGraph<I> &graph, const std::vector<int> &parent, std::vector<int> &mark, int i,
+                Visit visit)
+{
+    mark[i] = i;
+    for (I k = graph.ptr[i]; k < graph.ptr[i + 1]; k++)
+    {
+        int j = graph.adj[k];
+        if (j >= i)
+        {
+            continue;
+        }
+        while (mark[j] != i)
+        {
+            visit(j);
+            mark[j] = i;
+            j = parent[j];
+        }
+    }
+}
+} // namespace
+
+template <class I>
+SymbolicFactor<I> symbolicCholesky(const AdjacencyGraph<I> &graph)
+{
+    int n = graph.n;
+    SymbolicFactor<I> factor;
+    factor.n = n;
+    factor.parent = eliminationTree(graph);
+    factor.postorder = treePostorder(factor.parent);
+
+    // Row and column counts
+    std::vector<int> mark(n, -1);
+    factor.row_counts.assign(n, 1);
+    factor.col_counts.assign(n, 1);
+    for (int i = 0; i < n; i++)
+    {
+        rowSubtree(graph, factor.parent, mark, i, [&](int j) {
+            factor.row_counts[i]++;
+            factor.col_counts[j]++;
+        });
+    }
+
+    // Columns of L: the diagonal first, then the rows in increasing order as
+    // the row subtrees are visited for i = 0, 1, ...
+    factor.col_position.assign(n + 1, 0);
+    for (int j = 0; j < n; j++)
+    {
+        factor.col_position[j + 1] = factor.col_position[j] + factor.col_counts[j];
+    }
+    factor.row_index.resize(factor.col_position[n]);
+    std::vector<I> next(n);
+    for (int j = 0; j < n; j++)
+    {
+        factor.row_index[factor.col_position[j]] = j;
+        next[j] = factor.col_position[j] + 1;
+    }
+    std::fill(mark.begin(), mark.end(), -1);
+    for (int i = 0; i < n; i++)
+    {
+        rowSubtree(graph, factor.parent, mark, i, [&](int j) { factor.row_index[next[j]++] = i; });
+    }
+
+    // Rows of L by transposing the columns, which leaves every row sorted
+    factor.row_position.assign(n + 1, 0);
+    for (int i = 0; i < n; i++)
+    {
+        factor.row_position[i + 1] = factor.row_position[i] + factor.row_counts[i];
+    }
+    factor.col_index.resize(factor.row_position[n]);
+    std::copy(factor.row_position.begin(), factor.row_position.end() - 1, next.begin());
+    for (int j = 0; j < n; j++)
+    {
+        for (I k = factor.col_position[j]; k < factor.col_position[j + 1]; k++)
+        {
+            factor.col_index[next[factor.row_index[k]]++] = j;
+        }
+    }
+
+    return factor;
+}
+
+template <class I>
+I choleskyFillCount(const AdjacencyGraph<I> &graph)
+{
+    std::vector<int> parent = eliminationTree(graph);
+    std::vector<int> mark(graph.n, -1);
+    I count = graph.n;
+    for (int i = 0; i < graph.n; i++)
+    {
+        rowSubtree(graph, parent, mark, i, [&](int) { count++; });
+    }
+    return count;
+}
@@ -0,0 +1,44 @@
+#pragma once
+#include "Reordering.h"
+#include <vector>
+
+// Elimination tree of a symmetric pattern: parent[j] is the row of the first
+// off-diagonal non-zero in column j of the Cholesky factor L, -1 for a root.
+template <class I>
+std::vector<int> eliminationTree(const AdjacencyGraph<I> &graph);
+
+// Postorder of a forest given by its parent array, children visited in
+// increasing order. post[k] = node visited k-th.
+std::vector<int> treePostorder(const std::vector<int> &parent);
+
+// Exact non-zero structure of the Cholesky factor L (A = L L^T) of a
+// symmetric pattern, in both row (CSR) and column (CSC) form, with
+// sorted indices. The diagonal is the last entry of every row and the
+// first entry of every column.
+template <class I = int>
+struct SymbolicFactor
+{
+    int n = 0;
+    std::vector<int> parent;    // elimination tree
+    std::vector<int> postorder; // postorder of the elimination tree
+    std::vector<I> col_counts;  // nnz of each column of L, including the diagonal
+    std::vector<I> row_counts;  // nnz of each row of L, including the diagonal
+
+    std::vector<I> row_position; // rows of L
+    std::vector<int> col_index;
+    std::vector<I> col_position; // columns of L
+    std::vector<int> row_index;
+
+    I nnz() const { return row_position.empty() ? 0 : row_position[n]; }
+};
+
+// Symbolic Cholesky factorisation: elimination tree, postorder, then the row
+// and column counts from a traversal of each row subtree, then the pattern.
+// Time and memory are O(nnz(A) + nnz(L)).
+template <class I>
+SymbolicFactor<I> symbolicCholesky(const AdjacencyGraph<I> &graph);
+
+// nnz(L), including the diagonal, from the row subtrees alone without forming
+// the pattern: O(nnz(L)) time and O(n) memory, to compare orderings
+template <class I>
+I choleskyFillCount(const AdjacencyGraph<I> &graph);
@@ -8,6 +8,9 @@
 #define GREEN "\033[32m"
 #define RESET "\033[0m"
 #define BLUE "\033[34m"
+#define YELLOW "\033[33m"
+
+bool TestRunner::skipped = false;
 
 TestRunner::TestRunner(std::string new_title) : title(new_title)
 {
@@ -20,15 +23,21 @@ TestRunner::~TestRunner()
 
 void TestRunner::test(bool (*test_ptr)(), std::string title)
 {
-    int total = this->testsFailed + this->testsSucceeded;
+    int total = this->testsFailed + this->testsSucceeded + this->testsSkipped;
 
     // title displayed before any terminal outputs
     std::cout << std::endl
               << BLUE << "Test " << total + 1 << ": " << title << RESET << std::endl;
 
+    skipped = false;
     bool outcome = test_ptr();
 
-    if (outcome)
+    if (skipped)
+    {
+        this->testsSkipped += 1;
+        std::cout << YELLOW << "Skipped" << RESET << std::endl;
+    }
+    else if (outcome)
     {
         this->testsSucceeded += 1;
         std::cout << GREEN << "Passed" << RESET << std::endl;
@@ -54,6 +63,10 @@ void TestRunner::completeRun()
                   << " " << this->testsFailed << "/" << total << " tests failed." << RESET << std::endl
                   << std::endl;
     }
+    if (this->testsSkipped > 0)
+    {
+        std::cout << YELLOW << this->title << ": " << this->testsSkipped << " tests skipped." << RESET << std::endl;
+    }
 }
 
 bool TestRunner::assertArrays(double *arr1, double *arr2, int length)
@@ -75,6 +88,12 @@ void TestRunner::testError(std::string message)
     std::cerr << RED << message << RESET << std::endl;
 }
 
+void TestRunner::skip(std::string reason)
+{
+    std::cout << YELLOW << reason << RESET << std::endl;
+    skipped = true;
+}
+
 bool TestRunner::assertArrays(int *arr1, int *arr2, int length)
 {
     // ideally this would be a template function to avoid duplication
@@ -8,6 +8,7 @@ private:
     // keeps track of every time test method is run & the outcome
     int testsFailed = 0;
     int testsSucceeded = 0;
+    int testsSkipped = 0;
     std::string title = "";
 
     // called when the test run finishes - gives summary of outcomes
@@ -26,4 +27,11 @@ public:
     static bool assertArrays(int *arr1, int *arr2, int length);
     static bool assertArrays(double *arr1, double *arr2, int length);
     static void testError(std::string message);
+
+    // marks the running test as skipped (e.g. not enough memory), so its
+    // return value is not counted as a pass or a failure
+    static void skip(std::string reason);
+
+private:
+    static bool skipped;
 };
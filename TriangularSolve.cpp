@@ -0,0 +1,176 @@
+#include "TriangularSolve.h"
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
+
+namespace
+{
+// Group rows by level, keeping the rows of each level in increasing order
+inline LevelSchedule scheduleFromLevels(const std::vector<int> &level, int levels)
+{
+    LevelSchedule schedule;
+    schedule.levels = levels;
+    schedule.level_ptr.assign(levels + 1, 0);
+    for (int l : level)
+    {
+        schedule.level_ptr[l + 1]++;
+    }
+    for (int l = 0; l < levels; l++)
+    {
+        schedule.level_ptr[l + 1] += schedule.level_ptr[l];
+    }
+    schedule.rows.resize(level.size());
+    std::vector<int> next(schedule.level_ptr.begin(), schedule.level_ptr.end() - 1);
+    for (int i = 0; i < (int)level.size(); i++)
+    {
+        schedule.rows[next[level[i]]++] = i;
+    }
+    return schedule;
+}
+} // namespace
+
+template <class RowFunction>
+void forEachScheduledRow(const LevelSchedule &schedule, int n, bool forward, RowFunction row_function)
+{
+    if (!schedule.parallel())
+    {
+        for (int k = 0; k < n; k++)
+        {
+            row_function(forward ? k : n - 1 - k);
+        }
+        return;
+    }
+#pragma omp parallel
+    for (int l = 0; l < schedule.levels; l++)
+    {
+#pragma omp for schedule(static)
+        for (int k = schedule.level_ptr[l]; k < schedule.level_ptr[l + 1]; k++)
+        {
+            row_function(schedule.rows[k]);
+        }
+    }
+}
+
+template <class T, class I>
+std::shared_ptr<TriangularAnalysis<I>> analyseTriangular(CSRMatrix<T, I> &F, bool transposed)
+{
+    int n = F.rows;
+    I *diag = F.diagonalPositions();
+    if (!F.rowsSorted())
+    {
+        throw std::invalid_argument("Triangular analysis needs sorted rows");
+    }
+    auto analysis = std::make_shared<TriangularAnalysis<I>>();
+    analysis->pattern = F.col_index;
+
+    // level of a row = 1 + the highest level of the rows it depends on
+    std::vector<int> level(n, 0);
+    int levels = n > 0 ? 1 : 0;
+    for (int i = 0; i < n; i++)
+    {
+        int l = 0;
+        for (I k = F.row_position[i]; k < diag[i]; k++)
+        {
+            l = std::max(l, level[F.col_index[k]] + 1);
+        }
+        level[i] = l;
+        levels = std::max(levels, l + 1);
+    }
+    analysis->lower = scheduleFromLevels(level, levels);
+
+    if (transposed)
+    {
+        // Row i of R^T is column i of R
+        analysis->t_row_position.assign(n + 1, 0);
+        for (I k = 0; k < F.row_position[n]; k++)
+        {
+            analysis->t_row_position[F.col_index[k] + 1]++;
+        }
+        for (int i = 0; i < n; i++)
+        {
+            analysis->t_row_position[i + 1] += analysis->t_row_position[i];
+        }
+        analysis->t_col_index.resize(F.row_position[n]);
+        analysis->t_source.resize(F.row_position[n]);
+        std::vector<I> next(analysis->t_row_position.begin(), analysis->t_row_position.end() - 1);
+        for (int i = 0; i < n; i++)
+        {
+            for (I k = F.row_position[i]; k < F.row_position[i + 1]; k++)
+            {
+                I dest = next[F.col_index[k]]++;
+                analysis->t_col_index[dest] = i;
+                analysis->t_source[dest] = k;
+            }
+        }
+
+        // R^T is upper triangular with the diagonal first in each row
+        levels = n > 0 ? 1 : 0;
+        for (int i = n - 1; i >= 0; i--)
+        {
+            int l = 0;
+            for (I k = analysis->t_row_position[i] + 1; k < analysis->t_row_position[i + 1]; k++)
+            {
+                l = std::max(l, level[analysis->t_col_index[k]] + 1);
+            }
+            level[i] = l;
+            levels = std::max(levels, l + 1);
+        }
+    }
+    else
+    {
+        levels = n > 0 ? 1 : 0;
+        for (int i = n - 1; i >= 0; i--)
+        {
+            int l = 0;
+            for (I k = diag[i] + 1; k < F.row_position[i + 1]; k++)
+            {
+                l = std::max(l, level[F.col_index[k]] + 1);
+            }
+            level[i] = l;
+            levels = std::max(levels, l + 1);
+        }
+    }
+    analysis->upper = scheduleFromLevels(level, levels);
+    return analysis;
+}
+
+template <class T, class I>
+void lowerSolve(CSRMatrix<T, I> &F, const TriangularAnalysis<I> &analysis, const T *inv_diag, std::vector<T> &x)
+{
+    I *diag = F.diagonalPositions();
+    forEachScheduledRow(analysis.lower, F.rows, true, [&](int i) {
+        T sum = x[i];
+        for (I k = F.row_position[i]; k < diag[i]; k++)
+        {
+            sum -= F.values[k] * x[F.col_index[k]];
+        }
+        x[i] = inv_diag ? sum * inv_diag[i] : sum;
+    });
+}
+
+template <class T, class I>
+void upperSolve(CSRMatrix<T, I> &F, const TriangularAnalysis<I> &analysis, const T *inv_diag, std::vector<T> &x)
+{
+    I *diag = F.diagonalPositions();
+    forEachScheduledRow(analysis.upper, F.rows, false, [&](int i) {
+        T sum = x[i];
+        for (I k = diag[i] + 1; k < F.row_position[i + 1]; k++)
+        {
+            sum -= F.values[k] * x[F.col_index[k]];
+        }
+        x[i] = inv_diag ? sum * inv_diag[i] : sum / F.values[diag[i]];
+    });
+}
+
+template <class T, class I>
+void transposedLowerSolve(CSRMatrix<T, I> &R, const TriangularAnalysis<I> &analysis, const T *inv_diag, std::vector<T> &x)
+{
+    forEachScheduledRow(analysis.upper, R.rows, false, [&](int i) {
+        T sum = x[i];
+        for (I k = analysis.t_row_position[i] + 1; k < analysis.t_row_position[i + 1]; k++)
+        {
+            sum -= R.values[analysis.t_source[k]] * x[analysis.t_col_index[k]];
+        }
+        x[i] = sum * inv_diag[i];
+    });
+}
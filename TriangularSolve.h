@@ -0,0 +1,59 @@
+#pragma once
+#include "CSRMatrix.h"
+#include <vector>
+#include <memory>
+
+// Rows of a sparse triangular matrix grouped into dependency levels: a row
+// only depends on rows in earlier levels, so the rows of one level can be
+// solved in parallel.
+struct LevelSchedule
+{
+    int levels = 0;
+    std::vector<int> level_ptr; // size levels + 1
+    std::vector<int> rows;
+
+    // Below this many rows per level the barriers cost more than they save,
+    // and the solves run serially in row order
+    bool parallel() const { return levels > 0 && rows.size() >= 64 * (size_t)levels; }
+};
+
+// Analysis for the triangular solves with a factor, built once per pattern and
+// reused for every solve with factors that share it
+template <class I = int>
+struct TriangularAnalysis
+{
+    std::shared_ptr<int[]> pattern; // col_index of the factor analysed, kept alive so it identifies the pattern
+    LevelSchedule lower;            // entries before the diagonal of each row
+    LevelSchedule upper;            // entries after the diagonal, or of the transpose for lower factors
+
+    // Pattern of the transpose of a lower triangular factor, with the position
+    // of each entry in the factor, for solves with R^T without forming it
+    std::vector<I> t_row_position;
+    std::vector<int> t_col_index;
+    std::vector<I> t_source;
+};
+
+// Call row_function(i) for every row, level by level with the rows of a level
+// in parallel, or serially in row order (forward or backward) when the levels
+// are too small. Also drives numeric factorisations with the same dependencies.
+template <class RowFunction>
+void forEachScheduledRow(const LevelSchedule &schedule, int n, bool forward, RowFunction row_function);
+
+// Analysis for a factor with L before and U after the diagonal in each row (LU),
+// or for a lower triangular R used as R and R^T (Cholesky) when transposed is true.
+// The rows must be sorted with a diagonal entry.
+template <class T, class I>
+std::shared_ptr<TriangularAnalysis<I>> analyseTriangular(CSRMatrix<T, I> &F, bool transposed);
+
+// x <- L^-1 x with L the entries before the diagonal of each row, and either
+// a unit diagonal or the stored one (through its inverse)
+template <class T, class I>
+void lowerSolve(CSRMatrix<T, I> &F, const TriangularAnalysis<I> &analysis, const T *inv_diag, std::vector<T> &x);
+
+// x <- U^-1 x with U the diagonal and the entries after it in each row
+template <class T, class I>
+void upperSolve(CSRMatrix<T, I> &F, const TriangularAnalysis<I> &analysis, const T *inv_diag, std::vector<T> &x);
+
+// x <- R^-T x for a lower triangular R, using the transposed pattern
+template <class T, class I>
+void transposedLowerSolve(CSRMatrix<T, I> &R, const TriangularAnalysis<I> &analysis, const T *inv_diag, std::vector<T> &x);
@@ -5,10 +5,25 @@
 #include <vector>
 #include <fstream>
 #include <string>
+#include <random>
+#include <algorithm>
+#include <functional>
 #include "Matrix.h"
 #include "CSRMatrix.h"
 #include "Solver.h"
 #include "SparseSolver.h"
+#include "CSRBuilder.h"
+#include "MatrixMarket.h"
+#include "BinaryIO.h"
+#include "Generators.h"
+#include "Reordering.h"
+#include "Symbolic.h"
+#include "TriangularSolve.h"
+#include "Preconditioner.h"
+#include "Chebyshev.h"
+#include "AMG.h"
+#include "GeometricMultigrid.h"
+#include "SolverSession.h"
 #include "TestRunner.h"
 #include "utilities.h"
 
@@ -126,6 +141,833 @@ void performance_lu_dense(int minsize, int maxsize)
     myfile.close();
 }
 
+void performance_csr_builder(int size, int per_row)
+{
+    std::string filename = "data/csr_builder_" + std::to_string(size) + "x" + std::to_string(per_row) + ".txt";
+    std::ofstream myfile;
+    myfile.open(filename);
+
+    // Every entry is contributed twice, as in finite element assembly
+    long long n_triplets = 2LL * size * per_row;
+    int max_threads = numThreads();
+
+    for (int threads = 1; threads <= max_threads; threads *= 2)
+    {
+        setNumThreads(threads);
+        CSRBuilder<double> builder(size, size);
+
+        auto t1 = std::chrono::high_resolution_clock::now();
+#pragma omp parallel for schedule(static)
+        for (int i = 0; i < size; i++)
+        {
+            std::vector<int> rows(2 * per_row, i);
+            std::vector<int> cols(2 * per_row);
+            std::vector<double> vals(2 * per_row, 0.5);
+            for (int k = 0; k < 2 * per_row; k++)
+            {
+                cols[k] = (int)(((long long)i * 7919 + (k % per_row) * 104729) % size);
+            }
+            builder.addBatch(rows, cols, vals);
+        }
+        auto t2 = std::chrono::high_resolution_clock::now();
+        auto matrix = builder.build();
+        auto t3 = std::chrono::high_resolution_clock::now();
+
+        double add_time = std::chrono::duration<double>(t2 - t1).count();
+        double build_time = std::chrono::duration<double>(t3 - t2).count();
+        std::cout << "CSRBuilder with " << threads << " threads, " << n_triplets << " triplets: add = " << add_time
+                  << " s, build = " << build_time << " s, nnzs = " << matrix->nnzs << std::endl;
+
+        if (myfile.is_open())
+        {
+            myfile << threads << "," << add_time << "," << build_time << std::endl;
+        }
+        else
+            std::cout << "Unable to open file";
+    }
+    setNumThreads(max_threads);
+    myfile.close();
+}
+
+void performance_matrix_market(int size, int per_row)
+{
+    // banded test matrix, written to disk and read back
+    long long nnzs = (long long)size * per_row;
+    CSRMatrix<double> A(size, size, (int)nnzs, true);
+    for (int i = 0; i <= size; i++)
+    {
+        A.row_position[i] = i * per_row;
+    }
+    for (int i = 0; i < size; i++)
+    {
+        for (int k = 0; k < per_row; k++)
+        {
+            A.col_index[i * per_row + k] = std::min(size - per_row, std::max(0, i - per_row / 2)) + k;
+            A.values[i * per_row + k] = 1.0 / (1.0 + i + k);
+        }
+    }
+
+    std::string filename = "data/matrix_market_benchmark.mtx";
+    auto t1 = std::chrono::high_resolution_clock::now();
+    writeMatrixMarket(filename, A);
+    auto t2 = std::chrono::high_resolution_clock::now();
+    std::cout << "Matrix Market write of " << nnzs << " non-zeros, time = " << std::chrono::duration<double>(t2 - t1).count() << " s" << std::endl;
+
+    // reports its own throughput in MB/s
+    auto B = readMatrixMarket<double>(filename, true);
+    std::remove(filename.c_str());
+
+    if (B->nnzs != A.nnzs)
+    {
+        throw "Matrix Market round trip lost entries";
+    }
+
+    // the same matrix through the binary container
+    std::string bin_filename = "data/binary_benchmark.bin";
+    writeBinary(bin_filename, A);
+    t1 = std::chrono::high_resolution_clock::now();
+    auto C = loadBinaryCSR<double>(bin_filename);
+    t2 = std::chrono::high_resolution_clock::now();
+    auto C_checked = loadBinaryCSR<double>(bin_filename, true);
+    auto t3 = std::chrono::high_resolution_clock::now();
+    std::remove(bin_filename.c_str());
+    std::cout << "Binary load, time = " << std::chrono::duration<double>(t2 - t1).count() << " s, with checksum = "
+              << std::chrono::duration<double>(t3 - t2).count() << " s" << std::endl;
+}
+
+void performance_generators(int n)
+{
+    // n^3 unknowns for the 3D stencils and the random matrices, 8 n^3 for the 2D ones
+    auto time_generator = [](std::string name, auto generate) {
+        auto t1 = std::chrono::high_resolution_clock::now();
+        auto A = generate();
+        auto t2 = std::chrono::high_resolution_clock::now();
+        double duration = std::chrono::duration<double>(t2 - t1).count();
+        std::cout << name << ": rows = " << A->rows << ", nnzs = " << A->nnzs << ", time = " << duration
+                  << " s, " << (double)A->nnzs / duration / 1e6 << " M nnzs/s" << std::endl;
+    };
+
+    int n2 = (int)sqrt(8.0 * n * n * n);
+    time_generator("Poisson 2D 5-point", [&]() { return poisson2D<double>(n2, n2); });
+    time_generator("Poisson 3D 7-point", [&]() { return poisson3D<double>(n, n, n, 7); });
+    time_generator("Poisson 3D 27-point", [&]() { return poisson3D<double>(n, n, n, 27); });
+    time_generator("Anisotropic 2D", [&]() { return anisotropicDiffusion2D<double>(n2, n2, 1e-3, M_PI / 6); });
+    time_generator("Banded", [&]() { return bandedSPD<double>(n * n * n, 8, 1); });
+    time_generator("Random SPD (power law)", [&]() { return randomSPD<double>(n * n * n, 8, RowLengthDistribution::PowerLaw, 1); });
+}
+
+// average time of one matVecMult over repeats
+template <class T, class I>
+double time_spmv(CSRMatrix<T, I> &A, int repeats)
+{
+    std::vector<T> x(A.cols, 1.0);
+    std::vector<T> y(A.rows, 0);
+    A.matVecMult(x, y);
+    auto t1 = std::chrono::high_resolution_clock::now();
+    for (int r = 0; r < repeats; r++)
+    {
+        A.matVecMult(x, y);
+    }
+    auto t2 = std::chrono::high_resolution_clock::now();
+    return std::chrono::duration<double>(t2 - t1).count() / repeats;
+}
+
+void performance_rcm(int nx)
+{
+    // a 3D mesh numbered in a scattered order, as an unstructured mesh generator might
+    int size = nx * nx * nx;
+    auto mesh = poisson3D<double>(nx, nx, nx, 27);
+    std::vector<int> scatter(size);
+    for (int i = 0; i < size; i++)
+    {
+        scatter[i] = i;
+    }
+    std::shuffle(scatter.begin(), scatter.end(), std::mt19937(1));
+    auto A = permuteSymmetric(*mesh, scatter);
+
+    auto t1 = std::chrono::high_resolution_clock::now();
+    std::vector<int> perm = reverseCuthillMcKee(*A);
+    auto B = permuteSymmetric(*A, perm);
+    auto t2 = std::chrono::high_resolution_clock::now();
+
+    int repeats = 20;
+    double before = time_spmv(*A, repeats);
+    double after = time_spmv(*B, repeats);
+    std::cout << "RCM for " << size << " rows, nnzs = " << A->nnzs << ", time = " << std::chrono::duration<double>(t2 - t1).count() << " s" << std::endl;
+    std::cout << "Bandwidth before = " << bandwidth(*A) << ", after = " << bandwidth(*B) << std::endl;
+    std::cout << "SpMV before = " << before << " s (" << 2.0 * A->nnzs / before / 1e9 << " GFlop/s), after = " << after
+              << " s (" << 2.0 * B->nnzs / after / 1e9 << " GFlop/s)" << std::endl;
+}
+
+void performance_spmm(int nx)
+{
+    auto A = poisson3D<double>(nx, nx, nx, 27);
+    int size = A->rows;
+    int repeats = 5;
+
+    for (int n_vecs : {8, 16, 32})
+    {
+        std::vector<double> X((size_t)size * n_vecs, 1.0);
+        std::vector<double> Y((size_t)size * n_vecs, 0);
+        std::vector<double> x(size, 1.0), y(size, 0);
+
+        auto t1 = std::chrono::high_resolution_clock::now();
+        for (int r = 0; r < repeats; r++)
+        {
+            A->matMultiVecMult(X, n_vecs, Y);
+        }
+        auto t2 = std::chrono::high_resolution_clock::now();
+        for (int r = 0; r < repeats; r++)
+        {
+            for (int k = 0; k < n_vecs; k++)
+            {
+                A->matVecMult(x, y);
+            }
+        }
+        auto t3 = std::chrono::high_resolution_clock::now();
+
+        double spmm = std::chrono::duration<double>(t2 - t1).count() / repeats;
+        double spmv = std::chrono::duration<double>(t3 - t2).count() / repeats;
+        std::cout << "SpMM with " << n_vecs << " vectors: " << spmm << " s, " << n_vecs << " x SpMV: " << spmv
+                  << " s, speedup = " << spmv / spmm << std::endl;
+    }
+}
+
+void performance_symbolic(int nx)
+{
+    auto A = poisson2D<double>(nx, nx);
+    std::vector<double> b(A->rows, 1);
+    SparseSolver<double> sparse_solver = SparseSolver<double>(*A, b);
+
+    auto t1 = std::chrono::high_resolution_clock::now();
+    auto R = sparse_solver.cholesky_symbolic();
+    auto t2 = std::chrono::high_resolution_clock::now();
+    auto LU = sparse_solver.lu_symbolic();
+    auto t3 = std::chrono::high_resolution_clock::now();
+
+    std::cout << "Symbolic Cholesky for " << A->rows << " rows, nnzs(A) = " << A->nnzs << ", nnzs(L) = " << R->nnzs
+              << ", time = " << std::chrono::duration<double>(t2 - t1).count() << " s" << std::endl;
+    std::cout << "Symbolic LU: nnzs(L + U) = " << LU->nnzs << ", time = " << std::chrono::duration<double>(t3 - t2).count()
+              << " s" << std::endl;
+}
+
+void performance_supernodal_cholesky(int nx)
+{
+    auto A = poisson3D<double>(nx, nx, nx, 7);
+    std::vector<double> b(A->rows, 1);
+    SparseSolver<double> sparse_solver = SparseSolver<double>(*A, b);
+
+    auto t1 = std::chrono::high_resolution_clock::now();
+    auto pattern = sparse_solver.cholesky_symbolic();
+    auto t2 = std::chrono::high_resolution_clock::now();
+    auto R = sparse_solver.cholesky_decomp();
+    auto t3 = std::chrono::high_resolution_clock::now();
+
+    // flops of the factorisation: sum over the columns of count^2
+    double flops = 0;
+    std::vector<double> col_counts(R->rows, 0);
+    for (int k = 0; k < R->nnzs; k++)
+    {
+        col_counts[R->col_index[k]]++;
+    }
+    for (double c : col_counts)
+    {
+        flops += c * c;
+    }
+
+    double numeric = std::chrono::duration<double>(t3 - t2).count();
+    std::cout << "Supernodal Cholesky for " << A->rows << " rows, nnzs(L) = " << R->nnzs << ", supernodes = "
+              << sparse_solver.cholesky_analysis->supernodes->count << std::endl;
+    std::cout << "Symbolic = " << std::chrono::duration<double>(t2 - t1).count() << " s, numeric = " << numeric << " s ("
+              << flops / numeric / 1e9 << " GFlop/s) on " << numThreads() << " threads" << std::endl;
+}
+
+void performance_orderings(int nx2, int nx3)
+{
+    std::vector<std::pair<std::string, std::shared_ptr<CSRMatrix<double>>>> problems = {
+        {"2D Poisson", poisson2D<double>(nx2, nx2)}, {"3D Poisson", poisson3D<double>(nx3, nx3, nx3, 7)}};
+    std::vector<std::pair<std::string, FillOrdering>> orderings = {
+        {"natural", FillOrdering::Natural}, {"AMD", FillOrdering::AMD}, {"nested dissection", FillOrdering::NestedDissection}};
+
+    for (auto &problem : problems)
+    {
+        CSRMatrix<double> &A = *problem.second;
+        std::vector<double> b(A.rows, 1);
+        for (auto &ordering : orderings)
+        {
+            SparseSolver<double> sparse_solver = SparseSolver<double>(A, b);
+            sparse_solver.ordering = ordering.second;
+
+            auto t1 = std::chrono::high_resolution_clock::now();
+            sparse_solver.cholesky_symbolic();
+            auto t2 = std::chrono::high_resolution_clock::now();
+            auto R = sparse_solver.cholesky_decomp();
+            auto t3 = std::chrono::high_resolution_clock::now();
+
+            std::cout << problem.first << " (" << A.rows << " rows), " << ordering.first
+                      << ": nnz(L) = " << sparse_solver.cholesky_analysis->predicted_nnzs
+                      << ", ordering + symbolic = " << std::chrono::duration<double>(t2 - t1).count()
+                      << " s, factor = " << std::chrono::duration<double>(t3 - t2).count() << " s" << std::endl;
+        }
+    }
+}
+
+void performance_lu_pivoting(int nx)
+{
+    // cell Peclet number 6: the east/west couplings outweigh the diagonal, so
+    // pivoting interchanges rows
+    auto A = convectionDiffusion2D<double>(nx, nx, 6);
+    std::vector<double> b(A->rows, 1);
+
+    for (double threshold : {1.0, 0.1})
+    {
+        SparseSolver<double> sparse_solver = SparseSolver<double>(*A, b);
+        sparse_solver.lu_symbolic();
+        std::vector<int> perm_indx;
+        auto t1 = std::chrono::high_resolution_clock::now();
+        auto LU = sparse_solver.lu_decomp(perm_indx, threshold);
+        auto t2 = std::chrono::high_resolution_clock::now();
+        std::vector<double> x(A->rows, 0);
+        sparse_solver.lu_solve(*LU, perm_indx, x);
+        std::vector<double> b_estimate(A->rows, 0);
+        double residual = sparse_solver.residualCalc(x, b_estimate);
+
+        int swaps = 0;
+        for (int i = 0; i < A->rows; i++)
+        {
+            swaps += perm_indx[i] != i;
+        }
+        std::cout << "Gilbert-Peierls LU, threshold " << threshold << ": " << A->rows << " rows, nnz(L + U) = " << LU->nnzs
+                  << ", row interchanges = " << swaps << ", time = " << std::chrono::duration<double>(t2 - t1).count()
+                  << " s, residual = " << residual << std::endl;
+    }
+}
+
+void performance_triangular_solves(int nx, int repeats)
+{
+    auto A = poisson2D<double>(nx, nx);
+    std::vector<double> b(A->rows, 1);
+    std::vector<std::pair<std::string, FillOrdering>> orderings = {{"AMD", FillOrdering::AMD},
+                                                                   {"nested dissection", FillOrdering::NestedDissection}};
+
+    for (auto &ordering : orderings)
+    {
+        SparseSolver<double> sparse_solver = SparseSolver<double>(*A, b);
+        sparse_solver.ordering = ordering.second;
+        auto R = sparse_solver.cholesky_decomp();
+        std::vector<double> x(A->rows, 0);
+
+        // the first solve builds the level schedules, the others reuse them
+        auto t1 = std::chrono::high_resolution_clock::now();
+        sparse_solver.cholesky_solve(*R, x);
+        auto t2 = std::chrono::high_resolution_clock::now();
+        for (int r = 0; r < repeats; r++)
+        {
+            sparse_solver.cholesky_solve(*R, x);
+        }
+        auto t3 = std::chrono::high_resolution_clock::now();
+        auto R_T = R->transpose();
+        auto t4 = std::chrono::high_resolution_clock::now();
+
+        auto &analysis = *sparse_solver.cholesky_solve_analysis;
+        std::cout << "Cholesky solves, " << ordering.first << ": " << A->rows << " rows, nnz(L) = " << R->nnzs
+                  << ", levels = " << analysis.lower.levels << " / " << analysis.upper.levels
+                  << ", first solve = " << std::chrono::duration<double>(t2 - t1).count()
+                  << " s, solve = " << std::chrono::duration<double>(t3 - t2).count() / repeats
+                  << " s, transpose = " << std::chrono::duration<double>(t4 - t3).count() << " s on " << numThreads()
+                  << " threads" << std::endl;
+    }
+}
+
+void performance_preconditioners(int nx)
+{
+    // anisotropic diffusion at 30 degrees, badly conditioned for plain CG
+    auto A = anisotropicDiffusion2D<double>(nx, nx, 0.001, M_PI / 6);
+    std::vector<double> b(A->rows, 1);
+    double tol = 1e-8;
+    int it_max = 20000;
+
+    JacobiPreconditioner<double> jacobi;
+    SSORPreconditioner<double> ssor(1.5);
+    IC0Preconditioner<double> ic0;
+    ILU0Preconditioner<double> ilu0;
+    std::vector<std::pair<std::string, Preconditioner<double> *>> preconditioners = {
+        {"none", nullptr}, {"Jacobi", &jacobi}, {"SSOR(1.5)", &ssor}, {"IC(0)", &ic0}, {"ILU(0)", &ilu0}};
+
+    for (auto &preconditioner : preconditioners)
+    {
+        SparseSolver<double> sparse_solver = SparseSolver<double>(*A, b);
+        std::vector<double> x(A->rows, 0);
+        auto t1 = std::chrono::high_resolution_clock::now();
+        if (preconditioner.second)
+        {
+            preconditioner.second->setup(sparse_solver.A);
+        }
+        auto t2 = std::chrono::high_resolution_clock::now();
+        if (preconditioner.second)
+        {
+            sparse_solver.conjugateGradient(x, tol, it_max, *preconditioner.second);
+        }
+        else
+        {
+            sparse_solver.conjugateGradient(x, tol, it_max);
+        }
+        auto t3 = std::chrono::high_resolution_clock::now();
+
+        std::cout << "PCG, " << preconditioner.first << ": " << A->rows << " rows, iterations = " << sparse_solver.iterations
+                  << ", setup = " << std::chrono::duration<double>(t2 - t1).count()
+                  << " s, solve = " << std::chrono::duration<double>(t3 - t2).count() << " s on " << numThreads()
+                  << " threads" << std::endl;
+    }
+}
+
+void performance_multicolour(int nx, int sweeps)
+{
+    for (int stencil : {7, 27})
+    {
+        auto A = poisson3D<double>(nx, nx, nx, stencil);
+        std::vector<double> b(A->rows, 1);
+        SparseSolver<double> sparse_solver = SparseSolver<double>(*A, b);
+
+        // a fixed number of sweeps: natural-order Gauss-Seidel is sequential,
+        // the multicolour one parallel within each colour
+        for (bool multicolour : {false, true})
+        {
+            double tol = 0;
+            int it_max = sweeps;
+            std::vector<double> x(A->rows, 0);
+            auto t1 = std::chrono::high_resolution_clock::now();
+            if (multicolour)
+            {
+                sparse_solver.sor(x, tol, it_max);
+            }
+            else
+            {
+                sparse_solver.stationaryIterative(x, tol, it_max, true);
+            }
+            auto t2 = std::chrono::high_resolution_clock::now();
+            std::vector<double> b_estimate(A->rows, 0);
+            std::cout << "Gauss-Seidel, " << (multicolour ? "multicolour" : "natural order") << ", " << stencil
+                      << "-point: " << A->rows << " rows, " << sweeps
+                      << " sweeps = " << std::chrono::duration<double>(t2 - t1).count()
+                      << " s, residual = " << sparse_solver.residualCalc(x, b_estimate) << " on " << numThreads()
+                      << " threads" << std::endl;
+        }
+
+        // symmetric Gauss-Seidel preconditioning, level-scheduled or by colours
+        double tol = 1e-8;
+        int it_max = 5000;
+        SSORPreconditioner<double> ssor(1.0);
+        MulticolourSORPreconditioner<double> multicolour_ssor(1.0);
+        std::vector<std::pair<std::string, Preconditioner<double> *>> preconditioners = {
+            {"level-scheduled SGS", &ssor}, {"multicolour SGS", &multicolour_ssor}};
+        for (auto &preconditioner : preconditioners)
+        {
+            std::vector<double> x(A->rows, 0);
+            auto t1 = std::chrono::high_resolution_clock::now();
+            preconditioner.second->setup(sparse_solver.A);
+            auto t2 = std::chrono::high_resolution_clock::now();
+            sparse_solver.conjugateGradient(x, tol, it_max, *preconditioner.second);
+            auto t3 = std::chrono::high_resolution_clock::now();
+            std::cout << "PCG, " << preconditioner.first << ", " << stencil << "-point: " << A->rows
+                      << " rows, iterations = " << sparse_solver.iterations
+                      << ", setup = " << std::chrono::duration<double>(t2 - t1).count()
+                      << " s, solve = " << std::chrono::duration<double>(t3 - t2).count() << " s on " << numThreads()
+                      << " threads" << std::endl;
+        }
+    }
+}
+
+void performance_chebyshev(int nx)
+{
+    auto A = poisson3D<double>(nx, nx, nx, 7);
+    std::vector<double> b(A->rows, 1);
+    double tol = 1e-8;
+    int it_max = 20000;
+    SparseSolver<double> sparse_solver = SparseSolver<double>(*A, b);
+
+    // reduction-free Chebyshev against Jacobi (stopped early, it needs about
+    // the square of the Chebyshev iterations) and CG. The few Lanczos steps
+    // chebyshev takes by default find lambda_max, but only many find lambda_min.
+    for (int steps : {10, 500})
+    {
+        auto t1 = std::chrono::high_resolution_clock::now();
+        SpectrumEstimate estimate = lanczosSpectrum(*A, steps, true, 0, 0.01);
+        auto t2 = std::chrono::high_resolution_clock::now();
+        std::cout << "Lanczos, " << estimate.steps << " steps: D^-1 A in [" << estimate.lambda_min << ", "
+                  << estimate.lambda_max << "], time = " << std::chrono::duration<double>(t2 - t1).count() << " s"
+                  << std::endl;
+    }
+
+    // lambda_min of D^-1 A for the 7-point stencil
+    double lambda_min = 1 - cos(M_PI / (nx + 1));
+    std::vector<std::string> methods = {"Jacobi", "Chebyshev", "Chebyshev, lambda_min given", "CG"};
+    for (std::string &method : methods)
+    {
+        std::vector<double> x(A->rows, 0);
+        auto t1 = std::chrono::high_resolution_clock::now();
+        if (method == "Jacobi")
+        {
+            int jacobi_it_max = 1000;
+            sparse_solver.stationaryIterative(x, tol, jacobi_it_max, false);
+        }
+        else if (method == "Chebyshev")
+        {
+            sparse_solver.chebyshev(x, tol, it_max);
+        }
+        else if (method == "Chebyshev, lambda_min given")
+        {
+            sparse_solver.chebyshev(x, tol, it_max, true, lambda_min);
+        }
+        else
+        {
+            sparse_solver.conjugateGradient(x, tol, it_max);
+        }
+        auto t2 = std::chrono::high_resolution_clock::now();
+        std::vector<double> b_estimate(A->rows, 0);
+        std::cout << method << ": " << A->rows << " rows, iterations = " << sparse_solver.iterations
+                  << ", time = " << std::chrono::duration<double>(t2 - t1).count()
+                  << " s, residual = " << sparse_solver.residualCalc(x, b_estimate) << " on " << numThreads()
+                  << " threads" << std::endl;
+    }
+
+    // Chebyshev polynomials as a preconditioner, and as the AMG smoother
+    for (int degree : {2, 4, 8})
+    {
+        ChebyshevPreconditioner<double> chebyshev(degree, 0.01);
+        std::vector<double> x(A->rows, 0);
+        auto t1 = std::chrono::high_resolution_clock::now();
+        chebyshev.setup(sparse_solver.A);
+        auto t2 = std::chrono::high_resolution_clock::now();
+        sparse_solver.conjugateGradient(x, tol, it_max, chebyshev);
+        auto t3 = std::chrono::high_resolution_clock::now();
+        std::cout << "PCG, Chebyshev degree " << degree << ": iterations = " << sparse_solver.iterations
+                  << ", setup = " << std::chrono::duration<double>(t2 - t1).count()
+                  << " s, solve = " << std::chrono::duration<double>(t3 - t2).count() << " s" << std::endl;
+    }
+    std::vector<std::pair<std::string, AMGSmoother>> smoothers = {{"Gauss-Seidel", AMGSmoother::GaussSeidel},
+                                                                  {"Jacobi", AMGSmoother::Jacobi},
+                                                                  {"Chebyshev", AMGSmoother::Chebyshev}};
+    for (auto &smoother : smoothers)
+    {
+        SmoothedAggregationAMG<double> amg;
+        amg.smoother = smoother.second;
+        std::vector<double> x(A->rows, 0);
+        auto t1 = std::chrono::high_resolution_clock::now();
+        amg.setup(sparse_solver.A);
+        auto t2 = std::chrono::high_resolution_clock::now();
+        sparse_solver.conjugateGradient(x, tol, it_max, amg);
+        auto t3 = std::chrono::high_resolution_clock::now();
+        std::cout << "AMG-PCG, " << smoother.first << " smoother: iterations = " << sparse_solver.iterations
+                  << ", setup = " << std::chrono::duration<double>(t2 - t1).count()
+                  << " s, solve = " << std::chrono::duration<double>(t3 - t2).count() << " s on " << numThreads()
+                  << " threads" << std::endl;
+    }
+}
+
+void performance_cg_variants(int nx)
+{
+    auto A = poisson3D<double>(nx, nx, nx, 7);
+    std::vector<double> b(A->rows, 1);
+    double tol = 1e-8;
+    int it_max = 5000;
+    SparseSolver<double> sparse_solver = SparseSolver<double>(*A, b);
+
+    std::vector<std::pair<std::string, CGVariant>> variants = {{"standard", CGVariant::Standard},
+                                                               {"Chronopoulos-Gear", CGVariant::ChronopoulosGear},
+                                                               {"pipelined", CGVariant::Pipelined}};
+    for (auto &variant : variants)
+    {
+        sparse_solver.cg_variant = variant.second;
+        std::vector<double> x(A->rows, 0);
+        auto t1 = std::chrono::high_resolution_clock::now();
+        sparse_solver.conjugateGradient(x, tol, it_max);
+        auto t2 = std::chrono::high_resolution_clock::now();
+        double time = std::chrono::duration<double>(t2 - t1).count();
+        std::vector<double> b_estimate(A->rows, 0);
+        std::cout << "CG, " << variant.first << ": " << A->rows << " rows, iterations = " << sparse_solver.iterations
+                  << ", time = " << time << " s (" << time / sparse_solver.iterations * 1e3
+                  << " ms per iteration), residual = " << sparse_solver.residualCalc(x, b_estimate) << " on "
+                  << numThreads() << " threads" << std::endl;
+    }
+}
+
+void performance_mixed_precision_cg(int nx)
+{
+    auto A = poisson3D<double>(nx, nx, nx, 7);
+    std::vector<double> b(A->rows, 1);
+    double tol = 1e-8;
+    int it_max = 5000;
+    SparseSolver<double> sparse_solver = SparseSolver<double>(*A, b);
+
+    for (bool mixed : {false, true})
+    {
+        sparse_solver.mixed_precision = mixed;
+        std::vector<double> x(A->rows, 0);
+        auto t1 = std::chrono::high_resolution_clock::now();
+        sparse_solver.conjugateGradient(x, tol, it_max);
+        auto t2 = std::chrono::high_resolution_clock::now();
+        double time = std::chrono::duration<double>(t2 - t1).count();
+        std::vector<double> b_estimate(A->rows, 0);
+        std::cout << "CG, " << (mixed ? "single precision with reliable updates" : "double precision") << ": "
+                  << A->rows << " rows, iterations = " << sparse_solver.iterations << ", time = " << time << " s ("
+                  << time / sparse_solver.iterations * 1e3 << " ms per iteration), residual = "
+                  << sparse_solver.residualCalc(x, b_estimate) << " on " << numThreads() << " threads" << std::endl;
+    }
+}
+
+// A sequence of systems as in implicit time stepping: a slowly growing shift of
+// A and a drifting b, solved from zero, from the previous solution, and by a
+// SolverSession recycling a deflation space
+void performance_solver_session(int nx, int steps)
+{
+    auto A_ptr = poisson2D<double>(nx, nx);
+    CSRMatrix<double> &A = *A_ptr;
+    int *diag = A.diagonalPositions();
+    std::vector<double> b(A.rows);
+    double tol = 1e-8;
+    int it_max = 20000;
+
+    IC0Preconditioner<double> ic0;
+    for (bool preconditioned : {false, true})
+    {
+        std::vector<std::string> names = {"CG from zero", "CG, warm start", "SolverSession"};
+        std::vector<int> iterations(3, 0);
+        std::vector<double> times(3, 0);
+        std::vector<double> x_warm(A.rows, 0), x_session(A.rows, 0);
+        SolverSession<double> session;
+        for (int t = 0; t < steps; t++)
+        {
+            for (int i = 0; i < A.rows; i++)
+            {
+                A.values[diag[i]] = 4 + 1e-3 * (1 + 0.05 * t);
+                b[i] = 1 + sin(0.05 * t + 0.01 * i);
+            }
+            if (preconditioned)
+            {
+                ic0.setup(A);
+            }
+            SparseSolver<double> sparse_solver = SparseSolver<double>(A, b);
+            std::vector<double> x(A.rows, 0);
+            for (int method = 0; method < 3; method++)
+            {
+                auto t1 = std::chrono::high_resolution_clock::now();
+                if (method == 2)
+                {
+                    session.solve(A, b, x_session, tol, it_max, preconditioned ? &ic0 : nullptr);
+                }
+                else
+                {
+                    sparse_solver.warm_start = method == 1;
+                    std::vector<double> &x_method = method == 1 ? x_warm : x;
+                    if (preconditioned)
+                    {
+                        sparse_solver.conjugateGradient(x_method, tol, it_max, ic0);
+                    }
+                    else
+                    {
+                        sparse_solver.conjugateGradient(x_method, tol, it_max);
+                    }
+                }
+                auto t2 = std::chrono::high_resolution_clock::now();
+                iterations[method] += method == 2 ? session.iterations : sparse_solver.iterations;
+                times[method] += std::chrono::duration<double>(t2 - t1).count();
+            }
+        }
+        for (int method = 0; method < 3; method++)
+        {
+            std::cout << names[method] << (preconditioned ? " with IC(0)" : "") << ", " << steps << " systems of "
+                      << A.rows << " rows: iterations = " << iterations[method] << ", time = " << times[method] << " s"
+                      << std::endl;
+        }
+    }
+}
+
+void performance_block_cg(int nx, int stencil)
+{
+    auto A = poisson3D<double>(nx, nx, nx, stencil);
+    int n = A->rows;
+    double tol = 1e-8;
+    int it_max = 5000;
+    std::vector<double> b(n);
+    SparseSolver<double> sparse_solver = SparseSolver<double>(*A, b);
+    std::mt19937 generator(1);
+    std::uniform_real_distribution<double> uniform(0, 1);
+
+    for (int n_rhs : {4, 8, 16})
+    {
+        std::vector<double> B((size_t)n * n_rhs);
+        for (double &value : B)
+        {
+            value = uniform(generator);
+        }
+
+        // one right-hand side at a time
+        std::vector<double> x(n);
+        int total_iterations = 0;
+        auto t1 = std::chrono::high_resolution_clock::now();
+        for (int c = 0; c < n_rhs; c++)
+        {
+            for (int i = 0; i < n; i++)
+            {
+                sparse_solver.b[i] = B[(size_t)i * n_rhs + c];
+            }
+            sparse_solver.conjugateGradient(x, tol, it_max);
+            total_iterations += sparse_solver.iterations;
+        }
+        auto t2 = std::chrono::high_resolution_clock::now();
+
+        std::vector<double> X;
+        sparse_solver.blockConjugateGradient(X, B, n_rhs, tol, it_max);
+        auto t3 = std::chrono::high_resolution_clock::now();
+
+        double sequential = std::chrono::duration<double>(t2 - t1).count();
+        double block = std::chrono::duration<double>(t3 - t2).count();
+        std::cout << "CG, " << n_rhs << " right-hand sides one at a time: " << n << " rows, " << stencil
+                  << "-point stencil, iterations = " << total_iterations << ", time = " << sequential << " s ("
+                  << n_rhs / sequential << " solves per second)" << std::endl;
+        std::cout << "Block CG, " << n_rhs << " right-hand sides: iterations = " << sparse_solver.iterations
+                  << ", time = " << block << " s (" << n_rhs / block << " solves per second), speedup = "
+                  << sequential / block << " on " << numThreads() << " threads" << std::endl;
+    }
+}
+
+void performance_amg(int nx2_max, int nx3_max)
+{
+    std::vector<std::pair<std::string, std::shared_ptr<CSRMatrix<double>>>> problems;
+    for (int nx = nx2_max / 4; nx <= nx2_max; nx *= 2)
+    {
+        problems.push_back({"2D Poisson", poisson2D<double>(nx, nx)});
+    }
+    for (int nx = nx3_max / 4; nx <= nx3_max; nx *= 2)
+    {
+        problems.push_back({"3D Poisson", poisson3D<double>(nx, nx, nx, 7)});
+    }
+    double tol = 1e-8;
+    int it_max = 5000;
+
+    for (auto &problem : problems)
+    {
+        CSRMatrix<double> &A = *problem.second;
+        std::vector<double> b(A.rows, 1);
+        SparseSolver<double> sparse_solver = SparseSolver<double>(A, b);
+        std::vector<double> x(A.rows, 0);
+
+        SmoothedAggregationAMG<double> amg;
+        auto t1 = std::chrono::high_resolution_clock::now();
+        amg.setup(sparse_solver.A);
+        auto t2 = std::chrono::high_resolution_clock::now();
+        sparse_solver.conjugateGradient(x, tol, it_max, amg);
+        auto t3 = std::chrono::high_resolution_clock::now();
+        int amg_iterations = sparse_solver.iterations;
+
+        IC0Preconditioner<double> ic0;
+        ic0.setup(sparse_solver.A);
+        auto t4 = std::chrono::high_resolution_clock::now();
+        sparse_solver.conjugateGradient(x, tol, it_max, ic0);
+        auto t5 = std::chrono::high_resolution_clock::now();
+
+        std::cout << problem.first << " (" << A.rows << " rows): AMG-PCG iterations = " << amg_iterations
+                  << ", setup = " << std::chrono::duration<double>(t2 - t1).count()
+                  << " s, solve = " << std::chrono::duration<double>(t3 - t2).count()
+                  << " s; IC(0)-PCG iterations = " << sparse_solver.iterations
+                  << ", solve = " << std::chrono::duration<double>(t5 - t4).count() << " s" << std::endl;
+    }
+}
+
+// Grid sides 2^k - 1 up to n2_max and n3_max, so that every level coarsens
+void performance_gmg(int n2_max, int n3_max)
+{
+    std::vector<std::pair<std::string, std::vector<int>>> grids;
+    for (int n = (n2_max + 1) / 4 - 1; n <= n2_max; n = 2 * n + 1)
+    {
+        grids.push_back({"2D Poisson", {n, n, 1}});
+    }
+    for (int n = (n3_max + 1) / 4 - 1; n <= n3_max; n = 2 * n + 1)
+    {
+        grids.push_back({"3D Poisson", {n, n, n}});
+    }
+    int it_max = 100;
+
+    for (auto &grid : grids)
+    {
+        std::vector<int> &g = grid.second;
+        auto A_ptr = g[2] > 1 ? poisson3D<double>(g[0], g[1], g[2], 7) : poisson2D<double>(g[0], g[1]);
+        CSRMatrix<double> &A = *A_ptr;
+        std::vector<double> b(A.rows, 1);
+        // relative to |b|: on the largest grids the true residual cannot reach 1e-8
+        double tol = 1e-9 * sqrt((double)A.rows);
+        SparseSolver<double> sparse_solver = SparseSolver<double>(A, b);
+        GeometricMultigrid<double> gmg(g[0], g[1], g[2]);
+
+        for (bool matrix_free : {true, false})
+        {
+            gmg.matrix_free = matrix_free;
+            auto t1 = std::chrono::high_resolution_clock::now();
+            gmg.setup(sparse_solver.A);
+            auto t2 = std::chrono::high_resolution_clock::now();
+            std::vector<double> x(A.rows, 0);
+            gmg.red_first_post_smoothing = true;
+            sparse_solver.stationaryIterative(x, tol, it_max, gmg);
+            auto t3 = std::chrono::high_resolution_clock::now();
+            int cycles = sparse_solver.iterations;
+            std::fill(x.begin(), x.end(), 0);
+            gmg.red_first_post_smoothing = false;
+            sparse_solver.conjugateGradient(x, tol, it_max, gmg);
+            auto t4 = std::chrono::high_resolution_clock::now();
+            std::cout << grid.first << " (" << A.rows << " rows), " << (matrix_free ? "matrix-free" : "CSR")
+                      << " levels: setup = " << std::chrono::duration<double>(t2 - t1).count()
+                      << " s; V-cycles = " << cycles << ", " << std::chrono::duration<double>(t3 - t2).count()
+                      << " s; GMG-PCG iterations = " << sparse_solver.iterations << ", "
+                      << std::chrono::duration<double>(t4 - t3).count() << " s" << std::endl;
+        }
+
+        SmoothedAggregationAMG<double> amg;
+        auto t1 = std::chrono::high_resolution_clock::now();
+        amg.setup(sparse_solver.A);
+        std::vector<double> x(A.rows, 0);
+        sparse_solver.conjugateGradient(x, tol, it_max, amg);
+        auto t2 = std::chrono::high_resolution_clock::now();
+        std::cout << grid.first << " (" << A.rows << " rows): AMG-PCG iterations = " << sparse_solver.iterations
+                  << ", setup and solve = " << std::chrono::duration<double>(t2 - t1).count() << " s" << std::endl;
+    }
+}
+
+void performance_nonsymmetric(int nx, double peclet)
+{
+    auto A = convectionDiffusion2D<double>(nx, nx, peclet);
+    std::vector<double> b(A->rows, 1);
+    double tol = 1e-8;
+    int it_max = 20000;
+
+    SparseSolver<double> sparse_solver = SparseSolver<double>(*A, b);
+    ILU0Preconditioner<double> ilu0;
+    ilu0.setup(sparse_solver.A);
+
+    std::vector<std::pair<std::string, Preconditioner<double> *>> preconditioners = {{"none", nullptr}, {"ILU(0)", &ilu0}};
+    for (auto &preconditioner : preconditioners)
+    {
+        std::vector<std::pair<std::string, std::function<void(std::vector<double> &)>>> solvers = {
+            {"GMRES(30), MGS",
+             [&](std::vector<double> &x) { sparse_solver.gmres(x, tol, it_max, 30, preconditioner.second, GramSchmidt::Modified); }},
+            {"GMRES(30), CGS2",
+             [&](std::vector<double> &x) { sparse_solver.gmres(x, tol, it_max, 30, preconditioner.second, GramSchmidt::Classical2); }},
+            {"BiCGSTAB", [&](std::vector<double> &x) { sparse_solver.bicgstab(x, tol, it_max, preconditioner.second); }}};
+        for (auto &solver : solvers)
+        {
+            std::vector<double> x(A->rows, 0);
+            auto t1 = std::chrono::high_resolution_clock::now();
+            solver.second(x);
+            auto t2 = std::chrono::high_resolution_clock::now();
+            std::vector<double> b_estimate(A->rows, 0);
+            std::cout << solver.first << ", preconditioner " << preconditioner.first << ": " << A->rows
+                      << " rows, iterations = " << sparse_solver.iterations
+                      << ", time = " << std::chrono::duration<double>(t2 - t1).count()
+                      << " s, residual = " << sparse_solver.residualCalc(x, b_estimate) << std::endl;
+        }
+    }
+}
+
 void run_performance()
 {
     int minsize = 100;
@@ -133,4 +975,25 @@ void run_performance()
 
     performance_lu_dense(minsize, maxsize);
     performance_dense_jacobi_and_gauss_seidl(minsize, maxsize);
+    performance_csr_builder(1000000, 16);
+    performance_matrix_market(1000000, 16);
+    performance_generators(100);
+    performance_rcm(100);
+    performance_spmm(60);
+    performance_symbolic(300);
+    performance_supernodal_cholesky(30);
+    performance_orderings(300, 30);
+    performance_lu_pivoting(300);
+    performance_triangular_solves(300, 20);
+    performance_preconditioners(300);
+    performance_multicolour(60, 50);
+    performance_chebyshev(60);
+    performance_cg_variants(80);
+    performance_mixed_precision_cg(80);
+    performance_solver_session(150, 10);
+    performance_block_cg(40, 7);
+    performance_block_cg(40, 27);
+    performance_amg(400, 80);
+    performance_gmg(1023, 127);
+    performance_nonsymmetric(300, 4);
 }
\ No newline at end of file
@@ -11,9 +11,42 @@
 #include "Solver.cpp"
 #include "SparseSolver.h"
 #include "SparseSolver.cpp"
+#include "Reordering.h"
+#include "Reordering.cpp"
+#include "Symbolic.h"
+#include "Symbolic.cpp"
+#include "Supernodal.h"
+#include "Supernodal.cpp"
+#include "TriangularSolve.h"
+#include "TriangularSolve.cpp"
+#include "Preconditioner.h"
+#include "Preconditioner.cpp"
+#include "Chebyshev.h"
+#include "Chebyshev.cpp"
+#include "AMG.h"
+#include "AMG.cpp"
+#include "GeometricMultigrid.h"
+#include "GeometricMultigrid.cpp"
+#include "SolverSession.h"
+#include "SolverSession.cpp"
+#include "CSRBuilder.h"
+#include "CSRBuilder.cpp"
+#include "MatrixMarket.h"
+#include "MatrixMarket.cpp"
+#include "BinaryIO.h"
+#include "BinaryIO.cpp"
+#include "Generators.h"
+#include "Generators.cpp"
 #include "TestRunner.h"
 #include "utilities.h"
 #include <memory>
+#include <limits>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <fstream>
+#include <cstdio>
+#include <random>
+#include <functional>
 
 bool test_residual_calculation()
 {
@@ -317,326 +350,2748 @@ bool test_sparse_gauss_seidel_random()
     return true;
 }
 
-bool test_sparse_CG()
+bool test_sparse_gauss_seidel_unsorted_and_updated()
 {
-    int size = 4;
-    double tol = 1e-6;
+    double tol = 1e-10;
     int it_max = 1000;
-    int nnzs = 4;
 
-    std::shared_ptr<int[]> init_row_position(new int[size + 1]{0, 1, 2, 3, 4});
-    std::shared_ptr<int[]> init_col_index(new int[nnzs]{0, 1, 2, 3});
-    std::shared_ptr<double[]> init_sparse_values(new double[nnzs]{2, 1, 3, 7});
+    // row 1 stored as columns 1, 0, 2
+    int size = 3;
+    std::shared_ptr<int[]> row_position(new int[size + 1]{0, 2, 5, 7});
+    std::shared_ptr<int[]> col_index(new int[7]{0, 1, 1, 0, 2, 1, 2});
+    std::shared_ptr<double[]> values(new double[7]{4, -1, 4, -1, -1, -1, 4});
+    CSRMatrix<double> m = CSRMatrix<double>(size, size, 7, values, row_position, col_index);
+    std::vector<double> b = {1, 2, 3};
+    std::vector<double> output_b(size, 0);
 
-    std::vector<double> b = {6.4, 7.8, 56.7, 51.1};
+    SparseSolver<double> sparse_solver = SparseSolver<double>(m, b);
     std::vector<double> x(size, 0);
+    sparse_solver.stationaryIterative(x, tol, it_max, true);
+    if (!TestRunner::assertBelowTolerance(sparse_solver.residualCalc(x, output_b), 1e-9))
+    {
+        return false;
+    }
 
-    CSRMatrix<double> sparse_matrix = CSRMatrix<double>(size, size, nnzs, init_sparse_values, init_row_position, init_col_index);
-    SparseSolver<double> sparse_solver = SparseSolver<double>(sparse_matrix, b);
+    // new values in the same pattern are picked up by the next solve
+    for (int k = 0; k < sparse_solver.A.nnzs; k++)
+    {
+        sparse_solver.A.values[k] *= 3;
+    }
+    sparse_solver.stationaryIterative(x, tol, it_max, true);
+    if (!TestRunner::assertBelowTolerance(sparse_solver.residualCalc(x, output_b), 1e-9))
+    {
+        return false;
+    }
+    sparse_solver.chebyshev(x, tol, it_max);
+    if (!TestRunner::assertBelowTolerance(sparse_solver.residualCalc(x, output_b), 1e-9))
+    {
+        return false;
+    }
 
-    auto t1 = std::chrono::high_resolution_clock::now();
-    sparse_solver.conjugateGradient(x, tol, it_max);
-    auto t2 = std::chrono::high_resolution_clock::now();
+    // the triangular preconditioners accept the unsorted matrix and leave it as it is
+    IC0Preconditioner<double> M;
+    M.setup(m);
+    sparse_solver.conjugateGradient(x, tol, it_max, M);
+    return m.col_index[2] == 1 && TestRunner::assertBelowTolerance(sparse_solver.residualCalc(x, output_b), 1e-9);
+}
 
-    auto duration = std::chrono::duration<double>(t2 - t1).count();
-    std::cout << "Time taken for sparse conjugate gradient solver: " << duration << " s " << std::endl
-              << std::endl;
+bool test_multicolour_sor()
+{
+    double tol = 1e-8;
+    int it_max = 5000;
+    auto A_ptr = poisson2D<double>(20, 20);
+    CSRMatrix<double> &A = *A_ptr;
+    int size = A.rows;
+    std::vector<double> b(size);
+    for (int i = 0; i < size; i++)
+    {
+        b[i] = 1 + i % 5;
+    }
+    std::vector<double> b_estimate(size, 0);
+    SparseSolver<double> sparse_solver = SparseSolver<double>(A, b);
 
-    std::vector<double> output_b(size, 0);
+    // red-black Gauss-Seidel has the rate of the natural order and SOR near the
+    // optimal omega is much faster. (Red-black SSOR is not: over-relaxation
+    // barely helps it, so only SGS is checked.)
+    std::vector<double> x(size, 0);
+    sparse_solver.stationaryIterative(x, tol, it_max, true);
+    int natural_iterations = sparse_solver.iterations;
+    for (bool reorder : {false, true})
+    {
+        sparse_solver.reorder = reorder;
+        sparse_solver.sor(x, tol, it_max);
+        int gauss_seidel_iterations = sparse_solver.iterations;
+        if (!TestRunner::assertBelowTolerance(sparse_solver.residualCalc(x, b_estimate), 1e-7))
+        {
+            return false;
+        }
+        if (gauss_seidel_iterations > natural_iterations * 1.1)
+        {
+            TestRunner::testError("Multicolour Gauss-Seidel converges slower than the natural order");
+            return false;
+        }
+        sparse_solver.sor(x, tol, it_max, 1.7);
+        if (!TestRunner::assertBelowTolerance(sparse_solver.residualCalc(x, b_estimate), 1e-7))
+        {
+            return false;
+        }
+        if (sparse_solver.iterations * 3 > gauss_seidel_iterations)
+        {
+            TestRunner::testError("Multicolour SOR is not faster than Gauss-Seidel");
+            return false;
+        }
+        sparse_solver.sor(x, tol, it_max, 1.0, true);
+        if (!TestRunner::assertBelowTolerance(sparse_solver.residualCalc(x, b_estimate), 1e-7))
+        {
+            return false;
+        }
+    }
+    sparse_solver.reorder = false;
 
-    double residual = sparse_solver.residualCalc(x, output_b);
+    // SGS and SSOR are symmetric preconditioners for CG, also with more colours
+    sparse_solver.conjugateGradient(x, tol, it_max);
+    int cg_iterations = sparse_solver.iterations;
+    auto A27_ptr = poisson3D<double>(8, 8, 8, 27);
+    for (double omega : {1.0, 1.3})
+    {
+        MulticolourSORPreconditioner<double> M(omega);
+        M.setup(A);
+        sparse_solver.conjugateGradient(x, tol, it_max, M);
+        if (!TestRunner::assertBelowTolerance(sparse_solver.residualCalc(x, b_estimate), 1e-7))
+        {
+            return false;
+        }
+        if (sparse_solver.iterations >= cg_iterations)
+        {
+            TestRunner::testError("Multicolour SSOR does not reduce CG iterations");
+            return false;
+        }
 
-    return TestRunner::assertBelowTolerance(residual, 1e-6);
+        M.setup(*A27_ptr);
+        int n = A27_ptr->rows;
+        std::vector<double> u(n), v(n), Mu(n), Mv(n);
+        for (int i = 0; i < n; i++)
+        {
+            u[i] = (double)((i * 37) % 11) - 5.0;
+            v[i] = (double)((i * 13) % 7) - 3.0;
+        }
+        M.apply(u, Mu);
+        M.apply(v, Mv);
+        double uMv = 0, vMu = 0, scale = 0;
+        for (int i = 0; i < n; i++)
+        {
+            uMv += u[i] * Mv[i];
+            vMu += v[i] * Mu[i];
+            scale += fabs(u[i] * Mv[i]);
+        }
+        if (!TestRunner::assertBelowTolerance(fabs(uMv - vMu) / scale, 1e-12))
+        {
+            return false;
+        }
+    }
+
+    MulticolourSORPreconditioner<double> invalid(2.0);
+    try
+    {
+        invalid.setup(A);
+    }
+    catch (std::invalid_argument &)
+    {
+        return true;
+    }
+    TestRunner::testError("SOR accepted omega = 2");
+    return false;
 }
 
-bool test_lu_dense()
+bool test_lanczos_spectrum()
 {
-    int size = 4;
-    std::vector<double> x(size, 0);
-    std::vector<double> output_b(size, 0);
+    // the eigenvalues of the 5-point stencil are 4 - 2 cos(i pi / (nx + 1)) - 2 cos(j pi / (ny + 1))
+    int nx = 30, ny = 20;
+    auto A_ptr = poisson2D<double>(nx, ny);
+    double lambda_min = 4 - 2 * cos(M_PI / (nx + 1)) - 2 * cos(M_PI / (ny + 1));
+    double lambda_max = 4 + 2 * cos(M_PI / (nx + 1)) + 2 * cos(M_PI / (ny + 1));
 
-    std::shared_ptr<double[]> init_dense_values(new double[size * size]{10., 2., 3., 5., 1., 14., 6., 2., -1., 4., 16., -4, 5., 4., 3., 11.});
+    for (bool jacobi_scaled : {false, true})
+    {
+        // D = 4 I, so D^-1 A has the same spectrum divided by 4
+        double scale = jacobi_scaled ? 0.25 : 1;
+        SpectrumEstimate estimate = lanczosSpectrum(*A_ptr, 40, jacobi_scaled);
+        std::cout << "Ritz values: " << estimate.lambda_min << " .. " << estimate.lambda_max << " after "
+                  << estimate.steps << " steps, eigenvalues " << scale * lambda_min << " .. " << scale * lambda_max
+                  << std::endl;
+        // Ritz values lie inside the spectrum, the largest close to its end
+        if (estimate.lambda_max > scale * lambda_max * (1 + 1e-10) ||
+            estimate.lambda_min < scale * lambda_min * (1 - 1e-10))
+        {
+            TestRunner::testError("Ritz values outside the spectrum");
+            return false;
+        }
+        if (estimate.lambda_max < 0.98 * scale * lambda_max || estimate.lambda_min > 10 * scale * lambda_min)
+        {
+            TestRunner::testError("Lanczos estimate is too far from the spectrum");
+            return false;
+        }
+    }
 
-    Matrix<double> dense_mat = Matrix<double>(size, size, init_dense_values);
-    std::vector<double> b = {1., 2., 3., 4.};
+    // on a diagonal matrix the Krylov space becomes invariant, and the values are exact
+    std::vector<double> diagonal = {3, 1, 4, 1, 5, 9};
+    CSRMatrix<double> D = CSRMatrix<double>(6, 6, 6, true);
+    for (int i = 0; i < 6; i++)
+    {
+        D.values[i] = diagonal[i];
+        D.col_index[i] = i;
+        D.row_position[i] = i;
+    }
+    D.row_position[6] = 6;
+    SpectrumEstimate estimate = lanczosSpectrum(D, 30);
+    if (estimate.steps > 5)
+    {
+        TestRunner::testError("Lanczos did not stop on an invariant subspace");
+        return false;
+    }
+    return TestRunner::assertBelowTolerance(fabs(estimate.lambda_min - 1), 1e-10) &&
+           TestRunner::assertBelowTolerance(fabs(estimate.lambda_max - 9), 1e-10);
+}
 
-    Solver<double> dense_solver = Solver<double>(dense_mat, b);
+bool test_chebyshev()
+{
+    double tol = 1e-8;
+    int it_max = 5000;
+    auto A_ptr = poisson2D<double>(30, 30);
+    CSRMatrix<double> &A = *A_ptr;
+    int size = A.rows;
+    std::vector<double> b(size);
+    for (int i = 0; i < size; i++)
+    {
+        b[i] = 1 + i % 5;
+    }
+    std::vector<double> b_estimate(size, 0);
+    SparseSolver<double> sparse_solver = SparseSolver<double>(A, b);
+    std::vector<double> x(size, 0);
 
-    Matrix<double> LU(size, size, true);
+    // with estimated bounds, Chebyshev is still much faster than Jacobi
+    sparse_solver.stationaryIterative(x, tol, it_max, false);
+    int jacobi_iterations = sparse_solver.iterations;
+    sparse_solver.conjugateGradient(x, tol, it_max);
+    int cg_iterations = sparse_solver.iterations;
+    for (bool reorder : {false, true})
+    {
+        sparse_solver.reorder = reorder;
+        for (bool jacobi_scaled : {true, false})
+        {
+            sparse_solver.chebyshev(x, tol, it_max, jacobi_scaled);
+            if (!TestRunner::assertBelowTolerance(sparse_solver.residualCalc(x, b_estimate), 1e-7))
+            {
+                return false;
+            }
+            if (sparse_solver.iterations * 4 > jacobi_iterations)
+            {
+                TestRunner::testError("Chebyshev iteration converges too slowly");
+                return false;
+            }
+        }
+    }
+    sparse_solver.reorder = false;
 
-    auto t1 = std::chrono::high_resolution_clock::now();
-    std::vector<int> piv = dense_solver.lu_decomp(LU);
-    dense_solver.lu_solve(LU, piv, x);
-    auto t2 = std::chrono::high_resolution_clock::now();
+    // with the exact bounds of the spectrum of A it converges at the rate CG is bounded by
+    double lambda_min = 4 - 4 * cos(M_PI / 31);
+    sparse_solver.chebyshev(x, tol, it_max, false, lambda_min, 8 - lambda_min);
+    if (!TestRunner::assertBelowTolerance(sparse_solver.residualCalc(x, b_estimate), 1e-7))
+    {
+        return false;
+    }
+    if (sparse_solver.iterations > 3 * cg_iterations)
+    {
+        TestRunner::testError("Chebyshev iteration with exact bounds converges too slowly");
+        return false;
+    }
 
-    auto duration = std::chrono::duration<double>(t2 - t1).count();
-    std::cout << "Time taken for LU: " << duration << " s " << std::endl
-              << std::endl;
+    // a lower bound alone, with lambda_max estimated
+    int estimated_iterations = sparse_solver.iterations;
+    sparse_solver.chebyshev(x, tol, it_max, false, lambda_min);
+    if (!TestRunner::assertBelowTolerance(sparse_solver.residualCalc(x, b_estimate), 1e-7))
+    {
+        return false;
+    }
+    if (sparse_solver.iterations > 2 * estimated_iterations)
+    {
+        TestRunner::testError("Chebyshev iteration with an estimated lambda_max converges too slowly");
+        return false;
+    }
 
-    double residual = dense_solver.residualCalc(x, output_b);
+    // the polynomial preconditioner is symmetric and cuts CG iterations
+    for (int degree : {1, 4})
+    {
+        ChebyshevPreconditioner<double> M(degree, 0.01);
+        M.setup(A);
+        sparse_solver.conjugateGradient(x, tol, it_max, M);
+        if (!TestRunner::assertBelowTolerance(sparse_solver.residualCalc(x, b_estimate), 1e-7))
+        {
+            return false;
+        }
+        if (degree > 1 && sparse_solver.iterations * 2 > cg_iterations)
+        {
+            TestRunner::testError("Chebyshev preconditioner does not reduce CG iterations");
+            return false;
+        }
 
-    return TestRunner::assertBelowTolerance(residual, 1e-6);
+        std::vector<double> u(size), v(size), Mu(size), Mv(size);
+        for (int i = 0; i < size; i++)
+        {
+            u[i] = (double)((i * 37) % 11) - 5.0;
+            v[i] = (double)((i * 13) % 7) - 3.0;
+        }
+        M.apply(u, Mu);
+        M.apply(v, Mv);
+        double uMv = 0, vMu = 0, scale = 0;
+        for (int i = 0; i < size; i++)
+        {
+            uMv += u[i] * Mv[i];
+            vMu += v[i] * Mu[i];
+            scale += fabs(u[i] * Mv[i]);
+        }
+        if (!TestRunner::assertBelowTolerance(fabs(uMv - vMu) / scale, 1e-12))
+        {
+            return false;
+        }
+    }
+    return true;
 }
 
-bool test_jacobi_dense_random()
+bool test_sparse_CG()
 {
-    int size = 100;
+    int size = 4;
     double tol = 1e-6;
     int it_max = 1000;
+    int nnzs = 4;
+
+    std::shared_ptr<int[]> init_row_position(new int[size + 1]{0, 1, 2, 3, 4});
+    std::shared_ptr<int[]> init_col_index(new int[nnzs]{0, 1, 2, 3});
+    std::shared_ptr<double[]> init_sparse_values(new double[nnzs]{2, 1, 3, 7});
 
+    std::vector<double> b = {6.4, 7.8, 56.7, 51.1};
     std::vector<double> x(size, 0);
-    std::vector<double> output_b(size, 0);
 
-    auto solver = Solver<double>(size);
+    CSRMatrix<double> sparse_matrix = CSRMatrix<double>(size, size, nnzs, init_sparse_values, init_row_position, init_col_index);
+    SparseSolver<double> sparse_solver = SparseSolver<double>(sparse_matrix, b);
 
     auto t1 = std::chrono::high_resolution_clock::now();
-
-    solver.stationaryIterative(x, tol, it_max, false);
-
+    sparse_solver.conjugateGradient(x, tol, it_max);
     auto t2 = std::chrono::high_resolution_clock::now();
 
     auto duration = std::chrono::duration<double>(t2 - t1).count();
-
-    std::cout << "Time taken for Jacobi: " << duration << " s " << std::endl
+    std::cout << "Time taken for sparse conjugate gradient solver: " << duration << " s " << std::endl
               << std::endl;
 
-    double residual = solver.residualCalc(x, output_b);
+    std::vector<double> output_b(size, 0);
+
+    double residual = sparse_solver.residualCalc(x, output_b);
 
     return TestRunner::assertBelowTolerance(residual, 1e-6);
 }
 
-bool test_gauss_seidel_dense_random()
+bool test_preconditioned_CG()
 {
-    int size = 100;
-    double tol = 1e-6;
-    int it_max = 1000;
-
+    double tol = 1e-8;
+    int it_max = 2000;
+    auto A_ptr = anisotropicDiffusion2D<double>(40, 40, 0.01, 0.5);
+    CSRMatrix<double> &A = *A_ptr;
+    int size = A.rows;
+    std::vector<double> b(size, 1);
     std::vector<double> x(size, 0);
-    std::vector<double> output_b(size, 0);
+    std::vector<double> b_estimate(size, 0);
 
-    auto solver = Solver<double>(size);
+    SparseSolver<double> sparse_solver = SparseSolver<double>(A, b);
+    sparse_solver.conjugateGradient(x, tol, it_max);
+    int plain_iterations = sparse_solver.iterations;
+
+    JacobiPreconditioner<double> jacobi;
+    SSORPreconditioner<double> ssor(1.2);
+    IC0Preconditioner<double> ic0;
+    ILU0Preconditioner<double> ilu0;
+    std::vector<Preconditioner<double> *> preconditioners = {&jacobi, &ssor, &ic0, &ilu0};
+    for (Preconditioner<double> *M : preconditioners)
+    {
+        M->setup(A);
+        sparse_solver.conjugateGradient(x, tol, it_max, *M);
+        if (!TestRunner::assertBelowTolerance(sparse_solver.residualCalc(x, b_estimate), 1e-6))
+        {
+            return false;
+        }
+        if (sparse_solver.iterations > plain_iterations)
+        {
+            TestRunner::testError("Preconditioned CG took more iterations than CG");
+            return false;
+        }
+    }
 
-    auto t1 = std::chrono::high_resolution_clock::now();
+    // the pattern analysis is kept when setting up again after a value change
+    auto ic0_analysis = ic0.analysis;
+    auto ilu0_analysis = ilu0.analysis;
+    for (int k = 0; k < A.nnzs; k++)
+    {
+        A.values[k] *= 2;
+    }
+    A.invalidateDiagonal();
+    ic0.setup(A);
+    ilu0.setup(A);
+    if (ic0.analysis != ic0_analysis || ilu0.analysis != ilu0_analysis)
+    {
+        TestRunner::testError("Preconditioner setup redid the pattern analysis");
+        return false;
+    }
 
-    solver.stationaryIterative(x, tol, it_max, true);
+    // with no fill to drop, IC(0) and ILU(0) are exact factorisations
+    auto T_ptr = bandedSPD<double>(300, 1);
+    CSRMatrix<double> &tridiagonal = *T_ptr;
+    std::vector<double> r(tridiagonal.rows), z(tridiagonal.rows), Az(tridiagonal.rows);
+    for (int i = 0; i < tridiagonal.rows; i++)
+    {
+        r[i] = i % 5 - 2;
+    }
+    std::vector<Preconditioner<double> *> exact = {&ic0, &ilu0};
+    for (Preconditioner<double> *M : exact)
+    {
+        M->setup(tridiagonal);
+        M->apply(r, z);
+        tridiagonal.matVecMult(z, Az);
+        double error = 0;
+        for (int i = 0; i < tridiagonal.rows; i++)
+        {
+            error = std::max(error, fabs(Az[i] - r[i]));
+        }
+        if (!TestRunner::assertBelowTolerance(error, 1e-10))
+        {
+            return false;
+        }
+    }
+    return true;
+}
 
-    auto t2 = std::chrono::high_resolution_clock::now();
+bool test_cg_variants()
+{
+    double tol = 1e-8;
+    int it_max = 2000;
+    auto A_ptr = anisotropicDiffusion2D<double>(40, 40, 0.1, 0.3);
+    CSRMatrix<double> &A = *A_ptr;
+    int size = A.rows;
+    std::vector<double> b(size);
+    for (int i = 0; i < size; i++)
+    {
+        b[i] = 1 + i % 4;
+    }
+    std::vector<double> x(size, 0);
+    std::vector<double> b_estimate(size, 0);
+    SparseSolver<double> sparse_solver = SparseSolver<double>(A, b);
+    IC0Preconditioner<double> ic0;
+    ic0.setup(A);
 
-    auto duration = std::chrono::duration<double>(t2 - t1).count();
+    for (Preconditioner<double> *M : {(Preconditioner<double> *)nullptr, (Preconditioner<double> *)&ic0})
+    {
+        int standard_iterations = 0;
+        for (CGVariant variant : {CGVariant::Standard, CGVariant::ChronopoulosGear, CGVariant::Pipelined})
+        {
+            sparse_solver.cg_variant = variant;
+            if (M)
+            {
+                sparse_solver.conjugateGradient(x, tol, it_max, *M);
+            }
+            else
+            {
+                sparse_solver.conjugateGradient(x, tol, it_max);
+            }
+            if (!TestRunner::assertBelowTolerance(sparse_solver.residualCalc(x, b_estimate), 1e-6))
+            {
+                return false;
+            }
+
+            // same Krylov iterates up to rounding
+            if (variant == CGVariant::Standard)
+            {
+                standard_iterations = sparse_solver.iterations;
+            }
+            else if (abs(sparse_solver.iterations - standard_iterations) > 2 + standard_iterations / 20)
+            {
+                TestRunner::testError("CG variant iteration count differs from standard CG");
+                return false;
+            }
+        }
+    }
+    return true;
+}
 
-    std::cout << "Time taken for Gauss-Seidel: " << duration << " s " << std::endl
-              << std::endl;
+bool test_mixed_precision_CG()
+{
+    double tol = 1e-9;
+    int it_max = 2000;
+    auto A_ptr = poisson2D<double>(40, 40);
+    CSRMatrix<double> &A = *A_ptr;
+    int size = A.rows;
+    std::vector<double> b(size);
+    for (int i = 0; i < size; i++)
+    {
+        b[i] = 1 + i % 3;
+    }
+    std::vector<double> x(size, 0);
+    std::vector<double> b_estimate(size, 0);
+    SparseSolver<double> sparse_solver = SparseSolver<double>(A, b);
 
-    double residual = solver.residualCalc(x, output_b);
+    // as accurate as double precision, in about as many iterations
+    sparse_solver.conjugateGradient(x, tol, it_max);
+    int double_iterations = sparse_solver.iterations;
+    sparse_solver.mixed_precision = true;
+    for (bool reorder : {false, true})
+    {
+        sparse_solver.reorder = reorder;
+        sparse_solver.conjugateGradient(x, tol, it_max);
+        if (!TestRunner::assertBelowTolerance(sparse_solver.residualCalc(x, b_estimate), 2 * tol))
+        {
+            return false;
+        }
+        if (sparse_solver.iterations > 1.5 * double_iterations)
+        {
+            TestRunner::testError("Mixed precision CG took too many iterations");
+            return false;
+        }
+    }
 
-    return TestRunner::assertBelowTolerance(residual, 1e-6);
+    // Neumann Laplacian plus 1e-7 I: singular once rounded to float, so the
+    // single precision iteration stagnates and the solve finishes in double
+    auto singular_ptr = poisson2D<double>(20, 20);
+    CSRMatrix<double> &singular = *singular_ptr;
+    int *diag = singular.diagonalPositions();
+    for (int i = 0; i < singular.rows; i++)
+    {
+        int degree = singular.row_position[i + 1] - singular.row_position[i] - 1;
+        singular.values[diag[i]] = degree + 1e-7;
+    }
+    std::vector<double> rhs(singular.rows);
+    for (int i = 0; i < singular.rows; i++)
+    {
+        rhs[i] = 1 + i % 3;
+    }
+    SparseSolver<double> singular_solver = SparseSolver<double>(singular, rhs);
+    singular_solver.mixed_precision = true;
+    std::vector<double> x_singular(singular.rows, 0);
+    std::vector<double> rhs_estimate(singular.rows, 0);
+    double loose = 1e-5;
+    singular_solver.conjugateGradient(x_singular, loose, it_max);
+    return TestRunner::assertBelowTolerance(singular_solver.residualCalc(x_singular, rhs_estimate), loose);
 }
 
-bool test_lu_dense_random()
+bool test_warm_start()
 {
-    int size = 100;
-    std::vector<double> x(size, 0);
-    std::vector<double> output_b(size, 0);
-
+    double tol = 1e-8;
+    int it_max = 5000;
+    auto A_ptr = poisson2D<double>(30, 30);
+    CSRMatrix<double> &A = *A_ptr;
+    int size = A.rows;
+    std::vector<double> b(size), b_next(size);
+    for (int i = 0; i < size; i++)
+    {
+        b[i] = 1 + i % 3;
+        b_next[i] = b[i] + 0.01 * (i % 5);
+    }
+    std::vector<double> b_estimate(size, 0);
+    JacobiPreconditioner<double> jacobi;
+
+    // every iterative solver converges in fewer iterations from the solution of
+    // a nearby system than from zero, also when reordered
+    std::vector<std::function<void(SparseSolver<double> &, std::vector<double> &)>> solvers = {
+        [&](SparseSolver<double> &s, std::vector<double> &x) { s.stationaryIterative(x, tol, it_max, true); },
+        [&](SparseSolver<double> &s, std::vector<double> &x) { s.conjugateGradient(x, tol, it_max); },
+        [&](SparseSolver<double> &s, std::vector<double> &x) {
+            jacobi.setup(s.A);
+            s.conjugateGradient(x, tol, it_max, jacobi);
+        },
+        [&](SparseSolver<double> &s, std::vector<double> &x) {
+            s.cg_variant = CGVariant::Pipelined;
+            s.conjugateGradient(x, tol, it_max);
+        },
+        [&](SparseSolver<double> &s, std::vector<double> &x) {
+            s.mixed_precision = true;
+            s.conjugateGradient(x, tol, it_max);
+        },
+        [&](SparseSolver<double> &s, std::vector<double> &x) { s.gmres(x, tol, it_max); },
+        [&](SparseSolver<double> &s, std::vector<double> &x) { s.bicgstab(x, tol, it_max); }};
+    for (auto &solve : solvers)
+    {
+        for (bool reorder : {false, true})
+        {
+            SparseSolver<double> sparse_solver = SparseSolver<double>(A, b);
+            sparse_solver.reorder = reorder;
+            std::vector<double> x(size, 0);
+            solve(sparse_solver, x);
+
+            sparse_solver.b = b_next;
+            std::vector<double> x_cold(x);
+            solve(sparse_solver, x_cold);
+            int cold = sparse_solver.iterations;
+            sparse_solver.warm_start = true;
+            solve(sparse_solver, x);
+            if (!TestRunner::assertBelowTolerance(sparse_solver.residualCalc(x, b_estimate), 2 * tol))
+            {
+                return false;
+            }
+            if (sparse_solver.iterations >= cold)
+            {
+                TestRunner::testError("Warm start did not save iterations");
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+bool test_solver_session()
+{
+    double tol = 1e-8;
+    int it_max = 5000;
+    auto A_ptr = poisson2D<double>(40, 40);
+    CSRMatrix<double> &A = *A_ptr;
+    int size = A.rows;
+    int *diag = A.diagonalPositions();
+    std::vector<double> b(size), b_estimate(size, 0);
+
+    // a slowly varying sequence: a small shift of A and a drifting b
+    auto step = [&](int t) {
+        for (int i = 0; i < size; i++)
+        {
+            A.values[diag[i]] = 4 + 1e-3 * (1 + 0.05 * t);
+            b[i] = 1 + sin(0.05 * t + 0.01 * i);
+        }
+    };
+
+    IC0Preconditioner<double> ic0;
+    for (bool preconditioned : {false, true})
+    {
+        SolverSession<double> session;
+        std::vector<double> x(size, 0);
+        int session_total = 0, cg_total = 0;
+        for (int t = 0; t < 6; t++)
+        {
+            step(t);
+            SparseSolver<double> sparse_solver = SparseSolver<double>(A, b);
+            std::vector<double> x_cg(size, 0);
+            if (preconditioned)
+            {
+                ic0.setup(A);
+                sparse_solver.conjugateGradient(x_cg, tol, it_max, ic0);
+            }
+            else
+            {
+                sparse_solver.conjugateGradient(x_cg, tol, it_max);
+            }
+            session.solve(A, b, x, tol, it_max, preconditioned ? &ic0 : nullptr);
+            if (!TestRunner::assertBelowTolerance(sparse_solver.residualCalc(x, b_estimate), 2 * tol))
+            {
+                return false;
+            }
+            if (t > 0)
+            {
+                session_total += session.iterations;
+                cg_total += sparse_solver.iterations;
+            }
+        }
+        if (session.deflation_vectors != session.deflation_size || session_total > 0.85 * cg_total)
+        {
+            TestRunner::testError("Recycled CG did not save iterations");
+            return false;
+        }
+    }
+
+    // deflation alone, from x = 0, also saves iterations
+    SolverSession<double> session;
+    session.warm_start = false;
+    std::vector<double> x(size, 0);
+    step(0);
+    session.solve(A, b, x, tol, it_max);
+    int first = session.iterations;
+    step(1);
+    session.solve(A, b, x, tol, it_max);
+    if (session.iterations >= first)
+    {
+        TestRunner::testError("Deflation did not save iterations");
+        return false;
+    }
+
+    // a system of another size starts over
+    auto small_ptr = poisson2D<double>(10, 10);
+    std::vector<double> b_small(small_ptr->rows, 1), x_small(small_ptr->rows, 0);
+    std::vector<double> b_small_estimate(small_ptr->rows, 0);
+    session.solve(*small_ptr, b_small, x_small, tol, it_max);
+    SparseSolver<double> small_solver = SparseSolver<double>(*small_ptr, b_small);
+    return TestRunner::assertBelowTolerance(small_solver.residualCalc(x_small, b_small_estimate), 2 * tol);
+}
+
+bool test_block_CG()
+{
+    double tol = 1e-8;
+    int it_max = 1000;
+    auto A_ptr = poisson2D<double>(30, 30);
+    CSRMatrix<double> &A = *A_ptr;
+    int size = A.rows;
+
+    // 8 right-hand sides: independent ones, a repeat, a combination and zero
+    int n_rhs = 8;
+    std::vector<double> B((size_t)size * n_rhs);
+    for (int i = 0; i < size; i++)
+    {
+        for (int c = 0; c < 5; c++)
+        {
+            B[i * n_rhs + c] = 1 + (i * (c + 1)) % (c + 3);
+        }
+        B[i * n_rhs + 5] = B[i * n_rhs + 1];
+        B[i * n_rhs + 6] = 2 * B[i * n_rhs + 0] - B[i * n_rhs + 3];
+        B[i * n_rhs + 7] = 0;
+    }
+    std::vector<double> b(size);
+    std::vector<double> x(size);
+    std::vector<double> b_estimate(size);
+    SparseSolver<double> sparse_solver = SparseSolver<double>(A, b);
+
+    for (bool reorder : {false, true})
+    {
+        sparse_solver.reorder = reorder;
+        std::vector<double> X;
+        sparse_solver.blockConjugateGradient(X, B, n_rhs, tol, it_max);
+        for (int c = 0; c < n_rhs; c++)
+        {
+            for (int i = 0; i < size; i++)
+            {
+                sparse_solver.b[i] = B[i * n_rhs + c];
+                x[i] = X[i * n_rhs + c];
+            }
+            if (!TestRunner::assertBelowTolerance(sparse_solver.residualCalc(x, b_estimate), 1e-6))
+            {
+                return false;
+            }
+        }
+    }
+
+    // the block Krylov space is larger, so it takes fewer iterations than CG on one column
+    sparse_solver.reorder = false;
+    for (int i = 0; i < size; i++)
+    {
+        sparse_solver.b[i] = B[i * n_rhs];
+    }
+    std::vector<double> X;
+    sparse_solver.blockConjugateGradient(X, B, n_rhs, tol, it_max);
+    int block_iterations = sparse_solver.iterations;
+    sparse_solver.conjugateGradient(x, tol, it_max);
+    if (block_iterations > sparse_solver.iterations)
+    {
+        TestRunner::testError("Block CG took more iterations than CG");
+        return false;
+    }
+    return true;
+}
+
+bool test_amg()
+{
+    double tol = 1e-8;
+    int it_max = 200;
+
+    // PCG iterations stay nearly flat as the grid is refined
+    std::vector<int> pcg_iterations;
+    for (int nx : {32, 64, 128})
+    {
+        auto A_ptr = poisson2D<double>(nx, nx);
+        CSRMatrix<double> &A = *A_ptr;
+        std::vector<double> b(A.rows, 1);
+        std::vector<double> x(A.rows, 0);
+        std::vector<double> b_estimate(A.rows, 0);
+        SparseSolver<double> sparse_solver = SparseSolver<double>(A, b);
+
+        SmoothedAggregationAMG<double> amg;
+        amg.coarse_size = 100;
+        amg.setup(A);
+        if (amg.levels.size() < 2)
+        {
+            TestRunner::testError("AMG built no coarse level");
+            return false;
+        }
+
+        // the Galerkin coarse operator of a symmetric matrix is symmetric
+        CSRMatrix<double> &A_coarse = *amg.levels[1].A;
+        auto A_coarse_T = A_coarse.transpose();
+        for (int k = 0; k < A_coarse.nnzs; k++)
+        {
+            if (A_coarse.col_index[k] != A_coarse_T->col_index[k] ||
+                fabs(A_coarse.values[k] - A_coarse_T->values[k]) > 1e-12)
+            {
+                TestRunner::testError("Coarse operator is not symmetric");
+                return false;
+            }
+        }
+
+        sparse_solver.conjugateGradient(x, tol, it_max, amg);
+        if (!TestRunner::assertBelowTolerance(sparse_solver.residualCalc(x, b_estimate), 1e-6))
+        {
+            return false;
+        }
+        pcg_iterations.push_back(sparse_solver.iterations);
+
+        // V-cycles on their own, with every smoother
+        for (AMGSmoother smoother : {AMGSmoother::GaussSeidel, AMGSmoother::Jacobi, AMGSmoother::Chebyshev})
+        {
+            amg.smoother = smoother;
+            sparse_solver.stationaryIterative(x, tol, it_max, amg);
+            if (!TestRunner::assertBelowTolerance(sparse_solver.residualCalc(x, b_estimate), 1e-6))
+            {
+                return false;
+            }
+        }
+
+        // New values on the same pattern keep the hierarchy and recompute its
+        // values: scaling A scales every Galerkin operator by the same factor
+        amg.smoother = AMGSmoother::GaussSeidel;
+        std::shared_ptr<CSRMatrix<double>> coarse_before = amg.levels.back().A;
+        std::vector<double> coarse_values(coarse_before->values.get(),
+                                          coarse_before->values.get() + coarse_before->nnzs);
+        for (int k = 0; k < A.nnzs; k++)
+        {
+            A.values[k] *= 2;
+        }
+        amg.setup(A);
+        if (amg.levels.back().A != coarse_before)
+        {
+            TestRunner::testError("AMG rebuilt its hierarchy for an unchanged pattern");
+            return false;
+        }
+        for (int k = 0; k < coarse_before->nnzs; k++)
+        {
+            if (fabs(coarse_before->values[k] - 2 * coarse_values[k]) > 1e-12 * fabs(coarse_values[k]) + 1e-14)
+            {
+                TestRunner::testError("AMG coarse operator not updated with the new values");
+                return false;
+            }
+        }
+        SparseSolver<double> scaled_solver(A, b);
+        std::fill(x.begin(), x.end(), 0);
+        scaled_solver.conjugateGradient(x, tol, it_max, amg);
+        if (!TestRunner::assertBelowTolerance(scaled_solver.residualCalc(x, b_estimate), 1e-6))
+        {
+            return false;
+        }
+        if (abs(scaled_solver.iterations - pcg_iterations.back()) > 1)
+        {
+            TestRunner::testError("AMG re-setup changed the CG iterations for a scaled matrix");
+            return false;
+        }
+    }
+    if (pcg_iterations.back() > 2 * pcg_iterations.front())
+    {
+        TestRunner::testError("AMG-preconditioned CG iterations grow with the grid");
+        return false;
+    }
+    return true;
+}
+
+bool test_gmg()
+{
+    double tol = 1e-8;
+    int it_max = 200;
+
+    // iterations stay flat as the grid is refined, in 2D and 3D
+    std::vector<std::pair<std::shared_ptr<CSRMatrix<double>>, std::vector<int>>> problems = {
+        {poisson2D<double>(31, 31), {31, 31, 1}},
+        {poisson2D<double>(127, 127), {127, 127, 1}},
+        {poisson3D<double>(15, 15, 15, 7), {15, 15, 15}},
+        {poisson3D<double>(31, 31, 31, 7), {31, 31, 31}}};
+    for (auto &problem : problems)
+    {
+        CSRMatrix<double> &A = *problem.first;
+        std::vector<int> &grid = problem.second;
+        std::vector<double> b(A.rows);
+        for (int i = 0; i < A.rows; i++)
+        {
+            b[i] = 1 + i % 3;
+        }
+        std::vector<double> x(A.rows, 0);
+        std::vector<double> b_estimate(A.rows, 0);
+        SparseSolver<double> sparse_solver = SparseSolver<double>(A, b);
+
+        GeometricMultigrid<double> gmg(grid[0], grid[1], grid[2]);
+        // red-black Gauss-Seidel smooths less well in 3D
+        int max_cycles = grid[2] > 1 ? 20 : 12;
+        int iterations = -1;
+        for (bool matrix_free : {true, false})
+        {
+            gmg.matrix_free = matrix_free;
+            gmg.setup(A);
+            if (gmg.levels.size() < 2)
+            {
+                TestRunner::testError("GMG built no coarse level");
+                return false;
+            }
+            for (MultigridCycle cycle : {MultigridCycle::V, MultigridCycle::W, MultigridCycle::F})
+            {
+                gmg.cycle_type = cycle;
+                // red first after the coarse correction is faster on its own, but not symmetric
+                gmg.red_first_post_smoothing = true;
+                sparse_solver.stationaryIterative(x, tol, it_max, gmg);
+                if (!TestRunner::assertBelowTolerance(sparse_solver.residualCalc(x, b_estimate), 1e-7))
+                {
+                    return false;
+                }
+                if (sparse_solver.iterations > max_cycles)
+                {
+                    TestRunner::testError("GMG cycles converge too slowly");
+                    return false;
+                }
+                gmg.red_first_post_smoothing = false;
+                sparse_solver.conjugateGradient(x, tol, it_max, gmg);
+                if (!TestRunner::assertBelowTolerance(sparse_solver.residualCalc(x, b_estimate), 1e-7))
+                {
+                    return false;
+                }
+
+                // by default the V- and W-cycles are symmetric, u^T M v = v^T M u
+                if (cycle != MultigridCycle::F)
+                {
+                    std::vector<double> u(A.rows), v(A.rows), Mu(A.rows), Mv(A.rows);
+                    for (int i = 0; i < A.rows; i++)
+                    {
+                        u[i] = (i * 7) % 11 - 5.0;
+                        v[i] = (i * 3) % 13 - 6.0;
+                    }
+                    gmg.apply(u, Mu);
+                    gmg.apply(v, Mv);
+                    double vMu = 0, uMv = 0, scale = 0;
+                    for (int i = 0; i < A.rows; i++)
+                    {
+                        vMu += v[i] * Mu[i];
+                        uMv += u[i] * Mv[i];
+                        scale += fabs(v[i] * Mu[i]);
+                    }
+                    if (!TestRunner::assertBelowTolerance(fabs(vMu - uMv) / scale, 1e-10))
+                    {
+                        TestRunner::testError("GMG cycle is not symmetric");
+                        return false;
+                    }
+                }
+
+                // the stencil applied directly or from CSR is the same operator
+                if (cycle == MultigridCycle::V && matrix_free)
+                {
+                    iterations = sparse_solver.iterations;
+                }
+                else if (cycle == MultigridCycle::V && sparse_solver.iterations != iterations)
+                {
+                    TestRunner::testError("Matrix-free and CSR levels differ");
+                    return false;
+                }
+            }
+        }
+    }
+
+    // the grid must match A, and A must be the grid's stencil in natural order
+    auto A_ptr = poisson2D<double>(15, 15);
+    auto scaled = poisson2D<double>(15, 15);
+    scaled->values[0] *= 2;
+    std::vector<int> perm(A_ptr->rows);
+    for (int i = 0; i < A_ptr->rows; i++)
+    {
+        perm[i] = (i + 1) % A_ptr->rows;
+    }
+    auto permuted = permuteSymmetric(*A_ptr, perm);
+    std::vector<std::pair<std::shared_ptr<CSRMatrix<double>>, int>> rejected = {
+        {A_ptr, 16}, {scaled, 15}, {permuted, 15}};
+    for (auto &matrix : rejected)
+    {
+        GeometricMultigrid<double> gmg(15, matrix.second);
+        try
+        {
+            gmg.setup(*matrix.first);
+        }
+        catch (std::invalid_argument &)
+        {
+            continue;
+        }
+        TestRunner::testError("GMG accepted a matrix that is not its grid's stencil");
+        return false;
+    }
+    return true;
+}
+
+bool test_gmres_bicgstab()
+{
+    auto A_ptr = convectionDiffusion2D<double>(30, 30, 2);
+    CSRMatrix<double> &A = *A_ptr;
+    int size = A.rows;
+    std::vector<double> b(size);
+    for (int i = 0; i < size; i++)
+    {
+        b[i] = 1 + i % 3;
+    }
+    std::vector<double> x(size, 0);
+    std::vector<double> b_estimate(size, 0);
+    double tol = 1e-9;
+    int it_max = 2000;
+
+    SparseSolver<double> sparse_solver = SparseSolver<double>(A, b);
+    ILU0Preconditioner<double> ilu0;
+    ilu0.setup(A);
+
+    for (GramSchmidt orthogonalisation : {GramSchmidt::Modified, GramSchmidt::Classical2})
+    {
+        int unpreconditioned = 0;
+        for (Preconditioner<double> *M : {(Preconditioner<double> *)nullptr, (Preconditioner<double> *)&ilu0})
+        {
+            sparse_solver.gmres(x, tol, it_max, 20, M, orthogonalisation);
+            if (!TestRunner::assertBelowTolerance(sparse_solver.residualCalc(x, b_estimate), 1e-8))
+            {
+                return false;
+            }
+            if (M && sparse_solver.iterations >= unpreconditioned)
+            {
+                TestRunner::testError("ILU(0) did not reduce the GMRES iterations");
+                return false;
+            }
+            unpreconditioned = sparse_solver.iterations;
+        }
+    }
+
+    for (Preconditioner<double> *M : {(Preconditioner<double> *)nullptr, (Preconditioner<double> *)&ilu0})
+    {
+        sparse_solver.bicgstab(x, tol, it_max, M);
+        if (!TestRunner::assertBelowTolerance(sparse_solver.residualCalc(x, b_estimate), 1e-8))
+        {
+            return false;
+        }
+    }
+
+    // GMRES without restarting is exact after n steps (up to rounding)
+    auto small_ptr = convectionDiffusion2D<double>(5, 5, 6);
+    CSRMatrix<double> &small = *small_ptr;
+    std::vector<double> rhs(small.rows, 1);
+    SparseSolver<double> small_solver = SparseSolver<double>(small, rhs);
+    std::vector<double> x_small(small.rows, 0);
+    std::vector<double> rhs_estimate(small.rows, 0);
+    double tight = 1e-12;
+    small_solver.gmres(x_small, tight, it_max, small.rows);
+    if (small_solver.iterations > small.rows)
+    {
+        TestRunner::testError("Full GMRES took more than n iterations");
+        return false;
+    }
+    return TestRunner::assertBelowTolerance(small_solver.residualCalc(x_small, rhs_estimate), 1e-10);
+}
+
+bool test_lu_dense()
+{
+    int size = 4;
+    std::vector<double> x(size, 0);
+    std::vector<double> output_b(size, 0);
+
+    std::shared_ptr<double[]> init_dense_values(new double[size * size]{10., 2., 3., 5., 1., 14., 6., 2., -1., 4., 16., -4, 5., 4., 3., 11.});
+
+    Matrix<double> dense_mat = Matrix<double>(size, size, init_dense_values);
+    std::vector<double> b = {1., 2., 3., 4.};
+
+    Solver<double> dense_solver = Solver<double>(dense_mat, b);
+
+    Matrix<double> LU(size, size, true);
+
+    auto t1 = std::chrono::high_resolution_clock::now();
+    std::vector<int> piv = dense_solver.lu_decomp(LU);
+    dense_solver.lu_solve(LU, piv, x);
+    auto t2 = std::chrono::high_resolution_clock::now();
+
+    auto duration = std::chrono::duration<double>(t2 - t1).count();
+    std::cout << "Time taken for LU: " << duration << " s " << std::endl
+              << std::endl;
+
+    double residual = dense_solver.residualCalc(x, output_b);
+
+    return TestRunner::assertBelowTolerance(residual, 1e-6);
+}
+
+bool test_jacobi_dense_random()
+{
+    int size = 100;
+    double tol = 1e-6;
+    int it_max = 1000;
+
+    std::vector<double> x(size, 0);
+    std::vector<double> output_b(size, 0);
+
+    auto solver = Solver<double>(size);
+
+    auto t1 = std::chrono::high_resolution_clock::now();
+
+    solver.stationaryIterative(x, tol, it_max, false);
+
+    auto t2 = std::chrono::high_resolution_clock::now();
+
+    auto duration = std::chrono::duration<double>(t2 - t1).count();
+
+    std::cout << "Time taken for Jacobi: " << duration << " s " << std::endl
+              << std::endl;
+
+    double residual = solver.residualCalc(x, output_b);
+
+    return TestRunner::assertBelowTolerance(residual, 1e-6);
+}
+
+bool test_gauss_seidel_dense_random()
+{
+    int size = 100;
+    double tol = 1e-6;
+    int it_max = 1000;
+
+    std::vector<double> x(size, 0);
+    std::vector<double> output_b(size, 0);
+
+    auto solver = Solver<double>(size);
+
+    auto t1 = std::chrono::high_resolution_clock::now();
+
+    solver.stationaryIterative(x, tol, it_max, true);
+
+    auto t2 = std::chrono::high_resolution_clock::now();
+
+    auto duration = std::chrono::duration<double>(t2 - t1).count();
+
+    std::cout << "Time taken for Gauss-Seidel: " << duration << " s " << std::endl
+              << std::endl;
+
+    double residual = solver.residualCalc(x, output_b);
+
+    return TestRunner::assertBelowTolerance(residual, 1e-6);
+}
+
+bool test_lu_dense_random()
+{
+    int size = 100;
+    std::vector<double> x(size, 0);
+    std::vector<double> output_b(size, 0);
+
     auto solver = Solver<double>(size);
 
-    Matrix<double> LU(size, size, true);
+    Matrix<double> LU(size, size, true);
+
+    auto t1 = std::chrono::high_resolution_clock::now();
+    std::vector<int> piv = solver.lu_decomp(LU);
+    solver.lu_solve(LU, piv, x);
+    auto t2 = std::chrono::high_resolution_clock::now();
+
+    auto duration = std::chrono::duration<double>(t2 - t1).count();
+    std::cout << "Time taken for LU: " << duration << " s " << std::endl
+              << std::endl;
+
+    // use a second b array
+    std::vector<double> b_new(size, 0);
+    std::vector<double> x_new(size, 0);
+    for (int i = 0; i < size; i++)
+    {
+        b_new[i] = i + 1;
+    }
+
+    t1 = std::chrono::high_resolution_clock::now();
+    solver.lu_solve(LU, piv, x_new, b_new);
+    t2 = std::chrono::high_resolution_clock::now();
+
+    duration = std::chrono::duration<double>(t2 - t1).count();
+    std::cout << "Time taken for LU with second b: " << duration << " s " << std::endl
+              << std::endl;
+
+    double residual = solver.residualCalc(x, output_b);
+    return TestRunner::assertBelowTolerance(residual, 1e-6);
+}
+
+bool test_cholesky()
+{
+    int size = 4;
+    int nnzs = 14;
+
+    std::shared_ptr<int[]> init_row_position1(new int[size + 1]{0, 3, 6, 10, 14});
+    std::shared_ptr<int[]> init_col_index1(new int[nnzs]{0, 2, 3, 1, 2, 3, 0, 1, 2, 3, 0, 1, 2, 3});
+    std::shared_ptr<double[]> init_sparse_values1(new double[nnzs]{9, -27, 18, 9, -9, -27, -27, -9, 99, -27, 18, -27, -27, 121});
+
+    CSRMatrix<double> sparse_matrix1 = CSRMatrix<double>(size, size, nnzs, init_sparse_values1, init_row_position1, init_col_index1);
+
+    std::vector<double> b = {-0.5, 1.5, -2.5, 4.5};
+
+    SparseSolver<double> sparse_solver = SparseSolver<double>(sparse_matrix1, b);
+
+    std::shared_ptr<CSRMatrix<double>> R = sparse_solver.cholesky_decomp();
+
+    std::vector<double> x(size, 0);
+
+    sparse_solver.cholesky_solve(*R, x);
+
+    std::cout << "Result: ";
+    for (int i = 0; i < x.size(); i++)
+    {
+        std::cout << " " << x[i] << " ";
+    }
+    std::cout << "\n";
+
+    std::vector<double> b_estimate(size, 0);
+
+    if (sparse_solver.residualCalc(x, b_estimate) > 1e-6)
+    {
+        TestRunner::testError("Sparse Cholesky residual is above 1e-6");
+        return false;
+    }
+
+    return true;
+}
+
+bool test_random_cholesky()
+{
+    int size = 100;
+    double sparsity = 0.7;
+
+    CSRMatrix<double> sparse_matrix1 = CSRMatrix<double>(size, sparsity);
+
+    std::vector<double> b(size, 0);
+    for (int i = 0; i < size; i++)
+    {
+        b[i] = i;
+    }
+
+    SparseSolver<double> sparse_solver = SparseSolver<double>(sparse_matrix1, b);
+
+    std::shared_ptr<CSRMatrix<double>> R = sparse_solver.cholesky_decomp();
+
+    std::vector<double> x(size, 0);
+
+    sparse_solver.cholesky_solve(*R, x);
+
+    std::vector<double> b_estimate(size, 0);
+
+    double residual = sparse_solver.residualCalc(x, b_estimate);
+    return TestRunner::assertBelowTolerance(residual, 1e-6);
+}
+
+bool test_sparse_lu()
+{
+    int size = 6;
+    int nnzs = 12;
+
+    std::shared_ptr<double[]> init_sparse_values(new double[size * size]{5., 1., 1., 1., 5., 1., 5., 1., 5., 1., 5., 5.});
+    std::shared_ptr<int[]> init_row_position(new int[size * size]{0, 4, 5, 7, 9, 11, 12});
+    std::shared_ptr<int[]> init_col_index(new int[size * size]{0, 2, 3, 4, 1, 0, 2, 0, 3, 0, 4, 5});
+
+    std::vector<double> b = {17., 10., 16., 21., 26., 30.};
+    std::vector<int> perm = {0, 1, 2, 3, 4, 5};
+
+    CSRMatrix<double> sparse_matrix = CSRMatrix<double>(size, size, nnzs, init_sparse_values, init_row_position, init_col_index);
+    SparseSolver<double> sparse_solver = SparseSolver<double>(sparse_matrix, b);
+    // exact comparison, so factor in the order given
+    sparse_solver.ordering = FillOrdering::Natural;
+    std::vector<double> x(size, 0);
+
+    auto LU = sparse_solver.lu_decomp();
+    sparse_solver.lu_solve(*LU, perm, x);
+
+    double expected[] = {1, 2, 3, 4, 5, 6};
+
+    for (int i = 0; i < size; i++)
+    {
+        if (expected[i] != x[i])
+        {
+            std::cout << expected[i] << " does not match " << x[i] << std::endl;
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool test_random_sparse_lu()
+{
+    int size = 100;
+    double sparsity = 0.7;
+
+    CSRMatrix<double> sparse_matrix1 = CSRMatrix<double>(size, sparsity);
+
+    std::vector<double> b(size, 0);
+    std::vector<int> perm(size, 0);
+
+    for (int i = 0; i < size; i++)
+    {
+        b[i] = i + 1;
+        perm[i] = i;
+    }
+    // NOTE: we haven't implemented partial pivoting, but the permutation vector could be used in the lu_solve method
+    SparseSolver<double> sparse_solver = SparseSolver<double>(sparse_matrix1, b);
+    std::vector<double> x(size, 0);
+
+    auto LU = sparse_solver.lu_decomp();
+    sparse_solver.lu_solve(*LU, perm, x);
+
+    std::vector<double> b_estimate(size, 0);
+
+    double residual = sparse_solver.residualCalc(x, b_estimate);
+    return TestRunner::assertBelowTolerance(residual, 1e-6);
+}
+
+bool test_sparse_lu_pivoting()
+{
+    // A nonsymmetric matrix that needs row interchanges: the rows of a
+    // diagonally dominant matrix in reverse order, so the diagonal is zero
+    int size = 200;
+    CSRBuilder<double> builder(size, size);
+    std::vector<int> rows, cols;
+    std::vector<double> vals;
+    std::mt19937 rng(7);
+    std::uniform_int_distribution<int> column(0, size - 1);
+    std::uniform_real_distribution<double> value(-1, 1);
+    for (int i = 0; i < size; i++)
+    {
+        int row = size - 1 - i;
+        rows.push_back(row);
+        cols.push_back(i);
+        vals.push_back(10 + i % 3);
+        for (int k = 0; k < 3; k++)
+        {
+            int j = column(rng);
+            if (j != i && j != row)
+            {
+                rows.push_back(row);
+                cols.push_back(j);
+                vals.push_back(value(rng));
+            }
+        }
+    }
+    builder.addBatch(rows, cols, vals);
+    auto A = builder.build();
+
+    std::vector<double> b(size);
+    for (int i = 0; i < size; i++)
+    {
+        b[i] = i + 1;
+    }
+
+    for (double threshold : {1.0, 0.1})
+    {
+        for (FillOrdering ordering : {FillOrdering::Natural, FillOrdering::AMD})
+        {
+            SparseSolver<double> sparse_solver = SparseSolver<double>(*A, b);
+            sparse_solver.ordering = ordering;
+            std::vector<int> perm_indx;
+            auto LU = sparse_solver.lu_decomp(perm_indx, threshold);
+
+            for (int i = 0; i < size; i++)
+            {
+                if (perm_indx[i] < i || perm_indx[i] >= size)
+                {
+                    TestRunner::testError("perm_indx is not a sequence of forward interchanges");
+                    return false;
+                }
+            }
+
+            std::vector<double> x(size, 0);
+            sparse_solver.lu_solve(*LU, perm_indx, x);
+            std::vector<double> b_estimate(size, 0);
+            if (!TestRunner::assertBelowTolerance(sparse_solver.residualCalc(x, b_estimate), 1e-8))
+            {
+                return false;
+            }
+        }
+    }
+
+    // a singular matrix is reported
+    auto singular = poisson2D<double>(4, 4);
+    for (int k = singular->row_position[5]; k < singular->row_position[6]; k++)
+    {
+        singular->values[k] = 0;
+    }
+    std::vector<double> b_singular(16, 1);
+    SparseSolver<double> singular_solver = SparseSolver<double>(*singular, b_singular);
+    std::vector<int> perm_indx;
+    try
+    {
+        singular_solver.lu_decomp(perm_indx);
+    }
+    catch (std::invalid_argument &)
+    {
+        return true;
+    }
+    TestRunner::testError("No exception for a singular matrix");
+    return false;
+}
+
+bool test_random_sparse_matrix()
+{
+    int size = 10;
+    CSRMatrix<double> rand_sparse = CSRMatrix<double>(size, 0.4);
+
+    if (rand_sparse.rows != size || rand_sparse.cols != size)
+    {
+        TestRunner::testError("Dimensions of random matrix are incorrect");
+        return false;
+    }
+
+    // compare to transpose to see whether it is symmetric
+    std::shared_ptr<CSRMatrix<double>> transpose = rand_sparse.transpose();
+
+    for (int i = 0; i < size + 1; i++)
+    {
+        if (rand_sparse.row_position[i] != transpose->row_position[i])
+        {
+            TestRunner::testError("row_position of random matrix and its transpose do not match");
+            return false;
+        }
+    }
+    for (int i = 0; i < rand_sparse.nnzs; i++)
+    {
+        if (rand_sparse.col_index[i] != transpose->col_index[i])
+        {
+            TestRunner::testError("col_index of random matrix and its transpose do not match");
+            return false;
+        }
+        if (rand_sparse.values[i] != transpose->values[i])
+        {
+            TestRunner::testError("values of random matrix and its transpose do not match");
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool test_symbolic_cholesky()
+{
+    for (int trial = 0; trial < 3; trial++)
+    {
+        std::shared_ptr<CSRMatrix<double>> A;
+        if (trial == 0)
+        {
+            A = poisson2D<double>(7, 6);
+        }
+        else
+        {
+            A = randomSPD<double>(60, 3, RowLengthDistribution::PowerLaw, trial);
+        }
+        int n = A->rows;
+        SymbolicFactor<int> factor = symbolicCholesky(buildAdjacency(*A));
+
+        // dense symbolic elimination as the reference
+        std::vector<char> L((size_t)n * n, 0);
+        for (int i = 0; i < n; i++)
+        {
+            L[(size_t)i * n + i] = 1;
+            for (int k = A->row_position[i]; k < A->row_position[i + 1]; k++)
+            {
+                int j = A->col_index[k];
+                L[(size_t)std::max(i, j) * n + std::min(i, j)] = 1;
+            }
+        }
+        for (int k = 0; k < n; k++)
+        {
+            for (int i = k + 1; i < n; i++)
+            {
+                for (int j = k + 1; j <= i && L[(size_t)i * n + k]; j++)
+                {
+                    if (L[(size_t)j * n + k])
+                    {
+                        L[(size_t)i * n + j] = 1;
+                    }
+                }
+            }
+        }
+
+        for (int j = 0; j < n; j++)
+        {
+            int expected_parent = -1;
+            for (int i = j + 1; i < n && expected_parent == -1; i++)
+            {
+                if (L[(size_t)i * n + j])
+                {
+                    expected_parent = i;
+                }
+            }
+            if (factor.parent[j] != expected_parent)
+            {
+                TestRunner::testError("Elimination tree parent is incorrect");
+                return false;
+            }
+        }
+
+        std::vector<int> visited_at(n, -1);
+        for (int k = 0; k < n; k++)
+        {
+            visited_at[factor.postorder[k]] = k;
+        }
+        for (int j = 0; j < n; j++)
+        {
+            if (visited_at[j] == -1 || (factor.parent[j] != -1 && visited_at[factor.parent[j]] < visited_at[j]))
+            {
+                TestRunner::testError("Postorder visits a node before its child");
+                return false;
+            }
+        }
+
+        int nnz = 0;
+        for (int i = 0; i < n; i++)
+        {
+            for (int j = 0; j <= i; j++)
+            {
+                nnz += L[(size_t)i * n + j];
+            }
+        }
+        if (factor.nnz() != nnz)
+        {
+            TestRunner::testError("Number of non-zeros in L is incorrect");
+            return false;
+        }
+        for (int i = 0; i < n; i++)
+        {
+            for (int k = factor.row_position[i]; k < factor.row_position[i + 1]; k++)
+            {
+                if (!L[(size_t)i * n + factor.col_index[k]] ||
+                    (k > factor.row_position[i] && factor.col_index[k] <= factor.col_index[k - 1]))
+                {
+                    TestRunner::testError("Row structure of L is incorrect");
+                    return false;
+                }
+            }
+            if (factor.col_index[factor.row_position[i + 1] - 1] != i)
+            {
+                TestRunner::testError("Diagonal is not the last entry of a row");
+                return false;
+            }
+        }
+        for (int j = 0; j < n; j++)
+        {
+            for (int k = factor.col_position[j]; k < factor.col_position[j + 1]; k++)
+            {
+                if (!L[(size_t)factor.row_index[k] * n + j] ||
+                    (k > factor.col_position[j] && factor.row_index[k] <= factor.row_index[k - 1]))
+                {
+                    TestRunner::testError("Column structure of L is incorrect");
+                    return false;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+bool test_supernodal_cholesky()
+{
+    for (int trial = 0; trial < 3; trial++)
+    {
+        std::shared_ptr<CSRMatrix<double>> A;
+        if (trial == 0)
+        {
+            A = poisson3D<double>(6, 5, 4, 27);
+        }
+        else if (trial == 1)
+        {
+            A = randomSPD<double>(300, 6, RowLengthDistribution::PowerLaw, 3);
+        }
+        else
+        {
+            A = bandedSPD<double>(200, 40, 5);
+        }
+        int size = A->rows;
+
+        SymbolicFactor<int> factor = symbolicCholesky(buildAdjacency(*A));
+        Supernodes<int> supernodes = findSupernodes(factor);
+        int columns = 0;
+        for (int s = 0; s < supernodes.count; s++)
+        {
+            columns += supernodes.width(s);
+            // the supernode rows must contain the structure of each of its columns
+            const int *rows = supernodes.rows.data() + supernodes.row_ptr[s];
+            for (int j = supernodes.first[s]; j < supernodes.first[s + 1]; j++)
+            {
+                for (int k = factor.col_position[j]; k < factor.col_position[j + 1]; k++)
+                {
+                    if (!std::binary_search(rows, rows + supernodes.height(s), factor.row_index[k]))
+                    {
+                        TestRunner::testError("Supernode rows do not contain the structure of a column");
+                        return false;
+                    }
+                }
+            }
+        }
+        if (columns != size || (trial == 2 && supernodes.count >= size))
+        {
+            TestRunner::testError("Supernodes do not partition the columns");
+            return false;
+        }
+
+        std::vector<double> b(size);
+        for (int i = 0; i < size; i++)
+        {
+            b[i] = i % 7 - 3;
+        }
+        SparseSolver<double> sparse_solver = SparseSolver<double>(*A, b);
+        auto R = sparse_solver.cholesky_decomp();
+        std::vector<double> x(size, 0);
+        sparse_solver.cholesky_solve(*R, x);
+
+        std::vector<double> b_estimate(size, 0);
+        if (!TestRunner::assertBelowTolerance(sparse_solver.residualCalc(x, b_estimate), 1e-8))
+        {
+            return false;
+        }
+    }
+
+    // a matrix that is not positive definite
+    auto A = poisson2D<double>(5, 5);
+    for (int i = 0; i < A->nnzs; i++)
+    {
+        A->values[i] = -A->values[i];
+    }
+    std::vector<double> b(A->rows, 1);
+    SparseSolver<double> sparse_solver = SparseSolver<double>(*A, b);
+    try
+    {
+        sparse_solver.cholesky_decomp();
+    }
+    catch (std::invalid_argument &)
+    {
+        return true;
+    }
+    TestRunner::testError("No exception for a matrix that is not positive definite");
+    return false;
+}
+
+bool test_fill_reducing_orderings()
+{
+    auto A = poisson2D<double>(40, 30);
+    int size = A->rows;
+    AdjacencyGraph<int> graph = buildAdjacency(*A);
+    int natural_fill = choleskyFillCount(graph);
+
+    std::vector<double> b(size);
+    for (int i = 0; i < size; i++)
+    {
+        b[i] = i % 5 - 2;
+    }
+
+    for (FillOrdering ordering : {FillOrdering::AMD, FillOrdering::NestedDissection})
+    {
+        std::vector<int> perm = ordering == FillOrdering::AMD ? approximateMinimumDegree(*A) : nestedDissection(*A);
+        std::vector<int> sorted = perm;
+        std::sort(sorted.begin(), sorted.end());
+        for (int i = 0; i < size; i++)
+        {
+            if (sorted[i] != i)
+            {
+                TestRunner::testError("Ordering is not a permutation");
+                return false;
+            }
+        }
+        if (2 * choleskyFillCount(permuteGraph(graph, perm)) > natural_fill)
+        {
+            TestRunner::testError("Ordering does not reduce the fill");
+            return false;
+        }
+
+        SparseSolver<double> sparse_solver = SparseSolver<double>(*A, b);
+        sparse_solver.ordering = ordering;
+        std::vector<double> x(size, 0);
+        std::vector<double> b_estimate(size, 0);
+        auto R = sparse_solver.cholesky_decomp();
+        sparse_solver.cholesky_solve(*R, x);
+        if (!TestRunner::assertBelowTolerance(sparse_solver.residualCalc(x, b_estimate), 1e-8))
+        {
+            return false;
+        }
+
+        std::vector<int> piv(size);
+        for (int i = 0; i < size; i++)
+        {
+            piv[i] = i;
+        }
+        std::fill(x.begin(), x.end(), 0);
+        auto LU = sparse_solver.lu_decomp();
+        sparse_solver.lu_solve(*LU, piv, x);
+        if (!TestRunner::assertBelowTolerance(sparse_solver.residualCalc(x, b_estimate), 1e-8) ||
+            sparse_solver.cholesky_analysis->perm != perm)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool test_symbolic_reuse()
+{
+    int nx = 12;
+    auto A_ptr = poisson2D<double>(nx, nx);
+    int size = A_ptr->rows;
+    std::vector<double> b(size, 1);
+
+    SparseSolver<double> sparse_solver = SparseSolver<double>(*A_ptr, b);
+    CSRMatrix<double> &A = sparse_solver.A;
+
+    auto R1 = sparse_solver.cholesky_decomp();
+    auto LU1 = sparse_solver.lu_decomp();
+
+    // new values, same pattern: the symbolic results must be reused
+    uint64_t hash = A.patternHash();
+    for (int k = 0; k < A.nnzs; k++)
+    {
+        if (A.values[k] > 0)
+        {
+            A.values[k] *= 2;
+        }
+    }
+    A.invalidateDiagonal();
+    if (A.patternHash() != hash)
+    {
+        TestRunner::testError("patternHash changed when only values changed");
+        return false;
+    }
+
+    auto R2 = sparse_solver.cholesky_decomp();
+    auto LU2 = sparse_solver.lu_decomp();
+    if (sparse_solver.cholesky_symbolic_cache.size() != 1 || sparse_solver.lu_symbolic_cache.size() != 1 ||
+        R1->col_index != R2->col_index || LU1->col_index != LU2->col_index || R1->values == R2->values)
+    {
+        TestRunner::testError("Symbolic analysis was not reused on refactorisation");
+        return false;
+    }
+
+    std::vector<double> x(size, 0);
+    std::vector<double> b_estimate(size, 0);
+    sparse_solver.cholesky_solve(*R2, x);
+    if (!TestRunner::assertBelowTolerance(sparse_solver.residualCalc(x, b_estimate), 1e-8))
+    {
+        return false;
+    }
+
+    std::vector<int> perm(size);
+    for (int i = 0; i < size; i++)
+    {
+        perm[i] = i;
+    }
+    std::fill(x.begin(), x.end(), 0);
+    sparse_solver.lu_solve(*LU2, perm, x);
+    if (!TestRunner::assertBelowTolerance(sparse_solver.residualCalc(x, b_estimate), 1e-8))
+    {
+        return false;
+    }
+
+    // a different pattern gets its own entry
+    auto B = poisson2D<double>(nx, nx + 1);
+    std::vector<double> b2(B->rows, 1);
+    SparseSolver<double> other_solver = SparseSolver<double>(*B, b2);
+    other_solver.cholesky_symbolic_cache = sparse_solver.cholesky_symbolic_cache;
+    other_solver.cholesky_decomp();
+    if (other_solver.cholesky_symbolic_cache.size() != 2)
+    {
+        TestRunner::testError("A new pattern did not get its own cache entry");
+        return false;
+    }
+
+    // an analysis of another pattern under the same key (a hash collision) is not reused
+    auto foreign = other_solver.cholesky_analysis;
+    sparse_solver.cholesky_symbolic_cache[sparse_solver.symbolicKey()] = foreign;
+    sparse_solver.cholesky_decomp();
+    if (sparse_solver.cholesky_analysis == foreign || sparse_solver.cholesky_analysis->pattern->rows != size)
+    {
+        TestRunner::testError("Symbolic analysis of another pattern was reused");
+        return false;
+    }
+
+    // the caches are bounded and can be emptied
+    other_solver.symbolic_cache_size = 1;
+    other_solver.ordering = FillOrdering::Natural;
+    other_solver.cholesky_decomp();
+    if (other_solver.cholesky_symbolic_cache.size() != 1 ||
+        other_solver.cholesky_symbolic_cache.begin()->second != other_solver.cholesky_analysis)
+    {
+        TestRunner::testError("Symbolic cache was not bounded");
+        return false;
+    }
+    other_solver.clearSymbolicCaches();
+    return other_solver.cholesky_symbolic_cache.empty() && other_solver.lu_symbolic_cache.empty();
+}
+
+bool test_factor_keeps_ordering()
+{
+    auto A_ptr = poisson2D<double>(30, 30);
+    int size = A_ptr->rows;
+    std::vector<double> b(size);
+    for (int i = 0; i < size; i++)
+    {
+        b[i] = 1 + i % 7;
+    }
+    SparseSolver<double> sparse_solver = SparseSolver<double>(*A_ptr, b);
+    std::vector<double> x(size, 0);
+    std::vector<double> b_estimate(size, 0);
+
+    // a factor kept across a decomposition with another ordering is solved
+    // and refactorised with its own
+    sparse_solver.ordering = FillOrdering::AMD;
+    auto R1 = sparse_solver.cholesky_decomp();
+    auto LU1 = sparse_solver.lu_decomp();
+    std::vector<int> pivots;
+    auto LU_pivoted = sparse_solver.lu_decomp(pivots, 1.0);
+    sparse_solver.ordering = FillOrdering::NestedDissection;
+    auto R2 = sparse_solver.cholesky_decomp();
+    sparse_solver.ordering = FillOrdering::Natural;
+    auto LU2 = sparse_solver.lu_decomp();
+
+    std::vector<int> no_pivots;
+    for (auto &R : {R1, R2})
+    {
+        std::fill(x.begin(), x.end(), 0);
+        sparse_solver.cholesky_solve(*R, x);
+        if (!TestRunner::assertBelowTolerance(sparse_solver.residualCalc(x, b_estimate), 1e-8))
+        {
+            TestRunner::testError("Cholesky factor solved with another ordering");
+            return false;
+        }
+    }
+    for (auto &LU : {LU1, LU2})
+    {
+        std::fill(x.begin(), x.end(), 0);
+        sparse_solver.lu_solve(*LU, no_pivots, x);
+        if (!TestRunner::assertBelowTolerance(sparse_solver.residualCalc(x, b_estimate), 1e-8))
+        {
+            TestRunner::testError("LU factor solved with another ordering");
+            return false;
+        }
+    }
+    std::fill(x.begin(), x.end(), 0);
+    sparse_solver.lu_solve(*LU_pivoted, pivots, x);
+    if (!TestRunner::assertBelowTolerance(sparse_solver.residualCalc(x, b_estimate), 1e-8))
+    {
+        return false;
+    }
+
+    sparse_solver.cholesky_numeric(*R1);
+    sparse_solver.lu_numeric(*LU1);
+    std::fill(x.begin(), x.end(), 0);
+    sparse_solver.cholesky_solve(*R1, x);
+    if (!TestRunner::assertBelowTolerance(sparse_solver.residualCalc(x, b_estimate), 1e-8))
+    {
+        return false;
+    }
+    std::fill(x.begin(), x.end(), 0);
+    sparse_solver.lu_solve(*LU1, no_pivots, x);
+    return TestRunner::assertBelowTolerance(sparse_solver.residualCalc(x, b_estimate), 1e-8);
+}
+
+// Every row of a schedule appears once, after the rows it depends on
+bool checkLevelSchedule(const LevelSchedule &schedule, int n, const std::vector<std::vector<int>> &depends)
+{
+    std::vector<int> level(n, -1);
+    for (int l = 0; l < schedule.levels; l++)
+    {
+        for (int k = schedule.level_ptr[l]; k < schedule.level_ptr[l + 1]; k++)
+        {
+            level[schedule.rows[k]] = l;
+        }
+    }
+    for (int i = 0; i < n; i++)
+    {
+        if (level[i] == -1)
+        {
+            TestRunner::testError("Row missing from the level schedule");
+            return false;
+        }
+        for (int j : depends[i])
+        {
+            if (level[j] >= level[i])
+            {
+                TestRunner::testError("Row scheduled with or before a row it depends on");
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+bool test_level_scheduled_solves()
+{
+    auto A_ptr = poisson2D<double>(60, 60);
+    CSRMatrix<double> &A = *A_ptr;
+    int size = A.rows;
+    std::vector<double> b(size);
+    for (int i = 0; i < size; i++)
+    {
+        b[i] = i % 7 + 1;
+    }
+
+    for (FillOrdering ordering : {FillOrdering::Natural, FillOrdering::NestedDissection})
+    {
+        SparseSolver<double> sparse_solver = SparseSolver<double>(A, b);
+        sparse_solver.ordering = ordering;
+
+        // Cholesky: R before the diagonal, R^T from the columns of R
+        auto R = sparse_solver.cholesky_decomp();
+        std::vector<double> x(size, 0);
+        sparse_solver.cholesky_solve(*R, x);
+        auto analysis = sparse_solver.cholesky_solve_analysis;
+        std::vector<std::vector<int>> lower(size), upper(size);
+        for (int i = 0; i < size; i++)
+        {
+            for (int k = R->row_position[i]; k < R->row_position[i + 1]; k++)
+            {
+                int j = R->col_index[k];
+                if (j < i)
+                {
+                    lower[i].push_back(j);
+                    upper[j].push_back(i);
+                }
+            }
+        }
+        if (!checkLevelSchedule(analysis->lower, size, lower) || !checkLevelSchedule(analysis->upper, size, upper))
+        {
+            return false;
+        }
+        std::vector<double> b_estimate(size, 0);
+        if (!TestRunner::assertBelowTolerance(sparse_solver.residualCalc(x, b_estimate), 1e-8))
+        {
+            return false;
+        }
+
+        // the analysis is reused by a refactorisation with the same pattern
+        R = sparse_solver.cholesky_decomp();
+        sparse_solver.cholesky_solve(*R, x);
+        if (sparse_solver.cholesky_solve_analysis != analysis)
+        {
+            TestRunner::testError("Triangular solve analysis rebuilt for an unchanged pattern");
+            return false;
+        }
+
+        // LU: L before the diagonal, U after it
+        auto LU = sparse_solver.lu_decomp();
+        std::vector<int> perm_indx(size);
+        for (int i = 0; i < size; i++)
+        {
+            perm_indx[i] = i;
+        }
+        sparse_solver.lu_solve(*LU, perm_indx, x);
+        for (int i = 0; i < size; i++)
+        {
+            lower[i].clear();
+            upper[i].clear();
+            for (int k = LU->row_position[i]; k < LU->row_position[i + 1]; k++)
+            {
+                int j = LU->col_index[k];
+                (j < i ? lower[i] : upper[i]).push_back(j);
+            }
+            upper[i].erase(std::remove(upper[i].begin(), upper[i].end(), i), upper[i].end());
+        }
+        if (!checkLevelSchedule(sparse_solver.lu_solve_analysis->lower, size, lower) ||
+            !checkLevelSchedule(sparse_solver.lu_solve_analysis->upper, size, upper))
+        {
+            return false;
+        }
+        if (!TestRunner::assertBelowTolerance(sparse_solver.residualCalc(x, b_estimate), 1e-8))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool test_sparse_64bit_indices()
+{
+    int size = 4;
+    double tol = 1e-6;
+    int it_max = 1000;
+    long long nnzs = 10;
+
+    std::shared_ptr<long long[]> init_row_position(new long long[size + 1]{0, 2, 5, 8, 10});
+    std::shared_ptr<int[]> init_col_index(new int[nnzs]{0, 1, 0, 1, 2, 1, 2, 3, 2, 3});
+    std::shared_ptr<double[]> init_sparse_values(new double[nnzs]{4, -1, -1, 4, -1, -1, 4, -1, -1, 4});
+
+    std::vector<double> b = {1., 2., 3., 4.};
+    std::vector<double> x(size, 0);
+
+    CSRMatrix<double, long long> sparse_matrix = CSRMatrix<double, long long>(size, size, nnzs, init_sparse_values, init_row_position, init_col_index);
+    SparseSolver<double, long long> sparse_solver = SparseSolver<double, long long>(sparse_matrix, b);
+
+    sparse_solver.conjugateGradient(x, tol, it_max);
+
+    std::vector<double> output_b(size, 0);
+    double residual = sparse_solver.residualCalc(x, output_b);
+
+    return TestRunner::assertBelowTolerance(residual, 1e-6);
+}
+
+bool test_sparse_matvec_above_int32_limit()
+{
+    // 2^22 rows with 520 entries each gives more non-zeros than an int can index.
+    // With float values and 32-bit column indices this needs ~17.5 GB of memory.
+    int size = 1 << 22;
+    int per_row = 520;
+    long long nnzs = (long long)size * per_row;
+
+    double required_bytes = (double)nnzs * (sizeof(float) + sizeof(int)) + (double)(size + 1) * sizeof(long long);
+    double available_bytes = (double)sysconf(_SC_PHYS_PAGES) * (double)sysconf(_SC_PAGE_SIZE);
+    if (required_bytes * 1.2 > available_bytes)
+    {
+        TestRunner::skip("Needs " + std::to_string(required_bytes / 1e9) + " GB, machine has " +
+                         std::to_string(available_bytes / 1e9) + " GB");
+        return true;
+    }
+    if (nnzs <= std::numeric_limits<int>::max())
+    {
+        TestRunner::testError("Test matrix does not exceed the int32 limit");
+        return false;
+    }
+
+    CSRMatrix<float, long long> sparse_matrix = CSRMatrix<float, long long>(size, size, nnzs, true);
+
+#pragma omp parallel for
+    for (int i = 0; i < size; i++)
+    {
+        long long start = (long long)i * per_row;
+        sparse_matrix.row_position[i] = start;
+        for (int k = 0; k < per_row; k++)
+        {
+            sparse_matrix.col_index[start + k] = (i + k) % size;
+            sparse_matrix.values[start + k] = 1.0f;
+        }
+    }
+    sparse_matrix.row_position[size] = nnzs;
+
+    std::vector<float> x(size, 1.0f);
+    std::vector<float> output(size, 0);
+
+    auto t1 = std::chrono::high_resolution_clock::now();
+    sparse_matrix.matVecMult(x, output);
+    auto t2 = std::chrono::high_resolution_clock::now();
+
+    auto duration = std::chrono::duration<double>(t2 - t1).count();
+    std::cout << "Time taken for matVecMult with " << nnzs << " non-zeros: " << duration << " s " << std::endl;
+
+    for (int i = 0; i < size; i++)
+    {
+        if (output[i] != (float)per_row)
+        {
+            TestRunner::testError("matVecMult result is wrong beyond the int32 limit");
+            return false;
+        }
+    }
+    return true;
+}
+
+bool test_sparse_matvec_mostly_zero_pages_above_int32_limit()
+{
+    // Three long rows of 800M entries put row_position past 2^31 for the rows
+    // after them. Their arrays are anonymous mappings that are only read, so
+    // apart from the few entries written they are backed by the shared zero
+    // page: ~10 GB of address space but little memory.
+    int size = 1 << 20;
+    long long long_row = 800000000LL;
+    int tail = 8;
+    long long nnzs = 3 * long_row + tail;
+    if (nnzs <= std::numeric_limits<int>::max())
+    {
+        TestRunner::testError("Test matrix does not exceed the int32 limit");
+        return false;
+    }
+
+    auto mapArray = [](size_t bytes) -> void * {
+        void *address = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        return address == MAP_FAILED ? nullptr : address;
+    };
+    size_t value_bytes = nnzs * sizeof(float);
+    size_t index_bytes = nnzs * sizeof(int);
+    void *value_address = mapArray(value_bytes);
+    void *index_address = mapArray(index_bytes);
+    if (value_address == nullptr || index_address == nullptr)
+    {
+        if (value_address != nullptr)
+        {
+            munmap(value_address, value_bytes);
+        }
+        if (index_address != nullptr)
+        {
+            munmap(index_address, index_bytes);
+        }
+        TestRunner::skip("Cannot reserve the address space for the test matrix");
+        return true;
+    }
+    std::shared_ptr<float[]> values((float *)value_address, [value_bytes](float *p) { munmap(p, value_bytes); });
+    std::shared_ptr<int[]> col_index((int *)index_address, [index_bytes](int *p) { munmap(p, index_bytes); });
+    std::shared_ptr<long long[]> row_position(new long long[size + 1]);
+
+    // rows 0-2 are long, the last row has the entries past 2^31, the rest are empty
+    for (int i = 0; i <= size; i++)
+    {
+        row_position[i] = std::min<long long>(i, 3) * long_row;
+    }
+    row_position[size] = nnzs;
+    values[0] = 2;
+    col_index[0] = 5;
+    values[2 * long_row + 7] = 3;
+    col_index[2 * long_row + 7] = 11;
+    for (int k = 0; k < tail; k++)
+    {
+        values[3 * long_row + k] = k + 1;
+        col_index[3 * long_row + k] = k * 1000;
+    }
+    CSRMatrix<float, long long> sparse_matrix(size, size, nnzs, values, row_position, col_index);
+
+    std::vector<float> x(size);
+    for (int i = 0; i < size; i++)
+    {
+        x[i] = 1 + i % 7;
+    }
+    std::vector<float> output(size, -1);
+    auto t1 = std::chrono::high_resolution_clock::now();
+    sparse_matrix.matVecMult(x, output);
+    auto t2 = std::chrono::high_resolution_clock::now();
+    std::cout << "Time taken for matVecMult with " << nnzs
+              << " non-zeros: " << std::chrono::duration<double>(t2 - t1).count() << " s " << std::endl;
+
+    float last = 0;
+    for (int k = 0; k < tail; k++)
+    {
+        last += (k + 1) * x[k * 1000];
+    }
+    for (int i = 0; i < size; i++)
+    {
+        float expected = i == 0 ? 2 * x[5] : i == 2 ? 3 * x[11] : i == size - 1 ? last : 0;
+        if (output[i] != expected)
+        {
+            TestRunner::testError("matVecMult result is wrong beyond the int32 limit in row " + std::to_string(i));
+            return false;
+        }
+    }
+    return true;
+}
+
+bool test_csr_builder()
+{
+    int size = 5;
+    int nnzs = 14;
+
+    // Same matrix as test_sparse_matmatmult_5x5, but each value is split into
+    // three contributions added in shuffled batches from several threads
+    int row_ind[] = {0, 0, 1, 1, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4};
+    int col_ind[] = {0, 4, 0, 1, 1, 2, 3, 0, 2, 3, 4, 1, 3, 4};
+    double values[] = {10, -2, 3, 9, 7, 8, 7, 3, 8, 7, 5, 8, 9, 13};
+    int expected_row_pos[] = {0, 2, 4, 7, 11, 14};
+
+    CSRBuilder<double> builder(size, size);
+
+    int n_batches = 6;
+#pragma omp parallel for
+    for (int batch = 0; batch < n_batches; batch++)
+    {
+        std::vector<int> rows, cols;
+        std::vector<double> vals;
+        for (int k = 0; k < nnzs; k++)
+        {
+            int i = (k * 5 + batch) % nnzs;
+            rows.push_back(row_ind[i]);
+            cols.push_back(col_ind[i]);
+            vals.push_back(values[i] / n_batches);
+        }
+        builder.addBatch(rows, cols, vals);
+    }
+
+    if (builder.size() != (size_t)(nnzs * n_batches))
+    {
+        TestRunner::testError("Builder lost triplets");
+        return false;
+    }
+
+    std::shared_ptr<CSRMatrix<double>> result = builder.build();
+
+    if (result->nnzs != nnzs || builder.size() != 0)
+    {
+        TestRunner::testError("Duplicates were not summed");
+        return false;
+    }
+    for (int i = 0; i < nnzs; i++)
+    {
+        if (fabs(result->values[i] - values[i]) > 1e-12)
+        {
+            TestRunner::testError("Values do not match");
+            return false;
+        }
+    }
+    bool rows = TestRunner::assertArrays(&expected_row_pos[0], &result->row_position[0], size + 1);
+    bool cols = TestRunner::assertArrays(&col_ind[0], &result->col_index[0], nnzs);
+    return rows && cols;
+}
+
+bool test_locked_pattern_assembly()
+{
+    int size = 4;
+    int nnzs = 10;
+
+    // columns of row 1 are deliberately unsorted
+    std::shared_ptr<int[]> init_row_position(new int[size + 1]{0, 2, 5, 8, 10});
+    std::shared_ptr<int[]> init_col_index(new int[nnzs]{0, 1, 2, 0, 1, 1, 2, 3, 2, 3});
+    std::shared_ptr<double[]> init_sparse_values(new double[nnzs]{1, 1, 1, 1, 1, 1, 1, 1, 1, 1});
+    CSRMatrix<double> sparse_matrix = CSRMatrix<double>(size, size, nnzs, init_sparse_values, init_row_position, init_col_index);
+
+    sparse_matrix.lockPattern();
+    int *col_ptr = &sparse_matrix.col_index[0];
+    sparse_matrix.zeroValues();
+
+    // Assemble a 1D Laplacian from 2x2 element contributions, twice from many threads
+    int n_steps = 2;
+    int n_repeats = 50;
+    for (int step = 0; step < n_steps; step++)
+    {
+        sparse_matrix.zeroValues();
+#pragma omp parallel for
+        for (int e = 0; e < (size - 1) * n_repeats; e++)
+        {
+            int i = e % (size - 1);
+            sparse_matrix.add(i, i, 1.0);
+            sparse_matrix.add(i, i + 1, -1.0);
+            sparse_matrix.add(i + 1, i, -1.0);
+            sparse_matrix.add(i + 1, i + 1, 1.0);
+        }
+    }
+
+    int expected_cols[] = {0, 1, 0, 1, 2, 1, 2, 3, 2, 3};
+    double expected_values[] = {1, -1, -1, 2, -1, -1, 2, -1, -1, 1};
+    for (int i = 0; i < nnzs; i++)
+    {
+        expected_values[i] *= n_repeats;
+    }
 
-    auto t1 = std::chrono::high_resolution_clock::now();
-    std::vector<int> piv = solver.lu_decomp(LU);
-    solver.lu_solve(LU, piv, x);
-    auto t2 = std::chrono::high_resolution_clock::now();
+    if (&sparse_matrix.col_index[0] != col_ptr || sparse_matrix.nnzs != nnzs)
+    {
+        TestRunner::testError("Pattern was rebuilt during assembly");
+        return false;
+    }
+    if (sparse_matrix.entryIndex(0, 3) != -1)
+    {
+        TestRunner::testError("Entry outside the pattern was found");
+        return false;
+    }
 
-    auto duration = std::chrono::duration<double>(t2 - t1).count();
-    std::cout << "Time taken for LU: " << duration << " s " << std::endl
-              << std::endl;
+    bool cols = TestRunner::assertArrays(&expected_cols[0], &sparse_matrix.col_index[0], nnzs);
+    bool vals = TestRunner::assertArrays(&expected_values[0], &sparse_matrix.values[0], nnzs);
+    return cols && vals;
+}
 
-    // use a second b array
-    std::vector<double> b_new(size, 0);
-    std::vector<double> x_new(size, 0);
-    for (int i = 0; i < size; i++)
+bool test_matrix_market_io()
+{
+    // symmetric file with a comment, blank line and an integer-valued entry
+    std::string filename = "test_matrix_market.mtx";
+    std::ofstream file(filename);
+    file << "%%MatrixMarket matrix coordinate real symmetric\n"
+         << "% 4x4 test matrix from test_cholesky\n"
+         << "4 4 9\n"
+         << "1 1 9\n3 1 -27\n4 1 18\n2 2 9\n3 2 -9\n4 2 -27\n\n3 3 99\n4 3 -27\n4 4 121\n";
+    file.close();
+
+    auto A = readMatrixMarket<double>(filename, true);
+
+    int expected_row_pos[] = {0, 3, 6, 10, 14};
+    int expected_cols[] = {0, 2, 3, 1, 2, 3, 0, 1, 2, 3, 0, 1, 2, 3};
+    double expected_values[] = {9, -27, 18, 9, -9, -27, -27, -9, 99, -27, 18, -27, -27, 121};
+
+    if (A->rows != 4 || A->cols != 4 || A->nnzs != 14)
     {
-        b_new[i] = i + 1;
+        TestRunner::testError("Dimensions of read matrix are incorrect");
+        return false;
     }
+    bool read_ok = TestRunner::assertArrays(&expected_row_pos[0], &A->row_position[0], 5) &&
+                   TestRunner::assertArrays(&expected_cols[0], &A->col_index[0], 14) &&
+                   TestRunner::assertArrays(&expected_values[0], &A->values[0], 14);
+
+    // round trip through the writer, as a general matrix
+    writeMatrixMarket(filename, *A);
+    auto B = readMatrixMarket<double>(filename);
+    std::remove(filename.c_str());
+
+    bool write_ok = B->nnzs == A->nnzs &&
+                    TestRunner::assertArrays(&A->row_position[0], &B->row_position[0], 5) &&
+                    TestRunner::assertArrays(&A->col_index[0], &B->col_index[0], 14) &&
+                    TestRunner::assertArrays(&A->values[0], &B->values[0], 14);
+    return read_ok && write_ok;
+}
 
-    t1 = std::chrono::high_resolution_clock::now();
-    solver.lu_solve(LU, piv, x_new, b_new);
-    t2 = std::chrono::high_resolution_clock::now();
+bool test_matrix_market_pattern()
+{
+    std::string filename = "test_matrix_market_pattern.mtx";
+    std::ofstream file(filename);
+    file << "%%MatrixMarket matrix coordinate pattern general\n3 4 4\n1 2\n3 4\n2 1\n1 1\n";
+    file.close();
 
-    duration = std::chrono::duration<double>(t2 - t1).count();
-    std::cout << "Time taken for LU with second b: " << duration << " s " << std::endl
-              << std::endl;
+    auto A = readMatrixMarket<float, long long>(filename);
+    std::remove(filename.c_str());
 
-    double residual = solver.residualCalc(x, output_b);
-    return TestRunner::assertBelowTolerance(residual, 1e-6);
+    long long expected_row_pos[] = {0, 2, 3, 4};
+    int expected_cols[] = {0, 1, 0, 3};
+    for (int i = 0; i < 4; i++)
+    {
+        if (A->row_position[i] != expected_row_pos[i] || A->col_index[i] != expected_cols[i] || A->values[i] != 1.0f)
+        {
+            TestRunner::testError("Pattern matrix was not read correctly");
+            return false;
+        }
+    }
+    return A->rows == 3 && A->cols == 4;
 }
 
-bool test_cholesky()
+bool test_binary_io()
 {
-    int size = 4;
+    int size = 5;
     int nnzs = 14;
 
-    std::shared_ptr<int[]> init_row_position1(new int[size + 1]{0, 3, 6, 10, 14});
-    std::shared_ptr<int[]> init_col_index1(new int[nnzs]{0, 2, 3, 1, 2, 3, 0, 1, 2, 3, 0, 1, 2, 3});
-    std::shared_ptr<double[]> init_sparse_values1(new double[nnzs]{9, -27, 18, 9, -9, -27, -27, -9, 99, -27, 18, -27, -27, 121});
+    std::shared_ptr<int[]> init_row_position(new int[size + 1]{0, 2, 4, 7, 11, 14});
+    std::shared_ptr<int[]> init_col_index(new int[nnzs]{0, 4, 0, 1, 1, 2, 3, 0, 2, 3, 4, 1, 3, 4});
+    std::shared_ptr<double[]> init_sparse_values(new double[nnzs]{10, -2, 3, 9, 7, 8, 7, 3, 8, 7, 5, 8, 9, 13});
+    CSRMatrix<double> sparse_matrix = CSRMatrix<double>(size, size, nnzs, init_sparse_values, init_row_position, init_col_index);
 
-    CSRMatrix<double> sparse_matrix1 = CSRMatrix<double>(size, size, nnzs, init_sparse_values1, init_row_position1, init_col_index1);
+    std::string filename = "test_binary_io.bin";
+    writeBinary(filename, sparse_matrix);
 
-    std::vector<double> b = {-0.5, 1.5, -2.5, 4.5};
+    std::shared_ptr<CSRMatrix<double>> loaded = loadBinaryCSR<double>(filename, true);
 
-    SparseSolver<double> sparse_solver = SparseSolver<double>(sparse_matrix1, b);
+    // sections must be aligned and the matrix must keep working after the loader returns
+    bool aligned = ((size_t)&loaded->values[0] % 64 == 0) && ((size_t)&loaded->col_index[0] % 64 == 0);
+    bool same = loaded->rows == size && loaded->nnzs == nnzs &&
+                TestRunner::assertArrays(&init_row_position[0], &loaded->row_position[0], size + 1) &&
+                TestRunner::assertArrays(&init_col_index[0], &loaded->col_index[0], nnzs) &&
+                TestRunner::assertArrays(&init_sparse_values[0], &loaded->values[0], nnzs);
 
-    std::shared_ptr<CSRMatrix<double>> R = sparse_solver.cholesky_decomp();
+    // wrong template types must be rejected
+    bool rejected = false;
+    try
+    {
+        loadBinaryCSR<float>(filename);
+    }
+    catch (const std::exception &e)
+    {
+        rejected = true;
+    }
 
-    std::vector<double> x(size, 0);
+    // dense matrices use the same container
+    std::shared_ptr<double[]> dense_values(new double[4]{1., 2., 3., 4.});
+    Matrix<double> dense = Matrix<double>(2, 2, dense_values);
+    writeBinary(filename, dense);
+    std::shared_ptr<Matrix<double>> loaded_dense = loadBinaryMatrix<double>(filename, true);
+    bool dense_same = loaded_dense->rows == 2 && loaded_dense->cols == 2 &&
+                      TestRunner::assertArrays(&dense_values[0], &loaded_dense->values[0], 4);
+
+    // corrupt row positions and section offsets are rejected without the checksum
+    bool corrupt_rejected = true;
+    for (int corruption = 0; corruption < 2; corruption++)
+    {
+        writeBinary(filename, sparse_matrix);
+        FILE *file = fopen(filename.c_str(), "r+b");
+        if (corruption == 0)
+        {
+            int bad_end = nnzs + 1000;
+            fseek(file, sizeof(BinaryHeader) + size * sizeof(int), SEEK_SET);
+            fwrite(&bad_end, sizeof(int), 1, file);
+        }
+        else
+        {
+            uint64_t bad_offset = (uint64_t)1 << 40;
+            fseek(file, offsetof(BinaryHeader, values_offset), SEEK_SET);
+            fwrite(&bad_offset, sizeof(uint64_t), 1, file);
+        }
+        fclose(file);
+        try
+        {
+            loadBinaryCSR<double>(filename);
+            corrupt_rejected = false;
+        }
+        catch (const std::invalid_argument &e)
+        {
+        }
+    }
+    std::remove(filename.c_str());
 
-    sparse_solver.cholesky_solve(*R, x);
+    if (!aligned)
+    {
+        TestRunner::testError("Binary sections are not aligned");
+    }
+    if (!rejected)
+    {
+        TestRunner::testError("Binary file was loaded with the wrong value type");
+    }
+    if (!corrupt_rejected)
+    {
+        TestRunner::testError("Corrupt binary file was loaded");
+    }
+    return aligned && same && rejected && dense_same && corrupt_rejected;
+}
 
-    std::cout << "Result: ";
-    for (int i = 0; i < x.size(); i++)
+// helper for generator tests: square, sorted columns and symmetric values
+template <class T, class I>
+bool isSymmetricCSR(CSRMatrix<T, I> &A)
+{
+    for (int i = 0; i < A.rows; i++)
     {
-        std::cout << " " << x[i] << " ";
+        for (I cii = A.row_position[i]; cii < A.row_position[i + 1]; cii++)
+        {
+            if (cii > A.row_position[i] && A.col_index[cii] <= A.col_index[cii - 1])
+            {
+                return false;
+            }
+            int j = A.col_index[cii];
+            bool found = false;
+            for (I k = A.row_position[j]; k < A.row_position[j + 1]; k++)
+            {
+                if (A.col_index[k] == i)
+                {
+                    found = A.values[k] == A.values[cii];
+                }
+            }
+            if (!found)
+            {
+                return false;
+            }
+        }
     }
-    std::cout << "\n";
+    return true;
+}
 
-    std::vector<double> b_estimate(size, 0);
+bool test_stencil_generators()
+{
+    // boundary rows lose the neighbours outside the grid: 5 * 12 - 2 * 4 - 2 * 3,
+    // 7 * 27 - 6 * 9, and (2 + 3 + 2)^3 and (2 + 3 + 3 + 3 + 2)^2 for the full stencils
+    auto A2 = poisson2D<double>(4, 3);
+    auto A7 = poisson3D<double>(3, 3, 3, 7);
+    auto A27 = poisson3D<double, long long>(3, 3, 3, 27);
+    auto A_rotated = anisotropicDiffusion2D<double>(5, 5, 0.01, M_PI / 6);
+
+    if (A2->nnzs != 46 || A7->nnzs != 135 || A27->nnzs != 343 || A_rotated->nnzs != 169)
+    {
+        TestRunner::testError("Stencil generators produced the wrong number of non-zeros");
+        return false;
+    }
 
-    if (sparse_solver.residualCalc(x, b_estimate) > 1e-6)
+    // rows of the Laplacian sum to zero away from the boundary
+    double row_sum = 0;
+    for (int cii = A2->row_position[5]; cii < A2->row_position[6]; cii++)
     {
-        TestRunner::testError("Sparse Cholesky residual is above 1e-6");
+        row_sum += A2->values[cii];
+    }
+    if (row_sum != 0)
+    {
+        TestRunner::testError("Interior row of the 5-point stencil does not sum to zero");
         return false;
     }
 
-    return true;
+    return isSymmetricCSR(*A2) && isSymmetricCSR(*A7) && isSymmetricCSR(*A27) && isSymmetricCSR(*A_rotated);
 }
 
-bool test_random_cholesky()
+bool test_random_generators()
 {
-    int size = 100;
-    double sparsity = 0.7;
-
-    CSRMatrix<double> sparse_matrix1 = CSRMatrix<double>(size, sparsity);
+    int size = 2000;
+    auto band = bandedSPD<double>(size, 3, 42);
+    auto A = randomSPD<double>(size, 5, RowLengthDistribution::PowerLaw, 7);
+    auto A_again = randomSPD<double>(size, 5, RowLengthDistribution::PowerLaw, 7);
 
-    std::vector<double> b(size, 0);
-    for (int i = 0; i < size; i++)
+    if (band->nnzs != 7 * size - 12 || !isSymmetricCSR(*band) || !isSymmetricCSR(*A))
     {
-        b[i] = i;
+        TestRunner::testError("Random generators are not symmetric");
+        return false;
     }
 
-    SparseSolver<double> sparse_solver = SparseSolver<double>(sparse_matrix1, b);
-
-    std::shared_ptr<CSRMatrix<double>> R = sparse_solver.cholesky_decomp();
+    // same seed gives the same matrix
+    if (A->nnzs != A_again->nnzs)
+    {
+        TestRunner::testError("randomSPD is not reproducible");
+        return false;
+    }
+    bool same = TestRunner::assertArrays(&A->col_index[0], &A_again->col_index[0], A->nnzs) &&
+                TestRunner::assertArrays(&A->values[0], &A_again->values[0], A->nnzs);
 
+    // diagonally dominant, so CG must converge
+    std::vector<double> b(size, 1.0);
     std::vector<double> x(size, 0);
+    double tol = 1e-8;
+    int it_max = 1000;
+    SparseSolver<double> sparse_solver = SparseSolver<double>(*A, b);
+    sparse_solver.conjugateGradient(x, tol, it_max);
+    std::vector<double> output_b(size, 0);
 
-    sparse_solver.cholesky_solve(*R, x);
-
-    std::vector<double> b_estimate(size, 0);
-
-    double residual = sparse_solver.residualCalc(x, b_estimate);
-    return TestRunner::assertBelowTolerance(residual, 1e-6);
+    return same && TestRunner::assertBelowTolerance(sparse_solver.residualCalc(x, output_b), 1e-6);
 }
 
-bool test_sparse_lu()
+bool test_reverse_cuthill_mckee()
 {
-    int size = 6;
-    int nnzs = 12;
-
-    std::shared_ptr<double[]> init_sparse_values(new double[size * size]{5., 1., 1., 1., 5., 1., 5., 1., 5., 1., 5., 5.});
-    std::shared_ptr<int[]> init_row_position(new int[size * size]{0, 4, 5, 7, 9, 11, 12});
-    std::shared_ptr<int[]> init_col_index(new int[size * size]{0, 2, 3, 4, 1, 0, 2, 0, 3, 0, 4, 5});
-
-    std::vector<double> b = {17., 10., 16., 21., 26., 30.};
-    std::vector<int> perm = {0, 1, 2, 3, 4, 5};
-
-    CSRMatrix<double> sparse_matrix = CSRMatrix<double>(size, size, nnzs, init_sparse_values, init_row_position, init_col_index);
-    SparseSolver<double> sparse_solver = SparseSolver<double>(sparse_matrix, b);
-    std::vector<double> x(size, 0);
+    // scatter a 2D Poisson matrix with a fixed permutation, then let RCM recover a narrow band
+    int nx = 20;
+    int size = nx * nx;
+    auto poisson = poisson2D<double>(nx, nx);
+    std::vector<int> scatter(size);
+    for (int i = 0; i < size; i++)
+    {
+        scatter[i] = (int)(((long long)i * 7919) % size);
+    }
+    auto A = permuteSymmetric(*poisson, scatter);
 
-    auto LU = sparse_solver.lu_decomp();
-    sparse_solver.lu_solve(*LU, perm, x);
+    std::vector<int> perm = reverseCuthillMcKee(*A);
+    auto B = permuteSymmetric(*A, perm);
 
-    double expected[] = {1, 2, 3, 4, 5, 6};
+    std::cout << "Bandwidth before: " << bandwidth(*A) << ", after: " << bandwidth(*B) << std::endl;
 
+    // must be a permutation
+    std::vector<int> sorted_perm = perm;
+    std::sort(sorted_perm.begin(), sorted_perm.end());
     for (int i = 0; i < size; i++)
     {
-        if (expected[i] != x[i])
+        if (sorted_perm[i] != i)
         {
-            std::cout << expected[i] << " does not match " << x[i] << std::endl;
+            TestRunner::testError("RCM did not return a permutation");
             return false;
         }
     }
+    if (bandwidth(*B) > 2 * nx || B->nnzs != A->nnzs || !isSymmetricCSR(*B))
+    {
+        TestRunner::testError("RCM bandwidth is too large");
+        return false;
+    }
 
-    return true;
-}
-
-bool test_random_sparse_lu()
-{
-    int size = 100;
-    double sparsity = 0.7;
-
-    CSRMatrix<double> sparse_matrix1 = CSRMatrix<double>(size, sparsity);
-
+    // solving with reordering must give the same answer as without
     std::vector<double> b(size, 0);
-    std::vector<int> perm(size, 0);
-
     for (int i = 0; i < size; i++)
     {
-        b[i] = i + 1;
-        perm[i] = i;
+        b[i] = i % 7;
     }
-    // NOTE: we haven't implemented partial pivoting, but the permutation vector could be used in the lu_solve method
-    SparseSolver<double> sparse_solver = SparseSolver<double>(sparse_matrix1, b);
+    double tol = 1e-10;
+    int it_max = 2000;
     std::vector<double> x(size, 0);
+    std::vector<double> x_reordered(size, 0);
+    SparseSolver<double> sparse_solver = SparseSolver<double>(*A, b);
+    sparse_solver.conjugateGradient(x, tol, it_max);
+    sparse_solver.reorder = true;
+    sparse_solver.conjugateGradient(x_reordered, tol, it_max);
 
-    auto LU = sparse_solver.lu_decomp();
-    sparse_solver.lu_solve(*LU, perm, x);
-
-    std::vector<double> b_estimate(size, 0);
-
-    double residual = sparse_solver.residualCalc(x, b_estimate);
-    return TestRunner::assertBelowTolerance(residual, 1e-6);
-}
+    double difference = 0;
+    for (int i = 0; i < size; i++)
+    {
+        difference = std::max(difference, fabs(x[i] - x_reordered[i]));
+    }
+    std::vector<double> output_b(size, 0);
+    if (!TestRunner::assertBelowTolerance(difference, 1e-8) ||
+        !TestRunner::assertBelowTolerance(sparse_solver.residualCalc(x_reordered, output_b), 1e-8))
+    {
+        return false;
+    }
 
-bool test_random_sparse_matrix()
-{
-    int size = 10;
-    CSRMatrix<double> rand_sparse = CSRMatrix<double>(size, 0.4);
+    // new values in the same pattern reach the reordered system: doubling A halves x
+    for (int k = 0; k < sparse_solver.A.nnzs; k++)
+    {
+        sparse_solver.A.values[k] *= 2;
+    }
+    sparse_solver.A.invalidateDiagonal();
+    std::vector<double> x_doubled(size, 0);
+    sparse_solver.conjugateGradient(x_doubled, tol, it_max);
+    difference = 0;
+    for (int i = 0; i < size; i++)
+    {
+        difference = std::max(difference, fabs(x[i] - 2 * x_doubled[i]));
+    }
+    if (!TestRunner::assertBelowTolerance(difference, 1e-8))
+    {
+        return false;
+    }
 
-    if (rand_sparse.rows != size || rand_sparse.cols != size)
+    // the pattern rewritten in place (each row stored back to front) is noticed
+    CSRMatrix<double> &A_solver = sparse_solver.A;
+    for (int i = 0; i < size; i++)
+    {
+        std::reverse(&A_solver.col_index[0] + A_solver.row_position[i], &A_solver.col_index[0] + A_solver.row_position[i + 1]);
+        std::reverse(&A_solver.values[0] + A_solver.row_position[i], &A_solver.values[0] + A_solver.row_position[i + 1]);
+    }
+    A_solver.invalidateDiagonal();
+    std::fill(x_doubled.begin(), x_doubled.end(), 0);
+    sparse_solver.conjugateGradient(x_doubled, tol, it_max);
+    if (!TestRunner::assertBelowTolerance(sparse_solver.residualCalc(x_doubled, output_b), 1e-8))
+    {
+        return false;
+    }
+    A_solver.sortRows();
+
+    // a preconditioner is left set up on A, not on the reordered matrix
+    IC0Preconditioner<double> M, M_fresh;
+    M.setup(sparse_solver.A);
+    std::vector<double> x_preconditioned(size, 0);
+    sparse_solver.conjugateGradient(x_preconditioned, tol, it_max, M);
+    M_fresh.setup(sparse_solver.A);
+    std::vector<double> z(size, 0), z_fresh(size, 0);
+    M.apply(b, z);
+    M_fresh.apply(b, z_fresh);
+    difference = 0;
+    for (int i = 0; i < size; i++)
+    {
+        difference = std::max(difference, fabs(z[i] - z_fresh[i]));
+    }
+    if (!TestRunner::assertBelowTolerance(difference, 1e-12) ||
+        !TestRunner::assertBelowTolerance(sparse_solver.residualCalc(x_preconditioned, output_b), 1e-8))
     {
-        TestRunner::testError("Dimensions of random matrix are incorrect");
         return false;
     }
 
-    // compare to transpose to see whether it is symmetric
-    std::shared_ptr<CSRMatrix<double>> transpose = rand_sparse.transpose();
+    // and is applied in A's ordering, which geometric multigrid depends on
+    auto grid_matrix = poisson2D<double>(31, 31);
+    std::vector<double> b_poisson(grid_matrix->rows, 1);
+    SparseSolver<double> poisson_solver = SparseSolver<double>(*grid_matrix, b_poisson);
+    GeometricMultigrid<double> gmg(31, 31);
+    gmg.setup(poisson_solver.A);
+    std::vector<double> x_gmg(grid_matrix->rows, 0);
+    std::vector<double> poisson_output(grid_matrix->rows, 0);
+    poisson_solver.conjugateGradient(x_gmg, tol, it_max, gmg);
+    int gmg_iterations = poisson_solver.iterations;
+    poisson_solver.reorder = true;
+    std::fill(x_gmg.begin(), x_gmg.end(), 0);
+    poisson_solver.conjugateGradient(x_gmg, tol, it_max, gmg);
+    return poisson_solver.iterations <= gmg_iterations + 1 &&
+           TestRunner::assertBelowTolerance(poisson_solver.residualCalc(x_gmg, poisson_output), 1e-8);
+}
 
-    for (int i = 0; i < size + 1; i++)
+bool test_greedy_colouring()
+{
+    // natural orderings of the 5- and 7-point stencils are red-black, of the 27-point one 8 colours
+    std::vector<std::pair<std::shared_ptr<CSRMatrix<double>>, int>> problems = {
+        {poisson2D<double>(13, 10), 2},
+        {poisson3D<double>(6, 5, 4, 7), 2},
+        {poisson3D<double>(6, 5, 4, 27), 8},
+        {randomSPD<double>(300, 9, RowLengthDistribution::PowerLaw, 5), -1}};
+    for (auto &problem : problems)
     {
-        if (rand_sparse.row_position[i] != transpose->row_position[i])
+        CSRMatrix<double> &A = *problem.first;
+        Colouring colouring = greedyColouring(A);
+        std::cout << "Colours: " << colouring.n_colours << std::endl;
+        if (problem.second > 0 && colouring.n_colours != problem.second)
         {
-            TestRunner::testError("row_position of random matrix and its transpose do not match");
+            TestRunner::testError("Unexpected number of colours");
             return false;
         }
-    }
-    for (int i = 0; i < rand_sparse.nnzs; i++)
-    {
-        if (rand_sparse.col_index[i] != transpose->col_index[i])
+
+        // no two neighbours share a colour
+        for (int i = 0; i < A.rows; i++)
         {
-            TestRunner::testError("col_index of random matrix and its transpose do not match");
-            return false;
+            for (int k = A.row_position[i]; k < A.row_position[i + 1]; k++)
+            {
+                int j = A.col_index[k];
+                if (j != i && colouring.colour[i] == colouring.colour[j])
+                {
+                    TestRunner::testError("Neighbours share a colour");
+                    return false;
+                }
+            }
         }
-        if (rand_sparse.values[i] != transpose->values[i])
+
+        // the colour classes partition the vertices, in increasing order
+        if ((int)colouring.ptr.size() != colouring.n_colours + 1 || colouring.ptr.back() != A.rows)
         {
-            TestRunner::testError("values of random matrix and its transpose do not match");
+            TestRunner::testError("Colour classes do not cover the vertices");
             return false;
         }
+        for (int c = 0; c < colouring.n_colours; c++)
+        {
+            for (int m = colouring.ptr[c]; m < colouring.ptr[c + 1]; m++)
+            {
+                int v = colouring.members[m];
+                if (colouring.colour[v] != c || (m > colouring.ptr[c] && colouring.members[m - 1] >= v))
+                {
+                    TestRunner::testError("Colour classes are inconsistent");
+                    return false;
+                }
+            }
+        }
     }
+    return true;
+}
+
+bool test_sparse_multi_vec_mult()
+{
+    auto A = poisson2D<double>(7, 5);
+    int size = A->rows;
+
+    // compare every block width path against one matVecMult per vector
+    for (int n_vecs : {1, 3, 8, 16, 32})
+    {
+        std::vector<double> X((size_t)size * n_vecs);
+        for (size_t i = 0; i < X.size(); i++)
+        {
+            X[i] = (double)((i * 37) % 11) - 5.0;
+        }
+        std::vector<double> Y((size_t)size * n_vecs, 0);
+        A->matMultiVecMult(X, n_vecs, Y);
 
+        std::vector<double> x(size), y(size);
+        for (int k = 0; k < n_vecs; k++)
+        {
+            for (int i = 0; i < size; i++)
+            {
+                x[i] = X[(size_t)i * n_vecs + k];
+            }
+            A->matVecMult(x, y);
+            for (int i = 0; i < size; i++)
+            {
+                if (y[i] != Y[(size_t)i * n_vecs + k])
+                {
+                    TestRunner::testError("matMultiVecMult does not match matVecMult for " + std::to_string(n_vecs) + " vectors");
+                    return false;
+                }
+            }
+        }
+    }
     return true;
 }
 
+bool test_diagonal_cache()
+{
+    int size = 3;
+    int nnzs = 6;
+
+    // row 1 is unsorted, row 2 has no stored diagonal
+    std::shared_ptr<int[]> init_row_position(new int[size + 1]{0, 2, 5, 6});
+    std::shared_ptr<int[]> init_col_index(new int[nnzs]{0, 1, 2, 1, 0, 0});
+    std::shared_ptr<double[]> init_sparse_values(new double[nnzs]{2, 1, 3, 4, 5, 6});
+    CSRMatrix<double> sparse_matrix = CSRMatrix<double>(size, size, nnzs, init_sparse_values, init_row_position, init_col_index);
+
+    // unsorted rows are searched, not sorted behind the caller's back
+    int *diag = sparse_matrix.diagonalPositions();
+    int unsorted_diag[] = {0, 3, -1};
+    if (!TestRunner::assertArrays(&unsorted_diag[0], diag, size) || sparse_matrix.rowsSorted() ||
+        sparse_matrix.col_index[2] != 2)
+    {
+        TestRunner::testError("diagonalPositions mishandled an unsorted row");
+        return false;
+    }
+
+    sparse_matrix.sortRows();
+    diag = sparse_matrix.diagonalPositions();
+    int expected_diag[] = {0, 3, -1};
+    if (!sparse_matrix.rowsSorted())
+    {
+        return false;
+    }
+    if (!TestRunner::assertArrays(&expected_diag[0], diag, size))
+    {
+        return false;
+    }
+
+    // a missing diagonal cannot be inverted
+    try
+    {
+        sparse_matrix.inverseDiagonal();
+        TestRunner::testError("Missing diagonal was not detected");
+        return false;
+    }
+    catch (const std::exception &e)
+    {
+    }
+
+    // values change through add, so the inverse is recomputed after the assembly
+    CSRMatrix<double> square = *poisson2D<double>(3, 3);
+    square.lockPattern();
+    double before = square.inverseDiagonal()[4];
+    square.add(4, 4, 4.0);
+    square.unlockPattern();
+    double after = square.inverseDiagonal()[4];
+
+    return before == 0.25 && after == 0.125;
+}
+
 void run_tests()
 {
     // MATRIX
@@ -648,6 +3103,18 @@ void run_tests()
     test_runner_csrmatrix.test(&test_sparse_matmatmult_4x4, "sparse matMatMult for two sparse 4x4 matrices.");
     test_runner_csrmatrix.test(&test_sparse_matmatmult_5x5, "sparse matMatMult for multiplying a 5x5 sparse matrix by itself.");
     test_runner_csrmatrix.test(&test_random_sparse_matrix, "constructor to create a random sparse matrix.");
+    test_runner_csrmatrix.test(&test_csr_builder, "CSRBuilder assembling duplicate triplets from several threads.");
+    test_runner_csrmatrix.test(&test_locked_pattern_assembly, "concurrent add into a locked sparsity pattern.");
+    test_runner_csrmatrix.test(&test_matrix_market_io, "Matrix Market symmetric read and write round trip.");
+    test_runner_csrmatrix.test(&test_matrix_market_pattern, "Matrix Market pattern matrix read.");
+    test_runner_csrmatrix.test(&test_binary_io, "binary CSR and dense matrix write and memory-mapped load.");
+    test_runner_csrmatrix.test(&test_stencil_generators, "Poisson and anisotropic stencil generators.");
+    test_runner_csrmatrix.test(&test_random_generators, "seeded banded and random SPD generators.");
+    test_runner_csrmatrix.test(&test_sparse_multi_vec_mult, "sparse matrix times a block of vectors.");
+    test_runner_csrmatrix.test(&test_diagonal_cache, "cached diagonal positions and inverse diagonal.");
+    test_runner_csrmatrix.test(&test_sparse_matvec_above_int32_limit, "matVecMult with more non-zeros than an int can index.");
+    test_runner_csrmatrix.test(&test_sparse_matvec_mostly_zero_pages_above_int32_limit,
+                               "matVecMult with row positions past 2^31 in a mostly empty matrix.");
 
     // SOLVER
     TestRunner test_runner_solver = TestRunner("Solver");
@@ -663,11 +3130,34 @@ void run_tests()
     test_runner_ss.test(&test_sparse_stationary_iterative, "sparse Jacobi solver for 4x4 matrix.");
     test_runner_ss.test(&test_sparse_jacobi_random, "sparse Jacobi solver for random 10x10 matrix.");
     test_runner_ss.test(&test_sparse_gauss_seidel_random, "sparse Gauss-Seidel solver for random 100x100 matrix.");
+    test_runner_ss.test(&test_sparse_gauss_seidel_unsorted_and_updated, "Gauss-Seidel on unsorted rows and after a change of values.");
+    test_runner_ss.test(&test_multicolour_sor, "multicolour Gauss-Seidel, SOR and SSOR, and SSOR as a CG preconditioner.");
+    test_runner_ss.test(&test_lanczos_spectrum, "Lanczos estimate of the extreme eigenvalues.");
+    test_runner_ss.test(&test_chebyshev, "Chebyshev iteration, and Chebyshev polynomials as a CG preconditioner.");
     test_runner_ss.test(&test_sparse_CG, "sparse conjugate gradient solver for 4x4 matrix.");
+    test_runner_ss.test(&test_preconditioned_CG, "conjugate gradient with Jacobi, SSOR, IC(0) and ILU(0) preconditioners.");
+    test_runner_ss.test(&test_cg_variants, "Chronopoulos-Gear and pipelined conjugate gradient variants.");
+    test_runner_ss.test(&test_block_CG, "block conjugate gradient for several right-hand sides.");
+    test_runner_ss.test(&test_mixed_precision_CG, "mixed precision conjugate gradient with reliable updates.");
+    test_runner_ss.test(&test_warm_start, "iterative solvers started from a given initial guess.");
+    test_runner_ss.test(&test_solver_session, "deflated CG recycling harmonic Ritz vectors over a sequence of systems.");
+    test_runner_ss.test(&test_amg, "smoothed aggregation AMG as a CG preconditioner and a V-cycle solver.");
+    test_runner_ss.test(&test_gmg, "geometric multigrid V-, W- and F-cycles as a solver and a CG preconditioner.");
+    test_runner_ss.test(&test_gmres_bicgstab, "GMRES and BiCGSTAB for a nonsymmetric convection-diffusion matrix.");
     test_runner_ss.test(&test_sparse_lu, "sparse LU decomposition.");
     test_runner_ss.test(&test_random_sparse_lu, "LU method with random 100x100 matrix.");
+    test_runner_ss.test(&test_sparse_lu_pivoting, "LU with threshold partial pivoting for a matrix with a zero diagonal.");
     test_runner_ss.test(&test_cholesky, "Cholesky method.");
     test_runner_ss.test(&test_random_cholesky, "Cholesky method with random 100x100 matrix.");
+    test_runner_ss.test(&test_reverse_cuthill_mckee, "Reverse Cuthill-McKee reordering and reordered CG.");
+    test_runner_ss.test(&test_greedy_colouring, "greedy graph colouring.");
+    test_runner_ss.test(&test_symbolic_cholesky, "elimination tree and symbolic Cholesky pattern.");
+    test_runner_ss.test(&test_supernodal_cholesky, "supernodal multifrontal Cholesky.");
+    test_runner_ss.test(&test_fill_reducing_orderings, "AMD and nested dissection orderings for the direct solvers.");
+    test_runner_ss.test(&test_symbolic_reuse, "symbolic factorisation reused across value updates.");
+    test_runner_ss.test(&test_factor_keeps_ordering, "factors solved with their own fill-reducing ordering.");
+    test_runner_ss.test(&test_level_scheduled_solves, "level-scheduled triangular solves with a cached analysis.");
+    test_runner_ss.test(&test_sparse_64bit_indices, "conjugate gradient with 64-bit row positions.");
 
     // UTILITIES
     TestRunner test_runner_utils = TestRunner("Utilities");
@@ -1,6 +1,9 @@
 #pragma once
 #include <iostream>
 #include <vector>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 // This header file includes functions that do not fall
 // under the scope of the Matrix or Solver classes
 
@@ -32,15 +35,35 @@ void checkDimensions(Matrix<T> &M1, std::vector<T> &vec)
 }
 
 template <typename T>
-double vecDotProduct(std::vector<T> v1, std::vector<T> v2)
+double vecDotProduct(const std::vector<T> &v1, const std::vector<T> &v2)
 {
     double result = 0;
     if (v1.size() == v2.size())
     {
-        for (int i = 0; i < v1.size(); i++)
+        int n = v1.size();
+#pragma omp parallel for reduction(+ : result) schedule(static)
+        for (int i = 0; i < n; i++)
         {
             result += v1[i] * v2[i];
         }
     }
     return result;
 }
+
+
+// Thread helpers that fall back to a single thread when compiled without OpenMP
+inline int numThreads()
+{
+#ifdef _OPENMP
+    return omp_get_max_threads();
+#else
+    return 1;
+#endif
+}
+
+inline void setNumThreads(int n)
+{
+#ifdef _OPENMP
+    omp_set_num_threads(n);
+#endif
+}